@@ -19,6 +19,7 @@ IF(UNIX)
     CHECK_INCLUDE_FILES(unistd.h HAVE_UNISTD_H)
     CHECK_INCLUDE_FILES(sys/uio.h HAVE_SYS_UIO_H)
     CHECK_INCLUDE_FILES(fcntl.h HAVE_FCNTL_H)
+    CHECK_INCLUDE_FILES(sys/mman.h HAVE_SYS_MMAN_H)
     CHECK_INCLUDE_FILES(sys/time.h HAVE_SYS_TIME_H)
     CHECK_INCLUDE_FILES(arpa/inet.h HAVE_ARPA_INET_H)
     CHECK_INCLUDE_FILES(inttypes.h HAVE_INTTYPES_H)
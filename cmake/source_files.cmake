@@ -58,6 +58,13 @@ SET(LCB_CORE_SRC
     src/newconfig.c
     src/nodeinfo.c
     src/iofactory.c
+    src/kvcache.c
+    src/hedge.c
+    src/admission.c
+    src/respbatch.c
+    src/singleflight.c
+    src/counteragg.c
+    src/metrics.c
     src/retryq.c
     src/retrychk.c
     src/settings.c
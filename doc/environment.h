@@ -76,6 +76,16 @@
  *
  * @volatile
  *
+ * @subsection LCB_FAULT_SCRIPT
+ *
+ * Degrade connections to the cluster according to a script, as with the
+ * @ref LCB_CNTL_FAULT_SCRIPT setting. For example,
+ * `latency=20,jitter=10,partial=0.3` delays each read and write by 20 to 30
+ * milliseconds and shortens about a third of them. This is meant for
+ * testing only.
+ *
+ * @volatile
+ *
  * @section LCB_INTERNAL_ENVVARS Internal Environment Variables
  *
  * @note
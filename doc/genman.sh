@@ -8,6 +8,8 @@ SRCDIR=.
 
 ronn --pipe --roff $SRCDIR/cbc.markdown > $OUTDIR/cbc.1
 ronn --pipe --roff $SRCDIR/cbc-pillowfight.markdown > $OUTDIR/cbc-pillowfight.1
+ronn --pipe --roff $SRCDIR/cbc-proxy.markdown > $OUTDIR/cbc-proxy.1
+ronn --pipe --roff $SRCDIR/cbc-replay.markdown > $OUTDIR/cbc-replay.1
 ronn --pipe --roff $SRCDIR/cbcrc.markdown > $OUTDIR/cbcrc.4
 
 MANLINKS="cat cp create observe flush hash lock unlock rm stats"
@@ -193,7 +193,15 @@ typedef enum {
     LCB_RESP_F_CLIENTGEN = 0x02,
 
     /**The response was a result of a not-my-vbucket error */
-    LCB_RESP_F_NMVGEN = 0x04
+    LCB_RESP_F_NMVGEN = 0x04,
+
+    /**The response was served from the client-side item cache
+     * (see @ref LCB_CNTL_KVCACHE_MAXBYTES) */
+    LCB_RESP_F_CACHED = 0x08,
+
+    /**The response was received from a replica, as the GET was hedged
+     * (see @ref LCB_CNTL_HEDGE_DELAY). The value may be stale */
+    LCB_RESP_F_REPLICA = 0x10
 } lcb_RESPFLAGS;
 
 /**
@@ -433,6 +441,43 @@ LIBCOUCHBASE_API
 lcb_error_t
 lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd);
 
+/**
+ * Callback receiving GET responses in batches
+ * @param instance the handle
+ * @param resps the responses. These (and the keys and values they point to)
+ * are only valid for the duration of the callback
+ * @param nresps the number of responses
+ * @see lcb_install_getbatch_callback()
+ */
+typedef void (*lcb_GETBATCHCALLBACK)
+        (lcb_t instance, const lcb_RESPGET *resps, lcb_SIZE nresps);
+
+/**
+ * @volatile
+ *
+ * Deliver GET responses in batches. When such a callback is installed, the
+ * responses to GETs which are decoded from a single read of a server's
+ * socket are collected, and delivered in one call once the read has been
+ * processed, rather than invoking the @ref LCB_CALLBACK_GET callback for
+ * each of them. This amortizes the cost of the callback invocation (and
+ * whatever locking the application's callback may perform) over the
+ * responses received together.
+ *
+ * Responses generated by the library (for example when a command times out
+ * or fails because of a network error) and those served from the item cache
+ * are still delivered to the @ref LCB_CALLBACK_GET callback, as are
+ * responses to hedged GETs. Batched responses are delivered after any other
+ * callback invoked for responses from the same read.
+ *
+ * @param instance the handle
+ * @param cb the callback to install, or `NULL` to deliver each response on
+ * its own (the default)
+ * @return the old callback
+ */
+LIBCOUCHBASE_API
+lcb_GETBATCHCALLBACK
+lcb_install_getbatch_callback(lcb_t instance, lcb_GETBATCHCALLBACK cb);
+
 /**@brief Command for lcb_unlock3()
  * @attention lcb_CMDBASE::cas must be specified, or the operation will fail on
  * the server*/
@@ -476,6 +476,10 @@ typedef struct lcb_logprocs_st {
  * @note The leading directories for the file must exist, otherwise the file
  * will never be created.
  *
+ * @note A binary copy of the configuration is kept in a file of the same name
+ * with `.bin` appended. It is loaded in preference to the file itself, which
+ * is only parsed if the binary copy is missing, corrupt or outdated.
+ *
  * @note Configuration cache is not supported for memcached buckets
  * @cntl_arg_get_and_set{char**, char*}
  * @uncommitted
@@ -748,8 +752,717 @@ typedef enum {
  */
 #define LCB_CNTL_SCHED_IMPLICIT_FLUSH 0x31
 
+/**
+ * @volatile
+ *
+ * Set the minimum number of connections the pool for http (view request)
+ * sockets keeps open to each node. When set to a nonzero value, connections
+ * are opened to every node as soon as a configuration is received (and again
+ * whenever a pooled connection is leased), so that view requests do not
+ * need to wait for a new connection to be established. Idle connections are
+ * not closed by the idle timeout if doing so would leave fewer than this
+ * number open. The default is 0.
+ *
+ * This setting is bounded by @ref LCB_CNTL_HTTP_POOLSIZE in that warming is
+ * disabled if pooling is disabled (i.e. the pool size is 0).
+ *
+ * @cntl_arg_both{lcb_SIZE}
+ */
+#define LCB_CNTL_HTTP_POOL_MINIDLE 0x33
+
+/**
+ * @volatile
+ *
+ * Set the number of memcached (data) connections opened to each node. By
+ * default a single connection is used, so that a large value being sent or
+ * received delays every other operation to the same node. With more than
+ * one connection, operations are spread across the connections by vBucket
+ * (or by key, for memcached buckets), so operations on the same key are
+ * still sent and answered in order.
+ *
+ * Additional connections are only opened once an operation needs them. This
+ * setting only affects nodes which are added after it is changed, and should
+ * therefore be set before lcb_connect() is called.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @see LCB_CNTL_KV_BULK_THRESHOLD
+ */
+#define LCB_CNTL_KV_NCONNS 0x34
+
+/**
+ * @volatile
+ *
+ * Dedicate one of the connections to each node (see @ref LCB_CNTL_KV_NCONNS)
+ * to storage operations whose value is at least this many bytes, so that
+ * they do not delay smaller operations. The default is 0, which disables
+ * this behavior; it also has no effect unless at least two connections are
+ * in use.
+ *
+ * @warning Because large values are sent over a different connection, an
+ * operation on a key may be answered before an earlier large storage
+ * operation on the same key. Applications which depend on such ordering
+ * should wait for the storage callback first.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ */
+#define LCB_CNTL_KV_BULK_THRESHOLD 0x35
+
+/**
+ * @volatile
+ *
+ * Set the maximum size, in bytes, of the client-side item cache. When this is
+ * nonzero, the values retrieved by lcb_get3() are kept in an in-process LRU
+ * cache (keyed by vBucket and key), and subsequent plain GETs for the same
+ * key (i.e. without a lock or expiry) are answered from the cache rather than
+ * from the server. Such responses have the @ref LCB_RESP_F_CACHED flag set
+ * and are delivered asynchronously, once the scheduling context is left.
+ *
+ * A cached item is discarded when a store, remove, counter or touch
+ * operation for its key is scheduled through this instance, and when it is
+ * older than @ref LCB_CNTL_KVCACHE_TTL. Modifications made by other clients
+ * are therefore only seen once the item expires from the cache (or once it
+ * is refreshed, see @ref LCB_CNTL_KVCACHE_REVALIDATE).
+ *
+ * Items larger than an eighth of the cache are not cached. Setting this
+ * to 0 (the default) disables the cache and frees its contents.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @see LCB_CNTL_KVCACHE_STATS
+ */
+#define LCB_CNTL_KVCACHE_MAXBYTES 0x36
+
+/**
+ * @volatile
+ *
+ * Maximum age of an item in the client-side cache (see
+ * @ref LCB_CNTL_KVCACHE_MAXBYTES). The default is one second.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ */
+#define LCB_CNTL_KVCACHE_TTL 0x37
+
+/**
+ * @volatile
+ *
+ * When an item in the client-side cache which is older than this value is
+ * read, it is still returned from the cache but is also refreshed from the
+ * server in the background. The cached item is replaced if the CAS returned
+ * by the server differs from the cached one, and removed if the item no
+ * longer exists. This keeps frequently read items reasonably fresh without
+ * having to lower @ref LCB_CNTL_KVCACHE_TTL. The default is 0, which
+ * disables background refreshes.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ */
+#define LCB_CNTL_KVCACHE_REVALIDATE 0x38
+
+/** @brief Client-side item cache counters
+ * @see LCB_CNTL_KVCACHE_STATS */
+typedef struct {
+    lcb_U64 hits; /**< GETs answered from the cache */
+    lcb_U64 misses; /**< GETs sent to the server while the cache was enabled */
+    lcb_U64 stores; /**< Items added to or replaced in the cache */
+    lcb_U64 invalidations; /**< Items removed because of a mutation */
+    lcb_U64 expirations; /**< Items removed because of their age */
+    lcb_U64 evictions; /**< Items removed to stay within the size limit */
+    lcb_U64 revalidations; /**< Background refreshes issued */
+    lcb_SIZE nitems; /**< Number of items currently cached */
+    lcb_SIZE nbytes; /**< Memory currently used by the cache */
+} lcb_KVCACHESTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the counters of the client-side item cache
+ * (see @ref LCB_CNTL_KVCACHE_MAXBYTES).
+ *
+ * @cntl_arg_getonly{lcb_KVCACHESTATS*}
+ */
+#define LCB_CNTL_KVCACHE_STATS 0x39
+
+/**
+ * @volatile
+ *
+ * Minimum severity (a @ref lcb_log_severity_t value) of the messages which
+ * are passed to the logger. The library checks this before a message is
+ * formatted, so raising it avoids the cost of messages which the logger would
+ * discard anyway. The default is @ref LCB_LOG_TRACE, i.e. all messages are
+ * passed to the logger, which may filter them further. Installing a logger
+ * via @ref LCB_CNTL_LOGGER resets this to @ref LCB_LOG_TRACE, and the console
+ * logger sets it to its own level.
+ *
+ * @cntl_arg_both{int*}
+ */
+#define LCB_CNTL_LOGLEVEL 0x3A
+
+/**
+ * @volatile
+ *
+ * Pass log messages to the logger from a background thread. Messages are
+ * formatted when they are logged, and placed in a fixed-size buffer from
+ * which a dedicated thread writes them out. If the buffer is full, messages
+ * are dropped rather than delaying the caller, and the number of dropped
+ * messages is logged once there is room again.
+ *
+ * When this is enabled, the logger's callback (see @ref LCB_CNTL_LOGGER) is
+ * invoked from that thread and must therefore be thread-safe. Messages which
+ * are longer than a few hundred bytes are truncated.
+ *
+ * Setting this returns @ref LCB_NOT_SUPPORTED on platforms without support
+ * for background logging.
+ *
+ * @cntl_arg_both{int* (as a boolean)}
+ */
+#define LCB_CNTL_LOG_ASYNC 0x3B
+
+/**
+ * @volatile
+ *
+ * Share bucket configurations with other instances in the same process.
+ * Instances which enable this and which have the same bucket, credentials and
+ * bootstrap hosts use a common, process-wide configuration cache: a
+ * configuration received by any one of them is made available to the others,
+ * so that newly created instances can bootstrap without fetching (and
+ * parsing) a configuration from the cluster, and existing ones can pick up
+ * topology changes discovered by their peers.
+ *
+ * Each instance still maintains its own connections and its own copy of the
+ * configuration.
+ *
+ * This may also be specified in the connection string as `config_shared=true`.
+ *
+ * @cntl_arg_both{int* (as a boolean)}
+ */
+#define LCB_CNTL_CONFIG_SHARED 0x3C
+
+/**
+ * @volatile
+ *
+ * Number of nodes from which the initial configuration is requested at once.
+ * By default nodes are tried one after the other, so that a node which does
+ * not respond delays the bootstrap by up to @ref LCB_CNTL_CONFIG_NODE_TIMEOUT.
+ * If this is greater than one, the configuration is requested from this many
+ * nodes at once (up to 8), and the first valid configuration received is used
+ * while the remaining requests are cancelled. Each of the enabled providers
+ * (e.g. CCCP and HTTP) is tried at the same time as well.
+ *
+ * The time it took each node to respond (or to fail) is logged with the
+ * `INFO` severity.
+ *
+ * This only affects the bootstrap; subsequent configuration updates are
+ * requested from one node at a time.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ */
+#define LCB_CNTL_BOOTSTRAP_RACE 0x3D
+
+/**
+ * @volatile
+ *
+ * Hedge GETs which are slow to be answered. If a plain GET (i.e. one which
+ * neither locks the item nor touches it) has not been answered by the
+ * vBucket's master after this long, it is also sent to each of the
+ * vBucket's replicas, and the first successful response is delivered. Such
+ * responses have the @ref LCB_RESP_F_REPLICA flag set, and may be stale.
+ *
+ * The master's response is always used if it arrives first, even if it is
+ * a "key not found" error. Requests which lost the race cannot be recalled
+ * and are discarded when they complete, so this increases the load on the
+ * cluster; see @ref LCB_CNTL_HEDGE_PERCENTILE to limit hedging to the
+ * slowest requests.
+ *
+ * The default is 0, which disables hedging. Buckets without replicas are
+ * never hedged.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @see LCB_CNTL_HEDGE_STATS
+ */
+#define LCB_CNTL_HEDGE_DELAY 0x3E
+
+/**
+ * @volatile
+ *
+ * If positive, the delay after which GETs are hedged (see
+ * @ref LCB_CNTL_HEDGE_DELAY) adapts to the observed latency: it becomes the
+ * given percentile (e.g. `95.0`) of the latencies of recent GETs, or the
+ * value of @ref LCB_CNTL_HEDGE_DELAY if that is larger. The percentile is
+ * approximate. The default is 0, i.e. a fixed delay.
+ *
+ * @cntl_arg_both{float*}
+ */
+#define LCB_CNTL_HEDGE_PERCENTILE 0x3F
+
+/** @brief Hedged GET counters
+ * @see LCB_CNTL_HEDGE_STATS */
+typedef struct {
+    lcb_U64 fired; /**< GETs for which replica reads were sent */
+    lcb_U64 won; /**< GETs answered by a replica before the master */
+    lcb_U32 delay; /**< The current hedging delay, in microseconds */
+} lcb_HEDGESTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the hedged GET counters (see @ref LCB_CNTL_HEDGE_DELAY).
+ *
+ * @cntl_arg_getonly{lcb_HEDGESTATS*}
+ */
+#define LCB_CNTL_HEDGE_STATS 0x40
+
+/**
+ * @volatile
+ *
+ * The library keeps a moving average of the response time of each data
+ * node, and of the rate at which commands sent to it fail (because they time
+ * out, because of network errors, or because the node replies with a
+ * temporary failure). A node is considered degraded once its average
+ * response time reaches this value, or once more than half of the commands
+ * sent to it fail.
+ *
+ * While a node is degraded:
+ *
+ * - Commands which are retried (see @ref LCB_CNTL_RETRY_INTERVAL) and which
+ *   map to it are retried less often.
+ * - If GETs are hedged (see @ref LCB_CNTL_HEDGE_DELAY), GETs for which it is
+ *   the master are hedged immediately, and replica reads avoid it if another
+ *   replica is healthy.
+ *
+ * The default is one second. If set to 0, only failures are considered.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @see LCB_CNTL_SERVER_HEALTH
+ */
+#define LCB_CNTL_DEGRADED_LATENCY 0x41
+
+/** @brief Health of a data node
+ * @see LCB_CNTL_SERVER_HEALTH */
+typedef struct {
+    int index; /**< [in] The index of the node in the configuration */
+    lcb_U32 latency; /**< Average response time, in microseconds */
+    lcb_U32 errors; /**< Average failure rate, in thousandths */
+    lcb_U64 nresponses; /**< Number of responses received */
+    lcb_U64 nfailures; /**< Number of commands which failed */
+    int degraded; /**< Whether the node is considered degraded */
+} lcb_SERVERHEALTH;
+
+/**
+ * @volatile
+ *
+ * Retrieve the health of a data node (see @ref LCB_CNTL_DEGRADED_LATENCY).
+ * Set the `index` field to the node's index before calling. If more than one
+ * connection is opened to each node (see @ref LCB_CNTL_KV_NCONNS), the
+ * averages are those of the worst connection.
+ *
+ * @cntl_arg_getonly{lcb_SERVERHEALTH*}
+ */
+#define LCB_CNTL_SERVER_HEALTH 0x42
+
+/**
+ * @volatile
+ *
+ * Limit the number of commands queued to a single data node, i.e. those
+ * which were scheduled but which have not yet completed. Once a node's queue
+ * reaches this limit, further commands for it are handled according to
+ * @ref LCB_CNTL_QUEUE_POLICY. If more than one connection is opened to each
+ * node (see @ref LCB_CNTL_KV_NCONNS), the limit applies to each connection.
+ *
+ * Only commands scheduled by the application are subject to the limits;
+ * replica reads sent by hedged GETs, retries and commands issued internally
+ * by the library (such as the GETs revalidating items of the client-side
+ * cache, or the aggregated counter commands) are never rejected, although
+ * they are counted and do not cause the queue to pause. The limits
+ * are checked before a command is added, so a queue may exceed them by
+ * one command.
+ *
+ * The default is 0, i.e. no limit.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @see LCB_CNTL_QUEUE_STATS
+ */
+#define LCB_CNTL_QUEUE_MAXPKTS 0x43
+
+/**
+ * @volatile
+ *
+ * Like @ref LCB_CNTL_QUEUE_MAXPKTS, but limits the number of bytes (headers,
+ * keys and values) queued to a single data node.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ */
+#define LCB_CNTL_QUEUE_MAXBYTES 0x44
+
+/**
+ * @volatile
+ *
+ * Like @ref LCB_CNTL_QUEUE_MAXPKTS, but limits the number of commands queued
+ * to all data nodes.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ */
+#define LCB_CNTL_QUEUE_TOTAL_MAXPKTS 0x45
+
+/**
+ * @volatile
+ *
+ * Like @ref LCB_CNTL_QUEUE_MAXBYTES, but limits the number of bytes queued
+ * to all data nodes.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ */
+#define LCB_CNTL_QUEUE_TOTAL_MAXBYTES 0x46
+
+/** @brief What to do with commands once a queue limit is reached
+ * @see LCB_CNTL_QUEUE_POLICY */
+typedef enum {
+    /** Reject the command with @ref LCB_EQUEUEFULL */
+    LCB_QUEUE_POLICY_FAILFAST = 0,
+    /** Accept the command. The application is expected to stop scheduling
+     * commands until the backpressure callback reports that the queues have
+     * drained */
+    LCB_QUEUE_POLICY_NOTIFY
+} lcb_QUEUEPOLICY;
+
+/**
+ * @volatile
+ *
+ * Select what happens once one of the queue limits (see
+ * @ref LCB_CNTL_QUEUE_MAXPKTS) is reached. In either case the callback set
+ * with lcb_set_backpressure_callback() is invoked, and invoked again once
+ * all queues have drained to half of their limits.
+ *
+ * The default is @ref LCB_QUEUE_POLICY_FAILFAST.
+ *
+ * @cntl_arg_both{int* (lcb_QUEUEPOLICY)}
+ */
+#define LCB_CNTL_QUEUE_POLICY 0x47
+
+/** @brief Command queue depth and admission counters
+ * @see LCB_CNTL_QUEUE_STATS */
+typedef struct {
+    lcb_U32 npkts; /**< Commands queued to all nodes */
+    lcb_SIZE nbytes; /**< Bytes queued to all nodes */
+    lcb_U32 max_pipeline_pkts; /**< Commands queued to the busiest node */
+    lcb_SIZE max_pipeline_bytes; /**< Bytes queued to the busiest node */
+    lcb_U64 nrejected; /**< Commands rejected with LCB_EQUEUEFULL */
+    lcb_U64 npauses; /**< Number of times a queue limit was reached */
+    int paused; /**< Whether a limit is reached and has not drained */
+} lcb_QUEUESTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the depth of the command queues (see
+ * @ref LCB_CNTL_QUEUE_MAXPKTS). The depths are tracked even if no limit
+ * is set.
+ *
+ * @cntl_arg_getonly{lcb_QUEUESTATS*}
+ */
+#define LCB_CNTL_QUEUE_STATS 0x48
+
+/**
+ * @volatile
+ *
+ * Reduce the number of replies for batches of GETs which are expected to
+ * miss often. When enabled, plain GETs (i.e. which neither lock the item nor
+ * touch it) scheduled within the same scheduling context (see
+ * lcb_sched_enter()) are sent as "quiet" GETs if more than one of them maps
+ * to the same node. The node does not reply to those for which the item
+ * does not exist; a NOOP is sent after them, and once it is answered, the
+ * GETs which were not are completed with @ref LCB_KEY_ENOENT.
+ *
+ * Callbacks are invoked as for regular GETs, although misses are reported
+ * in bulk once the NOOP reply arrives, after the hits preceding it.
+ *
+ * This applies to both memcached and couchbase buckets. The default is off.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ */
+#define LCB_CNTL_GET_QUIET 0x49
+
+/**
+ * @volatile
+ *
+ * `NOT_MY_VBUCKET` replies usually carry the cluster's current
+ * configuration. During a rebalance a great many of them carry the same
+ * one, so configurations which are not newer than the last one seen are
+ * dropped without being parsed. Beyond that, newer configurations are
+ * applied at most once per this interval: those received in the meantime
+ * are held, and only the newest of them is applied once it elapses.
+ *
+ * The default is 10 milliseconds. If set to 0, each new configuration is
+ * applied as soon as it is received.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @see LCB_CNTL_NMV_STATS
+ */
+#define LCB_CNTL_NMV_CONFIG_INTERVAL 0x4A
+
+/** @brief Counters for configurations received with `NOT_MY_VBUCKET`
+ * @see LCB_CNTL_NMV_STATS */
+typedef struct {
+    lcb_U64 nseen; /**< Replies which carried a configuration */
+    lcb_U64 nduplicate; /**< Configurations dropped as not newer */
+    lcb_U64 ncoalesced; /**< Configurations superseded before being applied */
+    lcb_U64 napplied; /**< Configurations parsed and applied */
+} lcb_NMVSTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the counters for configurations received with
+ * `NOT_MY_VBUCKET` replies (see @ref LCB_CNTL_NMV_CONFIG_INTERVAL).
+ *
+ * @cntl_arg_getonly{lcb_NMVSTATS*}
+ */
+#define LCB_CNTL_NMV_STATS 0x4B
+
+/** @brief Clock flags, see @ref LCB_CNTL_CLOCK */
+typedef enum {
+    /**
+     * Read the clock at most once per event handler (such as the processing
+     * of the data read from a socket, or a timer callback) for timeouts and
+     * retry scheduling. Latency measurements always read the clock.
+     */
+    LCB_CLOCK_F_CACHED = 0x01,
+
+    /**
+     * Read the time from the CPU's timestamp counter rather than the
+     * system's monotonic clock. The counter is calibrated against the
+     * monotonic clock when this is first enabled. This is only available if
+     * the CPU's counter runs at a constant rate and is synchronized across
+     * cores (the "invariant TSC" of x86-64 CPUs).
+     */
+    LCB_CLOCK_F_TSC = 0x02
+} lcb_CLOCKFLAGS;
+
+/**
+ * @volatile
+ *
+ * The library reads the clock to stamp each scheduled command, to measure
+ * the latency of its response, and to schedule timeouts and retries. This
+ * setting, a mask of @ref lcb_CLOCKFLAGS, makes these readings cheaper.
+ *
+ * The default is 0: the system's monotonic clock is read every time.
+ * Setting @ref LCB_CLOCK_F_TSC fails with @ref LCB_NOT_SUPPORTED if the
+ * CPU's timestamp counter cannot be used.
+ *
+ * @cntl_arg_both{int* (mask of lcb_CLOCKFLAGS)}
+ */
+#define LCB_CNTL_CLOCK 0x4C
+
+/**
+ * @volatile
+ *
+ * Coalesce concurrent GETs for the same key. When enabled, a plain GET
+ * (i.e. which neither locks the item nor touches it) for a key which is
+ * already being fetched by another plain GET is not sent to the server.
+ * Instead, it receives the same response as the outstanding GET, which is
+ * delivered to its callback right after the outstanding GET's.
+ *
+ * The response may therefore reflect the item as it was before the GET was
+ * scheduled. GETs which are hedged (see @ref LCB_CNTL_HEDGE_DELAY) are not
+ * coalesced. The default is off.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @see LCB_CNTL_SINGLEFLIGHT_STATS
+ */
+#define LCB_CNTL_GET_SINGLEFLIGHT 0x4D
+
+/** @brief Counters for coalesced GETs
+ * @see LCB_CNTL_SINGLEFLIGHT_STATS */
+typedef struct {
+    lcb_U64 nflights; /**< GETs sent which others could be coalesced with */
+    lcb_U64 ncoalesced; /**< GETs coalesced with an outstanding one */
+} lcb_SINGLEFLIGHTSTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the counters for coalesced GETs (see
+ * @ref LCB_CNTL_GET_SINGLEFLIGHT).
+ *
+ * @cntl_arg_getonly{lcb_SINGLEFLIGHTSTATS*}
+ */
+#define LCB_CNTL_SINGLEFLIGHT_STATS 0x4E
+
+/**
+ * @volatile
+ *
+ * Aggregate counter commands for the same key. When set, a counter command
+ * is not sent right away. Instead, its delta is summed with those of the
+ * other counter commands for its key which are scheduled within this
+ * interval, and a single command is then sent for the sum. Its response is
+ * delivered to the callback of each of the aggregated commands: on success,
+ * the value is that of the counter once all of them have been applied.
+ *
+ * Commands are only aggregated if they agree on whether (and how) the
+ * counter is to be created, and if their deltas have the same sign. Those with an explicit hashkey are never
+ * aggregated. Note that the item's value is only changed, and any cached
+ * copy (see @ref LCB_CNTL_KVCACHE_MAXBYTES) is only invalidated, once the
+ * sum is sent. Aggregated commands which were not yet sent when the
+ * instance is destroyed are discarded.
+ *
+ * The default is 0, which disables aggregation.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @see LCB_CNTL_COUNTERAGG_MAXBATCH, LCB_CNTL_COUNTERAGG_STATS
+ */
+#define LCB_CNTL_COUNTERAGG_WINDOW 0x4F
+
+/**
+ * @volatile
+ *
+ * Number of counter commands for the same key after which their sum is sent
+ * without waiting for the rest of the @ref LCB_CNTL_COUNTERAGG_WINDOW to
+ * elapse. The default is 128; 0 means no limit.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ */
+#define LCB_CNTL_COUNTERAGG_MAXBATCH 0x50
+
+/** @brief Counters for aggregated counter commands
+ * @see LCB_CNTL_COUNTERAGG_STATS */
+typedef struct {
+    lcb_U64 naggregated; /**< Counter commands added to a batch */
+    lcb_U64 nbatches; /**< Commands sent for the batches */
+} lcb_COUNTERAGGSTATS;
+
+/**
+ * @volatile
+ *
+ * Retrieve the counters for aggregated counter commands (see
+ * @ref LCB_CNTL_COUNTERAGG_WINDOW).
+ *
+ * @cntl_arg_getonly{lcb_COUNTERAGGSTATS*}
+ */
+#define LCB_CNTL_COUNTERAGG_STATS 0x51
+
+/** @brief Kind of an lcb_METRIC */
+typedef enum {
+    LCB_METRIC_COUNTER = 0, /**< Monotonic count of events */
+    LCB_METRIC_GAUGE, /**< Current level, which may go down */
+    LCB_METRIC_HISTOGRAM /**< Distribution of durations */
+} lcb_METRICTYPE;
+
+/** @brief Bucket of a histogram metric */
+typedef struct {
+    lcb_U64 upper; /**< Largest duration counted in this bucket, in nanoseconds */
+    lcb_U64 count; /**< Number of samples in this bucket */
+} lcb_METRICBUCKET;
+
+/** @brief A single metric
+ * @see LCB_CNTL_METRICS */
+typedef struct {
+    const char *subsystem; /**< e.g. `"queue"` */
+    const char *name; /**< e.g. `"npkts"` */
+    int server; /**< Index of the data node, or -1 for the whole instance */
+    lcb_METRICTYPE type;
+    /** The value, or for histograms the total number of samples */
+    lcb_U64 value;
+    const lcb_METRICBUCKET *buckets; /**< Nonempty buckets of a histogram */
+    lcb_SIZE nbuckets; /**< Number of entries in #buckets */
+} lcb_METRIC;
+
+/** @brief Snapshot of the metrics
+ * @see LCB_CNTL_METRICS */
+typedef struct {
+    const lcb_METRIC *metrics;
+    lcb_SIZE nmetrics;
+} lcb_METRICS;
+
+/**
+ * @volatile
+ *
+ * Take a snapshot of the library's internal counters. The snapshot is owned
+ * by the instance and remains valid until the next one is taken or the
+ * instance is destroyed. The metrics, by subsystem, are:
+ *
+ * - `queue`: `npkts` and `nbytes` (gauges) queued or in flight, for the
+ *   instance and for each node; `nrejected` and `npauses` (counters, instance
+ *   only), see @ref LCB_CNTL_ADMISSION_STATS
+ * - `server`: `nresponses`, `nfailures` (counters), `latency` and `degraded`
+ *   (gauges) for each node, see @ref LCB_CNTL_SERVER_HEALTH
+ * - `pool`: `nidle`, `npending`, `nleased` (gauges), `nrequests`, `nconnect`
+ *   and `nconnect_err` (counters) for the connections to each node
+ * - `netbuf`: `nallocs` (counter) and `nbytes` (gauge) for the buffers
+ *   holding each node's packets
+ * - `rope`: `nmalloc`, `nrequests`, `ntoobig` and `ntoosmall` (counters) for
+ *   the read buffers of each node's current connections. These start over
+ *   whenever a connection is replaced
+ * - `retryq`: `npending` (gauge), `nadded` and `nfailed` (counters)
+ * - `kv`: `latency` (histogram), only if enabled with lcb_enable_timings()
+ * - `faults`: `ndelayed`, `nthrottled`, `npartial`, `nstalls` and `nresets`
+ *   (counters), only while faults are injected (see
+ *   @ref LCB_CNTL_FAULT_SCRIPT)
+ *
+ * New metrics may be added in later versions, so look them up by name.
+ *
+ * @cntl_arg_getonly{lcb_METRICS*}
+ */
+#define LCB_CNTL_METRICS 0x52
+
+/**
+ * @volatile
+ *
+ * Inject network faults into the connections made from now on, to see how
+ * timeouts, retries and the connection pools behave when nodes are slow or
+ * flaky. This is meant for testing only.
+ *
+ * The script is a list of rules separated by `;`, each of them a list of
+ * `key=value` directives separated by `,`. A connection is governed by the
+ * first rule whose `host` and `port` (if given) match its endpoint:
+ *
+ * - `host=HOST`, `port=PORT`: endpoint to match
+ * - `latency=MS`: delay each notification that the socket is readable or
+ *   writable by this many milliseconds
+ * - `jitter=MS`: add a random delay of up to this many milliseconds
+ * - `bandwidth=BYTES`: cap the throughput, in bytes per second for each
+ *   direction
+ * - `partial=P`: probability (0 to 1) of a read or write transferring only
+ *   part of the data
+ * - `stall=P`: probability of a read or write making the connection hang
+ *   for `stall_time` milliseconds (default 1000)
+ * - `reset=P`: probability of a read or write, or of the connection attempt,
+ *   failing, after which the connection is unusable
+ * - `seed=N`: seed for the random choices (default 1), for the whole script
+ *
+ * For example, `port=11210,latency=20,jitter=10;reset=0.001` slows down the
+ * data nodes and occasionally resets any connection. Given the same seed and
+ * the same sequence of I/O, the same faults are injected.
+ *
+ * An empty script (or `NULL`) stops the injection. The counters of injected
+ * faults are reported as the `faults` metrics (see @ref LCB_CNTL_METRICS).
+ * The script may also be set with the `LCB_FAULT_SCRIPT` environment
+ * variable.
+ *
+ * Only event-based I/O plugins are supported; with others, setting a script
+ * fails with @ref LCB_NOT_SUPPORTED.
+ *
+ * @cntl_arg_get_and_set{const char**, const char*}
+ */
+#define LCB_CNTL_FAULT_SCRIPT 0x53
+
+/**
+ * @volatile
+ *
+ * Record the memcached traffic of the data connections made from now on
+ * into a file, which can then be replayed with `cbc-replay` to reproduce
+ * the same load against another cluster (or a stand-in server).
+ *
+ * Every byte sent and received is written, along with when it was, so the
+ * file contains keys and values in clear (even with SSL) and grows
+ * quickly. The format is documented in `src/lcbio/capture.h`.
+ *
+ * The file is created (or truncated) when the path is set, and closed when
+ * another path (or an empty one, or `NULL`) is set, or when the instance is
+ * destroyed. Setting a path fails if the file can't be created.
+ *
+ * @cntl_arg_get_and_set{const char**, const char*}
+ */
+#define LCB_CNTL_CAPTURE_PATH 0x54
+
 /** This is not a command, but rather an indicator of the last item */
-#define LCB_CNTL__MAX                    0x33
+#define LCB_CNTL__MAX                    0x55
 /**@}*/
 
 #ifdef __cplusplus
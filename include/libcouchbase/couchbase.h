@@ -491,6 +491,30 @@ LIBCOUCHBASE_API
 lcb_error_t
 lcb_get_bootstrap_status(lcb_t instance);
 
+/**
+ * Backpressure callback. Invoked when the command queues reach one of their
+ * limits, and again once they have drained.
+ * @param instance
+ * @param paused nonzero if a limit was reached, in which case the application
+ * should stop scheduling commands; zero once they may be scheduled again.
+ *
+ * @volatile
+ * @see LCB_CNTL_QUEUE_MAXPKTS
+ */
+typedef void (*lcb_backpressure_callback)(lcb_t instance, int paused);
+
+/**
+ * @brief Set the callback for notification of command queue backpressure
+ * @param instance the instance
+ * @param callback the callback to set. If `NULL`, return the existing callback
+ * @return The existing (and previous) callback.
+ * @volatile
+ * @see LCB_CNTL_QUEUE_POLICY
+ */
+LIBCOUCHBASE_API
+lcb_backpressure_callback
+lcb_set_backpressure_callback(lcb_t instance, lcb_backpressure_callback callback);
+
 /**
  * @uncommitted
  *
@@ -2890,6 +2914,7 @@ lcb_error_t lcb_cntl(lcb_t instance, int mode, int cmd, void *arg);
  *   is a zero (i.e. `"0"`) or the string `"false"`.
  * - **Float**. This is like a _Number_, but also allows fractional specification,
  *   e.g. `"2.4"`.
+ * - **String**. The value is used as is.
  *
  * | Code | Name | Type
  * |------|------|-----
@@ -2909,6 +2934,32 @@ lcb_error_t lcb_cntl(lcb_t instance, int mode, int cmd, void *arg);
  * |@ref LCB_CNTL_RETRY_BACKOFF             | `"retry_backoff"`     | Float |
  * |@ref LCB_CNTL_HTTP_POOLSIZE             | `"http_poolsize"`     | Number |
  * |@ref LCB_CNTL_VBGUESS_PERSIST           | `"vbguess_persist"`   | Boolean |
+ * |@ref LCB_CNTL_HTTP_POOL_MINIDLE        | `"http_pool_minidle"` | Number |
+ * |@ref LCB_CNTL_KV_NCONNS                | `"kv_connections"`    | Number (Positive) |
+ * |@ref LCB_CNTL_KV_BULK_THRESHOLD         | `"kv_bulk_threshold"` | Number |
+ * |@ref LCB_CNTL_KVCACHE_MAXBYTES          | `"kvcache_max_bytes"` | Number |
+ * |@ref LCB_CNTL_KVCACHE_TTL               | `"kvcache_ttl"`       | Timeout |
+ * |@ref LCB_CNTL_KVCACHE_REVALIDATE        | `"kvcache_revalidate"`| Timeout |
+ * |@ref LCB_CNTL_LOGLEVEL                  | `"log_minlevel"`      | Number (a severity value) |
+ * |@ref LCB_CNTL_LOG_ASYNC                 | `"log_async"`         | Boolean |
+ * |@ref LCB_CNTL_CONFIG_SHARED             | `"config_shared"`     | Boolean |
+ * |@ref LCB_CNTL_BOOTSTRAP_RACE             | `"bootstrap_race"`    | Number |
+ * |@ref LCB_CNTL_HEDGE_DELAY               | `"hedge_delay"`       | Timeout |
+ * |@ref LCB_CNTL_HEDGE_PERCENTILE          | `"hedge_percentile"`  | Float |
+ * |@ref LCB_CNTL_DEGRADED_LATENCY          | `"degraded_latency"`  | Timeout |
+ * |@ref LCB_CNTL_QUEUE_MAXPKTS              | `"queue_max_pkts"`    | Number (Positive) |
+ * |@ref LCB_CNTL_QUEUE_MAXBYTES             | `"queue_max_bytes"`   | Number (Positive) |
+ * |@ref LCB_CNTL_QUEUE_TOTAL_MAXPKTS        | `"queue_total_max_pkts"` | Number (Positive) |
+ * |@ref LCB_CNTL_QUEUE_TOTAL_MAXBYTES       | `"queue_total_max_bytes"` | Number (Positive) |
+ * |@ref LCB_CNTL_QUEUE_POLICY               | `"queue_policy"`      | Number |
+ * |@ref LCB_CNTL_GET_QUIET                  | `"get_quiet"`         | Boolean |
+ * |@ref LCB_CNTL_NMV_CONFIG_INTERVAL        | `"nmv_config_interval"` | Timeout |
+ * |@ref LCB_CNTL_CLOCK                      | `"clock"`             | Number |
+ * |@ref LCB_CNTL_GET_SINGLEFLIGHT           | `"get_singleflight"`  | Boolean |
+ * |@ref LCB_CNTL_COUNTERAGG_WINDOW          | `"counteragg_window"` | Timeout |
+ * |@ref LCB_CNTL_COUNTERAGG_MAXBATCH        | `"counteragg_max_batch"` | Number (Positive) |
+ * |@ref LCB_CNTL_FAULT_SCRIPT               | `"fault_script"`      | String |
+ * |@ref LCB_CNTL_CAPTURE_PATH               | `"capture_path"`      | String |
  *
  *
  * @committed - Note, the actual API call is considered committed and will
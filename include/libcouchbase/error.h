@@ -429,7 +429,14 @@ typedef enum {
       "The operation structure contains conflicting options") \
     \
     X(LCB_HTTP_ERROR, 0x3B, 0, \
-      "HTTP Operation failed. Inspect status code for details")
+      "HTTP Operation failed. Inspect status code for details") \
+    \
+    /**The command was not scheduled because the client's command queue for
+     * the target server (or for the whole instance) is full. See
+     * @ref LCB_CNTL_QUEUE_MAXPKTS. The command may be retried once the
+     * queue has drained */ \
+    X(LCB_EQUEUEFULL, 0x3C, LCB_ERRTYPE_TRANSIENT, \
+      "Client-side command queue is full. Try again later")
 
 /** Error codes returned by the library. */
 typedef enum {
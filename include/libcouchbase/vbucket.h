@@ -180,6 +180,55 @@ LIBCOUCHBASE_API
 char *
 lcbvb_save_json(lcbvb_CONFIG *vbc);
 
+/** Version of the format produced by lcbvb_save_binary() */
+#define LCBVB_BINARY_VERSION 1
+
+/**
+ * @volatile
+ * @brief Serialize the current config in a compact binary form.
+ *
+ * The binary form contains everything needed to map keys and locate nodes,
+ * and is much cheaper to load than JSON: the vBucket map and the ketama
+ * continuum are stored as they are laid out in memory. It is intended for
+ * caching a configuration locally, and can only be read back by a host with
+ * the same byte order.
+ *
+ * @param vbc the configuration to serialize
+ * @param[out] nbytes set to the size of the returned buffer
+ * @return a buffer which should be freed using free(), or NULL on allocation
+ * failure.
+ */
+LIBCOUCHBASE_API
+void *
+lcbvb_save_binary(lcbvb_CONFIG *vbc, lcb_SIZE *nbytes);
+
+/**
+ * @volatile
+ * @brief Load a configuration produced by lcbvb_save_binary()
+ * @param vbc Object to populate
+ * @param data the buffer. This is not referenced after the function returns,
+ * and may thus be a temporary mapping of a file.
+ * @param nbytes the size of the buffer
+ * @return 0 on success, nonzero if the buffer is not a valid binary
+ * configuration of the current version.
+ */
+LIBCOUCHBASE_API
+int
+lcbvb_load_binary(lcbvb_CONFIG *vbc, const void *data, lcb_SIZE nbytes);
+
+/**
+ * @volatile
+ * @brief Get the revision of a binary configuration without loading it
+ * @param data the buffer
+ * @param nbytes the size of the buffer
+ * @param[out] revid the configuration's revision, or -1 if it has none
+ * @return 0 on success, nonzero if the buffer is not a binary configuration
+ * of the current version
+ */
+LIBCOUCHBASE_API
+int
+lcbvb_peek_binary_revision(const void *data, lcb_SIZE nbytes, int *revid);
+
 /**
  * @committed
  * @brief Return a string indicating why parsing the configuration failed
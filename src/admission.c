@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "logging.h"
+
+#define LOGARGS(instance, lvl) (instance)->settings, "admission", LCB_LOG_##lvl, __FILE__, __LINE__
+
+#define HAS_LIMITS(settings) \
+    ((settings)->queue_maxpkts || (settings)->queue_maxbytes || \
+    (settings)->queue_total_maxpkts || (settings)->queue_total_maxbytes)
+
+/* Whether the given depth reaches the limit, or more than half of it when
+ * checking whether the queue has drained */
+#define OVER(cur, max, drain) \
+    ((max) && ((drain) ? (cur) > (max) / 2 : (cur) >= (max)))
+
+static int
+pipeline_over(const lcb_settings *settings, const mc_PIPELINE *pl, int drain)
+{
+    return OVER(pl->nqpkts, settings->queue_maxpkts, drain) ||
+            OVER(pl->nqbytes, settings->queue_maxbytes, drain);
+}
+
+static int
+queue_over(const lcb_settings *settings, const mc_CMDQUEUE *cq, int drain)
+{
+    return OVER(cq->nqpkts, settings->queue_total_maxpkts, drain) ||
+            OVER(cq->nqbytes, settings->queue_total_maxbytes, drain);
+}
+
+static void
+resume(lcb_t instance)
+{
+    instance->admission.paused = 0;
+    instance->cmdq.drained = NULL;
+    lcb_log(LOGARGS(instance, INFO), "Command queue drained. Resuming (pkts=%u, bytes=%lu)", instance->cmdq.nqpkts, (unsigned long)instance->cmdq.nqbytes);
+    instance->callbacks.backpressure(instance, 0);
+}
+
+static void
+check_drained(mc_CMDQUEUE *cq)
+{
+    lcb_t instance = cq->cqdata;
+    lcb_settings *settings = instance->settings;
+    unsigned ii, jj;
+
+    if (queue_over(settings, cq, 1)) {
+        return;
+    }
+    if (settings->queue_maxpkts || settings->queue_maxbytes) {
+        for (ii = 0; ii < cq->npipelines; ii++) {
+            const mc_PIPELINE *pl = cq->pipelines[ii];
+            if (pipeline_over(settings, pl, 1)) {
+                return;
+            }
+            for (jj = 0; jj < pl->nlanes; jj++) {
+                if (pipeline_over(settings, pl->lanes[jj], 1)) {
+                    return;
+                }
+            }
+        }
+    }
+    resume(instance);
+}
+
+static lcb_error_t
+check_admit(mc_CMDQUEUE *cq, mc_PIPELINE *pl)
+{
+    lcb_t instance = cq->cqdata;
+    lcb_settings *settings = instance->settings;
+
+    if (!pipeline_over(settings, pl, 0) && !queue_over(settings, cq, 0)) {
+        return LCB_SUCCESS;
+    }
+
+    if (!instance->admission.paused) {
+        instance->admission.paused = 1;
+        instance->admission.npauses++;
+        cq->drained = check_drained;
+        lcb_log(LOGARGS(instance, WARN), "Command queue limits reached. Pausing (pkts=%u, bytes=%lu, server=%d)", cq->nqpkts, (unsigned long)cq->nqbytes, pl->index);
+        instance->callbacks.backpressure(instance, 1);
+    }
+
+    if (settings->queue_policy == LCB_QUEUE_POLICY_FAILFAST) {
+        instance->admission.nrejected++;
+        return LCB_EQUEUEFULL;
+    }
+    return LCB_SUCCESS;
+}
+
+void
+lcb_admission_update(lcb_t instance)
+{
+    if (HAS_LIMITS(instance->settings)) {
+        instance->cmdq.admit = check_admit;
+        if (instance->admission.paused) {
+            check_drained(&instance->cmdq);
+        }
+    } else {
+        instance->cmdq.admit = NULL;
+        if (instance->admission.paused) {
+            resume(instance);
+        }
+    }
+}
+
+void
+lcb_admission_stats(lcb_t instance, lcb_QUEUESTATS *stats)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    unsigned ii, jj;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->npkts = cq->nqpkts;
+    stats->nbytes = cq->nqbytes;
+    stats->nrejected = instance->admission.nrejected;
+    stats->npauses = instance->admission.npauses;
+    stats->paused = instance->admission.paused;
+
+    for (ii = 0; ii < cq->npipelines; ii++) {
+        const mc_PIPELINE *pl = cq->pipelines[ii];
+        for (jj = 0; jj <= pl->nlanes; jj++) {
+            const mc_PIPELINE *cur = jj ? pl->lanes[jj - 1] : pl;
+            if (cur->nqpkts > stats->max_pipeline_pkts) {
+                stats->max_pipeline_pkts = cur->nqpkts;
+            }
+            if (cur->nqbytes > stats->max_pipeline_bytes) {
+                stats->max_pipeline_bytes = cur->nqbytes;
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_ADMISSION_H
+#define LCB_ADMISSION_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Admission control
+ *
+ * @defgroup lcb-admission Admission control
+ *
+ * @details
+ * The command queue counts the packets (and their bytes) which were scheduled
+ * on each pipeline and not yet released (see mc_PIPELINE::nqpkts). When any
+ * of the limits in lcb_settings (`queue_*`) is set, mcreq_basic_packet()
+ * consults lcb_admission_check() before allocating a packet:
+ *
+ * - If the target pipeline, or the instance as a whole, is at its limit, the
+ *   instance becomes "paused" and the backpressure callback is invoked.
+ *   Depending on lcb_settings::queue_policy the command is then rejected with
+ *   LCB_EQUEUEFULL or admitted anyway.
+ * - Once the instance and each pipeline have drained to half of their limits,
+ *   the instance is resumed and the callback is invoked again.
+ *
+ * @addtogroup lcb-admission
+ * @{
+ */
+
+/** Per-instance admission control state */
+typedef struct {
+    lcb_U64 nrejected; /**< Commands rejected with LCB_EQUEUEFULL */
+    lcb_U64 npauses; /**< Number of times the limits were reached */
+    int paused; /**< Whether the limits were reached (and not drained) */
+} lcb_ADMISSION;
+
+/**
+ * Apply the current limits. This must be called whenever one of the `queue_*`
+ * settings changes.
+ */
+void
+lcb_admission_update(lcb_t instance);
+
+/**
+ * Retrieve the queue depth and admission counters
+ * @param instance
+ * @param[out] stats
+ */
+void
+lcb_admission_stats(lcb_t instance, lcb_QUEUESTATS *stats);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -57,7 +57,7 @@ config_callback(clconfig_listener *listener, clconfig_event_t event,
     if (info->origin != LCB_CLCONFIG_FILE) {
         /* Set the timestamp for the current config to control throttling,
          * but only if it's not an initial file-based config. See CCBC-482 */
-        bs->last_refresh = gethrtime();
+        bs->last_refresh = lcbio_now(instance->iotable);
         bs->errcounter = 0;
     }
 
@@ -159,7 +159,7 @@ lcb_error_t
 lcb_bootstrap_common(lcb_t instance, int options)
 {
     struct lcb_BOOTSTRAP *bs = instance->bootstrap;
-    hrtime_t now = gethrtime();
+    hrtime_t now = lcbio_now(instance->iotable);
 
     if (!bs) {
         bs = calloc(1, sizeof(*instance->bootstrap));
@@ -32,21 +32,54 @@
 #include "ctx-log-inl.h"
 #define LOGARGS(cccp, lvl) cccp->base.parent->settings, "cccp", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGFMT "<%s:%s> "
-#define LOGID(cccp) get_ctx_host(cccp->ioctx), get_ctx_port(cccp->ioctx)
+#define LOGID(conn) get_ctx_host(conn->ioctx), get_ctx_port(conn->ioctx)
+
+/** Maximum number of nodes contacted at once when racing the bootstrap */
+#define CCCP_MAX_RACE 8
 
 struct cccp_cookie_st;
+struct cccp_provider_st;
 
+/** A dedicated connection used to request the configuration from a node */
 typedef struct {
+    struct cccp_provider_st *parent;
+    lcbio_CONNREQ creq;
+    lcbio_CTX *ioctx;
+    lcb_host_t host;
+    /** When the node was first contacted */
+    hrtime_t start;
+} cccp_conn;
+
+typedef struct cccp_provider_st {
     clconfig_provider base;
     hostlist_t nodes;
     clconfig_info *config;
     int server_active;
     int disabled;
+    /**Whether the configuration is being requested from several nodes at
+     * once. In this case all the elements of `conns` may be used, otherwise
+     * only the first one is */
+    int racing;
     lcbio_pTIMER timer;
     lcb_t instance;
-    lcbio_CONNREQ creq;
-    lcbio_CTX *ioctx;
+    cccp_conn conns[CCCP_MAX_RACE];
     struct cccp_cookie_st *cmdcookie;
+
+    /** Configurations received with NOT_MY_VBUCKET replies */
+    struct {
+        /** Applies the pending configuration once the interval has elapsed */
+        lcbio_pTIMER timer;
+        /** The newest configuration not yet applied, if any */
+        lcb_string pending;
+        char *pending_host;
+        /** Revision of the newest configuration applied or pending */
+        int last_rev;
+        /** Hash of that configuration, for those without a revision */
+        lcb_U32 last_hash;
+        /** When a configuration was last applied */
+        hrtime_t last_applied;
+        lcb_NMVSTATS stats;
+    } nmv;
 } cccp_provider;
 
 typedef struct cccp_cookie_st {
@@ -59,7 +92,7 @@ typedef struct cccp_cookie_st {
 
 static void io_error_handler(lcbio_CTX *, lcb_error_t);
 static void io_read_handler(lcbio_CTX *, unsigned nr);
-static void request_config(cccp_provider *);
+static void request_config(cccp_conn *);
 static void on_connected(lcbio_SOCKET *, void*, lcb_error_t, lcbio_OSERR);
 
 static void
@@ -74,22 +107,139 @@ pooled_close_cb(lcbio_SOCKET *sock, int reusable, void *arg)
     }
 }
 
+#define CONN_ACTIVE(conn) ((conn)->creq.u.p_generic || (conn)->ioctx)
+
+static void release_conn(cccp_conn *conn, int can_reuse)
+{
+    lcbio_connreq_cancel(&conn->creq);
+
+    if (conn->ioctx) {
+        lcbio_ctx_close(conn->ioctx, pooled_close_cb, &can_reuse);
+        conn->ioctx = NULL;
+    }
+}
+
 static void release_socket(cccp_provider *cccp, int can_reuse)
 {
+    unsigned ii;
     if (cccp->cmdcookie) {
         cccp->cmdcookie->ignore_errors = 1;
         cccp->cmdcookie =  NULL;
         return;
     }
 
-    lcbio_connreq_cancel(&cccp->creq);
+    for (ii = 0; ii < CCCP_MAX_RACE; ii++) {
+        release_conn(&cccp->conns[ii], can_reuse);
+    }
+}
+
+static void report_latency(const cccp_conn *conn, lcb_error_t err)
+{
+    lcb_U32 elapsed = LCB_NS2US(gethrtime() - conn->start);
+    cccp_provider *cccp = conn->parent;
+    if (err == LCB_SUCCESS) {
+        lcb_log(LOGARGS(cccp, INFO), "Got configuration from %s:%s in %uus", conn->host.host, conn->host.port, elapsed);
+    } else {
+        lcb_log(LOGARGS(cccp, INFO), "Failed to get configuration from %s:%s after %uus (0x%x)", conn->host.host, conn->host.port, elapsed, err);
+    }
+}
+
+static void connect_node(cccp_conn *conn, const lcb_host_t *host)
+{
+    cccp_provider *cccp = conn->parent;
+    lcbio_pMGRREQ preq;
+
+    lcb_log(LOGARGS(cccp, INFO), "Requesting connection to node %s:%s for CCCP configuration", host->host, host->port);
+    conn->host = *host;
+    conn->start = gethrtime();
+    preq = lcbio_mgr_get(
+            cccp->instance->memd_sockpool, &conn->host,
+            PROVIDER_SETTING(&cccp->base, config_node_timeout),
+            on_connected, conn);
+    LCBIO_CONNREQ_MKPOOLED(&conn->creq, preq);
+}
 
-    if (cccp->ioctx) {
-        lcbio_ctx_close(cccp->ioctx, pooled_close_cb, &can_reuse);
-        cccp->ioctx = NULL;
+/** Rearm the timer for the connection which was started first */
+static void rearm_race_timer(cccp_provider *cccp)
+{
+    unsigned ii;
+    hrtime_t now = gethrtime(), first = 0;
+    hrtime_t tmo = LCB_US2NS(PROVIDER_SETTING(&cccp->base, config_node_timeout));
+
+    for (ii = 0; ii < CCCP_MAX_RACE; ii++) {
+        const cccp_conn *conn = &cccp->conns[ii];
+        if (CONN_ACTIVE(conn) && (!first || conn->start < first)) {
+            first = conn->start;
+        }
+    }
+    if (!first) {
+        lcbio_timer_disarm(cccp->timer);
+    } else if (now - first >= tmo) {
+        lcbio_timer_rearm(cccp->timer, 0);
+    } else {
+        lcbio_timer_rearm(cccp->timer, LCB_NS2US(tmo - (now - first)));
     }
 }
 
+static void finish_race(cccp_provider *cccp)
+{
+    release_socket(cccp, 0);
+    lcbio_timer_disarm(cccp->timer);
+    cccp->racing = 0;
+    cccp->server_active = 0;
+}
+
+/**
+ * Request the configuration from several nodes at once. The first valid
+ * configuration wins and the remaining requests are cancelled; whenever a
+ * node fails, the next node in the list (if any) takes its place.
+ */
+static lcb_error_t start_race(cccp_provider *cccp)
+{
+    unsigned ii, nrace = PROVIDER_SETTING(&cccp->base, bc_race_nodes);
+    if (nrace > CCCP_MAX_RACE) {
+        nrace = CCCP_MAX_RACE;
+    }
+
+    lcb_log(LOGARGS(cccp, DEBUG), "Requesting configuration from up to %u nodes at once", nrace);
+    cccp->nodes->ix = 0;
+    cccp->racing = 1;
+    cccp->server_active = 1;
+    for (ii = 0; ii < nrace; ii++) {
+        lcb_host_t *next_host = hostlist_shift_next(cccp->nodes, 0);
+        if (!next_host) {
+            break;
+        }
+        connect_node(&cccp->conns[ii], next_host);
+    }
+    lcbio_timer_rearm(
+            cccp->timer, PROVIDER_SETTING(&cccp->base, config_node_timeout));
+    return LCB_SUCCESS;
+}
+
+static lcb_error_t race_error(cccp_conn *conn, lcb_error_t err)
+{
+    unsigned ii;
+    cccp_provider *cccp = conn->parent;
+    lcb_host_t *next_host;
+
+    release_conn(conn, err == LCB_NOT_SUPPORTED);
+    if ((next_host = hostlist_shift_next(cccp->nodes, 0)) != NULL) {
+        connect_node(conn, next_host);
+        return LCB_SUCCESS;
+    }
+    for (ii = 0; ii < CCCP_MAX_RACE; ii++) {
+        if (CONN_ACTIVE(&cccp->conns[ii])) {
+            return LCB_SUCCESS;
+        }
+    }
+
+    /* All nodes failed */
+    finish_race(cccp);
+    lcb_confmon_provider_failed(&cccp->base, err);
+    return err;
+}
+
 static lcb_error_t
 schedule_next_request(cccp_provider *cccp, lcb_error_t err, int can_rollover)
 {
@@ -108,34 +258,38 @@ schedule_next_request(cccp_provider *cccp, lcb_error_t err, int can_rollover)
         cccp->cmdcookie = cookie;
         cookie->parent = cccp;
         lcb_log(LOGARGS(cccp, INFO), "Re-Issuing CCCP Command on server struct %p (%s:%s)", (void*)server, next_host->host, next_host->port);
+        cccp->conns[0].start = 0;
         lcbio_timer_rearm(
                 cccp->timer, PROVIDER_SETTING(&cccp->base, config_node_timeout));
         return lcb_getconfig(cccp->instance, cookie, server);
 
     } else {
-        lcbio_pMGRREQ preq;
-
-        lcb_log(LOGARGS(cccp, INFO), "Requesting connection to node %s:%s for CCCP configuration", next_host->host, next_host->port);
-        preq = lcbio_mgr_get(
-                cccp->instance->memd_sockpool, next_host,
-                PROVIDER_SETTING(&cccp->base, config_node_timeout),
-                on_connected, cccp);
-        LCBIO_CONNREQ_MKPOOLED(&cccp->creq, preq);
+        connect_node(&cccp->conns[0], next_host);
     }
 
     cccp->server_active = 1;
     return LCB_SUCCESS;
 }
 
-static lcb_error_t mcio_error(cccp_provider *cccp, lcb_error_t err)
+static lcb_error_t mcio_error(cccp_conn *conn, lcb_error_t err)
 {
+    cccp_provider *cccp = conn->parent;
     if (err != LCB_NOT_SUPPORTED && err != LCB_UNKNOWN_COMMAND) {
-        lcb_log(LOGARGS(cccp, ERR), LOGFMT "Got I/O Error=0x%x", LOGID(cccp), err);
+        lcb_log(LOGARGS(cccp, ERR), LOGFMT "Got I/O Error=0x%x", LOGID(conn), err);
+    }
+    if (conn->start) {
+        report_latency(conn, err);
     }
     if (err == LCB_AUTH_ERROR && cccp->base.parent->config == NULL) {
+        if (cccp->racing) {
+            finish_race(cccp);
+        }
         lcb_confmon_provider_failed(&cccp->base, err);
         return err;
     }
+    if (cccp->racing) {
+        return race_error(conn, err);
+    }
 
     release_socket(cccp, err == LCB_NOT_SUPPORTED);
     return schedule_next_request(cccp, err, 0);
@@ -144,7 +298,25 @@ static lcb_error_t mcio_error(cccp_provider *cccp, lcb_error_t err)
 static void socket_timeout(void *arg)
 {
     cccp_provider *cccp = arg;
-    mcio_error(cccp, LCB_ETIMEDOUT);
+    unsigned ii;
+    hrtime_t now, tmo;
+
+    if (!cccp->racing) {
+        mcio_error(&cccp->conns[0], LCB_ETIMEDOUT);
+        return;
+    }
+
+    now = gethrtime();
+    tmo = LCB_US2NS(PROVIDER_SETTING(&cccp->base, config_node_timeout));
+    for (ii = 0; ii < CCCP_MAX_RACE && cccp->racing; ii++) {
+        cccp_conn *conn = &cccp->conns[ii];
+        if (CONN_ACTIVE(conn) && now - conn->start >= tmo) {
+            mcio_error(conn, LCB_ETIMEDOUT);
+        }
+    }
+    if (cccp->racing) {
+        rearm_race_timer(cccp);
+    }
 }
 
 void lcb_clconfig_cccp_enable(clconfig_provider *pb, lcb_t instance)
@@ -202,6 +374,158 @@ lcb_error_t lcb_cccp_update(clconfig_provider *provider,
     return LCB_SUCCESS;
 }
 
+/* Extract the revision of a configuration without parsing it. Returns -1 if
+ * the configuration has none */
+static int
+nmv_get_rev(const char *data, lcb_SIZE ndata)
+{
+    static const char needle[] = "\"rev\"";
+    const char *end = data + ndata, *cur;
+    lcb_U64 rev = 0;
+
+    for (cur = data; cur + sizeof(needle) - 1 <= end; cur++) {
+        if (*cur == '"' && memcmp(cur, needle, sizeof(needle) - 1) == 0) {
+            break;
+        }
+    }
+    if (cur + sizeof(needle) - 1 > end) {
+        return -1;
+    }
+    for (cur += sizeof(needle) - 1; cur < end && (isspace((int)*cur) || *cur == ':'); cur++) {
+    }
+    if (cur == end || !isdigit((int)*cur)) {
+        return -1;
+    }
+    for (; cur < end && isdigit((int)*cur); cur++) {
+        rev = rev * 10 + (*cur - '0');
+        if (rev > INT_MAX) {
+            /* Not a revision we could compare; fall back to the hash */
+            return -1;
+        }
+    }
+    return (int)rev;
+}
+
+/* FNV-1a */
+static lcb_U32
+nmv_get_hash(const char *data, lcb_SIZE ndata)
+{
+    lcb_U32 hash = 2166136261U;
+    lcb_SIZE ii;
+    for (ii = 0; ii < ndata; ii++) {
+        hash = (hash ^ (lcb_U8)data[ii]) * 16777619U;
+    }
+    return hash;
+}
+
+static void
+nmv_apply(cccp_provider *cccp, const char *host, lcb_string *data)
+{
+    lcb_error_t err;
+
+    cccp->nmv.last_applied = gethrtime();
+    cccp->nmv.stats.napplied++;
+    err = lcb_cccp_update(&cccp->base, host, data);
+    if (err != LCB_SUCCESS) {
+        lcb_log(LOGARGS(cccp, WARN), "Couldn't apply configuration from NOT_MY_VBUCKET (0x%x). Requesting a new one", err);
+        /* Allow the same configuration to be tried again */
+        cccp->nmv.last_rev = -1;
+        cccp->nmv.last_hash = 0;
+        lcb_bootstrap_common(cccp->instance, LCB_BS_REFRESH_ALWAYS);
+    }
+}
+
+static void
+nmv_timer_callback(void *arg)
+{
+    cccp_provider *cccp = arg;
+    lcb_string data = cccp->nmv.pending;
+    char *host = cccp->nmv.pending_host;
+
+    lcb_string_init(&cccp->nmv.pending);
+    cccp->nmv.pending_host = NULL;
+    if (data.nused) {
+        nmv_apply(cccp, host, &data);
+    }
+    lcb_string_release(&data);
+    free(host);
+}
+
+lcb_error_t
+lcb_cccp_update_nmv(clconfig_provider *provider, const char *host,
+    const char *data, lcb_SIZE ndata)
+{
+    cccp_provider *cccp = (cccp_provider *)provider;
+    lcb_confmon *mon = provider->parent;
+    lcb_U32 interval = PROVIDER_SETTING(provider, nmv_config_interval);
+    int rev = nmv_get_rev(data, ndata);
+    lcb_U32 hash = 0;
+    hrtime_t now;
+
+    cccp->nmv.stats.nseen++;
+    if (rev > -1) {
+        if (rev <= cccp->nmv.last_rev ||
+                (mon->config && rev <= mon->config->vbc->revid)) {
+            cccp->nmv.stats.nduplicate++;
+            return LCB_SUCCESS;
+        }
+    } else {
+        hash = nmv_get_hash(data, ndata);
+        if (hash == cccp->nmv.last_hash) {
+            cccp->nmv.stats.nduplicate++;
+            return LCB_SUCCESS;
+        }
+    }
+    cccp->nmv.last_rev = rev;
+    cccp->nmv.last_hash = hash;
+
+    /* The pending configuration, if any, is older than this one */
+    if (cccp->nmv.pending.nused) {
+        cccp->nmv.stats.ncoalesced++;
+    }
+    lcb_string_clear(&cccp->nmv.pending);
+    free(cccp->nmv.pending_host);
+    cccp->nmv.pending_host = NULL;
+    if (lcb_string_append(&cccp->nmv.pending, data, ndata) != 0 ||
+            (cccp->nmv.pending_host = strdup(host)) == NULL) {
+        lcb_string_clear(&cccp->nmv.pending);
+        cccp->nmv.last_rev = -1;
+        cccp->nmv.last_hash = 0;
+        return LCB_CLIENT_ENOMEM;
+    }
+
+    now = gethrtime();
+    if (interval && cccp->nmv.last_applied &&
+            now - cccp->nmv.last_applied < LCB_US2NS(interval)) {
+        if (!lcbio_timer_armed(cccp->nmv.timer)) {
+            lcbio_timer_rearm(cccp->nmv.timer,
+                interval - LCB_NS2US(now - cccp->nmv.last_applied));
+        }
+        return LCB_SUCCESS;
+    }
+    lcbio_timer_disarm(cccp->nmv.timer);
+    nmv_timer_callback(cccp);
+    return LCB_SUCCESS;
+}
+
+void
+lcb_cccp_nmv_stats(clconfig_provider *provider, lcb_NMVSTATS *stats)
+{
+    *stats = ((cccp_provider *)provider)->nmv.stats;
+}
+
+int
+lcb_cccp_flush_nmv(clconfig_provider *provider)
+{
+    cccp_provider *cccp = (cccp_provider *)provider;
+    if (!lcbio_timer_armed(cccp->nmv.timer)) {
+        return 0;
+    }
+    lcbio_timer_disarm(cccp->nmv.timer);
+    nmv_timer_callback(cccp);
+    return 1;
+}
+
 void lcb_cccp_update2(const void *cookie, lcb_error_t err,
                       const void *bytes, lcb_size_t nbytes,
                       const lcb_host_t *origin)
@@ -224,7 +548,7 @@ void lcb_cccp_update2(const void *cookie, lcb_error_t err,
     }
 
     if (err != LCB_SUCCESS && ck->ignore_errors == 0) {
-        mcio_error(cccp, err);
+        mcio_error(&cccp->conns[0], err);
     }
 
     free(ck);
@@ -234,15 +558,15 @@ static void
 on_connected(lcbio_SOCKET *sock, void *data, lcb_error_t err, lcbio_OSERR syserr)
 {
     lcbio_CTXPROCS ioprocs;
-    cccp_provider *cccp = data;
-    lcb_settings *settings = cccp->base.parent->settings;
+    cccp_conn *conn = data;
+    lcb_settings *settings = conn->parent->base.parent->settings;
 
-    LCBIO_CONNREQ_CLEAR(&cccp->creq);
+    LCBIO_CONNREQ_CLEAR(&conn->creq);
     if (err != LCB_SUCCESS) {
         if (sock) {
             lcbio_mgr_discard(sock);
         }
-        mcio_error(cccp, err);
+        mcio_error(conn, err);
         return;
     }
 
@@ -250,16 +574,16 @@ on_connected(lcbio_SOCKET *sock, void *data, lcb_error_t err, lcbio_OSERR syserr
         mc_pSESSREQ sreq;
         sreq = mc_sessreq_start(
                 sock, settings, settings->config_node_timeout, on_connected,
-                cccp);
-        LCBIO_CONNREQ_MKGENERIC(&cccp->creq, sreq, mc_sessreq_cancel);
+                conn);
+        LCBIO_CONNREQ_MKGENERIC(&conn->creq, sreq, mc_sessreq_cancel);
         return;
     }
 
     ioprocs.cb_err = io_error_handler;
     ioprocs.cb_read = io_read_handler;
-    cccp->ioctx = lcbio_ctx_new(sock, data, &ioprocs);
-    cccp->ioctx->subsys = "bc_cccp";
-    request_config(cccp);
+    conn->ioctx = lcbio_ctx_new(sock, data, &ioprocs);
+    conn->ioctx->subsys = "bc_cccp";
+    request_config(conn);
 
     (void)syserr;
 }
@@ -267,10 +591,14 @@ on_connected(lcbio_SOCKET *sock, void *data, lcb_error_t err, lcbio_OSERR syserr
 static lcb_error_t cccp_get(clconfig_provider *pb)
 {
     cccp_provider *cccp = (cccp_provider *)pb;
-    if (cccp->creq.u.p_generic || cccp->server_active || cccp->cmdcookie) {
+    if (CONN_ACTIVE(&cccp->conns[0]) || cccp->server_active || cccp->cmdcookie) {
         return LCB_BUSY;
     }
 
+    if (pb->parent->config == NULL && cccp->nodes->nentries > 1 &&
+            PROVIDER_SETTING(pb, bc_race_nodes) > 1) {
+        return start_race(cccp);
+    }
     return schedule_next_request(cccp, LCB_SUCCESS, 1);
 }
 
@@ -288,6 +616,7 @@ static lcb_error_t cccp_pause(clconfig_provider *pb)
     }
 
     cccp->server_active = 0;
+    cccp->racing = 0;
     release_socket(cccp, 0);
     lcbio_timer_disarm(cccp->timer);
     return LCB_SUCCESS;
@@ -298,6 +627,11 @@ static void cccp_cleanup(clconfig_provider *pb)
     cccp_provider *cccp = (cccp_provider *)pb;
 
     release_socket(cccp, 0);
+    if (cccp->nmv.timer) {
+        lcbio_timer_destroy(cccp->nmv.timer);
+    }
+    lcb_string_release(&cccp->nmv.pending);
+    free(cccp->nmv.pending_host);
     if (cccp->config) {
         lcb_clconfig_decref(cccp->config);
     }
@@ -358,15 +692,16 @@ config_updated(clconfig_provider *provider, lcbvb_CONFIG* vbc)
 static void
 io_error_handler(lcbio_CTX *ctx, lcb_error_t err)
 {
-    cccp_provider *cccp = lcbio_ctx_data(ctx);
-    mcio_error(cccp, err);
+    cccp_conn *conn = lcbio_ctx_data(ctx);
+    mcio_error(conn, err);
 }
 
 static void
 io_read_handler(lcbio_CTX *ioctx, unsigned nr)
 {
     packet_info pi;
-    cccp_provider *cccp = lcbio_ctx_data(ioctx);
+    cccp_conn *conn = lcbio_ctx_data(ioctx);
+    cccp_provider *cccp = conn->parent;
     lcb_string jsonstr;
     lcb_error_t err;
     int rv;
@@ -377,7 +712,7 @@ io_read_handler(lcbio_CTX *ioctx, unsigned nr)
 
 #define return_error(e) \
     lcb_pktinfo_ectx_done(&pi, ioctx); \
-    mcio_error(cccp, e); \
+    mcio_error(conn, e); \
     return
 
     memset(&pi, 0, sizeof(pi));
@@ -389,7 +724,7 @@ io_read_handler(lcbio_CTX *ioctx, unsigned nr)
     }
 
     if (PACKET_STATUS(&pi) != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
-        lcb_log(LOGARGS(cccp, WARN), LOGFMT "CCCP Packet responded with 0x%x; nkey=%d, nbytes=%lu, cmd=0x%x, seq=0x%x", LOGID(cccp),
+        lcb_log(LOGARGS(cccp, WARN), LOGFMT "CCCP Packet responded with 0x%x; nkey=%d, nbytes=%lu, cmd=0x%x, seq=0x%x", LOGID(conn),
                 PACKET_STATUS(&pi), PACKET_NKEY(&pi), (unsigned long)PACKET_NBODY(&pi),
                 PACKET_OPCODE(&pi), PACKET_OPAQUE(&pi));
 
@@ -418,13 +753,17 @@ io_read_handler(lcbio_CTX *ioctx, unsigned nr)
 
     curhost = *lcbio_get_host(lcbio_ctx_sock(ioctx));
     lcb_pktinfo_ectx_done(&pi, ioctx);
-    release_socket(cccp, 1);
+    release_conn(conn, 1);
 
     err = lcb_cccp_update(&cccp->base, curhost.host, &jsonstr);
     lcb_string_release(&jsonstr);
     if (err == LCB_SUCCESS) {
-        lcbio_timer_disarm(cccp->timer);
-        cccp->server_active = 0;
+        report_latency(conn, err);
+        /* Cancel the other nodes, if racing */
+        finish_race(cccp);
+    } else if (cccp->racing) {
+        report_latency(conn, LCB_PROTOCOL_ERROR);
+        race_error(conn, LCB_PROTOCOL_ERROR);
     } else {
         schedule_next_request(cccp, LCB_PROTOCOL_ERROR, 0);
     }
@@ -432,17 +771,21 @@ io_read_handler(lcbio_CTX *ioctx, unsigned nr)
 #undef return_error
 }
 
-static void request_config(cccp_provider *cccp)
+static void request_config(cccp_conn *conn)
 {
+    cccp_provider *cccp = conn->parent;
     protocol_binary_request_set_cluster_config req;
     memset(&req, 0, sizeof(req));
     req.message.header.request.magic = PROTOCOL_BINARY_REQ;
     req.message.header.request.opcode = PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG;
     req.message.header.request.opaque = 0xF00D;
-    lcbio_ctx_put(cccp->ioctx, req.bytes, sizeof(req.bytes));
-    lcbio_ctx_rwant(cccp->ioctx, 24);
-    lcbio_ctx_schedule(cccp->ioctx);
-    lcbio_timer_rearm(cccp->timer, PROVIDER_SETTING(&cccp->base, config_node_timeout));
+    lcbio_ctx_put(conn->ioctx, req.bytes, sizeof(req.bytes));
+    lcbio_ctx_rwant(conn->ioctx, 24);
+    lcbio_ctx_schedule(conn->ioctx);
+    if (!cccp->racing) {
+        /* When racing, the timer tracks the connection started first */
+        lcbio_timer_rearm(cccp->timer, PROVIDER_SETTING(&cccp->base, config_node_timeout));
+    }
 }
 
 static void do_dump(clconfig_provider *pb, FILE *fp)
@@ -457,13 +800,23 @@ static void do_dump(clconfig_provider *pb, FILE *fp)
     fprintf(fp, "## BEGIN CCCP PROVIDER DUMP ##\n");
     fprintf(fp, "TIMER ACTIVE: %s\n", lcbio_timer_armed(cccp->timer) ? "YES" : "NO");
     fprintf(fp, "PIPELINE RESPONSE COOKIE: %p\n", (void*)cccp->cmdcookie);
-    if (cccp->ioctx) {
-        fprintf(fp, "CCCP Owns connection:\n");
-        lcbio_ctx_dump(cccp->ioctx, fp);
-    } else if (cccp->creq.u.p_generic) {
-        fprintf(fp, "CCCP Is connecting\n");
-    } else {
-        fprintf(fp, "CCCP does not have a dedicated connection\n");
+    fprintf(fp, "RACING: %s\n", cccp->racing ? "YES" : "NO");
+    fprintf(fp, "NOT_MY_VBUCKET CONFIGS: SEEN=%lu, DUPLICATE=%lu, COALESCED=%lu, APPLIED=%lu%s\n",
+        (unsigned long)cccp->nmv.stats.nseen,
+        (unsigned long)cccp->nmv.stats.nduplicate,
+        (unsigned long)cccp->nmv.stats.ncoalesced,
+        (unsigned long)cccp->nmv.stats.napplied,
+        cccp->nmv.pending.nused ? " (PENDING)" : "");
+    for (ii = 0; ii < CCCP_MAX_RACE; ii++) {
+        const cccp_conn *conn = &cccp->conns[ii];
+        if (conn->ioctx) {
+            fprintf(fp, "CCCP Owns connection:\n");
+            lcbio_ctx_dump(conn->ioctx, fp);
+        } else if (conn->creq.u.p_generic) {
+            fprintf(fp, "CCCP Is connecting to %s:%s\n", conn->host.host, conn->host.port);
+        } else if (ii == 0) {
+            fprintf(fp, "CCCP does not have a dedicated connection\n");
+        }
     }
 
     for (ii = 0; ii < cccp->nodes->nentries; ii++) {
@@ -475,6 +828,7 @@ static void do_dump(clconfig_provider *pb, FILE *fp)
 
 clconfig_provider * lcb_clconfig_create_cccp(lcb_confmon *mon)
 {
+    unsigned ii;
     cccp_provider *cccp = calloc(1, sizeof(*cccp));
     cccp->nodes = hostlist_create();
     cccp->base.type = LCB_CLCONFIG_CCCP;
@@ -489,6 +843,12 @@ clconfig_provider * lcb_clconfig_create_cccp(lcb_confmon *mon)
     cccp->base.parent = mon;
     cccp->base.enabled = 0;
     cccp->timer = lcbio_timer_new(mon->iot, cccp, socket_timeout);
+    cccp->nmv.timer = lcbio_timer_new(mon->iot, cccp, nmv_timer_callback);
+    cccp->nmv.last_rev = -1;
+    lcb_string_init(&cccp->nmv.pending);
+    for (ii = 0; ii < CCCP_MAX_RACE; ii++) {
+        cccp->conns[ii].parent = cccp;
+    }
 
     if (!cccp->nodes) {
         free(cccp);
@@ -20,9 +20,31 @@
 #include "simplestring.h"
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-ng.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define CONFIG_CACHE_MAGIC "{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}"
 
+/*
+ * Alongside the JSON cache file a binary copy of the configuration is kept,
+ * in the file with BINARY_SUFFIX appended. It is loaded in preference to the
+ * JSON (which needs to be fully parsed) if it was written together with the
+ * current contents of the JSON file.
+ */
+#define BINARY_SUFFIX ".bin"
+#define BINARY_MAGIC "LCBCFBIN"
+
+/* Precedes the output of lcbvb_save_binary() in the binary file. Its size
+ * keeps the configuration itself 8-byte aligned */
+typedef struct {
+    char magic[8];
+    lcb_U32 json_size; /* size of the JSON file written with this one */
+    lcb_U32 reserved;
+} binfile_HEADER;
+
 #define LOGARGS(pb, lvl) pb->base.parent->settings, "bc_file", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGFMT "(cache=%s) "
 #define LOGID(fb) fb->filename
@@ -30,13 +52,88 @@
 typedef struct {
     clconfig_provider base;
     char *filename;
+    char *binfilename;
     clconfig_info *config;
+    int last_binary; /* whether the last config was loaded from binfilename */
     time_t last_mtime;
     int last_errno;
     lcbio_pTIMER timer;
     clconfig_listener listener;
 } file_provider;
 
+/* Read the binary configuration, if it matches the JSON file */
+static lcbvb_CONFIG *
+load_binary(file_provider *provider, const struct stat *json_st)
+{
+    binfile_HEADER hdr;
+    lcbvb_CONFIG *config = NULL;
+    const char *data;
+    lcb_SIZE nbytes;
+    struct stat st;
+#ifdef HAVE_SYS_MMAN_H
+    void *map;
+    int fd = open(provider->binfilename, O_RDONLY);
+
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof hdr) {
+        close(fd);
+        return NULL;
+    }
+    nbytes = st.st_size;
+    map = mmap(NULL, nbytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    data = map;
+#else
+    char *buf;
+    FILE *fp = fopen(provider->binfilename, "rb");
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fstat(fileno(fp), &st) || st.st_size < (off_t)sizeof hdr ||
+            (buf = malloc(st.st_size)) == NULL) {
+        fclose(fp);
+        return NULL;
+    }
+    nbytes = st.st_size;
+    if (fread(buf, 1, nbytes, fp) != nbytes) {
+        fclose(fp);
+        free(buf);
+        return NULL;
+    }
+    fclose(fp);
+    data = buf;
+#endif
+
+    memcpy(&hdr, data, sizeof hdr);
+    if (memcmp(hdr.magic, BINARY_MAGIC, sizeof hdr.magic) != 0 ||
+            hdr.json_size != (lcb_U32)json_st->st_size ||
+            st.st_mtime < json_st->st_mtime) {
+        lcb_log(LOGARGS(provider, DEBUG), LOGFMT "Binary cache does not match JSON cache", LOGID(provider));
+        goto GT_DONE;
+    }
+
+    config = lcbvb_create();
+    if (config && lcbvb_load_binary(config, data + sizeof hdr, nbytes - sizeof hdr)) {
+        lcb_log(LOGARGS(provider, WARN), LOGFMT "Couldn't load binary cache: %s", LOGID(provider), lcbvb_get_error(config));
+        lcbvb_destroy(config);
+        config = NULL;
+    }
+
+    GT_DONE:
+#ifdef HAVE_SYS_MMAN_H
+    munmap(map, nbytes);
+#else
+    free(buf);
+#endif
+    return config;
+}
+
 static int load_cache(file_provider *provider)
 {
     lcb_string str;
@@ -72,12 +169,21 @@ static int load_cache(file_provider *provider)
         goto GT_DONE;
     }
 
+    if ((config = load_binary(provider, &st)) != NULL) {
+        provider->last_binary = 1;
+        goto GT_APPLY;
+    }
+    provider->last_binary = 0;
+
     config = lcbvb_create();
     if (config == NULL) {
         goto GT_DONE;
     }
 
     lcb_string_init(&str);
+    if (lcb_string_reserve(&str, st.st_size + 1)) {
+        goto GT_DONE;
+    }
 
     while ((nr = fread(line, 1, sizeof(line), fp)) > 0) {
         if (lcb_string_append(&str, line, nr)) {
@@ -104,6 +210,7 @@ static int load_cache(file_provider *provider)
         status = -1;
         goto GT_DONE;
     }
+    *end = '\0';
 
     fail = lcbvb_load_json(config, str.base);
     if (fail) {
@@ -113,6 +220,7 @@ static int load_cache(file_provider *provider)
         goto GT_DONE;
     }
 
+    GT_APPLY:
     if (lcbvb_get_distmode(config) != LCBVB_DIST_VBUCKET) {
         status = -1;
         lcb_log(LOGARGS(provider, ERROR), LOGFMT "Not applying cached memcached config", LOGID(provider));
@@ -143,6 +251,87 @@ static int load_cache(file_provider *provider)
     return status;
 }
 
+/* Whether the binary file already holds this revision of the config */
+static int
+binary_is_current(file_provider *provider, lcbvb_CONFIG *cfg)
+{
+    char buf[256];
+    binfile_HEADER hdr;
+    struct stat st;
+    lcb_SIZE nr;
+    int revid;
+    FILE *fp;
+
+    if (cfg->revid < 0 || stat(provider->filename, &st) != 0) {
+        return 0;
+    }
+    if ((fp = fopen(provider->binfilename, "rb")) == NULL) {
+        return 0;
+    }
+    nr = fread(buf, 1, sizeof buf, fp);
+    fclose(fp);
+    if (nr < sizeof hdr) {
+        return 0;
+    }
+    memcpy(&hdr, buf, sizeof hdr);
+    if (memcmp(hdr.magic, BINARY_MAGIC, sizeof hdr.magic) ||
+            hdr.json_size != (lcb_U32)st.st_size ||
+            lcbvb_peek_binary_revision(buf + sizeof hdr, nr - sizeof hdr, &revid)) {
+        return 0;
+    }
+    return revid == cfg->revid;
+}
+
+static void
+write_binary(file_provider *provider, lcbvb_CONFIG *cfg, lcb_SIZE json_size)
+{
+    binfile_HEADER hdr;
+    lcb_SIZE nbytes;
+    lcb_string tmpname;
+    void *data;
+    FILE *fp;
+    int ok;
+
+    if ((data = lcbvb_save_binary(cfg, &nbytes)) == NULL) {
+        return;
+    }
+
+    /* Write to a temporary file and rename it, so that other processes never
+     * map a partially written file */
+    lcb_string_init(&tmpname);
+    if (lcb_string_appendz(&tmpname, provider->binfilename) ||
+            lcb_string_appendz(&tmpname, ".tmp")) {
+        goto GT_DONE;
+    }
+
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, BINARY_MAGIC, sizeof hdr.magic);
+    hdr.json_size = json_size;
+
+    if ((fp = fopen(tmpname.base, "wb")) == NULL) {
+        int save_errno = errno;
+        lcb_log(LOGARGS(provider, ERROR), LOGFMT "Couldn't open binary file for writing: %s", LOGID(provider), strerror(save_errno));
+        goto GT_DONE;
+    }
+    ok = fwrite(&hdr, 1, sizeof hdr, fp) == sizeof hdr &&
+            fwrite(data, 1, nbytes, fp) == nbytes;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        remove(tmpname.base);
+    } else {
+#ifdef _WIN32
+        remove(provider->binfilename);
+#endif
+        if (rename(tmpname.base, provider->binfilename) != 0) {
+            remove(tmpname.base);
+        }
+    }
+
+    GT_DONE:
+    lcb_string_release(&tmpname);
+    free(data);
+}
+
 static void
 write_to_file(file_provider *provider, lcbvb_CONFIG *cfg)
 {
@@ -152,13 +341,22 @@ write_to_file(file_provider *provider, lcbvb_CONFIG *cfg)
         return;
     }
 
+    if (binary_is_current(provider, cfg)) {
+        lcb_log(LOGARGS(provider, DEBUG), LOGFMT "Cache already contains revision %d", LOGID(provider), cfg->revid);
+        return;
+    }
+
     fp = fopen(provider->filename, "w");
     if (fp) {
         char *json = lcbvb_save_json(cfg);
+        int nw;
         lcb_log(LOGARGS(provider, INFO), LOGFMT "Writing configuration to file", LOGID(provider));
-        fprintf(fp, "%s%s", json, CONFIG_CACHE_MAGIC);
+        nw = fprintf(fp, "%s%s", json, CONFIG_CACHE_MAGIC);
         fclose(fp);
         free(json);
+        if (nw > 0) {
+            write_binary(provider, cfg, nw);
+        }
     } else {
         int save_errno = errno;
         lcb_log(LOGARGS(provider, ERROR), LOGFMT "Couldn't open file for writing: %s", LOGID(provider), strerror(save_errno));
@@ -211,6 +409,7 @@ static void shutdown_file(clconfig_provider *pb)
 {
     file_provider *provider = (file_provider *)pb;
     free(provider->filename);
+    free(provider->binfilename);
     if (provider->timer) {
         lcbio_timer_destroy(provider->timer);
     }
@@ -250,7 +449,9 @@ do_file_dump(clconfig_provider *pb, FILE *fp)
     fprintf(fp, "## BEGIN FILE PROVIEDER DUMP ##\n");
     if (pr->filename) {
         fprintf(fp, "FILENAME: %s\n", pr->filename);
+        fprintf(fp, "BINARY FILENAME: %s\n", pr->binfilename);
     }
+    fprintf(fp, "LAST LOADED FROM BINARY: %d\n", pr->last_binary);
     fprintf(fp, "LAST SYSTEM ERRNO: %d\n", pr->last_errno);
     fprintf(fp, "LAST MTIME: %lu\n", (unsigned long)pr->last_mtime);
     fprintf(fp, "## END FILE PROVIDER DUMP ##\n");
@@ -304,7 +505,15 @@ int lcb_clconfig_file_set_filename(clconfig_provider *p, const char *f)
         free(provider->filename);
     }
 
+    if (provider->binfilename) {
+        free(provider->binfilename);
+    }
+
     provider->filename = mkcachefile(f, p->parent->settings->bucket);
+    provider->binfilename = malloc(
+        strlen(provider->filename) + sizeof(BINARY_SUFFIX));
+    strcpy(provider->binfilename, provider->filename);
+    strcat(provider->binfilename, BINARY_SUFFIX);
     return 0;
 }
 
@@ -0,0 +1,367 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "clconfig.h"
+#include <lcbio/lcbio.h>
+#include <lcbio/timer-ng.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/*
+ * Process-wide configuration registry.
+ *
+ * Instances which enable this provider with the same key (derived from the
+ * bucket, credentials and bootstrap hosts) share an entry in the registry.
+ * Whenever one of them accepts a configuration from the network, a binary
+ * snapshot of it (see lcbvb_save_binary()) is published to the entry; the
+ * others pick it up through get_cached() the next time their monitor looks
+ * for a configuration, which is also the first thing done when bootstrapping.
+ *
+ * Snapshots are immutable and refcounted, so they may be loaded outside the
+ * registry lock. Each instance still gets its own lcbvb_CONFIG, as the
+ * library modifies the vBucket map in place when it receives NOT_MY_VBUCKET
+ * replies; loading a snapshot is considerably cheaper than parsing JSON.
+ *
+ * An entry exists as long as at least one provider is attached to it.
+ */
+
+#define LOGARGS(sp, lvl) sp->base.parent->settings, "bc_shared", LCB_LOG_##lvl, __FILE__, __LINE__
+#define LOGFMT "(shared=%p) "
+#define LOGID(sp) (void *)sp->entry
+
+typedef struct {
+    unsigned refcount;
+    int revid;
+    lcb_U64 generation;
+    lcb_SIZE nbytes;
+    void *data;
+} shared_SNAPSHOT;
+
+typedef struct {
+    lcb_list_t ll;
+    char *key;
+    unsigned nusers;
+    shared_SNAPSHOT *snapshot;
+} shared_ENTRY;
+
+typedef struct {
+    clconfig_provider base;
+    shared_ENTRY *entry;
+    clconfig_info *config;
+    /** Generation of the last snapshot loaded or published by us */
+    lcb_U64 generation;
+    lcbio_pTIMER timer;
+    clconfig_listener listener;
+    unsigned nloaded;
+    unsigned npublished;
+} shared_provider;
+
+#ifdef _WIN32
+static SRWLOCK registry_lock = SRWLOCK_INIT;
+#define REGISTRY_LOCK() AcquireSRWLockExclusive(&registry_lock)
+#define REGISTRY_UNLOCK() ReleaseSRWLockExclusive(&registry_lock)
+#else
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+#define REGISTRY_LOCK() pthread_mutex_lock(&registry_lock)
+#define REGISTRY_UNLOCK() pthread_mutex_unlock(&registry_lock)
+#endif
+
+static lcb_list_t registry = { &registry, &registry };
+static lcb_U64 registry_generation = 0;
+
+/* Must be called with the registry locked */
+static void
+snapshot_unref(shared_SNAPSHOT *snap)
+{
+    if (snap && --snap->refcount == 0) {
+        free(snap->data);
+        free(snap);
+    }
+}
+
+static void
+detach_entry(shared_provider *sp)
+{
+    shared_ENTRY *entry = sp->entry;
+    if (!entry) {
+        return;
+    }
+    sp->entry = NULL;
+
+    REGISTRY_LOCK();
+    if (--entry->nusers == 0) {
+        lcb_list_delete(&entry->ll);
+        snapshot_unref(entry->snapshot);
+        free(entry->key);
+        free(entry);
+    }
+    REGISTRY_UNLOCK();
+}
+
+/* Load the entry's snapshot if it is one we have not seen yet */
+static int
+load_snapshot(shared_provider *sp)
+{
+    shared_SNAPSHOT *snap = NULL;
+    lcbvb_CONFIG *vbc;
+    clconfig_info *info;
+    int rv = 0;
+
+    if (!sp->entry) {
+        return 0;
+    }
+
+    REGISTRY_LOCK();
+    if (sp->entry->snapshot &&
+            sp->entry->snapshot->generation != sp->generation) {
+        snap = sp->entry->snapshot;
+        snap->refcount++;
+    }
+    REGISTRY_UNLOCK();
+
+    if (!snap) {
+        return 0;
+    }
+
+    /* Do not try this snapshot again, even if it fails to load */
+    sp->generation = snap->generation;
+    if ((vbc = lcbvb_create()) == NULL) {
+        goto GT_DONE;
+    }
+    if (lcbvb_load_binary(vbc, snap->data, snap->nbytes) != 0) {
+        lcb_log(LOGARGS(sp, ERROR), LOGFMT "Couldn't load shared configuration: %s", LOGID(sp), lcbvb_get_error(vbc));
+        lcbvb_destroy(vbc);
+        goto GT_DONE;
+    }
+    if ((info = lcb_clconfig_create(vbc, LCB_CLCONFIG_SHARED)) == NULL) {
+        lcbvb_destroy(vbc);
+        goto GT_DONE;
+    }
+    info->cmpclock = gethrtime();
+    if (sp->config) {
+        lcb_clconfig_decref(sp->config);
+    }
+    sp->config = info;
+    sp->nloaded++;
+    lcb_log(LOGARGS(sp, DEBUG), LOGFMT "Loaded shared configuration. Rev=%d", LOGID(sp), vbc->revid);
+    rv = 1;
+
+    GT_DONE:
+    REGISTRY_LOCK();
+    snapshot_unref(snap);
+    REGISTRY_UNLOCK();
+    return rv;
+}
+
+static void
+publish_config(shared_provider *sp, lcbvb_CONFIG *vbc)
+{
+    shared_SNAPSHOT *snap, *old = NULL;
+    shared_ENTRY *entry = sp->entry;
+
+    if ((snap = calloc(1, sizeof(*snap))) == NULL) {
+        return;
+    }
+    if ((snap->data = lcbvb_save_binary(vbc, &snap->nbytes)) == NULL) {
+        free(snap);
+        return;
+    }
+    snap->refcount = 1;
+    snap->revid = vbc->revid;
+
+    REGISTRY_LOCK();
+    /* Configurations without a revision cannot be compared, so they always
+     * replace the current one */
+    if (entry->snapshot == NULL || snap->revid < 0 ||
+            entry->snapshot->revid < 0 || snap->revid > entry->snapshot->revid) {
+        old = entry->snapshot;
+        snap->generation = ++registry_generation;
+        entry->snapshot = snap;
+        sp->generation = snap->generation;
+        snap = NULL;
+    }
+    snapshot_unref(old);
+    snapshot_unref(snap);
+    REGISTRY_UNLOCK();
+
+    if (snap == NULL) {
+        sp->npublished++;
+        lcb_log(LOGARGS(sp, TRACE), LOGFMT "Published configuration. Rev=%d", LOGID(sp), vbc->revid);
+    }
+}
+
+static clconfig_info *
+get_cached(clconfig_provider *pb)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    load_snapshot(sp);
+    return sp->config;
+}
+
+static void
+async_callback(void *cookie)
+{
+    shared_provider *sp = cookie;
+    if (load_snapshot(sp)) {
+        lcb_confmon_provider_success(&sp->base, sp->config);
+    } else {
+        lcb_confmon_provider_failed(&sp->base, LCB_ERROR);
+    }
+}
+
+static lcb_error_t
+refresh_shared(clconfig_provider *pb)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    if (!lcbio_timer_armed(sp->timer)) {
+        lcbio_async_signal(sp->timer);
+    }
+    return LCB_SUCCESS;
+}
+
+static lcb_error_t
+pause_shared(clconfig_provider *pb)
+{
+    (void)pb;
+    return LCB_SUCCESS;
+}
+
+static void
+shutdown_shared(clconfig_provider *pb)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    detach_entry(sp);
+    if (sp->timer) {
+        lcbio_timer_destroy(sp->timer);
+    }
+    if (sp->config) {
+        lcb_clconfig_decref(sp->config);
+    }
+    free(sp);
+}
+
+static void
+config_listener(clconfig_listener *lsn, clconfig_event_t event,
+    clconfig_info *info)
+{
+    shared_provider *sp;
+
+    if (event != CLCONFIG_EVENT_GOT_NEW_CONFIG) {
+        return;
+    }
+
+    sp = (shared_provider *)(void *)(((char *)lsn) - offsetof(shared_provider, listener));
+    if (!sp->base.enabled || !sp->entry) {
+        return;
+    }
+    if (info->origin == LCB_CLCONFIG_PHONY || info->origin == LCB_CLCONFIG_SHARED) {
+        return;
+    }
+    publish_config(sp, info->vbc);
+}
+
+static void
+do_shared_dump(clconfig_provider *pb, FILE *fp)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    unsigned nusers = 0;
+    int revid = -1;
+
+    if (sp->entry) {
+        REGISTRY_LOCK();
+        nusers = sp->entry->nusers;
+        if (sp->entry->snapshot) {
+            revid = sp->entry->snapshot->revid;
+        }
+        REGISTRY_UNLOCK();
+    }
+    fprintf(fp, "## BEGIN SHARED PROVIDER DUMP ##\n");
+    fprintf(fp, "ENTRY: %p\n", (void *)sp->entry);
+    fprintf(fp, "INSTANCES USING ENTRY: %u\n", nusers);
+    fprintf(fp, "SHARED REVISION: %d\n", revid);
+    fprintf(fp, "CONFIGS LOADED: %u\n", sp->nloaded);
+    fprintf(fp, "CONFIGS PUBLISHED: %u\n", sp->npublished);
+    fprintf(fp, "## END SHARED PROVIDER DUMP ##\n");
+}
+
+clconfig_provider *
+lcb_clconfig_create_shared(lcb_confmon *parent)
+{
+    shared_provider *sp = calloc(1, sizeof(*sp));
+    if (!sp) {
+        return NULL;
+    }
+    sp->base.type = LCB_CLCONFIG_SHARED;
+    sp->base.get_cached = get_cached;
+    sp->base.refresh = refresh_shared;
+    sp->base.pause = pause_shared;
+    sp->base.shutdown = shutdown_shared;
+    sp->base.dump = do_shared_dump;
+    sp->listener.callback = config_listener;
+    sp->timer = lcbio_timer_new(parent->iot, sp, async_callback);
+    lcb_confmon_add_listener(parent, &sp->listener);
+    return &sp->base;
+}
+
+void
+lcb_clconfig_shared_enable(clconfig_provider *pb, const char *key)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    lcb_list_t *llcur;
+    shared_ENTRY *entry = NULL;
+
+    lcb_assert(pb->type == LCB_CLCONFIG_SHARED);
+    if (sp->entry && strcmp(sp->entry->key, key) == 0) {
+        return;
+    }
+    detach_entry(sp);
+    sp->generation = 0;
+
+    REGISTRY_LOCK();
+    LCB_LIST_FOR(llcur, &registry) {
+        shared_ENTRY *cur = LCB_LIST_ITEM(llcur, shared_ENTRY, ll);
+        if (strcmp(cur->key, key) == 0) {
+            entry = cur;
+            break;
+        }
+    }
+    if (!entry && (entry = calloc(1, sizeof(*entry))) != NULL) {
+        if ((entry->key = strdup(key)) == NULL) {
+            free(entry);
+            entry = NULL;
+        } else {
+            lcb_list_append(&registry, &entry->ll);
+        }
+    }
+    if (entry) {
+        entry->nusers++;
+    }
+    REGISTRY_UNLOCK();
+
+    sp->entry = entry;
+    lcb_confmon_set_provider_active(pb->parent, LCB_CLCONFIG_SHARED, entry != NULL);
+}
+
+void
+lcb_clconfig_shared_disable(clconfig_provider *pb)
+{
+    shared_provider *sp = (shared_provider *)pb;
+    detach_entry(sp);
+    lcb_confmon_set_provider_active(pb->parent, LCB_CLCONFIG_SHARED, 0);
+}
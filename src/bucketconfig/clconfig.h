@@ -106,6 +106,11 @@ typedef enum {
     LCB_CLCONFIG_HTTP,
     /** Raw memcached provided */
     LCB_CLCONFIG_MCRAW,
+    /** Process-wide registry shared between instances. Implemented in
+     * bc_shared.c. Its cached configuration is consulted along with the
+     * others, so it is placed last to only be _refreshed_ once the network
+     * providers have failed */
+    LCB_CLCONFIG_SHARED,
 
     LCB_CLCONFIG_MAX,
 
@@ -143,6 +148,10 @@ typedef struct lcb_confmon_st {
     /* CONFMON_S_* values. Used internally */
     int state;
 
+    /**Number of providers which have not yet failed, if all the providers
+     * are being tried at once (see lcb_settings::bc_race_nodes) */
+    unsigned nracing;
+
     /** Last time the provider was stopped. As a microsecond timestamp */
     lcb_uint32_t last_stop_us;
 
@@ -316,6 +325,7 @@ clconfig_provider * lcb_clconfig_create_cccp(lcb_confmon *mon);
 clconfig_provider * lcb_clconfig_create_file(lcb_confmon *mon);
 clconfig_provider * lcb_clconfig_create_user(lcb_confmon *mon);
 clconfig_provider * lcb_clconfig_create_mcraw(lcb_confmon *mon);
+clconfig_provider * lcb_clconfig_create_shared(lcb_confmon *mon);
 
 /**@brief Get a provider by its type
  * @param mon the monitor
@@ -591,6 +601,24 @@ int lcb_clconfig_file_set_filename(clconfig_provider *p, const char *f);
 const char * lcb_clconfig_file_get_filename(clconfig_provider *p);
 /**@}*/
 
+/**
+ * @name Shared Provider-specific APIs
+ * @{
+ */
+
+/**
+ * Attach the provider to the process-wide registry entry for `key` (creating
+ * it if needed) and enable it. Instances using the same key share their
+ * configurations.
+ * @param p The provider of type LCB_CLCONFIG_SHARED
+ * @param key Identifies the cluster and bucket
+ */
+void lcb_clconfig_shared_enable(clconfig_provider *p, const char *key);
+
+/** Detach the provider from the registry and disable it */
+void lcb_clconfig_shared_disable(clconfig_provider *p);
+/**@}*/
+
 /**
  * @name HTTP Provider-specific APIs
  * @{
@@ -643,6 +671,42 @@ void lcb_clconfig_cccp_enable(clconfig_provider *pb, lcb_t instance);
 lcb_error_t
 lcb_cccp_update(clconfig_provider *provider, const char *host, lcb_string *data);
 
+/**
+ * @brief Like lcb_cccp_update(), but avoids parsing redundant configurations
+ *
+ * During a rebalance, many `NOT_MY_VBUCKET` replies carry the same
+ * configuration. Configurations whose revision (or, if they have none,
+ * whose contents) is not newer than the last one seen are dropped without
+ * being parsed. Configurations received within
+ * lcb_settings::nmv_config_interval of the last one applied are held, and
+ * only the newest of them is applied once the interval elapses.
+ *
+ * @param provider The CCCP provider
+ * @param host The hostname (without the port) on which the packet was received
+ * @param data The configuration JSON blob
+ * @param ndata The size of the blob
+ * @return LCB_SUCCESS, or an error code if the configuration could not be
+ * processed. Errors in applying the configuration are handled internally
+ */
+lcb_error_t
+lcb_cccp_update_nmv(clconfig_provider *provider, const char *host,
+    const char *data, lcb_SIZE ndata);
+
+/**
+ * @brief Retrieve the counters for configurations received from
+ * `NOT_MY_VBUCKET` replies (see lcb_cccp_update_nmv())
+ */
+void
+lcb_cccp_nmv_stats(clconfig_provider *provider, lcb_NMVSTATS *stats);
+
+/**
+ * @brief Apply the configuration held back by lcb_cccp_update_nmv(), if any,
+ * without waiting for lcb_settings::nmv_config_interval to elapse
+ * @return nonzero if a configuration was held back
+ */
+int
+lcb_cccp_flush_nmv(clconfig_provider *provider);
+
 /**
  * @brief Notify the CCCP provider about a configuration received from a
  * `CMD_GET_CLUSTER_CONFIG` response.
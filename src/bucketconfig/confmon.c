@@ -51,6 +51,7 @@ provider_string(clconfig_method_t type) {
     if (type == LCB_CLCONFIG_FILE) { return "FILE"; }
     if (type == LCB_CLCONFIG_MCRAW) { return "MCRAW"; }
     if (type == LCB_CLCONFIG_USER) { return "USER"; }
+    if (type == LCB_CLCONFIG_SHARED) { return "SHARED"; }
     return "";
 }
 
@@ -70,6 +71,7 @@ lcb_confmon* lcb_confmon_create(lcb_settings *settings, lcbio_pTABLE iot)
     mon->all_providers[LCB_CLCONFIG_HTTP] = lcb_clconfig_create_http(mon);
     mon->all_providers[LCB_CLCONFIG_USER] = lcb_clconfig_create_user(mon);
     mon->all_providers[LCB_CLCONFIG_MCRAW] = lcb_clconfig_create_mcraw(mon);
+    mon->all_providers[LCB_CLCONFIG_SHARED] = lcb_clconfig_create_shared(mon);
 
     for (ii = 0; ii < LCB_CLCONFIG_MAX; ii++) {
         mon->all_providers[ii]->parent = mon;
@@ -201,7 +203,7 @@ void lcb_confmon_provider_failed(clconfig_provider *provider,
 
     lcb_log(LOGARGS(mon, INFO), "Provider '%s' failed", provider_string(provider->type));
 
-    if (provider != mon->cur_provider) {
+    if (provider != mon->cur_provider && mon->nracing == 0) {
         lcb_log(LOGARGS(mon, TRACE), "Ignoring failure. Current=%p (%s)", (void*)mon->cur_provider, provider_string(mon->cur_provider->type));
         return;
     }
@@ -220,7 +222,16 @@ void lcb_confmon_provider_failed(clconfig_provider *provider,
         }
     }
 
-    mon->cur_provider = next_active(mon, mon->cur_provider);
+    if (mon->nracing) {
+        if (--mon->nracing) {
+            lcb_log(LOGARGS(mon, DEBUG), "Waiting for %u other providers", mon->nracing);
+            return;
+        }
+        /* All the providers failed */
+        mon->cur_provider = NULL;
+    } else {
+        mon->cur_provider = next_active(mon, mon->cur_provider);
+    }
 
     if (!mon->cur_provider) {
         LOG(mon, TRACE, "Maximum provider reached. Resetting index");
@@ -268,6 +279,18 @@ static int do_next_provider(lcb_confmon *mon)
         }
     }
 
+    if (mon->config == NULL && mon->settings->bc_race_nodes > 1 &&
+            LCB_CLIST_SIZE(&mon->active_providers) > 1) {
+        /* Count first, as providers may fail from within refresh() */
+        mon->nracing = LCB_CLIST_SIZE(&mon->active_providers);
+        LOG(mon, TRACE, "Trying all providers at once");
+        LCB_LIST_FOR(ii, (lcb_list_t *)&mon->active_providers) {
+            clconfig_provider *provider = LCB_LIST_ITEM(ii, clconfig_provider, ll);
+            provider->refresh(provider);
+        }
+        return 0;
+    }
+
     lcb_log(LOGARGS(mon, TRACE), "Current provider is %s", provider_string(mon->cur_provider->type));
 
     mon->cur_provider->refresh(mon->cur_provider);
@@ -329,6 +352,7 @@ lcb_error_t lcb_confmon_stop(lcb_confmon *mon)
     lcbio_timer_disarm(mon->as_start);
     lcbio_async_signal(mon->as_stop);
     mon->state = CONFMON_S_INACTIVE;
+    mon->nracing = 0;
     return LCB_SUCCESS;
 }
 
@@ -50,6 +50,9 @@ static void dummy_pktfwd_callback(lcb_t instance, const void *cookie,
     lcb_error_t err, lcb_PKTFWDRESP *resp) {
     (void)instance;(void)cookie;(void)err;(void)resp;
 }
+static void dummy_backpressure_callback(lcb_t instance, int paused) {
+    (void)instance;(void)paused;
+}
 static void dummy_pktflushed_callback(lcb_t instance, const void *cookie) {
     (void)instance;(void)cookie;
 }
@@ -239,6 +242,7 @@ void lcb_initialize_packet_handlers(lcb_t instance)
     instance->callbacks.bootstrap = dummy_bootstrap_callback;
     instance->callbacks.pktflushed = dummy_pktflushed_callback;
     instance->callbacks.pktfwd = dummy_pktfwd_callback;
+    instance->callbacks.backpressure = dummy_backpressure_callback;
     instance->callbacks.v3callbacks[LCB_CALLBACK_DEFAULT] = compat_default_callback;
 }
 
@@ -283,6 +287,7 @@ CALLBACK_ACCESSOR(lcb_set_errmap_callback, lcb_errmap_callback, errmap)
 CALLBACK_ACCESSOR(lcb_set_bootstrap_callback, lcb_bootstrap_callback, bootstrap)
 CALLBACK_ACCESSOR(lcb_set_pktfwd_callback, lcb_pktfwd_callback, pktfwd)
 CALLBACK_ACCESSOR(lcb_set_pktflushed_callback, lcb_pktflushed_callback, pktflushed)
+CALLBACK_ACCESSOR(lcb_set_backpressure_callback, lcb_backpressure_callback, backpressure)
 
 LIBCOUCHBASE_API
 lcb_RESPCALLBACK
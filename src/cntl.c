@@ -16,9 +16,16 @@
  */
 #include "internal.h"
 #include "bucketconfig/clconfig.h"
+#include "kvcache.h"
+#include "hedge.h"
+#include "singleflight.h"
+#include "counteragg.h"
+#include "metrics.h"
 #include <lcbio/iotable.h>
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
+#include <lcbio/faults.h>
+#include <lcbio/capture.h>
 
 #define CNTL__MODE_SETSTRING 0x1000
 
@@ -64,6 +71,12 @@ static lcb_uint32_t *get_timeout_field(lcb_t instance, int cmd)
     case LCB_CNTL_CONFIG_NODE_TIMEOUT: return &settings->config_node_timeout;
     case LCB_CNTL_HTCONFIG_IDLE_TIMEOUT: return &settings->bc_http_stream_time;
     case LCB_CNTL_RETRY_INTERVAL: return &settings->retry_interval;
+    case LCB_CNTL_KVCACHE_TTL: return &settings->kvcache_ttl;
+    case LCB_CNTL_KVCACHE_REVALIDATE: return &settings->kvcache_revalidate;
+    case LCB_CNTL_HEDGE_DELAY: return &settings->hedge_delay;
+    case LCB_CNTL_DEGRADED_LATENCY: return &settings->degraded_latency;
+    case LCB_CNTL_NMV_CONFIG_INTERVAL: return &settings->nmv_config_interval;
+    case LCB_CNTL_COUNTERAGG_WINDOW: return &settings->counteragg_window;
     default: return NULL;
     }
 }
@@ -144,9 +157,227 @@ HANDLER(bucketname_handler) {
 HANDLER(schedflush_handler) {
     RETURN_GET_SET(int, LCBT_SETTING(instance, sched_implicit_flush))
 }
+HANDLER(get_quiet_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, get_quiet))
+}
+HANDLER(get_singleflight_handler) {
+    RETURN_GET_SET(int, LCBT_SETTING(instance, get_singleflight))
+}
+HANDLER(singleflight_stats_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    lcb_singleflight_stats(instance, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(counteragg_maxbatch_handler) {
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, counteragg_maxbatch))
+}
+HANDLER(counteragg_stats_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    lcb_counteragg_stats(instance, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(metrics_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    (void)cmd; return lcb_metrics_snapshot(instance, arg);
+}
+HANDLER(fault_script_handler) {
+    lcbio_FAULTS **cur = &LCBT_SETTING(instance, faults);
+    if (mode == LCB_CNTL_SET) {
+        const char *script = arg;
+        lcbio_FAULTS *faults = NULL;
+        if (script && *script) {
+            if (!IOT_IS_EVENT(instance->iotable)) {
+                return LCB_NOT_SUPPORTED;
+            }
+            if (!(faults = lcbio_faults_new(script))) {
+                return LCB_ECTL_BADARG;
+            }
+        }
+        if (*cur) {
+            lcbio_faults_unref(*cur);
+        }
+        *cur = faults;
+    } else if (mode == LCB_CNTL_GET) {
+        *(const char **)arg = *cur ? lcbio_faults_script(*cur) : NULL;
+    } else {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(capture_path_handler) {
+    lcbio_CAPTURE **cur = &LCBT_SETTING(instance, capture);
+    if (mode == LCB_CNTL_SET) {
+        const char *path = arg;
+        lcbio_CAPTURE *capture = NULL;
+        if (path && *path && !(capture = lcbio_capture_new(path))) {
+            return LCB_ECTL_BADARG;
+        }
+        if (*cur) {
+            lcbio_capture_stop(*cur);
+            lcbio_capture_unref(*cur);
+        }
+        *cur = capture;
+    } else if (mode == LCB_CNTL_GET) {
+        *(const char **)arg = *cur ? lcbio_capture_path(*cur) : NULL;
+    } else {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
 HANDLER(vbguess_handler) {
     RETURN_GET_SET(int, LCBT_SETTING(instance, keep_guess_vbs))
 }
+HANDLER(http_pool_minidle_handler) {
+    if (mode == LCB_CNTL_SET) {
+        instance->http_sockpool->minidle = *(lcb_SIZE *)arg;
+        lcb_http_pool_warmup(instance);
+    } else {
+        *(lcb_SIZE *)arg = instance->http_sockpool->minidle;
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+
+HANDLER(kv_nconns_handler) {
+    if (mode == LCB_CNTL_SET && *(lcb_U32*)arg < 1) { return LCB_ECTL_BADARG; }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, kv_nconns))
+}
+HANDLER(kv_bulk_threshold_handler) {
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, kv_bulk_threshold))
+}
+HANDLER(bootstrap_race_handler) {
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, bc_race_nodes))
+}
+HANDLER(kvcache_maxbytes_handler) {
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, kvcache_maxbytes) = *(lcb_SIZE *)arg;
+        lcb_kvcache_trim(instance);
+    } else {
+        *(lcb_SIZE *)arg = LCBT_SETTING(instance, kvcache_maxbytes);
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(loglevel_handler) {
+    if (mode == LCB_CNTL_SET) {
+        int level = *(int *)arg;
+        if (level < LCB_LOG_TRACE || level > LCB_LOG_MAX) { return LCB_ECTL_BADARG; }
+    }
+    RETURN_GET_SET(int, LCBT_SETTING(instance, loglevel))
+}
+HANDLER(log_async_handler) {
+    if (mode == LCB_CNTL_SET) {
+        return lcb_asynclog_set(instance->settings, *(int *)arg);
+    }
+    RETURN_GET_ONLY(int, LCBT_SETTING(instance, asynclog) != NULL)
+}
+HANDLER(config_shared_handler) {
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, config_shared) = *(int *)arg ? 1 : 0;
+        lcb_init_shared_config(instance);
+    } else if (mode == LCB_CNTL_GET) {
+        *(int *)arg = LCBT_SETTING(instance, config_shared);
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(hedge_percentile_handler) {
+    RETURN_GET_SET(float, LCBT_SETTING(instance, hedge_percentile))
+}
+HANDLER(hedge_stats_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    lcb_hedge_stats(instance, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(server_health_handler) {
+    lcb_SERVERHEALTH *health = arg;
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    if (health->index < 0 || health->index >= (int)LCBT_NSERVERS(instance)) {
+        return LCB_ECTL_BADARG;
+    }
+    mcserver_get_health(LCBT_GET_SERVER(instance, health->index), health);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(queue_limit_handler) {
+    lcb_settings *settings = instance->settings;
+    if (mode != LCB_CNTL_GET && mode != LCB_CNTL_SET) {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    switch (cmd) {
+    case LCB_CNTL_QUEUE_MAXPKTS:
+    case LCB_CNTL_QUEUE_TOTAL_MAXPKTS: {
+        lcb_U32 *ptr = cmd == LCB_CNTL_QUEUE_MAXPKTS ?
+                &settings->queue_maxpkts : &settings->queue_total_maxpkts;
+        if (mode == LCB_CNTL_GET) {
+            *(lcb_U32 *)arg = *ptr;
+            return LCB_SUCCESS;
+        }
+        *ptr = *(lcb_U32 *)arg;
+        break;
+    }
+    case LCB_CNTL_QUEUE_MAXBYTES:
+    case LCB_CNTL_QUEUE_TOTAL_MAXBYTES: {
+        lcb_SIZE *ptr = cmd == LCB_CNTL_QUEUE_MAXBYTES ?
+                &settings->queue_maxbytes : &settings->queue_total_maxbytes;
+        if (mode == LCB_CNTL_GET) {
+            *(lcb_SIZE *)arg = *ptr;
+            return LCB_SUCCESS;
+        }
+        *ptr = *(lcb_SIZE *)arg;
+        break;
+    }
+    default:
+        return LCB_ECTL_BADARG;
+    }
+    lcb_admission_update(instance);
+    return LCB_SUCCESS;
+}
+HANDLER(queue_policy_handler) {
+    if (mode == LCB_CNTL_SET) {
+        int policy = *(int *)arg;
+        if (policy != LCB_QUEUE_POLICY_FAILFAST &&
+                policy != LCB_QUEUE_POLICY_NOTIFY) {
+            return LCB_ECTL_BADARG;
+        }
+        LCBT_SETTING(instance, queue_policy) = policy;
+    } else if (mode == LCB_CNTL_GET) {
+        *(int *)arg = LCBT_SETTING(instance, queue_policy);
+    } else {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(queue_stats_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    lcb_admission_stats(instance, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(nmv_stats_handler) {
+    clconfig_provider *cccp;
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    cccp = lcb_confmon_get_provider(instance->confmon, LCB_CLCONFIG_CCCP);
+    lcb_cccp_nmv_stats(cccp, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(clock_handler) {
+    if (mode == LCB_CNTL_SET) {
+        int flags = *(int *)arg;
+        if (flags & ~(LCB_CLOCK_F_CACHED|LCB_CLOCK_F_TSC)) {
+            return LCB_ECTL_BADARG;
+        }
+        if ((flags & LCB_CLOCK_F_TSC) && !lcb_tsc_init()) {
+            return LCB_NOT_SUPPORTED;
+        }
+        instance->iotable->clock.flags = flags;
+    } else if (mode == LCB_CNTL_GET) {
+        *(int *)arg = instance->iotable->clock.flags;
+    } else {
+        return LCB_ECTL_UNSUPPMODE;
+    }
+    (void)cmd; return LCB_SUCCESS;
+}
+HANDLER(kvcache_stats_handler) {
+    if (mode != LCB_CNTL_GET) { return LCB_ECTL_UNSUPPMODE; }
+    lcb_kvcache_stats(instance, arg);
+    (void)cmd; return LCB_SUCCESS;
+}
 
 HANDLER(get_kvb) {
     struct lcb_cntl_vbinfo_st *vbi = arg;
@@ -236,6 +467,7 @@ HANDLER(logprocs_handler) {
         *(lcb_logprocs**)arg = LCBT_SETTING(instance, logger);
     } else if (mode == LCB_CNTL_SET) {
         LCBT_SETTING(instance, logger) = (lcb_logprocs *)arg;
+        LCBT_SETTING(instance, loglevel) = LCB_LOG_TRACE;
     }
     (void)cmd; return LCB_SUCCESS;
 }
@@ -361,6 +593,7 @@ HANDLER(console_log_handler) {
     level = LCB_LOG_ERROR - level;
     logger->minlevel = level;
     LCBT_SETTING(instance, logger) = &logger->base;
+    LCBT_SETTING(instance, loglevel) = level;
     (void)cmd; return LCB_SUCCESS;
 }
 
@@ -420,7 +653,41 @@ static ctl_handler handlers[] = {
     http_refresh_config_handler, /* LCB_CNTL_HTTP_REFRESH_CONFIG_ON_ERROR */
     bucketname_handler, /* LCB_CNTL_BUCKETNAME */
     schedflush_handler, /* LCB_CNTL_SCHED_IMPLICIT_FLUSH */
-    vbguess_handler /* LCB_CNTL_VBGUESS_PERSIST */
+    vbguess_handler, /* LCB_CNTL_VBGUESS_PERSIST */
+    http_pool_minidle_handler, /* LCB_CNTL_HTTP_POOL_MINIDLE */
+    kv_nconns_handler, /* LCB_CNTL_KV_NCONNS */
+    kv_bulk_threshold_handler, /* LCB_CNTL_KV_BULK_THRESHOLD */
+    kvcache_maxbytes_handler, /* LCB_CNTL_KVCACHE_MAXBYTES */
+    timeout_common, /* LCB_CNTL_KVCACHE_TTL */
+    timeout_common, /* LCB_CNTL_KVCACHE_REVALIDATE */
+    kvcache_stats_handler, /* LCB_CNTL_KVCACHE_STATS */
+    loglevel_handler, /* LCB_CNTL_LOGLEVEL */
+    log_async_handler, /* LCB_CNTL_LOG_ASYNC */
+    config_shared_handler, /* LCB_CNTL_CONFIG_SHARED */
+    bootstrap_race_handler, /* LCB_CNTL_BOOTSTRAP_RACE */
+    timeout_common, /* LCB_CNTL_HEDGE_DELAY */
+    hedge_percentile_handler, /* LCB_CNTL_HEDGE_PERCENTILE */
+    hedge_stats_handler, /* LCB_CNTL_HEDGE_STATS */
+    timeout_common, /* LCB_CNTL_DEGRADED_LATENCY */
+    server_health_handler, /* LCB_CNTL_SERVER_HEALTH */
+    queue_limit_handler, /* LCB_CNTL_QUEUE_MAXPKTS */
+    queue_limit_handler, /* LCB_CNTL_QUEUE_MAXBYTES */
+    queue_limit_handler, /* LCB_CNTL_QUEUE_TOTAL_MAXPKTS */
+    queue_limit_handler, /* LCB_CNTL_QUEUE_TOTAL_MAXBYTES */
+    queue_policy_handler, /* LCB_CNTL_QUEUE_POLICY */
+    queue_stats_handler, /* LCB_CNTL_QUEUE_STATS */
+    get_quiet_handler, /* LCB_CNTL_GET_QUIET */
+    timeout_common, /* LCB_CNTL_NMV_CONFIG_INTERVAL */
+    nmv_stats_handler, /* LCB_CNTL_NMV_STATS */
+    clock_handler, /* LCB_CNTL_CLOCK */
+    get_singleflight_handler, /* LCB_CNTL_GET_SINGLEFLIGHT */
+    singleflight_stats_handler, /* LCB_CNTL_SINGLEFLIGHT_STATS */
+    timeout_common, /* LCB_CNTL_COUNTERAGG_WINDOW */
+    counteragg_maxbatch_handler, /* LCB_CNTL_COUNTERAGG_MAXBATCH */
+    counteragg_stats_handler, /* LCB_CNTL_COUNTERAGG_STATS */
+    metrics_handler, /* LCB_CNTL_METRICS */
+    fault_script_handler, /* LCB_CNTL_FAULT_SCRIPT */
+    capture_path_handler /* LCB_CNTL_CAPTURE_PATH */
 };
 
 /* Union used for conversion to/from string functions */
@@ -563,6 +830,32 @@ static cntl_OPCODESTRS stropcode_map[] = {
         {"retry_backoff", LCB_CNTL_RETRY_BACKOFF, convert_float },
         {"http_poolsize", LCB_CNTL_HTTP_POOLSIZE, convert_SIZE },
         {"vbguess_persist", LCB_CNTL_VBGUESS_PERSIST, convert_intbool },
+        {"http_pool_minidle", LCB_CNTL_HTTP_POOL_MINIDLE, convert_SIZE },
+        {"kv_connections", LCB_CNTL_KV_NCONNS, convert_u32 },
+        {"kv_bulk_threshold", LCB_CNTL_KV_BULK_THRESHOLD, convert_u32 },
+        {"kvcache_max_bytes", LCB_CNTL_KVCACHE_MAXBYTES, convert_SIZE },
+        {"kvcache_ttl", LCB_CNTL_KVCACHE_TTL, convert_timeout },
+        {"kvcache_revalidate", LCB_CNTL_KVCACHE_REVALIDATE, convert_timeout },
+        {"log_minlevel", LCB_CNTL_LOGLEVEL, convert_int },
+        {"log_async", LCB_CNTL_LOG_ASYNC, convert_intbool },
+        {"config_shared", LCB_CNTL_CONFIG_SHARED, convert_intbool },
+        {"bootstrap_race", LCB_CNTL_BOOTSTRAP_RACE, convert_u32 },
+        {"hedge_delay", LCB_CNTL_HEDGE_DELAY, convert_timeout },
+        {"hedge_percentile", LCB_CNTL_HEDGE_PERCENTILE, convert_float },
+        {"degraded_latency", LCB_CNTL_DEGRADED_LATENCY, convert_timeout },
+        {"queue_max_pkts", LCB_CNTL_QUEUE_MAXPKTS, convert_u32 },
+        {"queue_max_bytes", LCB_CNTL_QUEUE_MAXBYTES, convert_SIZE },
+        {"queue_total_max_pkts", LCB_CNTL_QUEUE_TOTAL_MAXPKTS, convert_u32 },
+        {"queue_total_max_bytes", LCB_CNTL_QUEUE_TOTAL_MAXBYTES, convert_SIZE },
+        {"queue_policy", LCB_CNTL_QUEUE_POLICY, convert_int },
+        {"get_quiet", LCB_CNTL_GET_QUIET, convert_intbool },
+        {"nmv_config_interval", LCB_CNTL_NMV_CONFIG_INTERVAL, convert_timeout },
+        {"clock", LCB_CNTL_CLOCK, convert_int },
+        {"get_singleflight", LCB_CNTL_GET_SINGLEFLIGHT, convert_intbool },
+        {"counteragg_window", LCB_CNTL_COUNTERAGG_WINDOW, convert_timeout },
+        {"counteragg_max_batch", LCB_CNTL_COUNTERAGG_MAXBATCH, convert_u32 },
+        {"fault_script", LCB_CNTL_FAULT_SCRIPT, convert_passthru },
+        {"capture_path", LCB_CNTL_CAPTURE_PATH, convert_passthru },
         {NULL, -1}
 };
 
@@ -147,6 +147,16 @@ extern "C" {
 #endif
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+    /* Clock derived from the CPU's timestamp counter, see gethrtime.c */
+    extern int lcb_tsc_init(void);
+    extern hrtime_t lcb_tsc_gethrtime(void);
+#ifdef __cplusplus
+}
+#endif
+
 #if defined(EWOULDBLOCK) && defined(EAGAIN) && EWOULDBLOCK != EAGAIN
 #define USE_EAGAIN 1
 #endif
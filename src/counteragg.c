@@ -0,0 +1,473 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "counteragg.h"
+#include "list.h"
+#include "contrib/genhash/genhash.h"
+#include <lcbio/timer-ng.h>
+
+/** Longest key (the protocol maximum) */
+#define CA_MAXKEY 250
+
+/** Largest magnitude of a delta. Its negation must be representable too */
+#define CA_MAXDELTA ((lcb_S64)(((lcb_U64)1 << 63) - 1))
+
+typedef struct {
+    /** Receives the response to the batch's command. This must be the first
+     * field, as the batch is the command's cookie (see
+     * LCB_CMD_F_INTERNAL_CALLBACK) */
+    lcb_RESPCALLBACK callback;
+    lcb_list_t llnode; /**< Node in the pending or the inflight list */
+    lcb_list_t llstaged; /**< Node in the staged list, if #staged */
+    hrtime_t deadline; /**< When the batch is to be sent */
+    lcb_S64 delta; /**< Sum of the waiters' deltas */
+    lcb_S64 committed; /**< Sum of the committed waiters' deltas */
+    lcb_S64 first; /**< Delta of the first waiter */
+    lcb_U64 initial;
+    lcb_U32 exptime;
+    int create;
+    lcb_error_t rc; /**< Error scheduling the batch's command */
+    /** Batch is the one commands for its key are added to */
+    unsigned hashed : 1;
+    /** Batch was touched within the current scheduling context */
+    unsigned staged : 1;
+    unsigned nwaiters;
+    unsigned ncommitted; /**< Waiters added in earlier scheduling contexts */
+    unsigned nalloc;
+    const void **cookies; /**< Cookies of the waiters */
+    lcb_SIZE nkey;
+    char key[1];
+} ca_BATCH;
+
+struct lcb_COUNTERAGG_st {
+    lcb_t instance;
+    genhash_t *ht;
+    lcb_list_t pending; /**< Batches not yet sent, oldest first */
+    lcb_list_t inflight; /**< Batches whose command was scheduled */
+    lcb_list_t staged;
+    lcbio_pTIMER timer; /**< Sends the batches once they are due */
+    /** Whether the pending batches keep lcb_wait() from returning */
+    int loopref;
+    lcb_COUNTERAGGSTATS stats;
+};
+
+static int
+key_hash(const void *k, lcb_size_t nk)
+{
+    const unsigned char *p = k;
+    lcb_U32 hv = 2166136261U;
+    lcb_size_t ii;
+    for (ii = 0; ii < nk; ii++) {
+        hv = (hv ^ p[ii]) * 16777619U;
+    }
+    return (int)(hv & 0x7fffffff);
+}
+
+static int
+key_eq(const void *a, lcb_size_t na, const void *b, lcb_size_t nb)
+{
+    return na == nb && memcmp(a, b, na) == 0;
+}
+
+static struct lcb_hash_ops key_hashops = {
+    key_hash, /* hashfunc */
+    key_eq, /* hasheq */
+    NULL, /* dupKey */
+    NULL, /* dupValue */
+    NULL, /* freeKey */
+    NULL /* freeValue */
+};
+
+static void flush_batches(void *arg);
+
+static lcb_COUNTERAGG *
+agg_get(lcb_t instance)
+{
+    lcb_COUNTERAGG *agg = instance->counteragg;
+    if (agg) {
+        return agg;
+    }
+    agg = calloc(1, sizeof(*agg));
+    agg->instance = instance;
+    agg->ht = genhash_init(64, key_hashops);
+    lcb_list_init(&agg->pending);
+    lcb_list_init(&agg->inflight);
+    lcb_list_init(&agg->staged);
+    agg->timer = lcbio_timer_new(instance->iotable, agg, flush_batches);
+    instance->counteragg = agg;
+    return agg;
+}
+
+static void
+rearm_timer(lcb_COUNTERAGG *agg)
+{
+    lcb_list_t *ll;
+    hrtime_t now, next = 0;
+    int found = 0;
+
+    /* Batches still being added to are only sent once the scheduling context
+     * is left */
+    LCB_LIST_FOR(ll, &agg->pending) {
+        const ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llnode);
+        if (!batch->staged && (!found || batch->deadline < next)) {
+            next = batch->deadline;
+            found = 1;
+        }
+    }
+    if (!found) {
+        lcbio_timer_disarm(agg->timer);
+        return;
+    }
+    now = lcbio_now(agg->instance->iotable);
+    if (next <= now) {
+        lcbio_timer_rearm(agg->timer, 0);
+    } else {
+        lcbio_timer_rearm(agg->timer, LCB_NS2US(next - now + 999));
+    }
+}
+
+static void
+update_loopref(lcb_COUNTERAGG *agg)
+{
+    int pending = !LCB_LIST_IS_EMPTY(&agg->pending);
+    if (pending && !agg->loopref) {
+        agg->loopref = 1;
+        lcb_loop_ref(agg->instance);
+    } else if (!pending && agg->loopref) {
+        agg->loopref = 0;
+        lcb_loop_unref(agg->instance);
+    }
+}
+
+static void
+batch_stage(lcb_COUNTERAGG *agg, ca_BATCH *batch)
+{
+    if (!batch->staged) {
+        batch->staged = 1;
+        lcb_list_append(&agg->staged, &batch->llstaged);
+    }
+}
+
+/* Stop adding commands to the batch, and send it as soon as possible */
+static void
+batch_close(lcb_COUNTERAGG *agg, ca_BATCH *batch)
+{
+    if (batch->hashed) {
+        genhash_delete(agg->ht, batch->key, batch->nkey);
+        batch->hashed = 0;
+    }
+    batch->deadline = 0;
+}
+
+static void
+batch_free(ca_BATCH *batch)
+{
+    free(batch->cookies);
+    free(batch);
+}
+
+/* Whether the command may be added to the batch. Deltas must all have the
+ * same sign, as decrements stop at 0 but increments do not */
+static int
+batch_accepts(const ca_BATCH *batch, const lcb_CMDCOUNTER *cmd)
+{
+    if (!cmd->create != !batch->create) {
+        return 0;
+    }
+    if (batch->create &&
+            (cmd->initial != batch->initial || cmd->exptime != batch->exptime)) {
+        return 0;
+    }
+    if ((cmd->delta > 0 && batch->delta < 0) ||
+            (cmd->delta < 0 && batch->delta > 0)) {
+        return 0;
+    }
+    if (cmd->delta > 0) {
+        return batch->delta <= CA_MAXDELTA - cmd->delta;
+    } else {
+        return batch->delta >= -CA_MAXDELTA - cmd->delta;
+    }
+}
+
+static ca_BATCH *
+batch_new(lcb_COUNTERAGG *agg, const lcb_CMDCOUNTER *cmd)
+{
+    lcb_t instance = agg->instance;
+    ca_BATCH *batch;
+    lcb_SIZE nkey = cmd->key.contig.nbytes;
+
+    if ((batch = calloc(1, sizeof(*batch) + nkey)) == NULL) {
+        return NULL;
+    }
+    batch->nalloc = 4;
+    if ((batch->cookies = malloc(sizeof(*batch->cookies) * batch->nalloc)) == NULL) {
+        free(batch);
+        return NULL;
+    }
+    batch->create = cmd->create;
+    batch->first = cmd->delta;
+    batch->initial = cmd->initial;
+    batch->exptime = cmd->exptime;
+    batch->deadline = lcbio_now(instance->iotable) +
+            LCB_US2NS(LCBT_SETTING(instance, counteragg_window));
+    batch->nkey = nkey;
+    memcpy(batch->key, cmd->key.contig.bytes, nkey);
+    batch->hashed = 1;
+    genhash_store(agg->ht, batch->key, nkey, batch, 0);
+    lcb_list_append(&agg->pending, &batch->llnode);
+    return batch;
+}
+
+int
+lcb_counteragg_add(lcb_t instance, const void *cookie,
+    const lcb_CMDCOUNTER *cmd)
+{
+    lcb_COUNTERAGG *agg;
+    ca_BATCH *batch;
+    lcb_U32 maxbatch = LCBT_SETTING(instance, counteragg_maxbatch);
+
+    if (!LCB_COUNTERAGG_ENABLED(instance) || !LCBT_VBCONFIG(instance)) {
+        return 0;
+    }
+    if (cmd->key.type != LCB_KV_COPY && cmd->key.type != LCB_KV_CONTIG) {
+        return 0;
+    }
+    if (cmd->_hashkey.contig.nbytes || cmd->key.contig.nbytes > CA_MAXKEY ||
+            (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK)) {
+        return 0;
+    }
+
+    agg = agg_get(instance);
+    batch = genhash_find(agg->ht, cmd->key.contig.bytes, cmd->key.contig.nbytes);
+    if (batch && !batch_accepts(batch, cmd)) {
+        batch_close(agg, batch);
+        batch = NULL;
+    }
+    if (!batch && (batch = batch_new(agg, cmd)) == NULL) {
+        return 0;
+    }
+
+    if (batch->nwaiters == batch->nalloc) {
+        unsigned nalloc = batch->nalloc * 2;
+        const void **cookies = realloc(
+            (void *)batch->cookies, sizeof(*cookies) * nalloc);
+        if (!cookies) {
+            return 0;
+        }
+        batch->cookies = cookies;
+        batch->nalloc = nalloc;
+    }
+    batch->cookies[batch->nwaiters++] = cookie;
+    batch->delta += cmd->delta;
+    batch_stage(agg, batch);
+    agg->stats.naggregated++;
+    if (maxbatch && batch->nwaiters >= maxbatch) {
+        batch_close(agg, batch);
+    }
+    return 1;
+}
+
+static void
+deliver(lcb_t instance, const ca_BATCH *batch, lcb_RESPCOUNTER *resp)
+{
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_COUNTER);
+    unsigned ii;
+    for (ii = 0; ii < batch->nwaiters; ii++) {
+        resp->cookie = (void *)batch->cookies[ii];
+        callback(instance, LCB_CALLBACK_COUNTER, (const lcb_RESPBASE *)resp);
+    }
+}
+
+static void
+batch_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    ca_BATCH *batch = rb->cookie;
+    lcb_RESPCOUNTER resp = *(const lcb_RESPCOUNTER *)rb;
+
+    lcb_list_delete(&batch->llnode);
+    deliver(instance, batch, &resp);
+    batch_free(batch);
+    (void)cbtype;
+}
+
+/* If the counter does not exist, the first command creates it with the
+ * initial value and ignores its delta; the others then apply theirs */
+static lcb_U64
+batch_initial(const ca_BATCH *batch)
+{
+    lcb_S64 rest = batch->delta - batch->first;
+    if (rest >= 0) {
+        return batch->initial + (lcb_U64)rest;
+    } else if (batch->initial > (lcb_U64)-rest) {
+        return batch->initial - (lcb_U64)-rest;
+    } else {
+        return 0;
+    }
+}
+
+static void
+flush_batches(void *arg)
+{
+    lcb_COUNTERAGG *agg = arg;
+    lcb_t instance = agg->instance;
+    lcb_list_t *ll, *llnext, failed;
+    hrtime_t now = lcbio_now(instance->iotable);
+    unsigned nsent = 0;
+
+    lcb_list_init(&failed);
+    LCB_LIST_SAFE_FOR(ll, llnext, &agg->pending) {
+        ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llnode);
+        lcb_CMDCOUNTER cmd;
+
+        if (batch->staged || batch->deadline > now) {
+            continue;
+        }
+        batch_close(agg, batch);
+        lcb_list_delete(&batch->llnode);
+
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+        LCB_CMD_SET_KEY(&cmd, batch->key, batch->nkey);
+        cmd.delta = batch->delta;
+        cmd.create = batch->create;
+        cmd.initial = batch_initial(batch);
+        cmd.exptime = batch->exptime;
+        batch->callback = batch_callback;
+        batch->rc = lcb_counter3(instance, batch, &cmd);
+        if (batch->rc == LCB_SUCCESS) {
+            lcb_list_append(&agg->inflight, &batch->llnode);
+            agg->stats.nbatches++;
+            nsent++;
+        } else {
+            lcb_list_append(&failed, &batch->llnode);
+        }
+    }
+    if (nsent) {
+        /* Use this, rather than lcb_sched_leave(), because this is being
+         * invoked internally by the library. */
+        mcreq_sched_leave(&instance->cmdq, 1);
+    }
+    rearm_timer(agg);
+
+    /* Batches which could not be scheduled fail right away */
+    while ((ll = lcb_list_shift(&failed))) {
+        ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llnode);
+        lcb_RESPCOUNTER resp = { 0 };
+        resp.rc = batch->rc;
+        resp.key = batch->key;
+        resp.nkey = batch->nkey;
+        deliver(instance, batch, &resp);
+        batch_free(batch);
+    }
+    update_loopref(agg);
+}
+
+void
+lcb_counteragg_sched_leave(lcb_t instance)
+{
+    lcb_COUNTERAGG *agg = instance->counteragg;
+    lcb_list_t *ll;
+
+    if (!agg || LCB_LIST_IS_EMPTY(&agg->staged)) {
+        return;
+    }
+    while ((ll = lcb_list_shift(&agg->staged))) {
+        ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llstaged);
+        batch->staged = 0;
+        batch->ncommitted = batch->nwaiters;
+        batch->committed = batch->delta;
+    }
+    rearm_timer(agg);
+    update_loopref(agg);
+}
+
+void
+lcb_counteragg_sched_fail(lcb_t instance)
+{
+    lcb_COUNTERAGG *agg = instance->counteragg;
+    lcb_list_t *ll;
+
+    if (!agg || LCB_LIST_IS_EMPTY(&agg->staged)) {
+        return;
+    }
+    while ((ll = lcb_list_shift(&agg->staged))) {
+        ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llstaged);
+        batch->staged = 0;
+        agg->stats.naggregated -= batch->nwaiters - batch->ncommitted;
+        batch->nwaiters = batch->ncommitted;
+        batch->delta = batch->committed;
+        if (!batch->nwaiters) {
+            batch_close(agg, batch);
+            lcb_list_delete(&batch->llnode);
+            batch_free(batch);
+        }
+    }
+    rearm_timer(agg);
+    update_loopref(agg);
+}
+
+static void
+free_batches(lcb_list_t *list)
+{
+    lcb_list_t *ll;
+    while ((ll = lcb_list_shift(list))) {
+        batch_free(LCB_LIST_ITEM(ll, ca_BATCH, llnode));
+    }
+}
+
+void
+lcb_counteragg_destroy(lcb_COUNTERAGG *agg)
+{
+    /* Commands in flight never resume the application once the instance is
+     * being destroyed, so their batches are freed here too */
+    free_batches(&agg->pending);
+    free_batches(&agg->inflight);
+    lcbio_timer_destroy(agg->timer);
+    genhash_free(agg->ht);
+    free(agg);
+}
+
+void
+lcb_counteragg_stats(lcb_t instance, lcb_COUNTERAGGSTATS *stats)
+{
+    if (instance->counteragg) {
+        *stats = instance->counteragg->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void
+lcb_counteragg_dump(const lcb_COUNTERAGG *agg, FILE *fp)
+{
+    lcb_list_t *ll;
+    unsigned npending = 0, nwaiters = 0, ninflight = 0;
+
+    LCB_LIST_FOR(ll, &agg->pending) {
+        const ca_BATCH *batch = LCB_LIST_ITEM(ll, ca_BATCH, llnode);
+        npending++;
+        nwaiters += batch->nwaiters;
+    }
+    LCB_LIST_FOR(ll, &agg->inflight) {
+        ninflight++;
+    }
+    fprintf(fp, "PENDING BATCHES: %u (%u WAITERS)\n", npending, nwaiters);
+    fprintf(fp, "BATCHES IN FLIGHT: %u\n", ninflight);
+    fprintf(fp, "AGGREGATED COMMANDS: %lu\n", (unsigned long)agg->stats.naggregated);
+    fprintf(fp, "BATCHES SENT: %lu\n", (unsigned long)agg->stats.nbatches);
+}
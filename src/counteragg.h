@@ -0,0 +1,103 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_COUNTERAGG_H
+#define LCB_COUNTERAGG_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <mc/mcreq.h>
+
+/**
+ * @file
+ * @brief Client-side aggregation of counter commands
+ *
+ * @defgroup lcb-counteragg Counter aggregation
+ *
+ * @details
+ * When enabled, a plain counter command does not get a packet of its own.
+ * Its delta is added to a batch for its key, and its cookie to the batch's
+ * waiters. Once the batch is older than the aggregation window, or has
+ * reached the maximum number of commands, a single INCREMENT (or DECREMENT,
+ * if the sum is negative) is sent for the sum of the deltas. Its response
+ * is delivered, unchanged, to each waiter's cookie: on success, the value is
+ * therefore that of the counter after the whole batch was applied.
+ *
+ * Commands are added to the same batch only if they agree on whether, and
+ * how, the counter is created. A command which does not starts a new batch,
+ * which is sent after the current one. Commands with an explicit hashkey or
+ * which use an internal callback are never aggregated.
+ *
+ * If the scheduling context is failed (lcb_sched_fail()), the commands
+ * added within it are removed from their batches again. Batches which were
+ * not yet sent when the instance is destroyed are discarded without
+ * invoking callbacks, as are any other outstanding commands.
+ *
+ * @addtogroup lcb-counteragg
+ * @{
+ */
+
+typedef struct lcb_COUNTERAGG_st lcb_COUNTERAGG;
+
+/** Whether counter commands are aggregated for the instance */
+#define LCB_COUNTERAGG_ENABLED(instance) \
+    (LCBT_SETTING(instance, counteragg_window) != 0)
+
+/** Destroy the state. Waiters are discarded without invoking callbacks */
+void
+lcb_counteragg_destroy(lcb_COUNTERAGG *agg);
+
+/**
+ * Add a counter command to the batch for its key.
+ * @param instance
+ * @param cookie the cookie to deliver the response to
+ * @param cmd the command, which should have been validated
+ * @return nonzero if the command was added. Otherwise a packet should be
+ * scheduled for it as usual.
+ */
+int
+lcb_counteragg_add(lcb_t instance, const void *cookie,
+    const lcb_CMDCOUNTER *cmd);
+
+/** Commit the commands added within the scheduling context */
+void
+lcb_counteragg_sched_leave(lcb_t instance);
+
+/** Discard the commands added within the scheduling context */
+void
+lcb_counteragg_sched_fail(lcb_t instance);
+
+/**
+ * Retrieve the counters
+ * @param instance
+ * @param[out] stats the counters. These are zero if no command was ever
+ * aggregated
+ */
+void
+lcb_counteragg_stats(lcb_t instance, lcb_COUNTERAGGSTATS *stats);
+
+void
+lcb_counteragg_dump(const lcb_COUNTERAGG *agg, FILE *fp);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
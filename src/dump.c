@@ -20,12 +20,16 @@
 #include "list.h"
 #include "mc/mcreq.h"
 #include "retryq.h"
+#include "kvcache.h"
+#include "hedge.h"
+#include "singleflight.h"
+#include "counteragg.h"
 
 LIBCOUCHBASE_API
 void
 lcb_dump(lcb_t instance, FILE *fp, lcb_U32 flags)
 {
-    unsigned ii;
+    unsigned ii, jj;
 
     if (!fp) {
         fp = stderr;
@@ -60,12 +64,28 @@ lcb_dump(lcb_t instance, FILE *fp, lcb_U32 flags)
     }
 
     fprintf(fp, "=== BEGIN PIPELINE DUMP ===\n");
+    fprintf(fp, "QUEUED: PACKETS=%u, BYTES=%lu%s\n", instance->cmdq.nqpkts,
+        (unsigned long)instance->cmdq.nqbytes,
+        instance->admission.paused ? " (PAUSED)" : "");
+    if (instance->callbacks.getbatch) {
+        fprintf(fp, "BATCHED GET RESPONSES: %lu (IN %lu BATCHES)\n",
+            (unsigned long)instance->respbatch.nbatched,
+            (unsigned long)instance->respbatch.nbatches);
+    }
     for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
         mc_SERVER *server;
         mc_PIPELINE *pl = instance->cmdq.pipelines[ii];
+        lcb_SERVERHEALTH health;
 
         server = (mc_SERVER *)pl;
         fprintf(fp, "** [%u] SERVER %s\n", ii, server->datahost);
+        mcserver_get_health(server, &health);
+        fprintf(fp, "** == HEALTH: LATENCY=%luus, ERRORS=%lu/1000, RESPONSES=%lu, FAILURES=%lu%s\n",
+            (unsigned long)health.latency, (unsigned long)health.errors,
+            (unsigned long)health.nresponses, (unsigned long)health.nfailures,
+            health.degraded ? " (DEGRADED)" : "");
+        fprintf(fp, "** == QUEUED: PACKETS=%u, BYTES=%lu\n",
+            pl->nqpkts, (unsigned long)pl->nqbytes);
         if (server->connctx) {
             fprintf(fp, "** == BEGIN SOCKET INFO\n");
             lcbio_ctx_dump(server->connctx, fp);
@@ -75,6 +95,21 @@ lcb_dump(lcb_t instance, FILE *fp, lcb_U32 flags)
         } else {
             fprintf(fp, "** == NOT CONNECTED\n");
         }
+        for (jj = 0; jj < MCSERVER_NLANES(server); jj++) {
+            mc_SERVER *lane = MCSERVER_LANE(server, jj);
+            fprintf(fp, "** == LANE %u (pending: %s)\n", jj,
+                mcserver_has_pending(lane) ? "Yes" : "No");
+            if (lane->connctx) {
+                lcbio_ctx_dump(lane->connctx, fp);
+            } else if (lane->connreq.u.p_generic) {
+                fprintf(fp, "** == STILL CONNECTING\n");
+            } else {
+                fprintf(fp, "** == NOT CONNECTED\n");
+            }
+            if (flags & LCB_DUMP_PKTINFO) {
+                mcreq_dump_chain(&lane->pipeline, fp, NULL);
+            }
+        }
         if (flags & LCB_DUMP_BUFINFO) {
             fprintf(fp, "** == DUMPING NETBUF INFO (For packet network data)\n");
             netbuf_dump_status(&pl->nbmgr, fp);
@@ -92,6 +127,37 @@ lcb_dump(lcb_t instance, FILE *fp, lcb_U32 flags)
     }
     fprintf(fp, "=== END PIPELINE DUMP ===\n");
 
+    fprintf(fp, "=== BEGIN SOCKET POOL DUMP ===\n");
+    fprintf(fp, "** MEMCACHED POOL\n");
+    lcbio_mgr_dump(instance->memd_sockpool, fp);
+    fprintf(fp, "** HTTP POOL\n");
+    lcbio_mgr_dump(instance->http_sockpool, fp);
+    fprintf(fp, "=== END SOCKET POOL DUMP ===\n");
+
+    if (instance->kvcache) {
+        fprintf(fp, "=== BEGIN ITEM CACHE DUMP ===\n");
+        lcb_kvcache_dump(instance->kvcache, fp);
+        fprintf(fp, "=== END ITEM CACHE DUMP ===\n");
+    }
+
+    if (instance->hedge) {
+        fprintf(fp, "=== BEGIN HEDGED GET DUMP ===\n");
+        lcb_hedge_dump(instance->hedge, fp);
+        fprintf(fp, "=== END HEDGED GET DUMP ===\n");
+    }
+
+    if (instance->singleflight) {
+        fprintf(fp, "=== BEGIN SINGLE-FLIGHT GET DUMP ===\n");
+        lcb_singleflight_dump(instance->singleflight, fp);
+        fprintf(fp, "=== END SINGLE-FLIGHT GET DUMP ===\n");
+    }
+
+    if (instance->counteragg) {
+        fprintf(fp, "=== BEGIN COUNTER AGGREGATION DUMP ===\n");
+        lcb_counteragg_dump(instance->counteragg, fp);
+        fprintf(fp, "=== END COUNTER AGGREGATION DUMP ===\n");
+    }
+
     fprintf(fp, "=== BEGIN CONFMON DUMP ===\n");
     lcb_confmon_dump(instance->confmon, fp);
     fprintf(fp, "=== END CONFMON DUMP ===\n");
@@ -83,7 +83,7 @@ lcb_getconfig(lcb_t instance, const void *cookie, mc_SERVER *server)
     rd = calloc(1, sizeof(*rd));
     rd->procs = &procs;
     rd->cookie = cookie;
-    rd->start = gethrtime();
+    rd->start = lcbio_now_fine(instance->iotable);
     packet->u_rdata.exdata = rd;
     packet->flags |= MCREQ_F_REQEXT;
 
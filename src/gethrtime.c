@@ -99,6 +99,90 @@ hrtime_t gethrtime(void)
 }
 #endif /* HAVE_GETHRTIME */
 
+/*
+ * Clock based on the CPU's timestamp counter. Reading the counter is
+ * considerably cheaper than clock_gettime(), but it only counts time reliably
+ * if it is "invariant", i.e. runs at a constant rate regardless of frequency
+ * scaling and sleep states, and is synchronized across cores. This is the
+ * case on most modern x86-64 CPUs, where the CPU advertises it.
+ *
+ * The counter is calibrated once against gethrtime(), and its readings are
+ * converted so they can be compared with those of gethrtime(). Where the
+ * counter cannot be used, lcb_tsc_gethrtime() is simply gethrtime().
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(_WIN32)
+#include <cpuid.h>
+#include <x86intrin.h>
+#include <pthread.h>
+#define LCB_HAVE_TSC 1
+
+/* How long to measure the counter's rate for */
+#define TSC_CALIBRATION_NS LCB_US2NS(2000)
+
+static struct {
+    int usable;
+    lcb_U64 tsc_base;
+    hrtime_t ns_base;
+    /* Nanoseconds per tick, as a 32.32 fixed point number */
+    lcb_U64 mult;
+} tsc;
+
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static void
+tsc_calibrate(void)
+{
+    unsigned eax, ebx, ecx, edx;
+    hrtime_t ns_begin, ns_end;
+    lcb_U64 tsc_begin, tsc_end;
+
+    /* CPUID.80000007H:EDX[8] is the invariant TSC bit */
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+        return;
+    }
+
+    ns_begin = gethrtime();
+    tsc_begin = __rdtsc();
+    do {
+        ns_end = gethrtime();
+    } while (ns_end - ns_begin < TSC_CALIBRATION_NS);
+    tsc_end = __rdtsc();
+
+    if (tsc_end <= tsc_begin) {
+        return;
+    }
+    tsc.mult = ((ns_end - ns_begin) << 32) / (tsc_end - tsc_begin);
+    tsc.tsc_base = tsc_end;
+    tsc.ns_base = ns_end;
+    tsc.usable = tsc.mult != 0;
+}
+#endif
+
+int
+lcb_tsc_init(void)
+{
+#ifdef LCB_HAVE_TSC
+    pthread_once(&tsc_once, tsc_calibrate);
+    return tsc.usable;
+#else
+    return 0;
+#endif
+}
+
+hrtime_t
+lcb_tsc_gethrtime(void)
+{
+#ifdef LCB_HAVE_TSC
+    if (tsc.usable) {
+        /* Multiply in two halves so the product does not overflow */
+        lcb_U64 delta = __rdtsc() - tsc.tsc_base;
+        return tsc.ns_base + (delta >> 32) * tsc.mult +
+                (((delta & 0xffffffff) * tsc.mult) >> 32);
+    }
+#endif
+    return gethrtime();
+}
+
 /* Symbol usable so other subsystems can get the same idea of time the library
  * has. This will also allow us to stop shipping the 'gethrtime' file around.
  */
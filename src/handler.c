@@ -20,6 +20,9 @@
 #include "mc/mcreq.h"
 #include "mc/compress.h"
 #include "trace.h"
+#include "kvcache.h"
+#include "hedge.h"
+#include "singleflight.h"
 
 LIBCOUCHBASE_API
 lcb_error_t
@@ -219,8 +222,25 @@ H_get(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
     }
 
     maybe_decompress(o, response, &resp, &freeptr);
+    if (LCB_KVCACHE_ENABLED(o)) {
+        lcb_kvcache_update(o, request, &resp);
+    }
     TRACE_GET_END(response, &resp);
-    INVOKE_CALLBACK3(request, &resp, o, LCB_CALLBACK_GET);
+    if (request->flags & MCREQ_F_REQEXT) {
+        /* Hedged GET */
+        request->u_rdata.exdata->procs->handler(pipeline, request, resp.rc, &resp);
+    } else if (!(request->flags & MCREQ_F_INVOKED)) {
+        /* GETs scheduled by the callbacks must not join this flight */
+        lcb_SFFLIGHT *flight = lcb_singleflight_detach(o, request);
+        int batched = lcb_respbatch_add(o, request, &resp, freeptr);
+        if (batched) {
+            freeptr = NULL; /* Owned by the batch */
+        } else {
+            INVOKE_CALLBACK3(request, &resp, o, LCB_CALLBACK_GET);
+        }
+        /* Then to the GETs coalesced with it */
+        lcb_singleflight_land(o, flight, request, &resp, batched);
+    }
     free(freeptr);
 }
 
@@ -256,6 +276,7 @@ H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, packet_info *response,
     lcb_t root = pipeline->parent->cqdata;
     lcb_RESPREMOVE resp = { 0 };
     init_resp3(root, response, packet, immerr, (lcb_RESPBASE *)&resp);
+    lcb_kvcache_invalidate(root, packet);
     TRACE_REMOVE_END(response, &resp);
     INVOKE_CALLBACK3(packet, &resp, root, LCB_CALLBACK_REMOVE);
 }
@@ -354,6 +375,7 @@ H_store(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
     } else if (opcode == PROTOCOL_BINARY_CMD_SET) {
         resp.op = LCB_SET;
     }
+    lcb_kvcache_invalidate(root, request);
     TRACE_STORE_END(response, &resp);
     INVOKE_CALLBACK3(request, &resp, root, LCB_CALLBACK_STORE);
 }
@@ -371,6 +393,7 @@ H_arithmetic(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
         resp.value = ntohll(resp.value);
     }
     resp.cas = PACKET_CAS(response);
+    lcb_kvcache_invalidate(root, request);
     TRACE_ARITHMETIC_END(response, &resp);
     INVOKE_CALLBACK3(request, &resp, root, LCB_CALLBACK_COUNTER);
 }
@@ -416,6 +439,16 @@ H_verbosity(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
     exdata->procs->handler(pipeline, request, dummy.rc, NULL);
 }
 
+static void
+H_noop(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
+       lcb_error_t immerr)
+{
+    /* NOOPs are only sent as fences for quiet commands (see MCREQ_F_QUIET),
+     * which are completed before the fence itself. If the fence fails, so
+     * do the commands before it */
+    (void)pipeline; (void)request; (void)response; (void)immerr;
+}
+
 static void
 H_version(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
           lcb_error_t immerr)
@@ -443,6 +476,7 @@ H_touch(mc_PIPELINE *pipeline, mc_PACKET *request, packet_info *response,
     lcb_RESPTOUCH resp = { 0 };
 
     init_resp3(root, response, request, immerr, &resp);
+    lcb_kvcache_invalidate(root, request);
     TRACE_TOUCH_END(response, &resp);
     INVOKE_CALLBACK3(request, &resp, root, LCB_CALLBACK_TOUCH);
 }
@@ -487,7 +521,8 @@ record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, packet_info *res)
     lcb_t instance = pipeline->parent->cqdata;
     if (instance->histogram) {
         lcb_record_metrics(
-                instance, gethrtime() - MCREQ_PKT_RDATA(req)->start,
+                instance,
+                lcbio_now_fine(instance->iotable) - MCREQ_PKT_RDATA(req)->start,
                 PACKET_OPCODE(res));
     }
 }
@@ -566,10 +601,8 @@ mcreq_dispatch_response(
     case PROTOCOL_BINARY_CMD_VERBOSITY:
         INVOKE_OP(H_verbosity);
 
-#if 0
     case PROTOCOL_BINARY_CMD_NOOP:
         INVOKE_OP(H_noop);
-#endif
 
     case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG:
         INVOKE_OP(H_config);
@@ -0,0 +1,440 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "hedge.h"
+#include "list.h"
+
+/**Latencies are recorded in buckets of a quarter of a power of two
+ * microseconds, i.e. with an error of at most 25%. The last bucket also
+ * holds anything larger (about 17 minutes) */
+#define HEDGE_NBUCKETS 128
+
+/** The percentile is recomputed after this many samples */
+#define HEDGE_RECALC_INTERVAL 64
+
+/**Once this many samples have been recorded, all the counts are halved so
+ * that the percentile follows recent latencies */
+#define HEDGE_DECAY_THRESHOLD 4096
+
+/** Couchbase buckets have at most three replicas */
+#define HEDGE_MAX_REPLICAS 4
+
+/** A hedged GET. Shared by the original request and its replica reads */
+typedef struct {
+    mc_REQDATAEX base;
+    /** Node in lcb_HEDGE::pending, until hedged or answered by the master */
+    lcb_list_t llnode;
+    lcb_t instance;
+    hrtime_t deadline; /**< When to send the replica reads */
+    unsigned nrefs; /**< Number of packets referring to this object */
+    unsigned nreplicas; /**< Replica reads which have not yet completed */
+    lcb_error_t master_err; /**< Error from the master, if it is waited on */
+    unsigned done : 1; /**< Whether the callback was invoked */
+    unsigned master_done : 1; /**< Whether the master responded */
+    lcb_U16 vbid;
+    lcb_U16 nkey;
+    char key[1];
+} hedge_GET;
+
+struct lcb_HEDGE_st {
+    lcb_list_t pending; /**< GETs which may need hedging, oldest first */
+    lcbio_pTIMER timer; /**< Fires when the oldest pending GET is due */
+    lcb_t instance;
+    lcb_U32 buckets[HEDGE_NBUCKETS];
+    lcb_U32 nsamples;
+    lcb_U32 nrecalc; /**< Samples since the delay was last computed */
+    lcb_U32 pctl_delay; /**< Delay derived from the latencies, in us */
+    lcb_HEDGESTATS stats;
+};
+
+static void fire_hedges(void *arg);
+static void hedge_handler(mc_PIPELINE *, mc_PACKET *, lcb_error_t, const void *);
+static void hedge_fail_dtor(mc_PACKET *);
+
+static mc_REQDATAPROCS hedge_procs = {
+        hedge_handler,
+        hedge_fail_dtor
+};
+
+static lcb_HEDGE *
+hedge_get(lcb_t instance)
+{
+    lcb_HEDGE *hedge = instance->hedge;
+    if (hedge) {
+        return hedge;
+    }
+    hedge = calloc(1, sizeof(*hedge));
+    hedge->instance = instance;
+    hedge->timer = lcbio_timer_new(instance->iotable, hedge, fire_hedges);
+    lcb_list_init(&hedge->pending);
+    instance->hedge = hedge;
+    return hedge;
+}
+
+static unsigned
+lat_bucket(lcb_U32 us)
+{
+    unsigned msb = 0, ix;
+    lcb_U32 tmp = us;
+    if (us < 4) {
+        return us;
+    }
+    while (tmp >>= 1) {
+        msb++;
+    }
+    ix = msb * 4 + ((us >> (msb - 2)) & 3);
+    return ix < HEDGE_NBUCKETS ? ix : HEDGE_NBUCKETS - 1;
+}
+
+/* Upper bound of the latencies held in a bucket */
+static lcb_U32
+bucket_limit(unsigned ix)
+{
+    unsigned msb = ix / 4;
+    if (ix < 4) {
+        return ix + 1;
+    }
+    return (lcb_U32)((4 + (ix % 4) + 1) << (msb - 2));
+}
+
+static void
+recalc_delay(lcb_HEDGE *hedge, float percentile)
+{
+    unsigned ii;
+    lcb_U32 seen = 0, target;
+
+    if (percentile >= 100) {
+        percentile = 100;
+    }
+    target = (lcb_U32)(hedge->nsamples * (percentile / 100.0));
+    for (ii = 0; ii < HEDGE_NBUCKETS - 1; ii++) {
+        seen += hedge->buckets[ii];
+        if (seen >= target) {
+            break;
+        }
+    }
+    hedge->pctl_delay = bucket_limit(ii);
+    hedge->nrecalc = 0;
+}
+
+static void
+record_latency(lcb_HEDGE *hedge, hrtime_t elapsed)
+{
+    float percentile = LCBT_SETTING(hedge->instance, hedge_percentile);
+    if (percentile <= 0) {
+        return;
+    }
+
+    hedge->buckets[lat_bucket((lcb_U32)LCB_NS2US(elapsed))]++;
+    if (++hedge->nsamples >= HEDGE_DECAY_THRESHOLD) {
+        unsigned ii;
+        hedge->nsamples = 0;
+        for (ii = 0; ii < HEDGE_NBUCKETS; ii++) {
+            hedge->buckets[ii] /= 2;
+            hedge->nsamples += hedge->buckets[ii];
+        }
+    }
+    if (++hedge->nrecalc >= HEDGE_RECALC_INTERVAL) {
+        recalc_delay(hedge, percentile);
+    }
+}
+
+static lcb_U32
+get_delay(const lcb_HEDGE *hedge)
+{
+    lcb_U32 delay = LCBT_SETTING(hedge->instance, hedge_delay);
+    if (LCBT_SETTING(hedge->instance, hedge_percentile) > 0 &&
+            hedge->pctl_delay > delay) {
+        delay = hedge->pctl_delay;
+    }
+    return delay;
+}
+
+static void
+rearm_timer(lcb_HEDGE *hedge)
+{
+    hedge_GET *first;
+    hrtime_t now = lcbio_now(hedge->instance->iotable);
+
+    if (LCB_LIST_IS_EMPTY(&hedge->pending)) {
+        lcbio_timer_disarm(hedge->timer);
+        return;
+    }
+    first = LCB_LIST_ITEM(hedge->pending.next, hedge_GET, llnode);
+    if (first->deadline <= now) {
+        lcbio_timer_rearm(hedge->timer, 0);
+    } else {
+        lcbio_timer_rearm(hedge->timer, LCB_NS2US(first->deadline - now));
+    }
+}
+
+static void
+unlink_pending(hedge_GET *hg)
+{
+    if (hg->llnode.next) {
+        lcb_list_delete(&hg->llnode);
+        hg->llnode.next = hg->llnode.prev = NULL;
+    }
+}
+
+static void
+hedge_unref(hedge_GET *hg)
+{
+    if (!--hg->nrefs) {
+        unlink_pending(hg);
+        free(hg);
+    }
+}
+
+int
+lcb_hedge_prepare(lcb_t instance, mc_PACKET *pkt)
+{
+    lcb_HEDGE *hedge;
+    hedge_GET *hg;
+    const void *key;
+    lcb_SIZE nkey;
+    int srvix;
+    protocol_binary_request_header hdr;
+    lcbvb_CONFIG *vbc = LCBT_VBCONFIG(instance);
+    mc_REQDATA *rd = &pkt->u_rdata.reqdata;
+
+    if (LCBVB_DISTTYPE(vbc) != LCBVB_DIST_VBUCKET || LCBVB_NREPLICAS(vbc) < 1) {
+        return 0;
+    }
+
+    hedge = hedge_get(instance);
+    mcreq_read_hdr(pkt, &hdr);
+    mcreq_get_key(pkt, &key, &nkey);
+    hg = calloc(1, sizeof(*hg) + nkey);
+    hg->base.cookie = rd->cookie;
+    hg->base.start = rd->start;
+    hg->base.procs = &hedge_procs;
+    hg->instance = instance;
+    hg->deadline = rd->start + LCB_US2NS(get_delay(hedge));
+    hg->nrefs = 1;
+    hg->vbid = ntohs(hdr.request.vbucket);
+
+    /* Don't wait for a master which is known to be slow */
+    srvix = lcbvb_vbmaster(vbc, hg->vbid);
+    if (srvix > -1 && srvix < (int)LCBT_NSERVERS(instance) &&
+            mcserver_is_degraded(LCBT_GET_SERVER(instance, srvix))) {
+        hg->deadline = rd->start;
+    }
+    hg->nkey = (lcb_U16)nkey;
+    memcpy(hg->key, key, nkey);
+
+    pkt->u_rdata.exdata = &hg->base;
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    lcb_list_append(&hedge->pending, &hg->llnode);
+    if (!lcbio_timer_armed(hedge->timer)) {
+        rearm_timer(hedge);
+    }
+    return 1;
+}
+
+/* Send replica reads for the GET. Returns the number of reads sent */
+static unsigned
+send_replicas(lcb_HEDGE *hedge, hedge_GET *hg)
+{
+    lcb_t instance = hedge->instance;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    protocol_binary_request_header req;
+    lcb_KEYBUF kb;
+    unsigned ii, nsent = 0, nhealthy = 0;
+    int ixs[HEDGE_MAX_REPLICAS];
+    unsigned nixs = 0;
+
+    if (!cq->config) {
+        return 0;
+    }
+
+    /* Avoid degraded replicas, unless all of them are */
+    for (ii = 0; ii < LCBVB_NREPLICAS(cq->config) && nixs < HEDGE_MAX_REPLICAS; ii++) {
+        int ix = lcbvb_vbreplica(cq->config, hg->vbid, ii);
+        if (ix < 0 || ix >= (int)cq->npipelines) {
+            continue;
+        }
+        if (!mcserver_is_degraded((mc_SERVER *)cq->pipelines[ix])) {
+            nhealthy++;
+        }
+        ixs[nixs++] = ix;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.request.magic = PROTOCOL_BINARY_REQ;
+    req.request.opcode = PROTOCOL_BINARY_CMD_GET_REPLICA;
+    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.request.vbucket = htons(hg->vbid);
+    req.request.keylen = htons(hg->nkey);
+    req.request.bodylen = htonl((lcb_U32)hg->nkey);
+    LCB_KREQ_SIMPLE(&kb, hg->key, hg->nkey);
+
+    for (ii = 0; ii < nixs; ii++) {
+        mc_PIPELINE *pl = cq->pipelines[ixs[ii]];
+        mc_PACKET *pkt;
+
+        if (nhealthy && mcserver_is_degraded((mc_SERVER *)pl)) {
+            continue;
+        }
+        if ((pkt = mcreq_allocate_packet(pl)) == NULL) {
+            break;
+        }
+        pkt->u_rdata.exdata = &hg->base;
+        pkt->flags |= MCREQ_F_REQEXT;
+        mcreq_reserve_key(pl, pkt, sizeof(req.bytes), &kb);
+        req.request.opaque = pkt->opaque;
+        mcreq_write_hdr(pkt, &req);
+        mcreq_sched_add(pl, pkt);
+        hg->nrefs++;
+        hg->nreplicas++;
+        nsent++;
+    }
+    return nsent;
+}
+
+static void
+fire_hedges(void *arg)
+{
+    lcb_HEDGE *hedge = arg;
+    lcb_list_t *ll, *llnext;
+    hrtime_t now = lcbio_now(hedge->instance->iotable);
+    unsigned nsent = 0;
+
+    LCB_LIST_SAFE_FOR(ll, llnext, &hedge->pending) {
+        hedge_GET *hg = LCB_LIST_ITEM(ll, hedge_GET, llnode);
+        unsigned cursent;
+        if (hg->deadline > now) {
+            break;
+        }
+        unlink_pending(hg);
+        if ((cursent = send_replicas(hedge, hg)) != 0) {
+            hedge->stats.fired++;
+            nsent += cursent;
+        }
+    }
+    if (nsent) {
+        /* Use this, rather than lcb_sched_leave(), because this is being
+         * invoked internally by the library. */
+        mcreq_sched_leave(&hedge->instance->cmdq, 1);
+    }
+    rearm_timer(hedge);
+}
+
+static void
+deliver(hedge_GET *hg, lcb_RESPGET *resp)
+{
+    lcb_t instance = hg->instance;
+    hg->done = 1;
+    lcb_find_callback(instance, LCB_CALLBACK_GET)(
+        instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+}
+
+static void
+hedge_handler(mc_PIPELINE *pl, mc_PACKET *pkt, lcb_error_t err, const void *arg)
+{
+    hedge_GET *hg = (hedge_GET *)pkt->u_rdata.exdata;
+    lcb_RESPGET *resp = (lcb_RESPGET *)arg;
+    lcb_HEDGE *hedge = hg->instance->hedge;
+    protocol_binary_request_header hdr;
+
+    mcreq_read_hdr(pkt, &hdr);
+    if (hdr.request.opcode != PROTOCOL_BINARY_CMD_GET_REPLICA) {
+        hg->master_done = 1;
+        unlink_pending(hg);
+        if (hedge && LCB_LIST_IS_EMPTY(&hedge->pending)) {
+            lcbio_timer_disarm(hedge->timer);
+        }
+        if (hedge && (err == LCB_SUCCESS || err == LCB_KEY_ENOENT)) {
+            record_latency(hedge,
+                lcbio_now_fine(hg->instance->iotable) - hg->base.start);
+        }
+        if (!hg->done) {
+            if (err == LCB_SUCCESS || err == LCB_KEY_ENOENT || !hg->nreplicas) {
+                deliver(hg, resp);
+            } else {
+                /* Wait for the replicas */
+                hg->master_err = err;
+            }
+        }
+
+    } else {
+        hg->nreplicas--;
+        if (hg->done) {
+            /* Lost the race. Reads still waiting to be written can't be
+             * withdrawn either, as the pipeline's buffers only drain in order */
+        } else if (err == LCB_SUCCESS) {
+            if (hedge) {
+                hedge->stats.won++;
+            }
+            resp->rflags |= LCB_RESP_F_REPLICA;
+            deliver(hg, resp);
+        } else if (hg->master_done && !hg->nreplicas) {
+            /* Everything failed. Report the master's error */
+            resp->rc = hg->master_err;
+            resp->cas = 0;
+            resp->value = NULL;
+            resp->nvalue = 0;
+            deliver(hg, resp);
+        }
+    }
+
+    hedge_unref(hg);
+    (void)pl;
+}
+
+static void
+hedge_fail_dtor(mc_PACKET *pkt)
+{
+    hedge_unref((hedge_GET *)pkt->u_rdata.exdata);
+}
+
+void
+lcb_hedge_destroy(lcb_HEDGE *hedge)
+{
+    lcb_list_t *ll, *llnext;
+    /* The requests themselves are still referenced by their packets */
+    LCB_LIST_SAFE_FOR(ll, llnext, &hedge->pending) {
+        unlink_pending(LCB_LIST_ITEM(ll, hedge_GET, llnode));
+    }
+    lcbio_timer_destroy(hedge->timer);
+    free(hedge);
+}
+
+void
+lcb_hedge_stats(lcb_t instance, lcb_HEDGESTATS *stats)
+{
+    if (instance->hedge) {
+        *stats = instance->hedge->stats;
+        stats->delay = get_delay(instance->hedge);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+        stats->delay = LCBT_SETTING(instance, hedge_delay);
+    }
+}
+
+void
+lcb_hedge_dump(const lcb_HEDGE *hedge, FILE *fp)
+{
+    fprintf(fp, "** FIRED: %lu, WON: %lu\n",
+        (unsigned long)hedge->stats.fired, (unsigned long)hedge->stats.won);
+    fprintf(fp, "** DELAY: %luus (PERCENTILE DELAY: %luus, SAMPLES: %lu)\n",
+        (unsigned long)get_delay(hedge), (unsigned long)hedge->pctl_delay,
+        (unsigned long)hedge->nsamples);
+    fprintf(fp, "** WAITING: %s\n", LCB_LIST_IS_EMPTY(&hedge->pending) ? "NO" : "YES");
+}
@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HEDGE_H
+#define LCB_HEDGE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <mc/mcreq.h>
+
+/**
+ * @file
+ * @brief Hedged GETs
+ *
+ * @defgroup lcb-hedge Hedged GETs
+ *
+ * @details
+ * When enabled, a plain GET which has not been answered by the vBucket's
+ * master within the hedging delay is also sent (as GET_REPLICA) to each of
+ * the vBucket's replicas. The first successful response is delivered to the
+ * GET callback and any later ones are discarded; requests which were already
+ * sent cannot be recalled, so they remain outstanding until they are answered
+ * or time out.
+ *
+ * The master remains authoritative: its response is delivered if it arrives
+ * first, even if it is an error such as LCB_KEY_ENOENT. Only if it fails
+ * with some other error while replica reads are still outstanding are those
+ * waited for.
+ *
+ * The delay is lcb_settings::hedge_delay, or, if lcb_settings::hedge_percentile
+ * is set, the given percentile of recent GET latencies, whichever is larger.
+ *
+ * @addtogroup lcb-hedge
+ * @{
+ */
+
+typedef struct lcb_HEDGE_st lcb_HEDGE;
+
+/** Whether GETs are hedged for the instance */
+#define LCB_HEDGE_ENABLED(instance) \
+    (LCBT_SETTING(instance, hedge_delay) != 0)
+
+/**
+ * Destroy the hedging state. Replica reads which were not yet sent are
+ * discarded.
+ */
+void
+lcb_hedge_destroy(lcb_HEDGE *hedge);
+
+/**
+ * Make a GET packet eligible for hedging. This should be called after the
+ * packet's request data has been initialized, but before it is scheduled.
+ * The packet's response is then handled by the hedging code (see H_get()).
+ *
+ * @param instance
+ * @param pkt the GET packet
+ * @return nonzero if the packet may be hedged. Packets for buckets without
+ * replicas are left untouched.
+ */
+int
+lcb_hedge_prepare(lcb_t instance, mc_PACKET *pkt);
+
+/**
+ * Retrieve the hedging counters
+ * @param instance
+ * @param[out] stats the counters. These are zero if no GET was ever hedged
+ */
+void
+lcb_hedge_stats(lcb_t instance, lcb_HEDGESTATS *stats);
+
+void
+lcb_hedge_dump(const lcb_HEDGE *hedge, FILE *fp);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -276,3 +276,35 @@ lcb_http_request_connect(lcb_http_request_t req)
 
     return LCB_SUCCESS;
 }
+
+void
+lcb_http_pool_warmup(lcb_t instance)
+{
+    unsigned ii;
+    lcbio_MGR *pool = instance->http_sockpool;
+    lcbvb_CONFIG *vbc = LCBT_VBCONFIG(instance);
+    lcbvb_SVCMODE mode;
+
+    if (!vbc || pool->minidle == 0 || pool->maxidle == 0) {
+        return;
+    }
+
+    if (LCBT_SETTING(instance, sslopts) & LCB_SSL_ENABLED) {
+        mode = LCBVB_SVCMODE_SSL;
+    } else {
+        mode = LCBVB_SVCMODE_PLAIN;
+    }
+
+    for (ii = 0; ii < (unsigned)LCBVB_NSERVERS(vbc); ++ii) {
+        lcb_host_t host;
+        const char *hp = lcbvb_get_hostport(vbc, ii, LCBVB_SVCTYPE_VIEWS, mode);
+        if (!hp) {
+            continue;
+        }
+        if (lcb_host_parsez(&host, hp, 8092) != LCB_SUCCESS) {
+            continue;
+        }
+        lcbio_mgr_preconnect(pool, &host, pool->minidle,
+                             LCBT_SETTING(instance, views_timeout));
+    }
+}
@@ -20,6 +20,11 @@
 #include "hostlist.h"
 #include "http/http.h"
 #include "bucketconfig/clconfig.h"
+#include "kvcache.h"
+#include "hedge.h"
+#include "singleflight.h"
+#include "counteragg.h"
+#include "metrics.h"
 #include <lcbio/iotable.h>
 #include <lcbio/ssl.h>
 #define LOGARGS(obj,lvl) (obj)->settings, "instance", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -120,6 +125,52 @@ populate_nodes(lcb_t obj, const lcb_CONNSPEC *spec)
 #undef ADD_CCCP
 }
 
+static void
+append_shared_hosts(lcb_string *str, const hostlist_t hl)
+{
+    lcb_size_t ii;
+    for (ii = 0; ii < hl->nentries; ii++) {
+        const lcb_host_t *host = hl->entries + ii;
+        lcb_string_appendv(str, host->host, (size_t)-1, ":", (size_t)1,
+            host->port, (size_t)-1, ",", (size_t)1, NULL);
+    }
+    lcb_string_appendz(str, ";");
+}
+
+void
+lcb_init_shared_config(lcb_t obj)
+{
+    lcb_settings *settings = obj->settings;
+    clconfig_provider *shared;
+    lcb_string key;
+
+    if (!obj->confmon || !obj->mc_nodes || !obj->ht_nodes) {
+        return; /* Still being created */
+    }
+    shared = lcb_confmon_get_provider(obj->confmon, LCB_CLCONFIG_SHARED);
+    if (!settings->config_shared || obj->type == LCB_TYPE_CLUSTER ||
+            (obj->mc_nodes->nentries == 0 && obj->ht_nodes->nentries == 0)) {
+        if (shared->enabled) {
+            lcb_clconfig_shared_disable(shared);
+        }
+        return;
+    }
+
+    /* Instances may only share configurations if they would have received
+     * the same ones from the cluster */
+    lcb_string_init(&key);
+    lcb_string_appendz(&key, settings->bucket ? settings->bucket : "");
+    lcb_string_appendz(&key, "\n");
+    lcb_string_appendz(&key, settings->username ? settings->username : "");
+    lcb_string_appendz(&key, "\n");
+    lcb_string_appendz(&key, settings->password ? settings->password : "");
+    lcb_string_appendz(&key, "\n");
+    append_shared_hosts(&key, obj->mc_nodes);
+    append_shared_hosts(&key, obj->ht_nodes);
+    lcb_clconfig_shared_enable(shared, key.base);
+    lcb_string_release(&key);
+}
+
 static lcb_error_t
 init_providers(lcb_t obj, const lcb_CONNSPEC *spec)
 {
@@ -177,6 +228,25 @@ init_providers(lcb_t obj, const lcb_CONNSPEC *spec)
     } else {
         lcb_confmon_set_provider_active(obj->confmon, LCB_CLCONFIG_CCCP, 0);
     }
+    lcb_init_shared_config(obj);
+    return LCB_SUCCESS;
+}
+
+static lcb_error_t
+setup_faults(lcb_t obj)
+{
+    char optbuf[4097];
+    lcb_error_t err;
+
+    if (!lcb_getenv_nonempty("LCB_FAULT_SCRIPT", optbuf, sizeof optbuf)) {
+        return LCB_SUCCESS;
+    }
+    lcb_log(LOGARGS(obj, WARN), "Injecting faults from environment: %s", optbuf);
+    err = lcb_cntl(obj, LCB_CNTL_SET, LCB_CNTL_FAULT_SCRIPT, optbuf);
+    if (err != LCB_SUCCESS) {
+        lcb_log(LOGARGS(obj, ERR), "Invalid value for environment LCB_FAULT_SCRIPT (0x%x)", err);
+        return LCB_BAD_ENVIRONMENT;
+    }
     return LCB_SUCCESS;
 }
 
@@ -363,6 +433,10 @@ lcb_error_t lcb_create(lcb_t *instance,
     settings->username = spec.username; spec.username = NULL;
     settings->password = spec.password; spec.password = NULL;
     settings->logger = lcb_init_console_logger();
+    if (settings->logger) {
+        settings->loglevel =
+                ((struct lcb_CONSOLELOGGER *)settings->logger)->minlevel;
+    }
     settings->iid = lcb_instance_index++;
     if (spec.loglevel) {
         lcb_U32 val = spec.loglevel;
@@ -414,6 +488,9 @@ lcb_error_t lcb_create(lcb_t *instance,
     if ((err = apply_env_options(obj)) != LCB_SUCCESS) {
         goto GT_DONE;
     }
+    if ((err = setup_faults(obj)) != LCB_SUCCESS) {
+        goto GT_DONE;
+    }
 
     populate_nodes(obj, &spec);
     err = init_providers(obj, &spec);
@@ -486,6 +563,9 @@ void lcb_destroy(lcb_t instance)
         }
     }
 
+    /* Packets failed during destruction do not resume the application */
+    instance->cmdq.admit = NULL;
+    instance->cmdq.drained = NULL;
     for (ii = 0; ii < LCBT_NSERVERS(instance); ++ii) {
         mc_SERVER *server = LCBT_GET_SERVER(instance, ii);
         mcserver_close(server);
@@ -507,8 +587,14 @@ void lcb_destroy(lcb_t instance)
     DESTROY(lcbio_mgr_destroy, memd_sockpool);
     DESTROY(lcbio_mgr_destroy, http_sockpool);
     DESTROY(lcb_vbguess_destroy, vbguess);
+    DESTROY(lcb_kvcache_destroy, kvcache);
+    DESTROY(lcb_hedge_destroy, hedge);
+    DESTROY(lcb_singleflight_destroy, singleflight);
+    DESTROY(lcb_counteragg_destroy, counteragg);
+    DESTROY(lcb_metrics_destroy, metrics);
 
     mcreq_queue_cleanup(&instance->cmdq);
+    lcb_respbatch_cleanup(&instance->respbatch);
     lcb_aspend_cleanup(po);
 
     if (instance->iotable && instance->iotable->refcount > 1 &&
@@ -643,12 +729,18 @@ void
 lcb_sched_leave(lcb_t instance)
 {
     mcreq_sched_leave(&instance->cmdq, LCBT_SETTING(instance, sched_implicit_flush));
+    lcb_kvcache_sched_leave(instance);
+    lcb_singleflight_sched_leave(instance);
+    lcb_counteragg_sched_leave(instance);
 }
 LIBCOUCHBASE_API
 void
 lcb_sched_fail(lcb_t instance)
 {
     mcreq_sched_fail(&instance->cmdq);
+    lcb_kvcache_sched_fail(instance);
+    lcb_singleflight_sched_fail(instance);
+    lcb_counteragg_sched_fail(instance);
 }
 
 LIBCOUCHBASE_API
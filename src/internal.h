@@ -46,6 +46,8 @@
 #include "retryq.h"
 #include "aspend.h"
 #include "bootstrap.h"
+#include "admission.h"
+#include "respbatch.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -76,12 +78,16 @@ struct lcb_callback_st {
     lcb_bootstrap_callback bootstrap;
     lcb_pktfwd_callback pktfwd;
     lcb_pktflushed_callback pktflushed;
+    lcb_backpressure_callback backpressure;
+    lcb_GETBATCHCALLBACK getbatch;
 };
 
 struct lcb_confmon_st;
 struct hostlist_st;
 struct lcb_BOOTSTRAP;
 struct lcb_GUESSVB_st;
+struct lcb_KVCACHE_st;
+struct lcb_HEDGE_st;
 
 struct lcb_st {
     mc_CMDQUEUE cmdq; /**< Base command queue object */
@@ -103,6 +109,13 @@ struct lcb_st {
     lcb_RETRYQ *retryq; /**< Retry queue for failed operations */
     struct lcb_string_st *scratch; /**< Generic buffer space */
     struct lcb_GUESSVB_st *vbguess; /**< Heuristic masters for vbuckets */
+    struct lcb_KVCACHE_st *kvcache; /**< Client-side item cache */
+    struct lcb_HEDGE_st *hedge; /**< Hedged GETs */
+    struct lcb_SINGLEFLIGHT_st *singleflight; /**< Coalesced GETs */
+    struct lcb_COUNTERAGG_st *counteragg; /**< Aggregated counter commands */
+    struct lcb_METRICSBUF_st *metrics; /**< Last snapshot of the metrics */
+    lcb_ADMISSION admission; /**< Command queue limits */
+    lcb_RESPBATCH respbatch; /**< Batched GET responses */
     lcbio_pTIMER dtor_timer; /**< Asynchronous destruction timer */
     int type; /**< Type of connection */
 
@@ -163,6 +176,7 @@ lcb_error_t lcb_initialize_socket_subsystem(void);
 lcb_error_t lcb_init_providers2(lcb_t obj,
                                const struct lcb_create_st2 *e_options);
 lcb_error_t lcb_reinit3(lcb_t obj, const char *connstr);
+void lcb_init_shared_config(lcb_t obj);
 
 
 LCB_INTERNAL_API
@@ -203,6 +217,13 @@ LCB_INTERNAL_API void lcb__timer_destroy_nowarn(lcb_t instance, lcb_timer_t time
         return lcb__synchandler_return(o); \
     }
 
+/**
+ * Open connections to each node's view service so that the HTTP socket pool
+ * holds at least `minidle` connections per node. Does nothing if no
+ * configuration is available or the pool's minimum idle count is 0.
+ */
+void lcb_http_pool_warmup(lcb_t instance);
+
 void lcb_vbguess_newconfig(lcb_t instance, lcbvb_CONFIG *cfg, struct lcb_GUESSVB_st *guesses);
 int lcb_vbguess_remap(lcbvb_CONFIG *cfg, struct lcb_GUESSVB_st *guesses, int vbid, int bad);
 #define lcb_vbguess_destroy(p) free(p)
@@ -0,0 +1,522 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "kvcache.h"
+#include "list.h"
+#include "contrib/genhash/genhash.h"
+
+/** Longest key which may be cached (the protocol maximum) */
+#define KVC_MAXKEY 250
+
+/** Size of the lookup key (vBucket followed by the key itself) */
+#define KVC_MAXLKEY (KVC_MAXKEY + 2)
+
+typedef struct {
+    lcb_list_t llnode; /**< Node in the LRU list */
+    unsigned refcount; /**< One for the cache itself, one per pending hit */
+    /**Entry is a marker for a recently mutated item. It has no value, and
+     * prevents responses to GETs sent before #mtime from being cached */
+    unsigned tombstone : 1;
+
+    hrtime_t mtime; /**< Time the entry was stored, validated or mutated */
+    hrtime_t reval_start; /**< Time a background refresh was sent, or 0 */
+    lcb_CAS cas;
+    lcb_U32 itmflags;
+    lcb_U8 datatype;
+    lcb_SIZE nalloc; /**< Number of bytes accounted to this entry */
+    lcb_SIZE nvalue;
+    const char *value;
+    lcb_SIZE nkey; /**< Length of #key, including the vBucket prefix */
+    char key[1];
+} kvc_ENTRY;
+
+/** A GET which was satisfied by the cache, and is pending delivery */
+typedef struct {
+    lcb_list_t llnode;
+    kvc_ENTRY *ent;
+    const void *cookie;
+} kvc_HIT;
+
+struct lcb_KVCACHE_st {
+    genhash_t *ht;
+    lcb_list_t lru; /**< Entries, least recently used first */
+    lcb_list_t staged; /**< Hits within the current scheduling context */
+    lcb_list_t ready; /**< Hits awaiting delivery */
+    lcbio_pTIMER timer; /**< Delivers the hits in #ready */
+    int loopref; /**< Whether the event loop is referenced for #ready */
+    lcb_t instance;
+    lcb_KVCACHESTATS stats;
+};
+
+static void deliver_hits(void *arg);
+
+/* Lookup keys begin with the vBucket, and may therefore contain NUL bytes,
+ * which genhash_string_hash() does not allow */
+static int
+lkey_hash(const void *k, lcb_size_t nk)
+{
+    const unsigned char *p = k;
+    lcb_U32 hv = 2166136261U;
+    lcb_size_t ii;
+    for (ii = 0; ii < nk; ii++) {
+        hv = (hv ^ p[ii]) * 16777619U;
+    }
+    return (int)(hv & 0x7fffffff);
+}
+
+static int
+lkey_eq(const void *a, lcb_size_t na, const void *b, lcb_size_t nb)
+{
+    return na == nb && memcmp(a, b, na) == 0;
+}
+
+static struct lcb_hash_ops lkey_hashops = {
+    lkey_hash, /* hashfunc */
+    lkey_eq, /* hasheq */
+    NULL, /* dupKey */
+    NULL, /* dupValue */
+    NULL, /* freeKey */
+    NULL /* freeValue */
+};
+
+static void
+on_revalidated(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    /* Nothing to do. The cache was already updated by lcb_kvcache_update() */
+    (void)instance; (void)cbtype; (void)rb;
+}
+static lcb_RESPCALLBACK revalidate_callback = on_revalidated;
+
+static lcb_KVCACHE *
+cache_get(lcb_t instance)
+{
+    lcb_KVCACHE *cache = instance->kvcache;
+    if (cache) {
+        return cache;
+    }
+    cache = calloc(1, sizeof(*cache));
+    cache->ht = genhash_init(64, lkey_hashops);
+    cache->instance = instance;
+    cache->timer = lcbio_timer_new(instance->iotable, cache, deliver_hits);
+    lcb_list_init(&cache->lru);
+    lcb_list_init(&cache->staged);
+    lcb_list_init(&cache->ready);
+    instance->kvcache = cache;
+    return cache;
+}
+
+static lcb_SIZE
+make_lkey(char *buf, lcb_U16 vbid, const void *key, lcb_SIZE nkey)
+{
+    buf[0] = (char)(vbid >> 8);
+    buf[1] = (char)(vbid & 0xff);
+    memcpy(buf + 2, key, nkey);
+    return nkey + 2;
+}
+
+/* Build the lookup key for a request packet. Returns 0 if the key cannot be
+ * cached */
+static lcb_SIZE
+pkt_lkey(const mc_PACKET *pkt, char *buf, protocol_binary_request_header *hdr)
+{
+    const void *key;
+    lcb_SIZE nkey;
+
+    mcreq_read_hdr(pkt, hdr);
+    mcreq_get_key(pkt, &key, &nkey);
+    if (!nkey || nkey > KVC_MAXKEY) {
+        return 0;
+    }
+    return make_lkey(buf, ntohs(hdr->request.vbucket), key, nkey);
+}
+
+static kvc_ENTRY *
+entry_new(const char *lkey, lcb_SIZE nlkey, const void *value, lcb_SIZE nvalue)
+{
+    kvc_ENTRY *ent = calloc(1, sizeof(*ent) + nlkey + nvalue);
+    ent->nalloc = sizeof(*ent) + nlkey + nvalue;
+    ent->refcount = 1;
+    ent->nkey = nlkey;
+    memcpy(ent->key, lkey, nlkey);
+    if (nvalue) {
+        ent->value = ent->key + nlkey;
+        ent->nvalue = nvalue;
+        memcpy(ent->key + nlkey, value, nvalue);
+    }
+    return ent;
+}
+
+static void
+entry_unref(kvc_ENTRY *ent)
+{
+    if (!--ent->refcount) {
+        free(ent);
+    }
+}
+
+static void
+entry_link(lcb_KVCACHE *cache, kvc_ENTRY *ent)
+{
+    genhash_store(cache->ht, ent->key, ent->nkey, ent, 0);
+    lcb_list_append(&cache->lru, &ent->llnode);
+    cache->stats.nbytes += ent->nalloc;
+    if (!ent->tombstone) {
+        cache->stats.nitems++;
+    }
+}
+
+static void
+entry_unlink(lcb_KVCACHE *cache, kvc_ENTRY *ent)
+{
+    genhash_delete(cache->ht, ent->key, ent->nkey);
+    lcb_list_delete(&ent->llnode);
+    cache->stats.nbytes -= ent->nalloc;
+    if (!ent->tombstone) {
+        cache->stats.nitems--;
+    }
+    entry_unref(ent);
+}
+
+static void
+entry_touch(lcb_KVCACHE *cache, kvc_ENTRY *ent)
+{
+    lcb_list_delete(&ent->llnode);
+    lcb_list_append(&cache->lru, &ent->llnode);
+}
+
+static void
+cache_trim(lcb_KVCACHE *cache)
+{
+    lcb_SIZE maxbytes = LCBT_SETTING(cache->instance, kvcache_maxbytes);
+    while (cache->stats.nbytes > maxbytes && !LCB_LIST_IS_EMPTY(&cache->lru)) {
+        kvc_ENTRY *ent = LCB_LIST_ITEM(cache->lru.next, kvc_ENTRY, llnode);
+        if (!ent->tombstone) {
+            cache->stats.evictions++;
+        }
+        entry_unlink(cache, ent);
+    }
+}
+
+static void
+free_hits(lcb_list_t *hits)
+{
+    lcb_list_t *ll;
+    while ((ll = lcb_list_shift(hits))) {
+        kvc_HIT *hit = LCB_LIST_ITEM(ll, kvc_HIT, llnode);
+        entry_unref(hit->ent);
+        free(hit);
+    }
+}
+
+void
+lcb_kvcache_destroy(lcb_KVCACHE *cache)
+{
+    lcb_list_t *ll;
+
+    free_hits(&cache->staged);
+    free_hits(&cache->ready);
+    while ((ll = LCB_LIST_HEAD(&cache->lru))) {
+        entry_unlink(cache, LCB_LIST_ITEM(ll, kvc_ENTRY, llnode));
+    }
+    lcbio_timer_destroy(cache->timer);
+    genhash_free(cache->ht);
+    free(cache);
+}
+
+static void
+maybe_revalidate(lcb_KVCACHE *cache, kvc_ENTRY *ent, const lcb_CMDGET *cmd,
+                 hrtime_t now)
+{
+    lcb_t instance = cache->instance;
+    hrtime_t interval = LCB_US2NS(LCBT_SETTING(instance, kvcache_revalidate));
+    hrtime_t tmo = LCB_US2NS(LCBT_SETTING(instance, operation_timeout));
+    lcb_CMDGET rcmd;
+
+    if (!interval || now - ent->mtime < interval) {
+        return;
+    }
+    /* Don't issue another refresh while one is (probably) still in flight */
+    if (ent->reval_start && now - ent->reval_start < tmo) {
+        return;
+    }
+
+    rcmd = *cmd;
+    rcmd.cmdflags |= LCB_CMD_F_INTERNAL_CALLBACK;
+    if (lcb_get3(instance, &revalidate_callback, &rcmd) == LCB_SUCCESS) {
+        ent->reval_start = now;
+        cache->stats.revalidations++;
+    }
+}
+
+int
+lcb_kvcache_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
+{
+    lcb_KVCACHE *cache;
+    kvc_ENTRY *ent;
+    kvc_HIT *hit;
+    const void *hk;
+    lcb_SIZE nhk, nlkey;
+    int vbid, srvix;
+    hrtime_t now;
+    char lkey[KVC_MAXLKEY];
+
+    if (!LCB_KVCACHE_ENABLED(instance) || !LCBT_VBCONFIG(instance)) {
+        return 0;
+    }
+    if (cmd->lock || cmd->exptime || cmd->key.type != LCB_KV_COPY ||
+            (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) ||
+            cmd->key.contig.nbytes > KVC_MAXKEY) {
+        return 0;
+    }
+
+    cache = cache_get(instance);
+    mcreq_extract_hashkey(&cmd->key, &cmd->_hashkey,
+        sizeof(protocol_binary_request_header), &hk, &nhk);
+    lcbvb_map_key(LCBT_VBCONFIG(instance), hk, nhk, &vbid, &srvix);
+    nlkey = make_lkey(lkey, vbid,
+        cmd->key.contig.bytes, cmd->key.contig.nbytes);
+
+    ent = genhash_find(cache->ht, lkey, nlkey);
+    if (!ent || ent->tombstone) {
+        cache->stats.misses++;
+        return 0;
+    }
+
+    now = lcbio_now_fine(instance->iotable);
+    if (now - ent->mtime > LCB_US2NS(LCBT_SETTING(instance, kvcache_ttl))) {
+        cache->stats.expirations++;
+        cache->stats.misses++;
+        entry_unlink(cache, ent);
+        return 0;
+    }
+
+    cache->stats.hits++;
+    entry_touch(cache, ent);
+    hit = malloc(sizeof(*hit));
+    hit->ent = ent;
+    hit->cookie = cookie;
+    ent->refcount++;
+    lcb_list_append(&cache->staged, &hit->llnode);
+    maybe_revalidate(cache, ent, cmd, now);
+    return 1;
+}
+
+void
+lcb_kvcache_update(lcb_t instance, const mc_PACKET *request,
+                   const lcb_RESPGET *resp)
+{
+    lcb_KVCACHE *cache;
+    kvc_ENTRY *ent, *newent;
+    protocol_binary_request_header hdr;
+    lcb_SIZE nlkey, maxbytes = LCBT_SETTING(instance, kvcache_maxbytes);
+    char lkey[KVC_MAXLKEY];
+
+    if (!maxbytes) {
+        return;
+    }
+    if (!(nlkey = pkt_lkey(request, lkey, &hdr))) {
+        return;
+    }
+    /* The CAS of a locked item is only valid for the lock holder */
+    if (hdr.request.opcode == PROTOCOL_BINARY_CMD_GET_LOCKED) {
+        return;
+    }
+
+    cache = cache_get(instance);
+    ent = genhash_find(cache->ht, lkey, nlkey);
+
+    if (resp->rc != LCB_SUCCESS) {
+        if (ent && !ent->tombstone) {
+            if (resp->rc == LCB_KEY_ENOENT) {
+                entry_unlink(cache, ent);
+            } else {
+                ent->reval_start = 0;
+            }
+        }
+        return;
+    }
+
+    if (ent) {
+        if (ent->tombstone) {
+            if (MCREQ_PKT_RDATA(request)->start <= ent->mtime) {
+                /* Sent before the last mutation completed */
+                return;
+            }
+        } else if (ent->cas == resp->cas) {
+            /* Unchanged on the server */
+            ent->mtime = lcbio_now_fine(instance->iotable);
+            ent->reval_start = 0;
+            return;
+        }
+    }
+
+    if (sizeof(*ent) + nlkey + resp->nvalue > maxbytes / 8) {
+        if (ent) {
+            entry_unlink(cache, ent);
+        }
+        return;
+    }
+
+    newent = entry_new(lkey, nlkey, resp->value, resp->nvalue);
+    newent->cas = resp->cas;
+    newent->itmflags = resp->itmflags;
+    newent->datatype = resp->datatype;
+    newent->mtime = lcbio_now_fine(instance->iotable);
+    if (ent) {
+        entry_unlink(cache, ent);
+    }
+    entry_link(cache, newent);
+    cache->stats.stores++;
+    cache_trim(cache);
+}
+
+void
+lcb_kvcache_invalidate(lcb_t instance, const mc_PACKET *pkt)
+{
+    lcb_KVCACHE *cache;
+    kvc_ENTRY *ent;
+    protocol_binary_request_header hdr;
+    lcb_SIZE nlkey;
+    char lkey[KVC_MAXLKEY];
+
+    if (!LCB_KVCACHE_ENABLED(instance)) {
+        return;
+    }
+    if (!(nlkey = pkt_lkey(pkt, lkey, &hdr))) {
+        return;
+    }
+
+    cache = cache_get(instance);
+    ent = genhash_find(cache->ht, lkey, nlkey);
+    if (ent && ent->tombstone) {
+        ent->mtime = lcbio_now_fine(instance->iotable);
+        entry_touch(cache, ent);
+        return;
+    }
+    if (ent) {
+        cache->stats.invalidations++;
+        entry_unlink(cache, ent);
+    }
+
+    ent = entry_new(lkey, nlkey, NULL, 0);
+    ent->tombstone = 1;
+    ent->mtime = lcbio_now_fine(instance->iotable);
+    entry_link(cache, ent);
+    cache_trim(cache);
+}
+
+void
+lcb_kvcache_sched_leave(lcb_t instance)
+{
+    lcb_KVCACHE *cache = instance->kvcache;
+    lcb_list_t *ll;
+
+    if (!cache || LCB_LIST_IS_EMPTY(&cache->staged)) {
+        return;
+    }
+    while ((ll = lcb_list_shift(&cache->staged))) {
+        lcb_list_append(&cache->ready, ll);
+    }
+    if (!cache->loopref) {
+        cache->loopref = 1;
+        lcb_loop_ref(instance);
+    }
+    lcbio_async_signal(cache->timer);
+}
+
+void
+lcb_kvcache_sched_fail(lcb_t instance)
+{
+    if (instance->kvcache) {
+        free_hits(&instance->kvcache->staged);
+    }
+}
+
+static void
+deliver_hits(void *arg)
+{
+    lcb_KVCACHE *cache = arg;
+    lcb_t instance = cache->instance;
+    lcb_list_t *ll, hits;
+
+    /* Hits added by the callbacks themselves are delivered in the next
+     * iteration */
+    lcb_list_init(&hits);
+    while ((ll = lcb_list_shift(&cache->ready))) {
+        lcb_list_append(&hits, ll);
+    }
+
+    while ((ll = lcb_list_shift(&hits))) {
+        kvc_HIT *hit = LCB_LIST_ITEM(ll, kvc_HIT, llnode);
+        kvc_ENTRY *ent = hit->ent;
+        lcb_RESPGET resp = { 0 };
+
+        resp.cookie = (void *)hit->cookie;
+        resp.key = ent->key + 2;
+        resp.nkey = ent->nkey - 2;
+        resp.cas = ent->cas;
+        resp.rflags = LCB_RESP_F_CACHED;
+        resp.value = ent->value;
+        resp.nvalue = ent->nvalue;
+        resp.itmflags = ent->itmflags;
+        resp.datatype = ent->datatype;
+        lcb_find_callback(instance, LCB_CALLBACK_GET)(
+            instance, LCB_CALLBACK_GET, (lcb_RESPBASE *)&resp);
+        entry_unref(ent);
+        free(hit);
+    }
+
+    if (LCB_LIST_IS_EMPTY(&cache->ready) && cache->loopref) {
+        cache->loopref = 0;
+        lcb_loop_unref(instance);
+    }
+}
+
+void
+lcb_kvcache_trim(lcb_t instance)
+{
+    if (instance->kvcache) {
+        cache_trim(instance->kvcache);
+    }
+}
+
+void
+lcb_kvcache_stats(lcb_t instance, lcb_KVCACHESTATS *stats)
+{
+    if (instance->kvcache) {
+        *stats = instance->kvcache->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void
+lcb_kvcache_dump(const lcb_KVCACHE *cache, FILE *fp)
+{
+    const lcb_KVCACHESTATS *st = &cache->stats;
+    fprintf(fp, "** ITEMS: %lu (%lu bytes including markers)\n",
+        (unsigned long)st->nitems, (unsigned long)st->nbytes);
+    fprintf(fp, "** HITS: %lu, MISSES: %lu, STORES: %lu\n",
+        (unsigned long)st->hits, (unsigned long)st->misses,
+        (unsigned long)st->stores);
+    fprintf(fp, "** INVALIDATED: %lu, EXPIRED: %lu, EVICTED: %lu, REVALIDATED: %lu\n",
+        (unsigned long)st->invalidations, (unsigned long)st->expirations,
+        (unsigned long)st->evictions, (unsigned long)st->revalidations);
+    fprintf(fp, "** PENDING HITS: %s\n",
+        LCB_LIST_IS_EMPTY(&cache->ready) ? "No" : "Yes");
+}
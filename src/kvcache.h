@@ -0,0 +1,136 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_KVCACHE_H
+#define LCB_KVCACHE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <mc/mcreq.h>
+
+/**
+ * @file
+ * @brief Client-side item cache
+ *
+ * @defgroup lcb-kvcache Item Cache
+ *
+ * @details
+ * Optional LRU cache of items retrieved by lcb_get3(). Items are keyed by
+ * their vBucket and key, and are populated from successful GET responses.
+ * A plain GET for a cached item is answered from the cache without
+ * contacting the server; the response is delivered asynchronously, once
+ * the scheduling context has been left (see lcb_sched_leave()).
+ *
+ * Items are removed when a mutation (store, remove, counter or touch) is
+ * scheduled for the key and again when its response arrives, and expire
+ * after @ref LCB_CNTL_KVCACHE_TTL. When the entry is removed a small
+ * marker takes its place, so that a GET response which was requested before
+ * the mutation completed does not repopulate the cache with the old value.
+ *
+ * The cache is created on demand and is only consulted when
+ * lcb_settings::kvcache_maxbytes is nonzero.
+ *
+ * @addtogroup lcb-kvcache
+ * @{
+ */
+
+typedef struct lcb_KVCACHE_st lcb_KVCACHE;
+
+/** Whether the item cache is enabled for the instance */
+#define LCB_KVCACHE_ENABLED(instance) \
+    (LCBT_SETTING(instance, kvcache_maxbytes) != 0)
+
+/**
+ * Destroy the cache. Pending cache hits are discarded without invoking
+ * their callbacks.
+ */
+void
+lcb_kvcache_destroy(lcb_KVCACHE *cache);
+
+/**
+ * Attempt to satisfy a GET command from the cache. Only plain GETs (i.e. with
+ * no lock or expiry) are eligible.
+ *
+ * @param instance
+ * @param cookie the user's cookie
+ * @param cmd the command
+ * @return nonzero if the item was found, in which case a response will be
+ * delivered for it once the scheduling context is left. If zero, the command
+ * should be sent to the server.
+ */
+int
+lcb_kvcache_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd);
+
+/**
+ * Update the cache with the response to a GET request.
+ * @param instance
+ * @param request the original request packet
+ * @param resp the response. A successful response (re)populates the entry,
+ *        an LCB_KEY_ENOENT response removes it.
+ */
+void
+lcb_kvcache_update(lcb_t instance, const mc_PACKET *request,
+                   const lcb_RESPGET *resp);
+
+/**
+ * Remove the entry for the key of the given packet. This should be called
+ * when a mutation is scheduled, and again when its response is received.
+ */
+void
+lcb_kvcache_invalidate(lcb_t instance, const mc_PACKET *pkt);
+
+/**
+ * Called when the scheduling context is left (lcb_sched_leave()). Hits
+ * found within the context are scheduled for delivery
+ */
+void
+lcb_kvcache_sched_leave(lcb_t instance);
+
+/**
+ * Called when the scheduling context is aborted (lcb_sched_fail()). Hits
+ * found within the context are discarded.
+ */
+void
+lcb_kvcache_sched_fail(lcb_t instance);
+
+/**
+ * Evict items until the cache fits its current size limit. Called when the
+ * limit is changed.
+ */
+void
+lcb_kvcache_trim(lcb_t instance);
+
+/**
+ * Retrieve the cache's counters
+ * @param instance
+ * @param[out] stats the counters. These are zero if the cache has never
+ *        been used
+ */
+void
+lcb_kvcache_stats(lcb_t instance, lcb_KVCACHESTATS *stats);
+
+void
+lcb_kvcache_dump(const lcb_KVCACHE *cache, FILE *fp);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
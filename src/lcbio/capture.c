@@ -0,0 +1,154 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "capture.h"
+#include <stdio.h>
+
+/* Records are small and frequent; let stdio batch them */
+#define CAPTURE_BUFSIZE 65536
+
+struct lcbio_CAPTURE {
+    FILE *fp;
+    char *path;
+    char *buf; /**< stdio buffer */
+    hrtime_t last; /**< Time of the previous record */
+    unsigned nconns; /**< Connection IDs handed out so far */
+    unsigned refcount;
+};
+
+lcbio_CAPTURE *
+lcbio_capture_new(const char *path)
+{
+    lcbio_CAPTURE *cap;
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        return NULL;
+    }
+
+    cap = calloc(1, sizeof(*cap));
+    cap->fp = fp;
+    cap->path = strdup(path);
+    cap->refcount = 1;
+    if ((cap->buf = malloc(CAPTURE_BUFSIZE))) {
+        setvbuf(fp, cap->buf, _IOFBF, CAPTURE_BUFSIZE);
+    }
+    fwrite(LCBIO_CAPTURE_MAGIC, 1, sizeof(LCBIO_CAPTURE_MAGIC) - 1, fp);
+    cap->last = gethrtime();
+    return cap;
+}
+
+void
+lcbio_capture_ref(lcbio_CAPTURE *cap)
+{
+    cap->refcount++;
+}
+
+void
+lcbio_capture_stop(lcbio_CAPTURE *cap)
+{
+    if (cap->fp) {
+        fclose(cap->fp);
+        cap->fp = NULL;
+    }
+}
+
+void
+lcbio_capture_unref(lcbio_CAPTURE *cap)
+{
+    if (--cap->refcount) {
+        return;
+    }
+    lcbio_capture_stop(cap);
+    free(cap->buf);
+    free(cap->path);
+    free(cap);
+}
+
+const char *
+lcbio_capture_path(const lcbio_CAPTURE *cap)
+{
+    return cap->path;
+}
+
+static void
+put_varint(FILE *fp, lcb_U64 value)
+{
+    unsigned char buf[10];
+    unsigned n = 0;
+    do {
+        buf[n] = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            buf[n] |= 0x80;
+        }
+        n++;
+    } while (value);
+    fwrite(buf, 1, n, fp);
+}
+
+static void
+put_header(lcbio_CAPTURE *cap, unsigned connid, lcbio_CAPTURETYPE type,
+    unsigned nbytes)
+{
+    hrtime_t now = gethrtime();
+    lcb_U64 elapsed = now > cap->last ? (now - cap->last) / 1000 : 0;
+
+    /* Only advance by whole microseconds, so that rounding doesn't add up */
+    cap->last += elapsed * 1000;
+    put_varint(cap->fp, elapsed);
+    put_varint(cap->fp, ((lcb_U64)connid << 2) | type);
+    put_varint(cap->fp, nbytes);
+}
+
+unsigned
+lcbio_capture_open(lcbio_CAPTURE *cap, const char *host, const char *port)
+{
+    unsigned connid = cap->nconns++;
+    if (cap->fp) {
+        size_t nhost = strlen(host), nport = strlen(port);
+        put_header(cap, connid, LCBIO_CAPTURE_OPEN, nhost + 1 + nport);
+        fwrite(host, 1, nhost, cap->fp);
+        fputc(':', cap->fp);
+        fwrite(port, 1, nport, cap->fp);
+    }
+    return connid;
+}
+
+void
+lcbio_capture_data(lcbio_CAPTURE *cap, unsigned connid,
+    lcbio_CAPTURETYPE type, const lcb_IOV *iov, unsigned niov, unsigned nbytes)
+{
+    unsigned ii;
+    if (!cap->fp || !nbytes) {
+        return;
+    }
+    put_header(cap, connid, type, nbytes);
+    for (ii = 0; ii < niov && nbytes; ii++) {
+        unsigned n = iov[ii].iov_len < nbytes ? (unsigned)iov[ii].iov_len : nbytes;
+        fwrite(iov[ii].iov_base, 1, n, cap->fp);
+        nbytes -= n;
+    }
+}
+
+void
+lcbio_capture_close(lcbio_CAPTURE *cap, unsigned connid)
+{
+    if (cap->fp) {
+        put_header(cap, connid, LCBIO_CAPTURE_CLOSE, 0);
+    }
+}
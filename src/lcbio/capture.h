@@ -0,0 +1,129 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_CAPTURE_H
+#define LCBIO_CAPTURE_H
+#include <libcouchbase/couchbase.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Traffic capture
+ */
+
+/**
+ * @ingroup lcbio
+ * @defgroup lcbio-capture Traffic Capture
+ *
+ * @details
+ * Records the bytes sent and received by contexts (see lcbio_ctx_capture())
+ * into a file, so that the requests can later be replayed (see
+ * `cbc-replay`). Data is recorded as seen by the context, i.e. after any
+ * decryption.
+ *
+ * The file starts with the 8 bytes of @ref LCBIO_CAPTURE_MAGIC, followed by
+ * records. All numbers are unsigned LEB128 varints (7 bits per byte, least
+ * significant group first, high bit set on all bytes but the last). Each
+ * record is:
+ *
+ * - the time since the previous record (or since the file was opened), in
+ *   microseconds
+ * - the connection ID shifted left by 2, ORed with the record type (see
+ *   lcbio_CAPTURETYPE)
+ * - the length of the payload
+ * - the payload
+ *
+ * Connection IDs are assigned in the order connections are opened, from 0.
+ *
+ * @addtogroup lcbio-capture
+ * @{
+ */
+
+#define LCBIO_CAPTURE_MAGIC "LCBCAP01"
+
+typedef enum {
+    /** Connection opened. The payload is the endpoint, as `host:port` */
+    LCBIO_CAPTURE_OPEN = 0,
+    /** The payload was sent */
+    LCBIO_CAPTURE_SEND = 1,
+    /** The payload was received */
+    LCBIO_CAPTURE_RECV = 2,
+    /** Connection closed. There is no payload */
+    LCBIO_CAPTURE_CLOSE = 3
+} lcbio_CAPTURETYPE;
+
+typedef struct lcbio_CAPTURE lcbio_CAPTURE;
+
+/**
+ * Create (or truncate) a capture file
+ * @param path the file to write
+ * @return the capture, or NULL if the file could not be opened. Release with
+ * lcbio_capture_unref()
+ */
+lcbio_CAPTURE *
+lcbio_capture_new(const char *path);
+
+void
+lcbio_capture_ref(lcbio_CAPTURE *cap);
+
+void
+lcbio_capture_unref(lcbio_CAPTURE *cap);
+
+/**
+ * Stop recording and close the file, even if contexts still refer to the
+ * capture.
+ */
+void
+lcbio_capture_stop(lcbio_CAPTURE *cap);
+
+/** @return the path of the capture file */
+const char *
+lcbio_capture_path(const lcbio_CAPTURE *cap);
+
+/**
+ * Record a new connection
+ * @return the ID of the connection, for the other calls
+ */
+unsigned
+lcbio_capture_open(lcbio_CAPTURE *cap, const char *host, const char *port);
+
+/**
+ * Record data sent or received
+ * @param cap the capture
+ * @param connid the connection, from lcbio_capture_open()
+ * @param type @ref LCBIO_CAPTURE_SEND or @ref LCBIO_CAPTURE_RECV
+ * @param iov the buffers holding the data
+ * @param niov the number of buffers
+ * @param nbytes the number of bytes to record, which may be less than the
+ * total size of the buffers
+ */
+void
+lcbio_capture_data(lcbio_CAPTURE *cap, unsigned connid,
+    lcbio_CAPTURETYPE type, const lcb_IOV *iov, unsigned niov, unsigned nbytes);
+
+void
+lcbio_capture_close(lcbio_CAPTURE *cap, unsigned connid);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -21,6 +21,7 @@
 #include "iotable.h"
 #include "settings.h"
 #include "timer-ng.h"
+#include "faults.h"
 #include <errno.h>
 
 /* win32 lacks EAI_SYSTEM */
@@ -416,19 +417,23 @@ lcbio_connect(lcbio_TABLE *iot, lcb_settings *settings, lcb_host_t *dest,
     ret = calloc(1, sizeof(*ret));
 
     /** Initialize the socket first */
-    s->io = iot;
+    if (settings->faults) {
+        s->io = lcbio_faults_wrap(settings->faults, iot, dest);
+    } else {
+        s->io = iot;
+        lcbio_table_ref(s->io);
+    }
     s->settings = settings;
     s->ctx = ret;
     s->refcount = 1;
     s->info = calloc(1, sizeof(*s->info));
     s->info->ep = *dest;
-    lcbio_table_ref(s->io);
     lcb_settings_ref(s->settings);
     lcb_list_init(&s->protos);
 
     if (IOT_IS_EVENT(iot)) {
         s->u.fd = INVALID_SOCKET;
-        ret->event = IOT_V0EV(iot).create(IOT_ARG(iot));
+        ret->event = IOT_V0EV(s->io).create(IOT_ARG(s->io));
     }
 
     /** Initialize the connstart structure */
@@ -336,6 +336,28 @@ lcbio_table_unref(lcbio_pTABLE iot);
 void
 lcbio_table_ref(lcbio_pTABLE iot);
 
+/**
+ * Get the current time, in nanoseconds, for coarse needs such as timeouts and
+ * retry scheduling. By default this reads the system's monotonic clock
+ * (gethrtime()), but the table's clock flags (see @ref LCB_CNTL_CLOCK) may
+ * make it cheaper:
+ *
+ * - With LCB_CLOCK_F_TSC, the time is derived from the CPU's timestamp
+ *   counter, calibrated against the monotonic clock.
+ * - With LCB_CLOCK_F_CACHED, the clock is read once per event handler (see
+ *   LCBIO_CLOCK_ENTER()) and the same time is returned for the rest of it.
+ *   Outside of handlers the clock is always read.
+ */
+lcb_U64
+lcbio_now(lcbio_pTABLE iot);
+
+/**
+ * Get the current time for latency measurements. This is like lcbio_now(),
+ * but is never cached.
+ */
+lcb_U64
+lcbio_now_fine(lcbio_pTABLE iot);
+
 /** @}*/
 
 /** @name IO Status Codes
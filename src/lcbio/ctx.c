@@ -19,12 +19,18 @@
 #include "iotable.h"
 #include "timer-ng.h"
 #include "ioutils.h"
+#include "capture.h"
 #include <stdio.h>
 #include <lcbio/ssl.h>
 
 #define CTX_FD(ctx) (ctx)->fd
 #define CTX_SD(ctx) (ctx)->sd
 #define CTX_IOT(ctx) (ctx)->io
+#define CTX_CAPTURE(ctx, type, iov, niov, nb) do { \
+    if ((ctx)->capture) { \
+        lcbio_capture_data((ctx)->capture, (ctx)->capid, type, iov, niov, nb); \
+    } \
+} while (0)
 #include "rw-inl.h"
 
 #define LOGARGS(c, lvl) (c)->sock->settings, "ioctx", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -147,6 +153,12 @@ lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg,
         ctx->as_err = NULL;
     }
 
+    if (ctx->capture) {
+        lcbio_capture_close(ctx->capture, ctx->capid);
+        lcbio_capture_unref(ctx->capture);
+        ctx->capture = NULL;
+    }
+
     oldrc = ctx->sock->refcount;
     lcb_log(LOGARGS(ctx, DEBUG), CTX_LOGFMT "Destroying. PND=%d,ENT=%d,SORC=%d", CTX_LOGID(ctx), (int)ctx->npending, (int)ctx->entered, oldrc);
 
@@ -368,6 +380,12 @@ Cr_handler(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
     if (ctx->state == ES_ACTIVE) {
         if (nr > 0) {
             unsigned total;
+            if (ctx->capture) {
+                /* Same buffers as were handed to read2() */
+                lcb_IOV iov[RWINL_IOVSIZE];
+                unsigned niov = rdb_rdstart(&ctx->ior, (nb_IOV *)iov, RWINL_IOVSIZE);
+                CTX_CAPTURE(ctx, LCBIO_CAPTURE_RECV, iov, niov, nr);
+            }
             rdb_rdend(&ctx->ior, nr);
             total = rdb_get_nused(&ctx->ior);
             if (total >= ctx->rdwant) {
@@ -407,6 +425,7 @@ C_schedule(lcbio_CTX *ctx)
             lcbio_ctx_senderr(ctx, convert_lcberr(ctx, LCBIO_IOERR));
             return;
         } else {
+            CTX_CAPTURE(ctx, LCBIO_CAPTURE_SEND, iov, niov, ctx->output->rb.nbytes);
             ctx->output = NULL;
             ctx->npending++;
         }
@@ -486,6 +505,7 @@ E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
     nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov,
         niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
     if (nw > 0) {
+        CTX_CAPTURE(ctx, LCBIO_CAPTURE_SEND, iov, niov, (unsigned)nw);
         ctx->procs.cb_flush_done(ctx, nb, nw);
         return 1;
 
@@ -548,6 +568,7 @@ C_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
         lcbio_ctx_senderr(ctx, lcbio_mklcberr(saverr, ctx->sock->settings));
         return 0;
     } else {
+        CTX_CAPTURE(ctx, LCBIO_CAPTURE_SEND, iov, niov, nb);
         ctx->npending++;
         return 1;
     }
@@ -605,3 +626,16 @@ lcbio_ctx_dump(lcbio_CTX *ctx, FILE *fp)
     fprintf(fp, "    WILL DUMP IOR/READBUF INFO:\n");
     rdb_dump(&ctx->ior, fp);
 }
+
+void
+lcbio_ctx_capture(lcbio_CTX *ctx, lcbio_CAPTURE *capture)
+{
+    const lcb_host_t *host = get_ctx_host(ctx);
+    if (ctx->capture) {
+        lcbio_capture_close(ctx->capture, ctx->capid);
+        lcbio_capture_unref(ctx->capture);
+    }
+    lcbio_capture_ref(capture);
+    ctx->capture = capture;
+    ctx->capid = lcbio_capture_open(capture, host->host, host->port);
+}
@@ -149,6 +149,8 @@ typedef struct lcbio_CTX {
     lcbio_pASYNC as_err; /**< async error handler */
     lcbio_CTXPROCS procs; /**< callbacks */
     const char *subsys; /**< Informational description of connection */
+    struct lcbio_CAPTURE *capture; /**< see lcbio_ctx_capture() */
+    unsigned capid; /**< connection ID within #capture */
 } lcbio_CTX;
 
 /**@name Creating and Closing
@@ -220,6 +222,14 @@ lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *cbarg,
 void
 lcbio_ctx_dump(lcbio_CTX *ctx, FILE *fp);
 
+/**
+ * Record everything sent and received on the context from now on
+ * @param ctx the context
+ * @param capture the capture to write to, see @ref lcbio-capture
+ */
+void
+lcbio_ctx_capture(lcbio_CTX *ctx, struct lcbio_CAPTURE *capture);
+
 /**@}*/
 
 /** Asynchronously trigger the error callback */
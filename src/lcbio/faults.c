@@ -0,0 +1,692 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "faults.h"
+#include "settings.h"
+#include "iotable.h"
+#include "timer-ng.h"
+#include <errno.h>
+
+/** A rule from the script */
+typedef struct {
+    char *host; /**< Host to match, or NULL for any */
+    unsigned port; /**< Port to match, or 0 for any */
+    lcb_U32 latency; /**< Microseconds */
+    lcb_U32 jitter; /**< Microseconds */
+    lcb_U32 bandwidth; /**< Bytes per second, or 0 for unlimited */
+    lcb_U32 stall_time; /**< Microseconds */
+    float partial;
+    float stall;
+    float reset;
+} faults_RULE;
+
+struct lcbio_FAULTS {
+    char *script;
+    faults_RULE *rules;
+    unsigned nrules;
+    lcb_U64 seed;
+    unsigned nwrapped; /**< Connections wrapped so far */
+    unsigned refcount; /**< One for the settings, one for each table */
+    lcbio_FAULTSTATS stats;
+};
+
+enum { DIR_RX, DIR_TX };
+
+/** Table used by a single connection */
+typedef struct {
+    lcbio_TABLE base_; /**< Base table structure to export */
+    lcbio_pTABLE orig; /**< Table pointer we are wrapping */
+    struct lcb_io_opt_st iops_; /**< Dummy IOPS structure exposed to LCB */
+    lcbio_FAULTS *parent;
+    const faults_RULE *rule;
+    lcb_U64 rng;
+    hrtime_t blocked_until; /**< No I/O until then (stalled or throttled) */
+    int reset; /**< Whether the connection was reset */
+    int connecting; /**< Whether connect0() was already called */
+    double tokens[2]; /**< Bandwidth available in each direction */
+    hrtime_t refilled[2]; /**< When #tokens was last updated */
+
+    /* The user's watcher */
+    lcb_socket_t fd;
+    void *event;
+    short requested; /**< Events the user is waiting for */
+    short pending; /**< Events held back for #deliver */
+    void *arg;
+    lcb_ioE_callback ucb;
+    lcbio_pTIMER deliver;
+} lcbio_FAULTIO;
+
+#define FIO_FROM_IOPS(iops) (lcbio_FAULTIO *)(iops)->v.v0.cookie
+#define FIO_ERRNO(fio) (fio)->iops_.v.v0.error
+#define FIO_IOVMAX 32
+
+/* The script may not be longer than this */
+#define SCRIPT_MAXLEN 4096
+
+static lcb_U64
+splitmix(lcb_U64 *state)
+{
+    lcb_U64 z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/** Whether an event of probability `p` happens */
+static int
+roll(lcbio_FAULTIO *fio, float p)
+{
+    if (p <= 0) {
+        return 0;
+    }
+    return (splitmix(&fio->rng) >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+static int
+parse_number(const char *s, double max, double *out)
+{
+    char *end;
+    double d = strtod(s, &end);
+    if (end == s || *end || d < 0 || d > max) {
+        return -1;
+    }
+    *out = d;
+    return 0;
+}
+
+static int
+parse_directive(lcbio_FAULTS *faults, faults_RULE *rule, char *directive)
+{
+    char *value = strchr(directive, '=');
+    double d;
+
+    if (!value) {
+        return -1;
+    }
+    *(value++) = '\0';
+
+    if (!strcmp(directive, "host")) {
+        free(rule->host);
+        rule->host = strdup(value);
+        return 0;
+    } else if (!strcmp(directive, "seed")) {
+        char *end;
+        faults->seed = strtoul(value, &end, 10);
+        return *value && !*end ? 0 : -1;
+    }
+
+    if (!strcmp(directive, "partial") || !strcmp(directive, "stall") ||
+            !strcmp(directive, "reset")) {
+        if (parse_number(value, 1, &d) != 0) {
+            return -1;
+        }
+        if (directive[0] == 'p') {
+            rule->partial = (float)d;
+        } else if (directive[0] == 's') {
+            rule->stall = (float)d;
+        } else {
+            rule->reset = (float)d;
+        }
+        return 0;
+    }
+
+    if (parse_number(value, 4000000, &d) != 0) {
+        return -1;
+    }
+    if (!strcmp(directive, "port")) {
+        rule->port = (unsigned)d;
+    } else if (!strcmp(directive, "bandwidth")) {
+        rule->bandwidth = (lcb_U32)d;
+    } else if (!strcmp(directive, "latency")) {
+        rule->latency = (lcb_U32)(d * 1000);
+    } else if (!strcmp(directive, "jitter")) {
+        rule->jitter = (lcb_U32)(d * 1000);
+    } else if (!strcmp(directive, "stall_time")) {
+        rule->stall_time = (lcb_U32)(d * 1000);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+lcbio_FAULTS *
+lcbio_faults_new(const char *script)
+{
+    lcbio_FAULTS *faults;
+    char *buf, *rulestr, *rulenext;
+
+    if (strlen(script) > SCRIPT_MAXLEN) {
+        return NULL;
+    }
+
+    faults = calloc(1, sizeof(*faults));
+    faults->script = strdup(script);
+    faults->seed = 1;
+    faults->refcount = 1;
+    buf = strdup(script);
+
+    for (rulestr = buf; rulestr; rulestr = rulenext) {
+        faults_RULE *rule;
+        char *directive, *dirnext;
+
+        if ((rulenext = strchr(rulestr, ';'))) {
+            *(rulenext++) = '\0';
+        }
+        if (!*rulestr) {
+            continue;
+        }
+
+        faults->rules = realloc(faults->rules,
+            sizeof(*faults->rules) * (faults->nrules + 1));
+        rule = faults->rules + faults->nrules++;
+        memset(rule, 0, sizeof(*rule));
+        rule->stall_time = 1000000;
+
+        for (directive = rulestr; directive; directive = dirnext) {
+            if ((dirnext = strchr(directive, ','))) {
+                *(dirnext++) = '\0';
+            }
+            if (parse_directive(faults, rule, directive) != 0) {
+                free(buf);
+                lcbio_faults_unref(faults);
+                return NULL;
+            }
+        }
+    }
+
+    free(buf);
+    return faults;
+}
+
+void
+lcbio_faults_unref(lcbio_FAULTS *faults)
+{
+    unsigned ii;
+    if (--faults->refcount) {
+        return;
+    }
+    for (ii = 0; ii < faults->nrules; ii++) {
+        free(faults->rules[ii].host);
+    }
+    free(faults->rules);
+    free(faults->script);
+    free(faults);
+}
+
+const char *
+lcbio_faults_script(const lcbio_FAULTS *faults)
+{
+    return faults->script;
+}
+
+void
+lcbio_faults_stats(const lcbio_FAULTS *faults, lcbio_FAULTSTATS *stats)
+{
+    *stats = faults->stats;
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Fault Checks                                                             **
+ ******************************************************************************
+ ******************************************************************************/
+
+/**
+ * Decide how much of a read or write of `n` bytes may go through
+ * @return the number of bytes, or -1 (with the error set) if the operation is
+ * to fail
+ */
+static lcb_SSIZE
+admit(lcbio_FAULTIO *fio, int dir, lcb_SIZE n)
+{
+    const faults_RULE *rule = fio->rule;
+    hrtime_t now;
+
+    if (fio->reset) {
+        FIO_ERRNO(fio) = ECONNRESET;
+        return -1;
+    }
+
+    now = lcbio_now(fio->orig);
+    if (now < fio->blocked_until) {
+        FIO_ERRNO(fio) = EWOULDBLOCK;
+        return -1;
+    }
+
+    if (roll(fio, rule->reset)) {
+        fio->reset = 1;
+        fio->parent->stats.nresets++;
+        FIO_ERRNO(fio) = ECONNRESET;
+        return -1;
+    }
+
+    if (roll(fio, rule->stall)) {
+        fio->blocked_until = now + LCB_US2NS(rule->stall_time);
+        fio->parent->stats.nstalls++;
+        FIO_ERRNO(fio) = EWOULDBLOCK;
+        return -1;
+    }
+
+    if (rule->bandwidth) {
+        /* Token bucket holding up to 100ms worth of data */
+        double burst = rule->bandwidth / 10.0 > 1 ? rule->bandwidth / 10.0 : 1;
+        double *tokens = &fio->tokens[dir];
+
+        *tokens += (double)(now - fio->refilled[dir]) * rule->bandwidth / 1e9;
+        if (*tokens > burst) {
+            *tokens = burst;
+        }
+        fio->refilled[dir] = now;
+
+        if (*tokens < 1) {
+            /* Wait until at least a millisecond's worth is available */
+            double want = rule->bandwidth / 1000.0;
+            if (want > n) {
+                want = (double)n;
+            }
+            if (want > burst) {
+                want = burst;
+            }
+            if (want < 1) {
+                want = 1;
+            }
+            fio->blocked_until = now +
+                    (hrtime_t)((want - *tokens) * 1e9 / rule->bandwidth);
+            fio->parent->stats.nthrottled++;
+            FIO_ERRNO(fio) = EWOULDBLOCK;
+            return -1;
+        }
+        if (n > *tokens) {
+            n = (lcb_SIZE)*tokens;
+        }
+    }
+
+    if (n > 1 && roll(fio, rule->partial)) {
+        n = 1 + (lcb_SIZE)(splitmix(&fio->rng) % (n - 1));
+        fio->parent->stats.npartial++;
+    }
+    return (lcb_SSIZE)n;
+}
+
+/** Account for the result of a read or write which was let through */
+static lcb_SSIZE
+complete(lcbio_FAULTIO *fio, int dir, lcb_SSIZE rv)
+{
+    if (rv == -1) {
+        FIO_ERRNO(fio) = IOT_ERRNO(fio->orig);
+    } else if (fio->rule->bandwidth) {
+        fio->tokens[dir] -= rv;
+    }
+    return rv;
+}
+
+/** Copy the first `n` bytes' worth of an IOV array */
+static unsigned
+clip_iov(const lcb_IOV *iov, lcb_SIZE niov, lcb_SIZE n, lcb_IOV *out)
+{
+    unsigned ii;
+    for (ii = 0; ii < niov && ii < FIO_IOVMAX && n; ii++) {
+        out[ii] = iov[ii];
+        if (out[ii].iov_len > n) {
+            out[ii].iov_len = n;
+        }
+        n -= out[ii].iov_len;
+    }
+    return ii;
+}
+
+static lcb_SIZE
+iov_size(const lcb_IOV *iov, lcb_SIZE niov)
+{
+    lcb_SIZE ii, ret = 0;
+    for (ii = 0; ii < niov; ii++) {
+        ret += iov[ii].iov_len;
+    }
+    return ret;
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Socket Routines                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+
+static lcb_SSIZE
+Efault_recv(lcb_io_opt_t iops, lcb_socket_t sock, void *buf, lcb_SIZE nbuf,
+            int flags)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcb_SSIZE n = admit(fio, DIR_RX, nbuf);
+    if (n == -1) {
+        return -1;
+    }
+    return complete(fio, DIR_RX, IOT_V0IO(fio->orig).recv(
+        IOT_ARG(fio->orig), sock, buf, n, flags));
+}
+
+static lcb_SSIZE
+Efault_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf,
+            lcb_SIZE nbuf, int flags)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcb_SSIZE n = admit(fio, DIR_TX, nbuf);
+    if (n == -1) {
+        return -1;
+    }
+    return complete(fio, DIR_TX, IOT_V0IO(fio->orig).send(
+        IOT_ARG(fio->orig), sock, buf, n, flags));
+}
+
+static lcb_SSIZE
+Efault_recvv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov,
+             lcb_SIZE niov)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcb_IOV clipped[FIO_IOVMAX];
+    lcb_SSIZE n = admit(fio, DIR_RX, iov_size(iov, niov));
+    if (n == -1) {
+        return -1;
+    }
+    niov = clip_iov(iov, niov, n, clipped);
+    return complete(fio, DIR_RX, IOT_V0IO(fio->orig).recvv(
+        IOT_ARG(fio->orig), sock, clipped, niov));
+}
+
+static lcb_SSIZE
+Efault_sendv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov,
+             lcb_SIZE niov)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcb_IOV clipped[FIO_IOVMAX];
+    lcb_SSIZE n = admit(fio, DIR_TX, iov_size(iov, niov));
+    if (n == -1) {
+        return -1;
+    }
+    niov = clip_iov(iov, niov, n, clipped);
+    return complete(fio, DIR_TX, IOT_V0IO(fio->orig).sendv(
+        IOT_ARG(fio->orig), sock, clipped, niov));
+}
+
+static lcb_socket_t
+Efault_socket(lcb_io_opt_t iops, int domain, int type, int protocol)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcb_socket_t ret = IOT_V0IO(fio->orig).socket0(
+        IOT_ARG(fio->orig), domain, type, protocol);
+    FIO_ERRNO(fio) = IOT_ERRNO(fio->orig);
+    return ret;
+}
+
+static int
+Efault_connect(lcb_io_opt_t iops, lcb_socket_t sock,
+               const struct sockaddr *dst, unsigned int addrlen)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    int rv;
+
+    /* Only the first call starts the connection; later ones check on it */
+    if (!fio->connecting) {
+        fio->connecting = 1;
+        if (roll(fio, fio->rule->reset)) {
+            fio->parent->stats.nresets++;
+            FIO_ERRNO(fio) = ECONNREFUSED;
+            return -1;
+        }
+    }
+    rv = IOT_V0IO(fio->orig).connect0(IOT_ARG(fio->orig), sock, dst, addrlen);
+    FIO_ERRNO(fio) = IOT_ERRNO(fio->orig);
+    return rv;
+}
+
+static void
+Efault_close(lcb_io_opt_t iops, lcb_socket_t sock)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    lcbio_timer_disarm(fio->deliver);
+    fio->requested = fio->pending = 0;
+    /* A new socket may be created if the next address is tried */
+    fio->connecting = 0;
+    IOT_V0IO(fio->orig).close(IOT_ARG(fio->orig), sock);
+}
+
+static int
+Efault_is_closed(lcb_io_opt_t iops, lcb_socket_t sock, int flags)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    return IOT_V0IO(fio->orig).is_closed(IOT_ARG(fio->orig), sock, flags);
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Event Routines                                                           **
+ ******************************************************************************
+ ******************************************************************************/
+
+/**
+ * Invoked by the original table when the socket is ready. If the rule calls
+ * for a delay, the watcher is suspended and the events are held back until
+ * deliver_pending() runs.
+ */
+static void
+ready_handler(lcb_socket_t sock, short which, void *arg)
+{
+    lcbio_FAULTIO *fio = arg;
+    const faults_RULE *rule = fio->rule;
+    lcb_U32 delay = rule->latency;
+    hrtime_t now = lcbio_now(fio->orig);
+
+    if (rule->jitter) {
+        delay += (lcb_U32)(splitmix(&fio->rng) % (rule->jitter + 1));
+    }
+    if (fio->blocked_until > now) {
+        lcb_U32 blocked = (lcb_U32)LCB_NS2US(fio->blocked_until - now) + 1;
+        if (blocked > delay) {
+            delay = blocked;
+        }
+    }
+    if (!delay) {
+        fio->ucb(sock, which, fio->arg);
+        return;
+    }
+
+    IOT_V0EV(fio->orig).cancel(IOT_ARG(fio->orig), sock, fio->event);
+    fio->pending |= which;
+    fio->parent->stats.ndelayed++;
+    lcbio_timer_rearm(fio->deliver, delay);
+}
+
+static void
+deliver_pending(void *arg)
+{
+    lcbio_FAULTIO *fio = arg;
+    short which = fio->pending & (fio->requested | LCB_ERROR_EVENT);
+
+    fio->pending = 0;
+    if (fio->requested) {
+        IOT_V0EV(fio->orig).watch(IOT_ARG(fio->orig), fio->fd, fio->event,
+            fio->requested, fio, ready_handler);
+    }
+    if (which) {
+        /* May close the socket, or release the table */
+        fio->ucb(fio->fd, which, fio->arg);
+    }
+}
+
+static void *
+Efault_create_event(lcb_io_opt_t iops)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    return IOT_V0EV(fio->orig).create(IOT_ARG(fio->orig));
+}
+
+static void
+Efault_destroy_event(lcb_io_opt_t iops, void *event)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    if (event == fio->event) {
+        fio->event = NULL;
+    }
+    IOT_V0EV(fio->orig).destroy(IOT_ARG(fio->orig), event);
+}
+
+static int
+Efault_watch(lcb_io_opt_t iops, lcb_socket_t sock, void *event, short flags,
+             void *arg, lcb_ioE_callback cb)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+
+    fio->fd = sock;
+    fio->event = event;
+    fio->requested = flags;
+    fio->arg = arg;
+    fio->ucb = cb;
+
+    if (lcbio_timer_armed(fio->deliver)) {
+        /* Resumed by deliver_pending() */
+        return 0;
+    }
+    return IOT_V0EV(fio->orig).watch(
+        IOT_ARG(fio->orig), sock, event, flags, fio, ready_handler);
+}
+
+static void
+Efault_cancel(lcb_io_opt_t iops, lcb_socket_t sock, void *event)
+{
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(iops);
+    if (event == fio->event) {
+        lcbio_timer_disarm(fio->deliver);
+        fio->requested = fio->pending = 0;
+    }
+    IOT_V0EV(fio->orig).cancel(IOT_ARG(fio->orig), sock, event);
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Table Routines                                                           **
+ ******************************************************************************
+ ******************************************************************************/
+
+static void loop_run(lcb_io_opt_t io) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    IOT_START(fio->orig);
+}
+static void loop_stop(lcb_io_opt_t io) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    IOT_STOP(fio->orig);
+}
+static void *create_timer(lcb_io_opt_t io) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    return fio->orig->timer.create(IOT_ARG(fio->orig));
+}
+static int schedule_timer(lcb_io_opt_t io, void *timer, lcb_uint32_t us,
+    void *arg, lcb_ioE_callback callback) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    return fio->orig->timer.schedule(IOT_ARG(fio->orig), timer, us, arg, callback);
+}
+static void destroy_timer(lcb_io_opt_t io, void *timer) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    fio->orig->timer.destroy(IOT_ARG(fio->orig), timer);
+}
+static void cancel_timer(lcb_io_opt_t io, void *timer) {
+    lcbio_FAULTIO *fio = FIO_FROM_IOPS(io);
+    fio->orig->timer.cancel(IOT_ARG(fio->orig), timer);
+}
+
+static void
+Efault_dtor(void *arg)
+{
+    lcbio_FAULTIO *fio = arg;
+    lcbio_timer_destroy(fio->deliver);
+    lcbio_table_unref(fio->orig);
+    lcbio_faults_unref(fio->parent);
+    free(fio);
+}
+
+static const faults_RULE *
+find_rule(const lcbio_FAULTS *faults, const lcb_host_t *dest)
+{
+    unsigned ii;
+    for (ii = 0; ii < faults->nrules; ii++) {
+        const faults_RULE *rule = faults->rules + ii;
+        if (rule->host && strcmp(rule->host, dest->host) != 0) {
+            continue;
+        }
+        if (rule->port && rule->port != (unsigned)atoi(dest->port)) {
+            continue;
+        }
+        return rule;
+    }
+    return NULL;
+}
+
+lcbio_pTABLE
+lcbio_faults_wrap(lcbio_FAULTS *faults, lcbio_pTABLE orig, const lcb_host_t *dest)
+{
+    lcbio_FAULTIO *fio;
+    lcbio_TABLE *iot;
+    const faults_RULE *rule = find_rule(faults, dest);
+    lcb_U64 seedstate;
+    int ii;
+
+    if (!rule || !IOT_IS_EVENT(orig)) {
+        lcbio_table_ref(orig);
+        return orig;
+    }
+
+    fio = calloc(1, sizeof(*fio));
+    iot = &fio->base_;
+    fio->orig = orig;
+    fio->parent = faults;
+    fio->rule = rule;
+    fio->fd = INVALID_SOCKET;
+    fio->iops_.v.v0.cookie = fio;
+    fio->deliver = lcbio_timer_new(orig, fio, deliver_pending);
+    seedstate = faults->seed + faults->nwrapped++;
+    fio->rng = splitmix(&seedstate);
+    for (ii = 0; ii < 2; ii++) {
+        fio->tokens[ii] = rule->bandwidth / 10.0;
+        fio->refilled[ii] = lcbio_now(orig);
+    }
+    faults->refcount++;
+    lcbio_table_ref(orig);
+
+    iot->p = &fio->iops_;
+    iot->model = orig->model;
+    iot->refcount = 1;
+    iot->clock.flags = orig->clock.flags;
+    iot->loop.start = loop_run;
+    iot->loop.stop = loop_stop;
+    iot->timer.create = create_timer;
+    iot->timer.destroy = destroy_timer;
+    iot->timer.schedule = schedule_timer;
+    iot->timer.cancel = cancel_timer;
+    iot->u_io.v0.ev.create = Efault_create_event;
+    iot->u_io.v0.ev.destroy = Efault_destroy_event;
+    iot->u_io.v0.ev.watch = Efault_watch;
+    iot->u_io.v0.ev.cancel = Efault_cancel;
+    iot->u_io.v0.io.socket0 = Efault_socket;
+    iot->u_io.v0.io.connect0 = Efault_connect;
+    iot->u_io.v0.io.recv = Efault_recv;
+    iot->u_io.v0.io.recvv = Efault_recvv;
+    iot->u_io.v0.io.send = Efault_send;
+    iot->u_io.v0.io.sendv = Efault_sendv;
+    iot->u_io.v0.io.close = Efault_close;
+    iot->u_io.v0.io.is_closed = Efault_is_closed;
+    iot->dtor = Efault_dtor;
+    return iot;
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_FAULTS_H
+#define LCBIO_FAULTS_H
+#include <lcbio/connect.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Network fault injection
+ */
+
+/**
+ * @ingroup lcbio
+ * @defgroup lcbio-faults Fault Injection
+ *
+ * @details
+ * Degrades new connections according to a script, to reproduce slow and
+ * flaky nodes locally. Each matching connection gets its own I/O table which
+ * wraps the original one (much like the SSL tables do), and which delays
+ * readiness notifications, caps the throughput, shortens reads and writes,
+ * stalls the connection or resets it.
+ *
+ * The script is a list of rules separated by `;`, each of them a list of
+ * `key=value` directives separated by `,`. A connection is governed by the
+ * first rule whose `host` and `port` (if given) match its endpoint:
+ *
+ * - `host=HOST`, `port=PORT`: endpoint to match
+ * - `latency=MS`: delay each notification that the socket is readable or
+ *   writable by this many milliseconds
+ * - `jitter=MS`: add a random delay of up to this many milliseconds
+ * - `bandwidth=BYTES`: cap the throughput, in bytes per second for each
+ *   direction
+ * - `partial=P`: probability of a read or write transferring only part of
+ *   what it was given
+ * - `stall=P`: probability of a read or write making the connection hang
+ *   for `stall_time` milliseconds (default 1000)
+ * - `reset=P`: probability of a read or write (or of the connection
+ *   attempt) failing, after which the connection is unusable
+ * - `seed=N`: seed for the random choices (default 1), for the whole script
+ *
+ * Random choices are drawn separately for each connection, from a sequence
+ * derived from the seed and the number of connections wrapped so far; given
+ * the same sequence of calls, the same faults are injected.
+ *
+ * Only event-based I/O plugins are supported.
+ *
+ * @addtogroup lcbio-faults
+ * @{
+ */
+
+typedef struct lcbio_FAULTS lcbio_FAULTS;
+
+/** @brief Counters for injected faults */
+typedef struct {
+    lcb_U64 ndelayed; /**< Readiness notifications delivered late */
+    lcb_U64 nthrottled; /**< Reads and writes refused for lack of bandwidth */
+    lcb_U64 npartial; /**< Reads and writes shortened */
+    lcb_U64 nstalls; /**< Stalls started */
+    lcb_U64 nresets; /**< Connections reset or refused */
+} lcbio_FAULTSTATS;
+
+/**
+ * Parse a script
+ * @param script the script (see above)
+ * @return the fault set, or NULL if the script is invalid. Release with
+ * lcbio_faults_unref()
+ */
+lcbio_FAULTS *
+lcbio_faults_new(const char *script);
+
+void
+lcbio_faults_unref(lcbio_FAULTS *faults);
+
+/** @return the script from which the fault set was created */
+const char *
+lcbio_faults_script(const lcbio_FAULTS *faults);
+
+void
+lcbio_faults_stats(const lcbio_FAULTS *faults, lcbio_FAULTSTATS *stats);
+
+/**
+ * Get the table to use for a new connection
+ * @param faults the fault set
+ * @param orig the table the connection would otherwise use
+ * @param dest the connection's endpoint
+ * @return a new table wrapping `orig` if a rule matches the endpoint, or
+ * else `orig` itself. Either way the caller owns a reference to it.
+ */
+lcbio_pTABLE
+lcbio_faults_wrap(lcbio_FAULTS *faults, lcbio_pTABLE orig, const lcb_host_t *dest);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
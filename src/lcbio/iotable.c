@@ -16,6 +16,7 @@
  */
 
 #define LCB_IOPS_V12_NO_DEPRECATE
+#include "config.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -264,6 +265,27 @@ lcbio_table_new(lcb_io_opt_t io)
     return table;
 }
 
+lcb_U64
+lcbio_now_fine(lcbio_TABLE *iot)
+{
+    if (iot->clock.flags & LCB_CLOCK_F_TSC) {
+        return lcb_tsc_gethrtime();
+    }
+    return gethrtime();
+}
+
+lcb_U64
+lcbio_now(lcbio_TABLE *iot)
+{
+    if (!(iot->clock.flags & LCB_CLOCK_F_CACHED) || !iot->clock.depth) {
+        return lcbio_now_fine(iot);
+    }
+    if (!iot->clock.now) {
+        iot->clock.now = lcbio_now_fine(iot);
+    }
+    return iot->clock.now;
+}
+
 void
 lcbio_table_unref(lcbio_TABLE *table)
 {
@@ -52,6 +52,13 @@ typedef struct lcbio_TABLE {
     } u_io;
     unsigned refcount;
     void (*dtor)(void *);
+
+    /** Clock state, see lcbio_now() */
+    struct {
+        int flags; /**< Mask of lcb_CLOCKFLAGS */
+        unsigned depth; /**< Nesting level of LCBIO_CLOCK_ENTER() */
+        lcb_U64 now; /**< Time cached for the current handler, 0 if unset */
+    } clock;
 } lcbio_TABLE;
 
 /** Whether the underlying model is event-based */
@@ -78,6 +85,24 @@ typedef struct lcbio_TABLE {
 /** First argument to IO Table */
 #define IOT_ARG(iot) (iot)->p
 
+/**
+ * @name Clock Handlers
+ * @details
+ * Event handlers which want lcbio_now() to be cached for their duration
+ * (see lcbio_now()) should be wrapped with these.
+ * @{
+ */
+
+/** Mark the start of an event handler. Handlers may be nested */
+#define LCBIO_CLOCK_ENTER(iot) do { \
+    if (!(iot)->clock.depth++) { (iot)->clock.now = 0; } \
+} while (0)
+
+/** Mark the end of an event handler */
+#define LCBIO_CLOCK_LEAVE(iot) (iot)->clock.depth--
+
+/**@}*/
+
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,20 @@ typedef struct lcbio_MGRHOST {
     lcbio_pASYNC async;
     unsigned n_total; /* number of total connections */
     unsigned refcount;
+    uint32_t tmoconnect; /* timeout to use when replenishing connections */
+
+    /* Statistics. All times are in nanoseconds */
+    struct {
+        lcb_U64 nrequests; /* total number of requests */
+        lcb_U64 nqueued; /* requests which had to wait for a connection */
+        hrtime_t queue_time; /* total time spent by requests waiting */
+        hrtime_t queue_time_max;
+        lcb_U64 nconnect; /* connection attempts */
+        lcb_U64 nconnect_err; /* failed connection attempts */
+        lcb_U64 npreconnect; /* attempts made without a pending request */
+        hrtime_t connect_time; /* total time taken by successful connects */
+        hrtime_t connect_time_max;
+    } stats;
 } mgr_HOST;
 
 typedef struct mgr_CINFO_st {
@@ -54,6 +68,8 @@ typedef struct mgr_CINFO_st {
     lcbio_SOCKET *sock;
     struct lcbio_CONNSTART *cs;
     lcbio_pTIMER idle_timer;
+    hrtime_t started; /* when the connection attempt began */
+    hrtime_t connected; /* when the connection was established */
     int state;
 } mgr_CINFO;
 
@@ -66,6 +82,7 @@ typedef struct lcbio_MGRREQ {
     int state;
     lcbio_SOCKET *sock;
     lcb_error_t err;
+    hrtime_t queued; /* when the request started waiting, if it had to */
 } mgr_REQ;
 
 #define HE_NPEND(he) LCB_CLIST_SIZE(&(he)->ll_pending)
@@ -78,6 +95,7 @@ static void he_available_notify(void *cookie);
 static void he_dump(mgr_HOST *he, FILE *out);
 static void he_unref(mgr_HOST *he);
 static void mgr_unref(lcbio_MGR *mgr);
+static void start_new_connection(mgr_HOST *he, uint32_t tmo);
 
 #define he_ref(he) (he)->refcount++
 #define mgr_ref(mgr) (mgr)->refcount++
@@ -228,6 +246,15 @@ invoke_request(mgr_REQ *req)
         req->timer = NULL;
     }
 
+    if (req->queued) {
+        mgr_HOST *he = req->host;
+        hrtime_t waited = gethrtime() - req->queued;
+        he->stats.queue_time += waited;
+        if (waited > he->stats.queue_time_max) {
+            he->stats.queue_time_max = waited;
+        }
+    }
+
     req->callback(req->sock, req->arg, req->err, 0);
     if (req->sock) {
         lcbio_unref(req->sock);
@@ -235,6 +262,22 @@ invoke_request(mgr_REQ *req)
     free(req);
 }
 
+/**
+ * Open new connections so that the number of connections available for
+ * future requests (idle or pending, minus those already claimed by waiting
+ * requests) is at least the pool's `minidle`.
+ */
+static void
+he_replenish(mgr_HOST *he)
+{
+    lcbio_MGR *mgr = he->parent;
+    while (HE_NIDLE(he) + HE_NPEND(he) < mgr->minidle + HE_NREQS(he)) {
+        lcb_log(LOGARGS(mgr, DEBUG), HE_LOGFMT "Opening connection to maintain minimum idle count (%u)", HE_LOGID(he), mgr->minidle);
+        he->stats.npreconnect++;
+        start_new_connection(he, he->tmoconnect);
+    }
+}
+
 /**
  * Called to notify that a connection has become available.
  */
@@ -255,6 +298,7 @@ connection_available(mgr_HOST *he)
         req->err = LCB_SUCCESS;
         invoke_request(req);
     }
+    he_replenish(he);
 }
 
 /**
@@ -271,6 +315,18 @@ on_connected(lcbio_SOCKET *sock, void *arg, lcb_error_t err, lcbio_OSERR oserr)
     lcb_log(LOGARGS(he->parent, DEBUG), HE_LOGFMT "Received result for I=%p,C=%p; E=0x%x", HE_LOGID(he), (void*)info, (void*)sock, err);
     lcb_clist_delete(&he->ll_pending, &info->llnode);
 
+    if (err != LCB_SUCCESS) {
+        he->stats.nconnect_err++;
+    } else {
+        hrtime_t elapsed;
+        info->connected = gethrtime();
+        elapsed = info->connected - info->started;
+        he->stats.connect_time += elapsed;
+        if (elapsed > he->stats.connect_time_max) {
+            he->stats.connect_time_max = elapsed;
+        }
+    }
+
     if (err != LCB_SUCCESS) {
         /** If the connection failed, fail out all remaining requests */
         lcb_list_t *cur, *next;
@@ -307,6 +363,7 @@ start_new_connection(mgr_HOST *he, uint32_t tmo)
     mgr_CINFO *info = calloc(1, sizeof(*info));
     info->state = CS_PENDING;
     info->parent = he;
+    info->started = gethrtime();
 
     info->base.id = LCBIO_PROTOCTX_POOL;
     info->base.dtor = cinfo_protoctx_dtor;
@@ -325,6 +382,7 @@ start_new_connection(mgr_HOST *he, uint32_t tmo)
 
     lcb_clist_append(&he->ll_pending, &info->llnode);
     he->n_total++;
+    he->stats.nconnect++;
     he_ref(he);
 }
 
@@ -347,21 +405,20 @@ async_invoke_request(void *cookie)
     invoke_request(req);
 }
 
-mgr_REQ *
-lcbio_mgr_get(lcbio_MGR *pool, lcb_host_t *dest, uint32_t timeout,
-              lcbio_CONNDONE_cb handler, void *arg)
+static mgr_HOST *
+he_find(lcbio_MGR *pool, const lcb_host_t *dest, mgr_KEY key)
 {
-    mgr_HOST *he;
-    lcb_list_t *cur;
-    mgr_REQ *req = calloc(1, sizeof(*req));
-    mgr_KEY key = { 0 };
-
     sprintf(key, "%s:%s", dest->host, dest->port);
+    return genhash_find(pool->ht, key, strlen(key));
+}
 
-    req->callback = handler;
-    req->arg = arg;
+static mgr_HOST *
+he_get(lcbio_MGR *pool, const lcb_host_t *dest)
+{
+    mgr_HOST *he;
+    mgr_KEY key = { 0 };
 
-    he = genhash_find(pool->ht, key, strlen(key));
+    he = he_find(pool, dest, key);
     if (!he) {
         he = calloc(1, sizeof(*he));
         he->parent = pool;
@@ -377,7 +434,23 @@ lcbio_mgr_get(lcbio_MGR *pool, lcb_host_t *dest, uint32_t timeout,
         he_ref(he);
         mgr_ref(pool);
     }
+    return he;
+}
 
+mgr_REQ *
+lcbio_mgr_get(lcbio_MGR *pool, lcb_host_t *dest, uint32_t timeout,
+              lcbio_CONNDONE_cb handler, void *arg)
+{
+    mgr_HOST *he;
+    lcb_list_t *cur;
+    mgr_REQ *req = calloc(1, sizeof(*req));
+
+    req->callback = handler;
+    req->arg = arg;
+
+    he = he_get(pool, dest);
+    he->tmoconnect = timeout;
+    he->stats.nrequests++;
     req->host = he;
 
     GT_POPAGAIN:
@@ -405,10 +478,13 @@ lcbio_mgr_get(lcbio_MGR *pool, lcb_host_t *dest, uint32_t timeout,
         info->state = CS_LEASED;
         lcbio_async_signal(req->timer);
         lcb_log(LOGARGS(pool, INFO), HE_LOGFMT "Found ready connection in pool. Reusing socket and not creating new connection", HE_LOGID(he));
+        he_replenish(he);
 
     } else {
         req->state = RS_PENDING;
         req->timer = lcbio_timer_new(pool->io, req, on_request_timeout);
+        req->queued = gethrtime();
+        he->stats.nqueued++;
         lcbio_timer_rearm(req->timer, timeout);
 
         lcb_clist_append(&he->requests, &req->llnode);
@@ -424,6 +500,25 @@ lcbio_mgr_get(lcbio_MGR *pool, lcb_host_t *dest, uint32_t timeout,
     return req;
 }
 
+unsigned
+lcbio_mgr_preconnect(lcbio_MGR *pool, const lcb_host_t *dest, unsigned n,
+                     uint32_t timeout)
+{
+    unsigned nstarted = 0;
+    mgr_HOST *he = he_get(pool, dest);
+
+    he->tmoconnect = timeout;
+    while (HE_NIDLE(he) + HE_NPEND(he) < n + HE_NREQS(he)) {
+        he->stats.npreconnect++;
+        start_new_connection(he, timeout);
+        nstarted++;
+    }
+    if (nstarted) {
+        lcb_log(LOGARGS(pool, INFO), HE_LOGFMT "Warming up pool with %u new connections", HE_LOGID(he), nstarted);
+    }
+    return nstarted;
+}
+
 /**
  * Invoked when a new socket is available for allocation within the
  * request queue.
@@ -460,6 +555,13 @@ static void
 on_idle_timeout(void *cookie)
 {
     mgr_CINFO *info = cookie;
+    mgr_HOST *he = info->parent;
+
+    if (HE_NIDLE(he) <= he->parent->minidle) {
+        /* Keep this one warm */
+        lcbio_timer_rearm(info->idle_timer, he->parent->tmoidle);
+        return;
+    }
 
     lcb_log(LOGARGS(info->parent->parent, DEBUG), HE_LOGFMT "Idle connection expired", HE_LOGID(info->parent));
 
@@ -482,7 +584,7 @@ lcbio_mgr_put(lcbio_SOCKET *sock)
     he = info->parent;
     mgr = he->parent;
 
-    if (HE_NIDLE(he) >= mgr->maxidle) {
+    if (HE_NIDLE(he) >= mgr->maxidle && HE_NIDLE(he) >= mgr->minidle) {
         lcb_log(LOGARGS(mgr, INFO), HE_LOGFMT "Closing idle connection. Too many in quota", HE_LOGID(he));
         lcbio_unref(info->sock);
         return;
@@ -524,6 +626,9 @@ write_he_list(lcb_clist_t *ll, FILE *out)
             fprintf(out, "SOCKDATA=%p", (void *)info->sock->u.sd);
         }
         fprintf(out, " STATE=0x%x", info->state);
+        if (info->connected) {
+            fprintf(out, " AGE=%lums", (unsigned long)((gethrtime() - info->connected) / 1000000));
+        }
         fprintf(out, "]\n");
     }
 
@@ -533,9 +638,19 @@ static void
 he_dump(mgr_HOST *he, FILE *out)
 {
     lcb_list_t *llcur;
-    fprintf(out, "HOST=%s", he->key);
+    lcb_U64 nconnected = he->stats.nconnect - he->stats.nconnect_err;
+    fprintf(out, "HOST=%s ", he->key);
     fprintf(out, "Requests=%d, Idle=%d, Pending=%d, Leased=%d\n",
             (int)HE_NREQS(he), (int)HE_NIDLE(he), (int)HE_NPEND(he), (int)HE_NLEASED(he));
+    fprintf(out, CONN_INDENT "Total requests=%lu, Queued=%lu, AvgWait=%luus, MaxWait=%luus\n",
+            (unsigned long)he->stats.nrequests, (unsigned long)he->stats.nqueued,
+            (unsigned long)(he->stats.nqueued ? he->stats.queue_time / he->stats.nqueued / 1000 : 0),
+            (unsigned long)(he->stats.queue_time_max / 1000));
+    fprintf(out, CONN_INDENT "Connects=%lu, Failed=%lu, Preconnects=%lu, AvgConnect=%luus, MaxConnect=%luus\n",
+            (unsigned long)he->stats.nconnect, (unsigned long)he->stats.nconnect_err,
+            (unsigned long)he->stats.npreconnect,
+            (unsigned long)(nconnected ? he->stats.connect_time / nconnected / 1000 : 0),
+            (unsigned long)(he->stats.connect_time_max / 1000));
 
     fprintf(out, CONN_INDENT "Idle Connections:\n");
     write_he_list(&he->ll_idle, out);
@@ -570,6 +685,29 @@ dumpfunc(const void *k, lcb_size_t nk, const void *v, lcb_size_t nv, void *arg)
     (void)nk;(void)k;(void)nv;
 }
 
+LCB_INTERNAL_API
+int
+lcbio_mgr_get_stats(lcbio_MGR *mgr, const lcb_host_t *dest,
+                    lcbio_MGRSTATS *stats)
+{
+    mgr_KEY key = { 0 };
+    mgr_HOST *he = he_find(mgr, dest, key);
+
+    memset(stats, 0, sizeof(*stats));
+    if (!he) {
+        return 0;
+    }
+    stats->nidle = HE_NIDLE(he);
+    stats->npending = HE_NPEND(he);
+    stats->nleased = HE_NLEASED(he);
+    stats->nwaiting = HE_NREQS(he);
+    stats->nrequests = he->stats.nrequests;
+    stats->nqueued = he->stats.nqueued;
+    stats->nconnect = he->stats.nconnect;
+    stats->nconnect_err = he->stats.nconnect_err;
+    return 1;
+}
+
 /**
  * Dumps the connection manager state to stderr
  */
@@ -580,5 +718,7 @@ void lcbio_mgr_dump(lcbio_MGR *mgr, FILE *out)
         out = stderr;
     }
 
+    fprintf(out, "POOL=%p MaxIdle=%u, MinIdle=%u, IdleTimeout=%uus\n",
+            (void *)mgr, mgr->maxidle, mgr->minidle, (unsigned)mgr->tmoidle);
     genhash_iter(mgr->ht, dumpfunc, out);
 }
@@ -61,6 +61,15 @@ typedef struct lcbio_MGR {
     uint32_t tmoidle;
     unsigned maxtotal;
     unsigned maxidle; /**< Maximum number of idle connections, per host */
+
+    /**
+     * Minimum number of connections to keep open (idle or connecting), per
+     * host. Once a host is known to the pool (either by a prior request or via
+     * lcbio_mgr_preconnect()), the pool will open new connections whenever
+     * a lease brings the number of idle connections below this value, and
+     * idle connections are not expired if doing so would go below it.
+     */
+    unsigned minidle;
     unsigned refcount;
 } lcbio_MGR;
 
@@ -99,6 +108,24 @@ struct lcbio_MGRREQ *
 lcbio_mgr_get(lcbio_MGR *mgr, lcb_host_t *dest, uint32_t timeout,
               lcbio_CONNDONE_cb handler, void *arg);
 
+/**
+ * Warm up the pool for a given host by opening connections in advance, so
+ * that subsequent calls to lcbio_mgr_get() do not need to wait for a
+ * connection to be established.
+ *
+ * @param mgr the pool
+ * @param dest the host to connect to
+ * @param n the number of connections which should be available (idle or
+ *        pending). Only the difference between this number and the number of
+ *        already idle or pending connections is opened.
+ * @param timeout the connection timeout for each new connection
+ * @return the number of new connections started
+ */
+LCB_INTERNAL_API
+unsigned
+lcbio_mgr_preconnect(lcbio_MGR *mgr, const lcb_host_t *dest, unsigned n,
+                     uint32_t timeout);
+
 /**
  * Cancel a pending request. The callback for the request must have not already
  * been invoked (if it has, use sockpool_put)
@@ -148,6 +175,31 @@ void lcbio_mgr_detach(lcbio_SOCKET *sock);
 LCB_INTERNAL_API
 void lcbio_mgr_dump(lcbio_MGR *mgr, FILE *out);
 
+/** @brief Connections and counters for a single host */
+typedef struct {
+    unsigned nidle; /**< Idle connections */
+    unsigned npending; /**< Connections being established */
+    unsigned nleased; /**< Connections in use */
+    unsigned nwaiting; /**< Requests waiting for a connection */
+    lcb_U64 nrequests; /**< Requests for a connection */
+    lcb_U64 nqueued; /**< Requests which had to wait for a connection */
+    lcb_U64 nconnect; /**< Connection attempts */
+    lcb_U64 nconnect_err; /**< Failed connection attempts */
+} lcbio_MGRSTATS;
+
+/**
+ * Retrieve the connections and counters for a host
+ * @param mgr the pool
+ * @param dest the host
+ * @param[out] stats the counters
+ * @return nonzero if the host is known to the pool. Otherwise the counters
+ * are all zero.
+ */
+LCB_INTERNAL_API
+int
+lcbio_mgr_get_stats(lcbio_MGR *mgr, const lcb_host_t *dest,
+                    lcbio_MGRSTATS *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,6 +36,11 @@
 #define RWINL_IOVSIZE IOV_MAX
 #endif
 
+/* Called with the data read or written, if the includer wants to see it */
+#ifndef CTX_CAPTURE
+#define CTX_CAPTURE(ctx, type, iov, niov, nb)
+#endif
+
 #ifndef USE_EAGAIN
 #define C_EAGAIN 0
 #else
@@ -55,6 +60,7 @@ lcbio_E_rdb_slurp(lcbio_CTX *ctx, rdb_IOROPE *ior)
         GT_READ:
         rv = IOT_V0IO(iot).recvv(IOT_ARG(iot), CTX_FD(ctx), iov, niov);
         if (rv > 0) {
+            CTX_CAPTURE(ctx, LCBIO_CAPTURE_RECV, iov, niov, (unsigned)rv);
             rdb_rdend(ior, rv);
         } else if (rv == -1) {
             switch (IOT_ERRNO(iot)) {
@@ -102,6 +108,9 @@ lcbio_E_rb_write(lcbio_CTX *ctx, ringbuffer_t *buf)
                 return LCBIO_IOERR;
             }
         }
+        if (nw > 0) {
+            CTX_CAPTURE(ctx, LCBIO_CAPTURE_SEND, iov, niov, (unsigned)nw);
+        }
         if (nw) {
             ringbuffer_consumed(buf, nw);
         }
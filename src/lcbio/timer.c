@@ -42,7 +42,9 @@ timer_callback(lcb_socket_t sock, short which, void *arg)
     timer->state |= LCBIO_TIMER_S_ENTERED;
 
     lcbio_timer_disarm(timer);
+    LCBIO_CLOCK_ENTER(timer->io);
     timer->callback(timer->data);
+    LCBIO_CLOCK_LEAVE(timer->io);
 
     if (TMR_IS_DESTROYED(timer)) {
         destroy_timer(timer);
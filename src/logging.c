@@ -21,6 +21,9 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+/* This file defines lcb_log() itself */
+#undef lcb_log
+
 #ifdef _WIN32
 #define flockfile(x) (void) 0
 #define funlockfile(x) (void) 0
@@ -69,6 +72,12 @@
     #define THREAD_ID_FMT "d"
 #endif
 
+#if defined(__GNUC__) && defined(__ATOMIC_SEQ_CST) && !defined(_WIN32) && \
+        (defined(unix) || defined(__unix__) || defined(__unix) || defined(_POSIX_VERSION))
+#define LCB_ASYNCLOG_SUPPORTED
+#include <sys/time.h>
+#endif
+
 static hrtime_t start_time = 0;
 
 static void console_log(struct lcb_logprocs_st *procs,
@@ -80,6 +89,15 @@ static void console_log(struct lcb_logprocs_st *procs,
                         const char *fmt,
                         va_list ap);
 
+static void console_write(struct lcb_CONSOLELOGGER *vprocs,
+                          hrtime_t now,
+                          unsigned int iid,
+                          const char *subsys,
+                          int severity,
+                          int srcline,
+                          const char *fmt,
+                          va_list ap);
+
 static struct lcb_CONSOLELOGGER console_logprocs = {
         {0 /* version */, {{console_log} /* v1 */} /*v*/},
         NULL,
@@ -125,19 +143,33 @@ static void console_log(struct lcb_logprocs_st *procs,
                         const char *fmt,
                         va_list ap)
 {
-    FILE *fp;
-    hrtime_t now;
     struct lcb_CONSOLELOGGER *vprocs = (struct lcb_CONSOLELOGGER *)procs;
 
     if (severity < vprocs->minlevel) {
         return;
     }
+    console_write(vprocs, gethrtime(), iid, subsys, severity, srcline, fmt, ap);
+    (void)srcfile;
+}
+
+/**
+ * Write a message to the console logger's output, as if it had been logged
+ * at time `now`
+ */
+static void console_write(struct lcb_CONSOLELOGGER *vprocs,
+                          hrtime_t now,
+                          unsigned int iid,
+                          const char *subsys,
+                          int severity,
+                          int srcline,
+                          const char *fmt,
+                          va_list ap)
+{
+    FILE *fp;
 
     if (!start_time) {
-        start_time = gethrtime();
+        start_time = now;
     }
-
-    now = gethrtime();
     if (now == start_time) {
         now++;
     }
@@ -156,11 +188,220 @@ static void console_log(struct lcb_logprocs_st *procs,
     vfprintf(fp, fmt, ap);
     fprintf(fp, "\n");
     funlockfile(fp);
+}
 
-    (void)procs;
-    (void)srcfile;
+
+#ifdef LCB_ASYNCLOG_SUPPORTED
+/**
+ * Asynchronous logging.
+ *
+ * Messages are formatted by lcb_log() into a fixed-size slot of a ring
+ * buffer, and handed to the logger by a background thread. Since an lcb_t
+ * (and therefore its settings) is only used by one thread at a time, each
+ * ring has a single producer and a single consumer, and the indexes can be
+ * advanced without a lock. The mutex and condition variable are only used
+ * to wake the consumer when it is idle.
+ */
+#define ASYNCLOG_NSLOTS 1024
+#define ASYNCLOG_MSGSIZE 480
+#define ASYNCLOG_IDLE_WAIT_MS 100
+
+#define ALOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ASTORE(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+
+typedef struct {
+    hrtime_t now;
+    lcb_logprocs *procs;
+    const char *subsys;
+    const char *srcfile;
+    int severity;
+    int srcline;
+    unsigned iid;
+    char msg[ASYNCLOG_MSGSIZE];
+} asynclog_RECORD;
+
+typedef struct lcb_ASYNCLOG_st {
+    asynclog_RECORD *slots;
+    unsigned long head; /**< Next slot to fill. Only advanced by lcb_log() */
+    unsigned long tail; /**< Next slot to write. Only advanced by the thread */
+    unsigned long ndropped; /**< Messages dropped because the ring was full */
+    unsigned long nreported; /**< Dropped messages already reported */
+    int sleeping;
+    int stopping;
+    pthread_t thr;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} lcb_ASYNCLOG;
+
+static void
+asynclog_push(const lcb_settings *settings, const char *subsys, int severity,
+              const char *srcfile, int srcline, const char *fmt, va_list ap)
+{
+    lcb_ASYNCLOG *alog = settings->asynclog;
+    unsigned long head = alog->head;
+    asynclog_RECORD *rec;
+
+    if (head - ALOAD(&alog->tail) >= ASYNCLOG_NSLOTS) {
+        ASTORE(&alog->ndropped, alog->ndropped + 1);
+        return;
+    }
+
+    rec = alog->slots + (head % ASYNCLOG_NSLOTS);
+    rec->now = gethrtime();
+    rec->procs = settings->logger;
+    rec->subsys = subsys;
+    rec->srcfile = srcfile;
+    rec->severity = severity;
+    rec->srcline = srcline;
+    rec->iid = settings->iid;
+    vsnprintf(rec->msg, sizeof(rec->msg), fmt, ap);
+    ASTORE(&alog->head, head + 1);
+
+    if (ALOAD(&alog->sleeping)) {
+        pthread_mutex_lock(&alog->mutex);
+        pthread_cond_signal(&alog->cond);
+        pthread_mutex_unlock(&alog->mutex);
+    }
+}
+
+static void
+asynclog_callv(lcb_logprocs *procs, const asynclog_RECORD *rec,
+               const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    if (procs == lcb_console_logprocs) {
+        struct lcb_CONSOLELOGGER *vprocs = (struct lcb_CONSOLELOGGER *)procs;
+        if (rec->severity >= vprocs->minlevel) {
+            console_write(vprocs, rec->now, rec->iid, rec->subsys,
+                rec->severity, rec->srcline, fmt, ap);
+        }
+    } else {
+        procs->v.v0.callback(procs, rec->iid, rec->subsys, rec->severity,
+            rec->srcfile, rec->srcline, fmt, ap);
+    }
+    va_end(ap);
 }
 
+static void
+asynclog_write(lcb_ASYNCLOG *alog, const asynclog_RECORD *rec)
+{
+    unsigned long ndropped = ALOAD(&alog->ndropped);
+    if (ndropped != alog->nreported) {
+        asynclog_callv(rec->procs, rec, "%lu log messages were dropped",
+            ndropped - alog->nreported);
+        alog->nreported = ndropped;
+    }
+    asynclog_callv(rec->procs, rec, "%s", rec->msg);
+}
+
+static void *
+asynclog_run(void *arg)
+{
+    lcb_ASYNCLOG *alog = arg;
+
+    for (;;) {
+        unsigned long tail = alog->tail;
+        if (tail == ALOAD(&alog->head)) {
+            struct timeval tv;
+            struct timespec ts;
+
+            if (ALOAD(&alog->stopping)) {
+                break;
+            }
+            gettimeofday(&tv, NULL);
+            tv.tv_usec += ASYNCLOG_IDLE_WAIT_MS * 1000;
+            ts.tv_sec = tv.tv_sec + tv.tv_usec / 1000000;
+            ts.tv_nsec = (tv.tv_usec % 1000000) * 1000;
+
+            pthread_mutex_lock(&alog->mutex);
+            ASTORE(&alog->sleeping, 1);
+            if (ALOAD(&alog->head) == tail && !ALOAD(&alog->stopping)) {
+                pthread_cond_timedwait(&alog->cond, &alog->mutex, &ts);
+            }
+            ASTORE(&alog->sleeping, 0);
+            pthread_mutex_unlock(&alog->mutex);
+            continue;
+        }
+        asynclog_write(alog, alog->slots + (tail % ASYNCLOG_NSLOTS));
+        ASTORE(&alog->tail, tail + 1);
+    }
+    return NULL;
+}
+
+LCB_INTERNAL_API
+lcb_error_t
+lcb_asynclog_set(lcb_settings *settings, int enabled)
+{
+    lcb_ASYNCLOG *alog;
+
+    if (!enabled) {
+        lcb_asynclog_destroy(settings);
+        return LCB_SUCCESS;
+    }
+    if (settings->asynclog) {
+        return LCB_SUCCESS;
+    }
+
+    alog = calloc(1, sizeof(*alog));
+    alog->slots = malloc(sizeof(*alog->slots) * ASYNCLOG_NSLOTS);
+    if (!alog->slots) {
+        free(alog);
+        return LCB_CLIENT_ENOMEM;
+    }
+    pthread_mutex_init(&alog->mutex, NULL);
+    pthread_cond_init(&alog->cond, NULL);
+    if (pthread_create(&alog->thr, NULL, asynclog_run, alog) != 0) {
+        pthread_cond_destroy(&alog->cond);
+        pthread_mutex_destroy(&alog->mutex);
+        free(alog->slots);
+        free(alog);
+        return LCB_EINTERNAL;
+    }
+    settings->asynclog = alog;
+    return LCB_SUCCESS;
+}
+
+LCB_INTERNAL_API
+void
+lcb_asynclog_destroy(lcb_settings *settings)
+{
+    lcb_ASYNCLOG *alog = settings->asynclog;
+    if (!alog) {
+        return;
+    }
+
+    pthread_mutex_lock(&alog->mutex);
+    ASTORE(&alog->stopping, 1);
+    pthread_cond_signal(&alog->cond);
+    pthread_mutex_unlock(&alog->mutex);
+    pthread_join(alog->thr, NULL);
+
+    pthread_cond_destroy(&alog->cond);
+    pthread_mutex_destroy(&alog->mutex);
+    free(alog->slots);
+    free(alog);
+    settings->asynclog = NULL;
+}
+
+#else
+
+LCB_INTERNAL_API
+lcb_error_t
+lcb_asynclog_set(lcb_settings *settings, int enabled)
+{
+    (void)settings;
+    return enabled ? LCB_NOT_SUPPORTED : LCB_SUCCESS;
+}
+
+LCB_INTERNAL_API
+void
+lcb_asynclog_destroy(lcb_settings *settings)
+{
+    (void)settings;
+}
+
+#endif /* LCB_ASYNCLOG_SUPPORTED */
 
 LCB_INTERNAL_API
 void lcb_log(const struct lcb_settings_st *settings,
@@ -174,7 +415,7 @@ void lcb_log(const struct lcb_settings_st *settings,
     va_list ap;
     lcb_logging_callback callback;
 
-    if (!settings->logger) {
+    if (!LCB_LOG_ENABLED(settings, severity)) {
         return;
     }
 
@@ -182,9 +423,15 @@ void lcb_log(const struct lcb_settings_st *settings,
         return;
     }
 
-    callback = settings->logger->v.v0.callback;
-
     va_start(ap, fmt);
+#ifdef LCB_ASYNCLOG_SUPPORTED
+    if (settings->asynclog) {
+        asynclog_push(settings, subsys, severity, srcfile, srcline, fmt, ap);
+        va_end(ap);
+        return;
+    }
+#endif
+    callback = settings->logger->v.v0.callback;
     callback(settings->logger, settings->iid, subsys, severity, srcfile, srcline, fmt, ap);
     va_end(ap);
 }
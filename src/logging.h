@@ -60,6 +60,50 @@ void lcb_log(const struct lcb_settings_st *settings,
 
 lcb_logprocs * lcb_init_console_logger(void);
 
+/**
+ * Check whether a message of the given severity would be passed to the
+ * logger. This does not call into the logger itself.
+ */
+#define LCB_LOG_ENABLED(settings, severity) \
+    ((settings)->logger && (severity) >= (settings)->loglevel)
+
+/*
+ * For C code, wrap lcb_log() so that the level is checked before the call is
+ * made (and before any of its arguments are evaluated). The extra expansion
+ * allows LOGARGS-style macros (which expand to the first five arguments) to
+ * be used as the first argument.
+ */
+#if !defined(__cplusplus) && !defined(LCB_LOG_NO_PRECHECK)
+#define LCB__LOG_EXPAND(x) x
+#define LCB__LOG_CHECKED(settings, subsys, severity, srcfile, srcline, ...) \
+    do { \
+        if (LCB_LOG_ENABLED(settings, severity)) { \
+            lcb_log(settings, subsys, severity, srcfile, srcline, __VA_ARGS__); \
+        } \
+    } while (0)
+#define lcb_log(...) LCB__LOG_EXPAND(LCB__LOG_CHECKED(__VA_ARGS__))
+#endif
+
+/**
+ * Enable or disable asynchronous logging for the given settings. When
+ * enabled, lcb_log() formats the message into a ring buffer owned by the
+ * settings, and a background thread passes it on to the logger. If the ring
+ * is full, the message is dropped (and the number of dropped messages is
+ * reported once there is room again), so that logging never blocks.
+ *
+ * @return LCB_SUCCESS, or LCB_NOT_SUPPORTED if this platform has no support
+ * for background logging.
+ */
+LCB_INTERNAL_API
+lcb_error_t lcb_asynclog_set(struct lcb_settings_st *settings, int enabled);
+
+/**
+ * Write out any remaining messages and stop the background thread. This is
+ * called when the settings are destroyed.
+ */
+LCB_INTERNAL_API
+void lcb_asynclog_destroy(struct lcb_settings_st *settings);
+
 #define LCB_LOGS(settings, subsys, severity, msg) \
     lcb_log(settings, subsys, severity, __FILE__, __LINE__, msg)
 
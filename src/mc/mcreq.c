@@ -163,6 +163,77 @@ pkt_tmo_compar(sllist_node *a, sllist_node *b)
     }
 }
 
+static lcb_SIZE
+pkt_nbytes(const mc_PACKET *packet)
+{
+    lcb_SIZE ret = packet->kh_span.size;
+    if (packet->flags & MCREQ_F_HASVALUE) {
+        if (packet->flags & MCREQ_F_VALUE_IOV) {
+            ret += packet->u_value.multi.total_length;
+        } else {
+            ret += packet->u_value.single.size;
+        }
+    }
+    return ret;
+}
+
+/* Count the packet in the depth of the pipeline's queue */
+static void
+pkt_account(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mc_CMDQUEUE *cq = pipeline->parent;
+    lcb_SIZE nbytes;
+
+    if ((packet->flags & MCREQ_F_QUEUED) || cq == NULL) {
+        return;
+    }
+    nbytes = pkt_nbytes(packet);
+    packet->flags |= MCREQ_F_QUEUED;
+    pipeline->nqpkts++;
+    pipeline->nqbytes += nbytes;
+    cq->nqpkts++;
+    cq->nqbytes += nbytes;
+}
+
+static void
+pkt_unaccount(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mc_CMDQUEUE *cq = pipeline->parent;
+    lcb_SIZE nbytes = pkt_nbytes(packet);
+
+    packet->flags &= ~MCREQ_F_QUEUED;
+    pipeline->nqpkts--;
+    pipeline->nqbytes -= nbytes;
+    cq->nqpkts--;
+    cq->nqbytes -= nbytes;
+    if (cq->drained) {
+        cq->drained(cq);
+    }
+}
+
+/* Turn a quiet packet into the equivalent regular command */
+static void
+pkt_unquiet(mc_PACKET *packet)
+{
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(packet, &hdr);
+    switch (hdr.request.opcode) {
+    case PROTOCOL_BINARY_CMD_GETQ:
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+        break;
+    case PROTOCOL_BINARY_CMD_GETKQ:
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GETK;
+        break;
+    case PROTOCOL_BINARY_CMD_GATQ:
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GAT;
+        break;
+    default:
+        break;
+    }
+    mcreq_write_hdr(packet, &hdr);
+    packet->flags &= ~MCREQ_F_QUIET;
+}
+
 void
 mcreq_reenqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
@@ -176,6 +247,7 @@ void
 mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     nb_SPAN *vspan = &packet->u_value.single;
+    pkt_account(pipeline, packet);
     sllist_append(&pipeline->requests, &packet->slnode);
     netbuf_enqueue_span(&pipeline->nbmgr, &packet->kh_span);
 
@@ -254,6 +326,9 @@ void
 mcreq_release_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     nb_SPAN span;
+    if (packet->flags & MCREQ_F_QUEUED) {
+        pkt_unaccount(pipeline, packet);
+    }
     if (packet->flags & MCREQ_F_DETACHED) {
         sllist_iterator iter;
         mc_EXPACKET *epkt = (mc_EXPACKET *)packet;
@@ -291,8 +366,13 @@ mcreq_renew_packet(const mc_PACKET *src)
     memcpy(kdata, SPAN_BUFFER(&src->kh_span), src->kh_span.size);
     CREATE_STANDALONE_SPAN(&dst->kh_span, kdata, src->kh_span.size);
 
-    dst->flags &= ~(MCREQ_F_KEY_NOCOPY|MCREQ_F_VALUE_NOCOPY|MCREQ_F_VALUE_IOV);
+    dst->flags &= ~(MCREQ_F_KEY_NOCOPY|MCREQ_F_VALUE_NOCOPY|MCREQ_F_VALUE_IOV|
+            MCREQ_F_QUEUED);
     dst->flags |= MCREQ_F_DETACHED;
+    if (dst->flags & MCREQ_F_QUIET) {
+        /* The fence is not renewed along with the packet */
+        pkt_unquiet(dst);
+    }
     dst->alloc_parent = NULL;
     dst->sl_flushq.next = NULL;
     dst->slnode.next = NULL;
@@ -413,6 +493,65 @@ mcreq_extract_hashkey(
     }
 }
 
+/* Memcached buckets have no vBuckets; use a hash of the key instead so that
+ * operations on the same key still share a lane */
+static int
+key_laneid(const void *key, lcb_size_t nkey)
+{
+    const unsigned char *p = key;
+    lcb_U32 hv = 2166136261U;
+    lcb_size_t ii;
+    for (ii = 0; ii < nkey; ii++) {
+        hv = (hv ^ p[ii]) * 16777619U;
+    }
+    return (int)(hv >> 1);
+}
+
+mc_PIPELINE *
+mcreq_pipeline_lane(mc_PIPELINE *pipeline, int vbid, int options)
+{
+    unsigned nordered, ix;
+
+    if (!pipeline->nlanes) {
+        return pipeline;
+    }
+
+    nordered = pipeline->nlanes + 1;
+    if (pipeline->bulk_lane) {
+        if (options & MCREQ_BASICPACKET_F_BULK) {
+            return pipeline->lanes[pipeline->nlanes - 1];
+        }
+        nordered--;
+    }
+
+    ix = (unsigned)vbid % nordered;
+    return ix == 0 ? pipeline : pipeline->lanes[ix - 1];
+}
+
+mc_PIPELINE *
+mcreq_key_lane(mc_PIPELINE *pipeline, lcbvb_DISTMODE dist, int vbid,
+    const void *key, lcb_SIZE nkey, int options)
+{
+    if (pipeline->nlanes && dist == LCBVB_DIST_KETAMA) {
+        vbid = key_laneid(key, nkey);
+    }
+    return mcreq_pipeline_lane(pipeline, vbid, options);
+}
+
+mc_PIPELINE *
+mcreq_packet_lane(mc_PIPELINE *pipeline, lcbvb_DISTMODE dist,
+    const mc_PACKET *packet)
+{
+    protocol_binary_request_header hdr;
+    const void *key;
+    lcb_SIZE nkey;
+
+    mcreq_read_hdr(packet, &hdr);
+    mcreq_get_key(packet, &key, &nkey);
+    return mcreq_key_lane(pipeline, dist, ntohs(hdr.request.vbucket), key,
+        nkey, (packet->flags & MCREQ_F_BULK) ? MCREQ_BASICPACKET_F_BULK : 0);
+}
+
 lcb_error_t
 mcreq_basic_packet(
         mc_CMDQUEUE *queue, const lcb_CMDBASE *cmd,
@@ -432,7 +571,8 @@ mcreq_basic_packet(
 
     lcbvb_map_key(queue->config, hashkey, nhashkey, &vb, &srvix);
     if (srvix > -1) {
-        *pipeline = queue->pipelines[srvix];
+        *pipeline = mcreq_key_lane(queue->pipelines[srvix],
+            LCBVB_DISTTYPE(queue->config), vb, hashkey, nhashkey, options);
 
     } else {
         if ((options & MCREQ_BASICPACKET_F_FALLBACKOK) && queue->fallback) {
@@ -442,7 +582,17 @@ mcreq_basic_packet(
         }
     }
 
+    if (queue->admit && !(options & MCREQ_BASICPACKET_F_NOADMIT)) {
+        lcb_error_t err = queue->admit(queue, *pipeline);
+        if (err != LCB_SUCCESS) {
+            return err;
+        }
+    }
+
     *packet = mcreq_allocate_packet(*pipeline);
+    if (options & MCREQ_BASICPACKET_F_BULK) {
+        (*packet)->flags |= MCREQ_F_BULK;
+    }
 
     mcreq_reserve_key(*pipeline, *packet, sizeof(*req) + extlen, &cmd->key);
 
@@ -513,8 +663,13 @@ mcreq_queue_add_pipelines(
     queue->scheds = calloc(npipelines+1, 1);
 
     for (ii = 0; ii < npipelines; ii++) {
+        unsigned jj;
         pipelines[ii]->parent = queue;
         pipelines[ii]->index = ii;
+        for (jj = 0; jj < pipelines[ii]->nlanes; jj++) {
+            pipelines[ii]->lanes[jj]->parent = queue;
+            pipelines[ii]->lanes[jj]->index = ii;
+        }
     }
 
     if (queue->fallback) {
@@ -542,6 +697,10 @@ mcreq_queue_init(mc_CMDQUEUE *queue)
     queue->scheds = NULL;
     queue->fallback = NULL;
     queue->npipelines = 0;
+    queue->nqpkts = 0;
+    queue->nqbytes = 0;
+    queue->admit = NULL;
+    queue->drained = NULL;
     return 0;
 }
 
@@ -566,43 +725,107 @@ mcreq_sched_enter(mc_CMDQUEUE *queue)
 
 
 
+/* Append a NOOP to the packets scheduled on the pipeline if more than one of
+ * them is quiet. Otherwise the quiet packet is sent as a regular one */
+static void
+pipeline_fence(mc_PIPELINE *pipeline)
+{
+    sllist_node *ll;
+    mc_PACKET *fence, *last = NULL;
+    protocol_binary_request_header hdr;
+    unsigned nquiet = 0;
+
+    SLLIST_FOREACH(&pipeline->ctxqueued, ll) {
+        last = SLLIST_ITEM(ll, mc_PACKET, slnode);
+        if (last->flags & MCREQ_F_QUIET) {
+            nquiet++;
+        }
+    }
+    if (!nquiet) {
+        return;
+    }
+
+    if (nquiet > 1 && (fence = mcreq_allocate_packet(pipeline)) != NULL) {
+        if (mcreq_reserve_header(pipeline, fence, MCREQ_PKT_BASESIZE) == LCB_SUCCESS) {
+            memset(&hdr, 0, sizeof hdr);
+            hdr.request.magic = PROTOCOL_BINARY_REQ;
+            hdr.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+            hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+            hdr.request.opaque = fence->opaque;
+            mcreq_write_hdr(fence, &hdr);
+            fence->u_rdata.reqdata.cookie = NULL;
+            /* Times out along with the packets it follows */
+            fence->u_rdata.reqdata.start = MCREQ_PKT_RDATA(last)->start;
+            sllist_append(&pipeline->ctxqueued, &fence->slnode);
+            return;
+        }
+        mcreq_release_packet(pipeline, fence);
+    }
+
+    SLLIST_FOREACH(&pipeline->ctxqueued, ll) {
+        mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+        if (pkt->flags & MCREQ_F_QUIET) {
+            pkt_unquiet(pkt);
+        }
+    }
+}
+
+static void
+pipeline_leave(mc_PIPELINE *pipeline, int success, int flush)
+{
+    sllist_node *ll_next, *ll;
+
+    if (SLLIST_IS_EMPTY(&pipeline->ctxqueued)) {
+        return;
+    }
+
+    if (success) {
+        pipeline_fence(pipeline);
+    }
+    ll = SLLIST_FIRST(&pipeline->ctxqueued);
+
+    while (ll) {
+        mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+        ll_next = ll->next;
+
+        if (success) {
+            mcreq_enqueue_packet(pipeline, pkt);
+        } else {
+            if (pkt->flags & MCREQ_F_REQEXT) {
+                mc_REQDATAEX *rd = pkt->u_rdata.exdata;
+                if (rd->procs->fail_dtor) {
+                    rd->procs->fail_dtor(pkt);
+                }
+            }
+            mcreq_wipe_packet(pipeline, pkt);
+            mcreq_release_packet(pipeline, pkt);
+        }
+
+        ll = ll_next;
+    }
+    SLLIST_FIRST(&pipeline->ctxqueued) = pipeline->ctxqueued.last = NULL;
+    if (flush) {
+        pipeline->flush_start(pipeline);
+    }
+}
+
 static void
 queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 {
-    unsigned ii;
+    unsigned ii, jj;
     for (ii = 0; ii < queue->_npipelines_ex; ii++) {
         mc_PIPELINE *pipeline;
-        sllist_node *ll_next, *ll;
 
         if (!queue->scheds[ii]) {
             continue;
         }
 
         pipeline = queue->pipelines[ii];
-        ll = SLLIST_FIRST(&pipeline->ctxqueued);
-
-        while (ll) {
-            mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
-            ll_next = ll->next;
+        pipeline_leave(pipeline, success, flush);
 
-            if (success) {
-                mcreq_enqueue_packet(pipeline, pkt);
-            } else {
-                if (pkt->flags & MCREQ_F_REQEXT) {
-                    mc_REQDATAEX *rd = pkt->u_rdata.exdata;
-                    if (rd->procs->fail_dtor) {
-                        rd->procs->fail_dtor(pkt);
-                    }
-                }
-                mcreq_wipe_packet(pipeline, pkt);
-                mcreq_release_packet(pipeline, pkt);
-            }
-
-            ll = ll_next;
-        }
-        SLLIST_FIRST(&pipeline->ctxqueued) = pipeline->ctxqueued.last = NULL;
-        if (flush) {
-            pipeline->flush_start(pipeline);
+        /* Lanes share the index of their pipeline */
+        for (jj = 0; jj < pipeline->nlanes; jj++) {
+            pipeline_leave(pipeline->lanes[jj], success, flush);
         }
         queue->scheds[ii] = 0;
     }
@@ -627,6 +850,7 @@ mcreq_sched_add(mc_PIPELINE *pipeline, mc_PACKET *pkt)
     if (!cq->scheds[pipeline->index]) {
         cq->scheds[pipeline->index] = 1;
     }
+    pkt_account(pipeline, pkt);
     sllist_append(&pipeline->ctxqueued, &pkt->slnode);
 }
 
@@ -721,6 +945,28 @@ mcreq_pipeline_timeout(
     return count;
 }
 
+unsigned
+mcreq_pipeline_quiet_misses(mc_PIPELINE *pl, const mc_PACKET *fence,
+    mcreq_pktfail_fn failcb, void *cbarg)
+{
+    sllist_iterator iter;
+    unsigned count = 0;
+
+    SLLIST_ITERFOR(&pl->requests, &iter) {
+        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+        /* Quiet packets scheduled after the fence have a newer opaque */
+        if (!(pkt->flags & MCREQ_F_QUIET) ||
+                (lcb_S32)(fence->opaque - pkt->opaque) <= 0) {
+            continue;
+        }
+        sllist_iter_remove(&pl->requests, &iter);
+        failcb(pl, pkt, LCB_KEY_ENOENT, cbarg);
+        mcreq_packet_handled(pl, pkt);
+        count++;
+    }
+    return count;
+}
+
 unsigned
 mcreq_pipeline_fail(
         mc_PIPELINE *pl, lcb_error_t err, mcreq_pktfail_fn failcb, void *arg)
@@ -795,7 +1041,10 @@ noop_dumpfn(const void *d, unsigned n, FILE *fp) { (void)d;(void)n;(void)fp; }
     X(UFWD) \
     X(FLUSHED) \
     X(INVOKED) \
-    X(DETACHED)
+    X(DETACHED) \
+    X(PRIVCALLBACK) \
+    X(QUEUED) \
+    X(QUIET)
 
 void
 mcreq_dump_packet(const mc_PACKET *packet, FILE *fp, mcreq_payload_dump_fn dumpfn)
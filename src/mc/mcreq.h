@@ -261,7 +261,30 @@ typedef enum {
      * };
      * @endcode
      */
-    MCREQ_F_PRIVCALLBACK = 1 << 9
+    MCREQ_F_PRIVCALLBACK = 1 << 9,
+
+    /**
+     * The packet is counted in the queue depth of the pipeline it was
+     * scheduled on (see mc_PIPELINE#nqpkts) and is uncounted when released.
+     */
+    MCREQ_F_QUEUED = 1 << 10,
+
+    /**
+     * The packet is a "quiet" command (e.g. GETQ), for which the server does
+     * not reply if the item does not exist. When the packets scheduled on a
+     * pipeline include more than one such packet, a NOOP is appended to them
+     * on lcb_sched_leave(); once its reply arrives, the quiet packets sent
+     * before it which are still pending are known to have missed (see
+     * mcreq_pipeline_quiet_misses()). If there is only one such packet, or if
+     * the packet is renewed, it is sent as the equivalent regular command.
+     */
+    MCREQ_F_QUIET = 1 << 11,
+
+    /**
+     * The packet was scheduled with @ref MCREQ_BASICPACKET_F_BULK, and is
+     * placed in the bulk lane whenever it is (re)scheduled
+     */
+    MCREQ_F_BULK = 1 << 12
 } mcreq_flags;
 
 /** @brief mask of flags indicating user-allocated buffers */
@@ -393,6 +416,30 @@ typedef struct mc_pipeline_st {
 
     /** Allocator for packet structures */
     nb_MGR reqpool;
+
+    /**
+     * Additional pipelines ("lanes") serving the same node, typically one per
+     * extra connection. Lanes are not part of mc_CMDQUEUE::pipelines; they
+     * share the index of the pipeline owning them and are selected by
+     * mcreq_pipeline_lane(). The array and its contents are owned by the
+     * application.
+     */
+    struct mc_pipeline_st **lanes;
+
+    /** Number of entries in #lanes */
+    unsigned nlanes;
+
+    /**
+     * If set, the last entry in #lanes is reserved for packets scheduled with
+     * @ref MCREQ_BASICPACKET_F_BULK
+     */
+    int bulk_lane;
+
+    /** Number of packets scheduled on this pipeline and not yet released */
+    unsigned nqpkts;
+
+    /** Number of bytes (headers, keys and values) held by those packets */
+    lcb_SIZE nqbytes;
 } mc_PIPELINE;
 
 typedef struct mc_cmdqueue_st {
@@ -423,6 +470,26 @@ typedef struct mc_cmdqueue_st {
     /**Special pipeline used to contain orphaned packets within a scheduling
      * context. This field is used by mcreq_set_fallback_handler() */
     mc_PIPELINE *fallback;
+
+    /** Sum of mc_PIPELINE#nqpkts for all the pipelines of the queue */
+    unsigned nqpkts;
+
+    /** Sum of mc_PIPELINE#nqbytes for all the pipelines of the queue */
+    lcb_SIZE nqbytes;
+
+    /**
+     * If set, invoked by mcreq_basic_packet() once the pipeline for a new
+     * packet has been selected, unless @ref MCREQ_BASICPACKET_F_NOADMIT is
+     * passed. If this returns an error, no packet is allocated and the error
+     * is returned to the caller.
+     */
+    lcb_error_t (*admit)(struct mc_cmdqueue_st *queue, mc_PIPELINE *pipeline);
+
+    /**
+     * If set, invoked whenever a packet counted in #nqpkts is released, i.e.
+     * when the queue depth decreases
+     */
+    void (*drained)(struct mc_cmdqueue_st *queue);
 } mc_CMDQUEUE;
 
 /**
@@ -616,6 +683,14 @@ mcreq_extract_hashkey(
  */
 #define MCREQ_BASICPACKET_F_FALLBACKOK 0x01
 
+/**The packet carries a large body and should be placed in the pipeline's
+ * bulk lane, if it has one. See mc_PIPELINE::bulk_lane */
+#define MCREQ_BASICPACKET_F_BULK 0x02
+
+/**The packet is issued by the library itself (e.g. with
+ * LCB_CMD_F_INTERNAL_CALLBACK) and is not subject to mc_CMDQUEUE::admit */
+#define MCREQ_BASICPACKET_F_NOADMIT 0x04
+
 /**
  * Handle the basic requirements of a packet common to all commands
  * @param queue the queue
@@ -629,8 +704,9 @@ mcreq_extract_hashkey(
  * @param[out] packet a pointer set to the address of the allocated packet
  * @param[out] pipeline a pointer set to the target pipeline
  * @param options a set of options to control creation behavior. Currently the
- * only recognized options are `0` (i.e. default options), or @ref
- * MCREQ_BASICPACKET_F_FALLBACKOK
+ * only recognized options are `0` (i.e. default options), @ref
+ * MCREQ_BASICPACKET_F_FALLBACKOK, @ref MCREQ_BASICPACKET_F_BULK and @ref
+ * MCREQ_BASICPACKET_F_NOADMIT
  */
 
 lcb_error_t
@@ -639,6 +715,49 @@ mcreq_basic_packet(
         protocol_binary_request_header *req, uint8_t extlen,
         mc_PACKET **packet, mc_PIPELINE **pipeline, int options);
 
+/**
+ * Select the lane of a pipeline which should carry a packet. Packets for the
+ * same vBucket are always placed in the same lane, so that their relative
+ * ordering is preserved.
+ *
+ * @param pipeline the pipeline the packet was mapped to
+ * @param vbid the vBucket of the packet, or any other value identifying the
+ * packets whose order should be preserved
+ * @param options the options passed to mcreq_basic_packet(); only @ref
+ * MCREQ_BASICPACKET_F_BULK is considered
+ * @return the pipeline itself, or one of its lanes
+ */
+mc_PIPELINE *
+mcreq_pipeline_lane(mc_PIPELINE *pipeline, int vbid, int options);
+
+/**
+ * Select the lane for a packet from its key. This is what should be used to
+ * (re)schedule a packet, so that it is placed in the same lane regardless of
+ * the path that scheduled it. Packets are placed by vBucket, except for
+ * memcached (ketama) buckets which have none, where a hash of the key is
+ * used instead.
+ *
+ * @param pipeline the pipeline the packet was mapped to
+ * @param dist the distribution type of the configuration it was mapped with
+ * @param vbid the vBucket of the packet
+ * @param key the key the packet was mapped by
+ * @param nkey the size of the key
+ * @param options @ref MCREQ_BASICPACKET_F_BULK if the packet belongs in the
+ * bulk lane (see @ref MCREQ_F_BULK)
+ * @return the pipeline itself, or one of its lanes
+ */
+mc_PIPELINE *
+mcreq_key_lane(mc_PIPELINE *pipeline, lcbvb_DISTMODE dist, int vbid,
+    const void *key, lcb_SIZE nkey, int options);
+
+/**
+ * Select the lane for a packet being rescheduled on another pipeline, from
+ * its own key, vBucket and flags.
+ */
+mc_PIPELINE *
+mcreq_packet_lane(mc_PIPELINE *pipeline, lcbvb_DISTMODE dist,
+    const mc_PACKET *packet);
+
 /**
  * @brief Get the key from a packet
  * @param[in] packet The packet from which to retrieve the key
@@ -878,6 +997,23 @@ mcreq_pipeline_timeout(
         hrtime_t oldest_valid,
         hrtime_t *oldest_start);
 
+/**
+ * Remove the quiet packets (see @ref MCREQ_F_QUIET) which were sent before
+ * the given fence and which are still pending. This should be called once
+ * the reply to the fence was received: as the server processes commands in
+ * order, the replies to those packets were suppressed.
+ *
+ * @param pipeline the pipeline the fence was sent on
+ * @param fence the fence, which should already be removed from the pipeline
+ * @param failcb invoked (with LCB_KEY_ENOENT) for each packet removed.
+ * The packet is released once the callback returns
+ * @param cbarg
+ * @return the number of packets removed
+ */
+unsigned
+mcreq_pipeline_quiet_misses(mc_PIPELINE *pipeline, const mc_PACKET *fence,
+    mcreq_pktfail_fn failcb, void *cbarg);
+
 /**
  * This function is called when a packet could not be properly mapped to a real
  * pipeline
@@ -22,13 +22,24 @@
 #include "negotiate.h"
 #include "bucketconfig/clconfig.h"
 #include "mc/mcreq-flush-inl.h"
+#include <lcbio/iotable.h>
 #include <lcbio/ssl.h>
+#include <lcbio/capture.h>
 #include "ctx-log-inl.h"
 
 #define LOGARGS(c, lvl) (c)->settings, "server", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGFMT "<%s:%s> (SRV=%p,IX=%d) "
 #define LOGID(server) get_ctx_host(server->connctx), get_ctx_port(server->connctx), (void*)server, server->pipeline.index
 #define MCREQ_MAXIOV 32
+
+/** Weight of a new sample in the moving averages (1/8, as for TCP's SRTT) */
+#define HEALTH_EWMA_SHIFT 3
+
+/** Failure rate (in thousandths) above which a node is degraded */
+#define HEALTH_MAX_ERRORS 500
+
+/** Number of samples needed before a node may be considered degraded */
+#define HEALTH_MIN_SAMPLES 8
 #define LCBCONN_UNWANT(conn, flags) (conn)->want &= ~(flags)
 
 typedef enum {
@@ -107,10 +118,17 @@ LIBCOUCHBASE_API
 void
 lcb_sched_flush(lcb_t instance)
 {
-    unsigned ii;
+    unsigned ii, jj;
     for (ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
         mc_SERVER *server = LCBT_GET_SERVER(instance, ii);
 
+        for (jj = 0; jj < MCSERVER_NLANES(server); jj++) {
+            mc_SERVER *lane = MCSERVER_LANE(server, jj);
+            if (mcserver_has_pending(lane)) {
+                lane->pipeline.flush_start(&lane->pipeline);
+            }
+        }
+
         if (!mcserver_has_pending(server)) {
             continue;
         }
@@ -150,12 +168,8 @@ handle_nmv(mc_SERVER *oldsrv, packet_info *resinfo, mc_PACKET *oldpkt)
     }
 
     if (PACKET_NBODY(resinfo) && cccp->enabled) {
-        lcb_string s;
-
-        lcb_string_init(&s);
-        lcb_string_append(&s, PACKET_VALUE(resinfo), PACKET_NVALUE(resinfo));
-        err = lcb_cccp_update(cccp, mcserver_get_host(oldsrv), &s);
-        lcb_string_release(&s);
+        err = lcb_cccp_update_nmv(cccp, mcserver_get_host(oldsrv),
+            PACKET_VALUE(resinfo), PACKET_NVALUE(resinfo));
     }
 
     if (err != LCB_SUCCESS) {
@@ -173,6 +187,90 @@ handle_nmv(mc_SERVER *oldsrv, packet_info *resinfo, mc_PACKET *oldpkt)
     return 1;
 }
 
+static void
+health_sample(mc_SERVER *server, const mc_PACKET *pkt, int failed)
+{
+    lcb_S64 delta;
+
+    /* The start time of retried commands is that of the first attempt */
+    if (!pkt->retries) {
+        hrtime_t now = lcbio_now_fine(server->instance->iotable);
+        hrtime_t start = MCREQ_PKT_RDATA(pkt)->start;
+        lcb_U32 latency = now > start ? LCB_NS2US(now - start) : 0;
+        if (!server->nresponses && !server->nfailures) {
+            server->ewma_latency = latency;
+        } else {
+            delta = (lcb_S64)latency - server->ewma_latency;
+            server->ewma_latency += delta / (1 << HEALTH_EWMA_SHIFT);
+        }
+    }
+
+    delta = (lcb_S64)(failed ? 1000 : 0) - server->ewma_errors;
+    server->ewma_errors += delta / (1 << HEALTH_EWMA_SHIFT);
+    if (failed) {
+        server->nfailures++;
+    } else {
+        server->nresponses++;
+    }
+}
+
+void
+mcserver_get_health(const mc_SERVER *server, lcb_SERVERHEALTH *health)
+{
+    unsigned ii;
+    health->latency = server->ewma_latency;
+    health->errors = server->ewma_errors;
+    health->nresponses = server->nresponses;
+    health->nfailures = server->nfailures;
+
+    for (ii = 0; ii < MCSERVER_NLANES(server); ii++) {
+        const mc_SERVER *lane = MCSERVER_LANE(server, ii);
+        if (lane->ewma_latency > health->latency) {
+            health->latency = lane->ewma_latency;
+        }
+        if (lane->ewma_errors > health->errors) {
+            health->errors = lane->ewma_errors;
+        }
+        health->nresponses += lane->nresponses;
+        health->nfailures += lane->nfailures;
+    }
+
+    health->degraded = 0;
+    if (health->nresponses + health->nfailures >= HEALTH_MIN_SAMPLES) {
+        lcb_U32 maxlat = server->settings->degraded_latency;
+        if (health->errors >= HEALTH_MAX_ERRORS ||
+                (maxlat && health->latency >= maxlat)) {
+            health->degraded = 1;
+        }
+    }
+}
+
+int
+mcserver_is_degraded(const mc_SERVER *server)
+{
+    lcb_SERVERHEALTH health;
+    mcserver_get_health(server, &health);
+    return health.degraded;
+}
+
+/* Deliver a quiet command whose reply was suppressed as a miss */
+static void
+quiet_miss_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_error_t err, void *arg)
+{
+    packet_info info;
+    protocol_binary_request_header hdr;
+    protocol_binary_response_header *res = &info.res;
+
+    memset(&info, 0, sizeof(info));
+    mcreq_read_hdr(pkt, &hdr);
+    res->response.magic = PROTOCOL_BINARY_RES;
+    res->response.status = htons(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    res->response.opcode = hdr.request.opcode;
+    res->response.opaque = hdr.request.opaque;
+    mcreq_dispatch_response(pipeline, pkt, &info, LCB_SUCCESS);
+    (void)err; (void)arg;
+}
+
 #define PKT_READ_COMPLETE 1
 #define PKT_READ_PARTIAL 0
 
@@ -194,7 +292,7 @@ try_read(lcbio_CTX *ctx, mc_SERVER *server, rdb_IOROPE *ior)
     unsigned pktsize = 24, is_last = 1;
 
     #define RETURN_NEED_MORE(n) \
-        if (mcserver_has_pending(server)) { \
+        if (ctx && mcserver_has_pending(server)) { \
             lcbio_ctx_rwant(ctx, n); \
         } \
         return PKT_READ_PARTIAL; \
@@ -237,6 +335,16 @@ try_read(lcbio_CTX *ctx, mc_SERVER *server, rdb_IOROPE *ior)
         return PKT_READ_COMPLETE;
     }
 
+    if (is_last) {
+        health_sample(server, request,
+            PACKET_STATUS(info) == PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+    }
+
+    if (PACKET_OPCODE(info) == PROTOCOL_BINARY_CMD_NOOP) {
+        /* Fence for quiet commands */
+        mcreq_pipeline_quiet_misses(pl, request, quiet_miss_callback, NULL);
+    }
+
     if (PACKET_STATUS(info) == PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET) {
         /* consume the header */
         DO_ASSIGN_PAYLOAD()
@@ -244,6 +352,10 @@ try_read(lcbio_CTX *ctx, mc_SERVER *server, rdb_IOROPE *ior)
             mcreq_dispatch_response(pl, request, info, LCB_NOT_MY_VBUCKET);
         }
         DO_SWALLOW_PAYLOAD()
+        /* The retried command is a copy; the original is done either way */
+        if (is_last) {
+            mcreq_packet_handled(pl, request);
+        }
         return PKT_READ_COMPLETE;
     }
 
@@ -291,13 +403,26 @@ on_read(lcbio_CTX *ctx, unsigned nb)
         return;
     }
 
+    LCBIO_CLOCK_ENTER(server->instance->iotable);
+    lcb_respbatch_enter(server->instance);
     while ((rv = try_read(ctx, server, ior)) == PKT_READ_COMPLETE);
+    lcb_respbatch_leave(server->instance);
+    LCBIO_CLOCK_LEAVE(server->instance->iotable);
     lcbio_ctx_schedule(ctx);
     lcb_maybe_breakout(server->instance);
 
     (void)nb;
 }
 
+LCB_INTERNAL_API
+void
+mcserver__read_responses(mc_SERVER *server, rdb_IOROPE *ior)
+{
+    lcb_respbatch_enter(server->instance);
+    while (try_read(NULL, server, ior) == PKT_READ_COMPLETE);
+    lcb_respbatch_leave(server->instance);
+}
+
 LCB_INTERNAL_API
 int
 mcserver_has_pending(mc_SERVER *server)
@@ -347,6 +472,7 @@ fail_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_error_t err, void *arg)
     protocol_binary_request_header hdr;
     protocol_binary_response_header *res = &info.res;
 
+    health_sample(server, pkt, 1);
     if (maybe_retry(pipeline, pkt, err)) {
         return;
     }
@@ -416,6 +542,10 @@ static void flush_errdrain(mc_PIPELINE *pipeline)
 void
 mcserver_fail_chain(mc_SERVER *server, lcb_error_t err)
 {
+    unsigned ii;
+    for (ii = 0; ii < MCSERVER_NLANES(server); ii++) {
+        purge_single_server(MCSERVER_LANE(server, ii), err, 0, NULL, REFRESH_NEVER);
+    }
     purge_single_server(server, err, 0, NULL, REFRESH_NEVER);
 }
 
@@ -430,7 +560,7 @@ get_next_timeout(mc_SERVER *server)
         return MCSERVER_TIMEOUT(server);
     }
 
-    now = gethrtime();
+    now = lcbio_now(server->instance->iotable);
     expiry = MCREQ_PKT_RDATA(pkt)->start + LCB_US2NS(MCSERVER_TIMEOUT(server));
     if (expiry <= now) {
         diff = 0;
@@ -449,7 +579,7 @@ timeout_server(void *arg)
     uint32_t next_us;
     int npurged;
 
-    now = gethrtime();
+    now = lcbio_now(server->instance->iotable);
     min_valid = now - LCB_US2NS(MCSERVER_TIMEOUT(server));
     npurged = purge_single_server(server,
         LCB_ETIMEDOUT, min_valid, &next_ns, REFRESH_ONFAILED);
@@ -500,6 +630,9 @@ on_connected(lcbio_SOCKET *sock, void *data, lcb_error_t err, lcbio_OSERR syserr
     procs.cb_flush_ready = on_flush_ready;
     server->connctx = lcbio_ctx_new(sock, server, &procs);
     server->connctx->subsys = "memcached";
+    if (server->settings->capture) {
+        lcbio_ctx_capture(server->connctx, server->settings->capture);
+    }
     server->pipeline.flush_start = (mcreq_flushstart_fn)mcserver_flush;
 
     tmo = get_next_timeout(server);
@@ -535,8 +668,8 @@ dupstr_or_null(const char *s) {
     return NULL;
 }
 
-mc_SERVER *
-mcserver_alloc2(lcb_t instance, lcbvb_CONFIG* vbc, int ix)
+static mc_SERVER *
+server_alloc(lcb_t instance, lcbvb_CONFIG* vbc, int ix)
 {
     mc_SERVER *ret;
     lcbvb_SVCMODE mode;
@@ -564,6 +697,42 @@ mcserver_alloc2(lcb_t instance, lcbvb_CONFIG* vbc, int ix)
     return ret;
 }
 
+mc_SERVER *
+mcserver_alloc2(lcb_t instance, lcbvb_CONFIG* vbc, int ix)
+{
+    unsigned ii, nlanes;
+    mc_SERVER *ret = server_alloc(instance, vbc, ix);
+    if (!ret) {
+        return ret;
+    }
+
+    nlanes = ret->settings->kv_nconns > 1 ? ret->settings->kv_nconns - 1 : 0;
+    if (!nlanes) {
+        return ret;
+    }
+
+    ret->pipeline.lanes = calloc(nlanes, sizeof(*ret->pipeline.lanes));
+    if (!ret->pipeline.lanes) {
+        return ret;
+    }
+
+    for (ii = 0; ii < nlanes; ii++) {
+        mc_SERVER *lane = server_alloc(instance, vbc, ix);
+        if (!lane) {
+            break;
+        }
+        ret->pipeline.lanes[ii] = &lane->pipeline;
+        ret->pipeline.nlanes++;
+    }
+
+    /* Only dedicate a lane to large values if there is at least one other */
+    if (ret->settings->kv_bulk_threshold && ret->pipeline.nlanes) {
+        ret->pipeline.bulk_lane = 1;
+    }
+    lcb_log(LOGARGS(ret, DEBUG), "<%s> (SRV=%p) Using %u additional connections (bulk lane: %s)", ret->datahost, (void*)ret, ret->pipeline.nlanes, ret->pipeline.bulk_lane ? "yes" : "no");
+    return ret;
+}
+
 mc_SERVER *
 mcserver_alloc(lcb_t instance, int ix)
 {
@@ -585,6 +754,7 @@ server_free(mc_SERVER *server)
     free(server->viewshost);
     free(server->datahost);
     free(server->curhost);
+    free(server->pipeline.lanes);
     lcb_settings_unref(server->settings);
     free(server);
 }
@@ -641,8 +811,15 @@ server_socket_failed(mc_SERVER *server, lcb_error_t err)
 void
 mcserver_close(mc_SERVER *server)
 {
+    unsigned ii;
+
     /* Should never be called twice */
     lcb_assert(server->state != S_CLOSED);
+
+    /* Lanes are freed independently once their own I/O has drained */
+    for (ii = 0; ii < MCSERVER_NLANES(server); ii++) {
+        start_errored_ctx(MCSERVER_LANE(server, ii), S_CLOSED);
+    }
     start_errored_ctx(server, S_CLOSED);
 }
 
@@ -32,8 +32,14 @@ struct lcb_server_st;
 
 /**
  * The structure representing each couchbase server
+ *
+ * If more than one connection per node is configured (see
+ * @ref LCB_CNTL_KV_NCONNS), the additional connections are themselves
+ * mc_SERVER objects ("lanes") referenced by the `pipeline.lanes` array of the
+ * primary server. Each lane has its own socket, timer and command log, but
+ * is not part of the command queue's server list.
  */
-typedef struct {
+typedef struct mc_SERVER_st {
     /** Pipeline object for command queues */
     mc_PIPELINE pipeline;
 
@@ -65,8 +71,24 @@ typedef struct {
 
     /** Request for current connection */
     lcb_host_t *curhost;
+
+    /** Moving average of the response time, in microseconds */
+    lcb_U32 ewma_latency;
+
+    /** Moving average of the failure rate, in thousandths */
+    lcb_U32 ewma_errors;
+
+    /** Number of responses received, and of commands which failed */
+    lcb_U64 nresponses;
+    lcb_U64 nfailures;
 } mc_SERVER;
 
+/** Number of additional connections (lanes) held by a server */
+#define MCSERVER_NLANES(server) (server)->pipeline.nlanes
+
+/** Get the lane at the given index. See mc_SERVER */
+#define MCSERVER_LANE(server, ix) ((mc_SERVER *)(server)->pipeline.lanes[ix])
+
 #define MCSERVER_TIMEOUT(c) (c)->settings->operation_timeout
 
 /**
@@ -83,9 +105,9 @@ mc_SERVER *
 mcserver_alloc2(lcb_t instance, lcbvb_CONFIG* vbc, int ix);
 
 /**
- * Close the server. The resources of the server may still continue to persist
- * internally for a bit until all callbacks have been delivered and all buffers
- * flushed and/or failed.
+ * Close the server and any of its lanes. The resources of the server may still
+ * continue to persist internally for a bit until all callbacks have been
+ * delivered and all buffers flushed and/or failed.
  * @param server the server to release
  */
 void
@@ -108,19 +130,46 @@ mcserver_flush(mc_SERVER *server);
  * @param err the error code by which to fail the commands
  *
  * @note This function does not modify the server's socket or state in itself,
- * but rather simply wipes the commands from its queue
+ * but rather simply wipes the commands from its queue (and those of its lanes)
  */
 void
 mcserver_fail_chain(mc_SERVER *server, lcb_error_t err);
 
 /**
  * Returns true or false depending on whether there are pending commands on
- * this server
+ * this server. Only the server's own queue is checked; lanes must be checked
+ * individually.
  */
 LCB_INTERNAL_API
 int
 mcserver_has_pending(mc_SERVER *server);
 
+/**
+ * Handle the complete responses in a read buffer as if they had been read
+ * from the server's socket. This allows response handling to be tested
+ * without a connection.
+ */
+LCB_INTERNAL_API
+void
+mcserver__read_responses(mc_SERVER *server, rdb_IOROPE *ior);
+
+/**
+ * Get the health of the node served by this server. The figures of its lanes
+ * are combined with its own; the node is judged by its worst connection.
+ * @param server the server
+ * @param[out] health the health. The `index` field is left untouched
+ */
+void
+mcserver_get_health(const mc_SERVER *server, lcb_SERVERHEALTH *health);
+
+/**
+ * Whether the node is considered degraded, i.e. its responses are slower than
+ * @ref LCB_CNTL_DEGRADED_LATENCY or too many commands sent to it fail. This is
+ * used to steer hedged reads and retries away from it.
+ */
+int
+mcserver_is_degraded(const mc_SERVER *server);
+
 #define mcserver_get_host(server) (server)->curhost->host
 #define mcserver_get_port(server) (server)->curhost->port
 
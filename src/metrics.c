@@ -0,0 +1,302 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "metrics.h"
+#include "retryq.h"
+#include "rdb/bigalloc.h"
+#include <lcbio/ctx.h>
+#include <lcbio/faults.h>
+
+struct lcb_METRICSBUF_st {
+    lcb_METRIC *metrics;
+    lcb_SIZE nmetrics;
+    lcb_SIZE nalloc;
+    lcb_METRICBUCKET *buckets;
+    lcb_SIZE nbuckets;
+    lcb_SIZE nbuckets_alloc;
+    int failed; /**< An allocation failed while taking the snapshot */
+};
+
+typedef void (*metrics_COLLECTOR)(lcb_t instance, lcb_METRICSBUF *buf);
+
+static lcb_METRIC *
+add_metric(lcb_METRICSBUF *buf, const char *subsystem, const char *name,
+    int server, lcb_METRICTYPE type)
+{
+    lcb_METRIC *metric;
+    if (buf->nmetrics == buf->nalloc) {
+        lcb_SIZE nalloc = buf->nalloc ? buf->nalloc * 2 : 64;
+        lcb_METRIC *metrics = realloc(buf->metrics, sizeof(*metrics) * nalloc);
+        if (!metrics) {
+            buf->failed = 1;
+            return NULL;
+        }
+        buf->metrics = metrics;
+        buf->nalloc = nalloc;
+    }
+    metric = buf->metrics + buf->nmetrics++;
+    memset(metric, 0, sizeof(*metric));
+    metric->subsystem = subsystem;
+    metric->name = name;
+    metric->server = server;
+    metric->type = type;
+    return metric;
+}
+
+static void
+add_value(lcb_METRICSBUF *buf, const char *subsystem, const char *name,
+    int server, lcb_METRICTYPE type, lcb_U64 value)
+{
+    lcb_METRIC *metric = add_metric(buf, subsystem, name, server, type);
+    if (metric) {
+        metric->value = value;
+    }
+}
+
+#define ADD_COUNTER(buf, subsys, name, ix, value) \
+    add_value(buf, subsys, name, ix, LCB_METRIC_COUNTER, value)
+#define ADD_GAUGE(buf, subsys, name, ix, value) \
+    add_value(buf, subsys, name, ix, LCB_METRIC_GAUGE, value)
+
+/* Command queues, see lcb_admission_stats() */
+static void
+collect_queue(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    const mc_CMDQUEUE *cq = &instance->cmdq;
+    unsigned ii, jj;
+
+    ADD_GAUGE(buf, "queue", "npkts", -1, cq->nqpkts);
+    ADD_GAUGE(buf, "queue", "nbytes", -1, cq->nqbytes);
+    ADD_COUNTER(buf, "queue", "nrejected", -1, instance->admission.nrejected);
+    ADD_COUNTER(buf, "queue", "npauses", -1, instance->admission.npauses);
+
+    for (ii = 0; ii < cq->npipelines; ii++) {
+        const mc_PIPELINE *pl = cq->pipelines[ii];
+        lcb_U64 npkts = 0, nbytes = 0;
+        for (jj = 0; jj <= pl->nlanes; jj++) {
+            const mc_PIPELINE *cur = jj ? pl->lanes[jj - 1] : pl;
+            npkts += cur->nqpkts;
+            nbytes += cur->nqbytes;
+        }
+        ADD_GAUGE(buf, "queue", "npkts", ii, npkts);
+        ADD_GAUGE(buf, "queue", "nbytes", ii, nbytes);
+    }
+}
+
+/* Responses and failures, see mcserver_get_health() */
+static void
+collect_server(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    unsigned ii;
+    for (ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        lcb_SERVERHEALTH health;
+        mcserver_get_health(LCBT_GET_SERVER(instance, ii), &health);
+        ADD_COUNTER(buf, "server", "nresponses", ii, health.nresponses);
+        ADD_COUNTER(buf, "server", "nfailures", ii, health.nfailures);
+        ADD_GAUGE(buf, "server", "latency", ii, health.latency);
+        ADD_GAUGE(buf, "server", "degraded", ii, health.degraded);
+    }
+}
+
+/* Connections to the data nodes, see lcbio_mgr_get_stats() */
+static void
+collect_pool(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    unsigned ii;
+    for (ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        const mc_SERVER *server = LCBT_GET_SERVER(instance, ii);
+        lcbio_MGRSTATS stats;
+
+        if (!server->curhost || !instance->memd_sockpool) {
+            memset(&stats, 0, sizeof(stats));
+        } else {
+            lcbio_mgr_get_stats(instance->memd_sockpool, server->curhost, &stats);
+        }
+        ADD_GAUGE(buf, "pool", "nidle", ii, stats.nidle);
+        ADD_GAUGE(buf, "pool", "npending", ii, stats.npending);
+        ADD_GAUGE(buf, "pool", "nleased", ii, stats.nleased);
+        ADD_COUNTER(buf, "pool", "nrequests", ii, stats.nrequests);
+        ADD_COUNTER(buf, "pool", "nconnect", ii, stats.nconnect);
+        ADD_COUNTER(buf, "pool", "nconnect_err", ii, stats.nconnect_err);
+    }
+}
+
+/* Buffers for the packets' headers and values (mc_PIPELINE::nbmgr) and for
+ * the packets themselves (mc_PIPELINE::reqpool) */
+static void
+collect_netbuf(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    const mc_CMDQUEUE *cq = &instance->cmdq;
+    unsigned ii, jj;
+
+    for (ii = 0; ii < cq->npipelines; ii++) {
+        const mc_PIPELINE *pl = cq->pipelines[ii];
+        lcb_U64 nallocs = 0, nbytes = 0;
+        for (jj = 0; jj <= pl->nlanes; jj++) {
+            const mc_PIPELINE *cur = jj ? pl->lanes[jj - 1] : pl;
+            nallocs += cur->nbmgr.datapool.nallocs + cur->reqpool.datapool.nallocs;
+            nbytes += cur->nbmgr.datapool.nbytes + cur->reqpool.datapool.nbytes;
+        }
+        ADD_COUNTER(buf, "netbuf", "nallocs", ii, nallocs);
+        ADD_GAUGE(buf, "netbuf", "nbytes", ii, nbytes);
+    }
+}
+
+/* Read buffers of the current connections, if allocated by rdb_bigalloc_new().
+ * These are reset whenever a connection is replaced */
+static void
+collect_rope(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    unsigned ii, jj;
+    for (ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        const mc_SERVER *server = LCBT_GET_SERVER(instance, ii);
+        lcb_U64 nmalloc = 0, nrequests = 0, ntoobig = 0, ntoosmall = 0;
+        for (jj = 0; jj <= MCSERVER_NLANES(server); jj++) {
+            const mc_SERVER *cur = jj ? MCSERVER_LANE(server, jj - 1) : server;
+            const rdb_BIGALLOC *alloc;
+            if (!cur->connctx) {
+                continue;
+            }
+            alloc = rdb_bigalloc_cast(cur->connctx->ior.recvd.allocator);
+            if (!alloc) {
+                continue;
+            }
+            nmalloc += alloc->total_malloc;
+            nrequests += alloc->total_requests;
+            ntoobig += alloc->total_toobig;
+            ntoosmall += alloc->total_toosmall;
+        }
+        ADD_COUNTER(buf, "rope", "nmalloc", ii, nmalloc);
+        ADD_COUNTER(buf, "rope", "nrequests", ii, nrequests);
+        ADD_COUNTER(buf, "rope", "ntoobig", ii, ntoobig);
+        ADD_COUNTER(buf, "rope", "ntoosmall", ii, ntoosmall);
+    }
+}
+
+static void
+collect_retryq(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    const lcb_RETRYQ *rq = instance->retryq;
+    if (!rq) {
+        return;
+    }
+    ADD_GAUGE(buf, "retryq", "npending", -1, rq->npending);
+    ADD_COUNTER(buf, "retryq", "nadded", -1, rq->nadded);
+    ADD_COUNTER(buf, "retryq", "nfailed", -1, rq->nfailed);
+}
+
+/* Injected faults, if enabled with LCB_CNTL_FAULT_SCRIPT */
+static void
+collect_faults(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    lcbio_FAULTSTATS stats;
+    if (!LCBT_SETTING(instance, faults)) {
+        return;
+    }
+    lcbio_faults_stats(LCBT_SETTING(instance, faults), &stats);
+    ADD_COUNTER(buf, "faults", "ndelayed", -1, stats.ndelayed);
+    ADD_COUNTER(buf, "faults", "nthrottled", -1, stats.nthrottled);
+    ADD_COUNTER(buf, "faults", "npartial", -1, stats.npartial);
+    ADD_COUNTER(buf, "faults", "nstalls", -1, stats.nstalls);
+    ADD_COUNTER(buf, "faults", "nresets", -1, stats.nresets);
+}
+
+/* Latencies, if enabled with lcb_enable_timings() */
+static void
+collect_timings(lcb_t instance, lcb_METRICSBUF *buf)
+{
+    lcb_METRIC *metric;
+
+    if (!instance->histogram) {
+        return;
+    }
+    if (buf->nbuckets_alloc - buf->nbuckets < LCB_HISTOGRAM_NBUCKETS) {
+        lcb_SIZE nalloc = buf->nbuckets + LCB_HISTOGRAM_NBUCKETS;
+        lcb_METRICBUCKET *buckets = realloc(
+            buf->buckets, sizeof(*buckets) * nalloc);
+        if (!buckets) {
+            buf->failed = 1;
+            return;
+        }
+        buf->buckets = buckets;
+        buf->nbuckets_alloc = nalloc;
+    }
+    if ((metric = add_metric(buf, "kv", "latency", -1, LCB_METRIC_HISTOGRAM))) {
+        /* Pointed to the buckets once the snapshot is complete */
+        metric->nbuckets = lcb_histogram_buckets(instance->histogram,
+            buf->buckets + buf->nbuckets, &metric->value);
+        buf->nbuckets += metric->nbuckets;
+    }
+}
+
+/** The subsystems, in the order their metrics appear in snapshots */
+static const metrics_COLLECTOR collectors[] = {
+    collect_queue,
+    collect_server,
+    collect_pool,
+    collect_netbuf,
+    collect_rope,
+    collect_retryq,
+    collect_timings,
+    collect_faults,
+    NULL
+};
+
+lcb_error_t
+lcb_metrics_snapshot(lcb_t instance, lcb_METRICS *metrics)
+{
+    lcb_METRICSBUF *buf = instance->metrics;
+    const metrics_COLLECTOR *collector;
+    lcb_SIZE ii, nbuckets = 0;
+
+    if (!buf) {
+        if ((buf = calloc(1, sizeof(*buf))) == NULL) {
+            return LCB_CLIENT_ENOMEM;
+        }
+        instance->metrics = buf;
+    }
+    buf->nmetrics = 0;
+    buf->nbuckets = 0;
+    buf->failed = 0;
+
+    for (collector = collectors; *collector; collector++) {
+        (*collector)(instance, buf);
+    }
+    if (buf->failed) {
+        return LCB_CLIENT_ENOMEM;
+    }
+
+    for (ii = 0; ii < buf->nmetrics; ii++) {
+        lcb_METRIC *metric = buf->metrics + ii;
+        if (metric->type == LCB_METRIC_HISTOGRAM) {
+            metric->buckets = buf->buckets + nbuckets;
+            nbuckets += metric->nbuckets;
+        }
+    }
+    metrics->metrics = buf->metrics;
+    metrics->nmetrics = buf->nmetrics;
+    return LCB_SUCCESS;
+}
+
+void
+lcb_metrics_destroy(lcb_METRICSBUF *buf)
+{
+    free(buf->metrics);
+    free(buf->buckets);
+    free(buf);
+}
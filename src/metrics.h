@@ -0,0 +1,77 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_METRICS_H
+#define LCB_METRICS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Snapshots of internal counters
+ *
+ * @defgroup lcb-metrics Metrics
+ *
+ * @details
+ * The counters are those the subsystems keep for themselves (see e.g.
+ * lcb_admission_stats(), lcbio_mgr_get_stats() or rdb_BIGALLOC), so keeping
+ * them costs nothing beyond what is already done. A snapshot reads them
+ * through the collectors registered in metrics.c, each of which appends the
+ * metrics of one subsystem, and is stored in a buffer owned by the instance
+ * so that taking one does not allocate once the buffer is large enough.
+ *
+ * @addtogroup lcb-metrics
+ * @{
+ */
+
+typedef struct lcb_METRICSBUF_st lcb_METRICSBUF;
+
+/**
+ * Take a snapshot of the metrics
+ * @param instance
+ * @param[out] metrics the snapshot, valid until the next one is taken or
+ * the instance is destroyed
+ * @return LCB_CLIENT_ENOMEM if the snapshot could not be stored
+ */
+lcb_error_t
+lcb_metrics_snapshot(lcb_t instance, lcb_METRICS *metrics);
+
+void
+lcb_metrics_destroy(lcb_METRICSBUF *buf);
+
+/** Most buckets lcb_histogram_buckets() may write */
+#define LCB_HISTOGRAM_NBUCKETS (1 + 100 + 100 + 100 + 10)
+
+/**
+ * Convert the timings histogram (see lcb_enable_timings()) to metric buckets
+ * @param hg the histogram
+ * @param[out] buckets the nonempty buckets, in increasing order. There must
+ * be room for LCB_HISTOGRAM_NBUCKETS
+ * @param[out] nsamples the total number of samples
+ * @return the number of buckets written
+ */
+lcb_SIZE
+lcb_histogram_buckets(const struct lcb_histogram_st *hg,
+                      lcb_METRICBUCKET *buckets, lcb_U64 *nsamples);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
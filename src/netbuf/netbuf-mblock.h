@@ -213,6 +213,12 @@ typedef struct netbuf_mblock_st {
     nb_MBLOCK *cacheblocks;
     nb_SIZE ncacheblocks;
 
+    /** Number of buffers allocated from the heap */
+    unsigned long nallocs;
+
+    /** Total size of the buffers currently allocated */
+    unsigned long nbytes;
+
     struct netbuf_st *mgr;
 } nb_MBPOOL;
 
@@ -61,7 +61,7 @@ static void mblock_release_data(nb_MBPOOL*,nb_MBLOCK*,nb_SIZE,nb_SIZE);
 static void mblock_release_ptr(nb_MBPOOL*,char*,nb_SIZE);
 static void mblock_init(nb_MBPOOL*);
 static void mblock_cleanup(nb_MBPOOL*);
-static void mblock_wipe_block(nb_MBLOCK *block);
+static void mblock_wipe_block(nb_MBPOOL *pool, nb_MBLOCK *block);
 
 /******************************************************************************
  ******************************************************************************
@@ -121,6 +121,8 @@ alloc_new_block(nb_MBPOOL *pool, nb_SIZE capacity)
         return NULL;
     }
 
+    pool->nallocs++;
+    pool->nbytes += ret->nalloc;
     return ret;
 }
 
@@ -374,7 +376,7 @@ mblock_release_data(nb_MBPOOL *pool,
         sllist_append(&pool->avail, &block->slnode);
         pool->curblocks++;
     } else {
-        mblock_wipe_block(block);
+        mblock_wipe_block(pool, block);
     }
 }
 
@@ -441,9 +443,10 @@ mblock_get_next_size(const nb_MBPOOL *pool, int allow_wrap)
 }
 
 static void
-mblock_wipe_block(nb_MBLOCK *block)
+mblock_wipe_block(nb_MBPOOL *pool, nb_MBLOCK *block)
 {
     if (block->root) {
+        pool->nbytes -= block->nalloc;
         free(block->root);
     }
     if (block->deallocs) {
@@ -473,9 +476,8 @@ free_blocklist(nb_MBPOOL *pool, sllist_root *list)
     SLLIST_ITERFOR(list, &iter) {
         nb_MBLOCK *block = SLLIST_ITEM(iter.cur, nb_MBLOCK, slnode);
         sllist_iter_remove(list, &iter);
-        mblock_wipe_block(block);
+        mblock_wipe_block(pool, block);
     }
-    (void)pool;
 }
 
 
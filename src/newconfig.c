@@ -136,18 +136,19 @@ iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, void *arg)
     mc_SERVER *srv = (mc_SERVER *)oldpl;
     mc_PIPELINE *newpl;
     mc_PACKET *newpkt;
-    int newix;
+    int newix, vbid;
 
     (void)arg;
 
     mcreq_read_hdr(oldpkt, &hdr);
+    vbid = ntohs(hdr.request.vbucket);
 
     if (!lcb_should_retry(srv->settings, oldpkt, LCB_MAX_ERROR)) {
         return MCREQ_KEEP_PACKET;
     }
 
     if (LCBVB_DISTTYPE(cq->config) == LCBVB_DIST_VBUCKET) {
-        newix = lcbvb_vbmaster(cq->config, ntohs(hdr.request.vbucket));
+        newix = lcbvb_vbmaster(cq->config, vbid);
 
     } else {
         const void *key = NULL;
@@ -166,6 +167,9 @@ iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, void *arg)
 
 
     newpl = cq->pipelines[newix];
+    if (newpl != NULL) {
+        newpl = mcreq_packet_lane(newpl, LCBVB_DISTTYPE(cq->config), oldpkt);
+    }
     if (newpl == oldpl || newpl == NULL) {
         return MCREQ_KEEP_PACKET;
     }
@@ -226,7 +230,11 @@ replace_config(lcb_t instance, clconfig_info *next_config)
      */
     mcreq_queue_add_pipelines(cq, ppnew, nnew, next_config->vbc);
     for (ii = 0; ii < nnew; ii++) {
+        unsigned jj;
         mcreq_iterwipe(cq, ppnew[ii], iterwipe_cb, NULL);
+        for (jj = 0; jj < ppnew[ii]->nlanes; jj++) {
+            mcreq_iterwipe(cq, ppnew[ii]->lanes[jj], iterwipe_cb, NULL);
+        }
     }
 
     /**
@@ -234,19 +242,30 @@ replace_config(lcb_t instance, clconfig_info *next_config)
      * from their queues into the new queues
      */
     for (ii = 0; ii < nold; ii++) {
+        unsigned jj;
         if (!ppold[ii]) {
             continue;
         }
 
         mcreq_iterwipe(cq, ppold[ii], iterwipe_cb, NULL);
+        for (jj = 0; jj < ppold[ii]->nlanes; jj++) {
+            mcreq_iterwipe(cq, ppold[ii]->lanes[jj], iterwipe_cb, NULL);
+        }
         mcserver_fail_chain((mc_SERVER *)ppold[ii], LCB_MAP_CHANGED);
         mcserver_close((mc_SERVER *)ppold[ii]);
     }
 
     for (ii = 0; ii < nnew; ii++) {
+        unsigned jj;
         if (mcserver_has_pending((mc_SERVER*)ppnew[ii])) {
             ppnew[ii]->flush_start(ppnew[ii]);
         }
+        for (jj = 0; jj < ppnew[ii]->nlanes; jj++) {
+            mc_PIPELINE *lane = ppnew[ii]->lanes[jj];
+            if (mcserver_has_pending((mc_SERVER*)lane)) {
+                lane->flush_start(lane);
+            }
+        }
     }
 
     free(ppnew);
@@ -326,6 +345,7 @@ void lcb_update_vbconfig(lcb_t instance, clconfig_info *config)
             hostlist_add_stringz(instance->ht_nodes, hp, LCB_CONFIG_HTTP_PORT);
         }
     }
+    lcb_http_pool_warmup(instance);
 
     instance->callbacks.configuration(instance, change_status);
     lcb_maybe_breakout(instance);
@@ -15,6 +15,8 @@
  *   limitations under the License.
  */
 #include "internal.h"
+#include "kvcache.h"
+#include "counteragg.h"
 #include "trace.h"
 
 LIBCOUCHBASE_API
@@ -27,6 +29,7 @@ lcb_counter3(
     mc_PACKET *packet;
     mc_REQDATA *rdata;
     lcb_error_t err;
+    int pktopts = MCREQ_BASICPACKET_F_FALLBACKOK;
 
     protocol_binary_request_incr acmd;
     protocol_binary_request_header *hdr = &acmd.message.header;
@@ -37,9 +40,17 @@ lcb_counter3(
     if (cmd->cas || (cmd->create == 0 && cmd->exptime != 0)) {
         return LCB_OPTIONS_CONFLICT;
     }
+    if (LCB_COUNTERAGG_ENABLED(instance) &&
+            lcb_counteragg_add(instance, cookie, cmd)) {
+        return LCB_SUCCESS;
+    }
+
+    if (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) {
+        pktopts |= MCREQ_BASICPACKET_F_NOADMIT;
+    }
 
     err = mcreq_basic_packet(q, (const lcb_CMDBASE *)cmd, hdr, 20, &packet,
-        &pipeline, MCREQ_BASICPACKET_F_FALLBACKOK);
+        &pipeline, pktopts);
 
     if (err != LCB_SUCCESS) {
         return err;
@@ -47,7 +58,10 @@ lcb_counter3(
 
     rdata = &packet->u_rdata.reqdata;
     rdata->cookie = cookie;
-    rdata->start = gethrtime();
+    rdata->start = lcbio_now_fine(instance->iotable);
+    if (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) {
+        packet->flags |= MCREQ_F_PRIVCALLBACK;
+    }
     hdr->request.magic = PROTOCOL_BINARY_REQ;
     hdr->request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     hdr->request.cas = 0;
@@ -73,6 +87,7 @@ lcb_counter3(
 
     memcpy(SPAN_BUFFER(&packet->kh_span), acmd.bytes, sizeof(acmd.bytes));
     TRACE_ARITHMETIC_BEGIN(hdr, cmd);
+    lcb_kvcache_invalidate(instance, packet);
     mcreq_sched_add(pipeline, packet);
     return LCB_SUCCESS;
 }
@@ -589,7 +589,7 @@ dset_ctx_schedule(lcb_MULTICMD_CTX *mctx, const void *cookie)
     dset_ref(dset);
     dset->cookie = cookie;
     dset->nremaining = dset->nentries;
-    dset->ns_timeout = gethrtime() + LCB_US2NS(DSET_OPTFLD(dset, timeout));
+    dset->ns_timeout = lcbio_now(dset->instance->iotable) + LCB_US2NS(DSET_OPTFLD(dset, timeout));
 
 
     lcb_aspend_add(&dset->instance->pendops, LCB_PENDTYPE_DURABILITY, dset);
@@ -743,7 +743,7 @@ void lcb_durability_dset_destroy(lcb_DURSET *dset)
 static void timer_callback(lcb_socket_t sock, short which, void *arg)
 {
     lcb_DURSET *dset = arg;
-    hrtime_t now = gethrtime();
+    hrtime_t now = lcbio_now(dset->instance->iotable);
 
     if (dset->ns_timeout && now > dset->ns_timeout) {
         dset->next_state = STATE_TIMEOUT;
@@ -781,7 +781,7 @@ timer_schedule(lcb_DURSET *dset, unsigned int state)
 {
     lcb_U32 delay = 0;
     lcbio_TABLE* io = dset->instance->iotable;
-    hrtime_t now = gethrtime();
+    hrtime_t now = lcbio_now(io);
 
     if (state == STATE_TIMEOUT) {
         if (dset->ns_timeout && now < dset->ns_timeout) {
@@ -17,6 +17,9 @@
 
 #include "internal.h"
 #include "trace.h"
+#include "kvcache.h"
+#include "hedge.h"
+#include "singleflight.h"
 
 LIBCOUCHBASE_API
 lcb_error_t
@@ -29,6 +32,7 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
     lcb_error_t err;
     lcb_uint8_t extlen = 0;
     lcb_uint8_t opcode = PROTOCOL_BINARY_CMD_GET;
+    int pktopts = MCREQ_BASICPACKET_F_FALLBACKOK;
     protocol_binary_request_gat gcmd;
     protocol_binary_request_header *hdr = &gcmd.message.header;
 
@@ -38,6 +42,14 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
     if (cmd->cas) {
         return LCB_OPTIONS_CONFLICT;
     }
+    if (lcb_kvcache_get3(instance, cookie, cmd)) {
+        return LCB_SUCCESS;
+    }
+    if (LCB_SINGLEFLIGHT_ENABLED(instance) && !cmd->lock && !cmd->exptime &&
+            !(cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) &&
+            lcb_singleflight_join(instance, cookie, cmd)) {
+        return LCB_SUCCESS;
+    }
 
     if (cmd->lock) {
         extlen = 4;
@@ -47,15 +59,19 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
         opcode = PROTOCOL_BINARY_CMD_GAT;
     }
 
+    if (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) {
+        pktopts |= MCREQ_BASICPACKET_F_NOADMIT;
+    }
+
     err = mcreq_basic_packet(q, (const lcb_CMDBASE *)cmd, hdr, extlen, &pkt, &pl,
-        MCREQ_BASICPACKET_F_FALLBACKOK);
+        pktopts);
     if (err != LCB_SUCCESS) {
         return err;
     }
 
     rdata = &pkt->u_rdata.reqdata;
     rdata->cookie = cookie;
-    rdata->start = gethrtime();
+    rdata->start = lcbio_now_fine(instance->iotable);
 
     hdr->request.magic = PROTOCOL_BINARY_REQ;
     hdr->request.opcode = opcode;
@@ -67,12 +83,25 @@ lcb_get3(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
     if (extlen) {
         gcmd.message.body.expiration = htonl(cmd->exptime);
     }
+    if (opcode == PROTOCOL_BINARY_CMD_GET && pl != q->fallback &&
+            LCBT_SETTING(instance, get_quiet)) {
+        /* Sent as a regular GET unless other GETs are scheduled on the same
+         * pipeline (see MCREQ_F_QUIET) */
+        hdr->request.opcode = PROTOCOL_BINARY_CMD_GETQ;
+        pkt->flags |= MCREQ_F_QUIET;
+    }
+
+    memcpy(SPAN_BUFFER(&pkt->kh_span), gcmd.bytes, MCREQ_PKT_BASESIZE + extlen);
 
     if (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) {
         pkt->flags |= MCREQ_F_PRIVCALLBACK;
+    } else if (opcode == PROTOCOL_BINARY_CMD_GET && LCB_HEDGE_ENABLED(instance)) {
+        lcb_hedge_prepare(instance, pkt);
+    }
+    if (opcode == PROTOCOL_BINARY_CMD_GET && LCB_SINGLEFLIGHT_ENABLED(instance) &&
+            !(pkt->flags & (MCREQ_F_REQEXT|MCREQ_F_PRIVCALLBACK))) {
+        lcb_singleflight_lead(instance, pkt);
     }
-
-    memcpy(SPAN_BUFFER(&pkt->kh_span), gcmd.bytes, MCREQ_PKT_BASESIZE + extlen);
     mcreq_sched_add(pl, pkt);
     TRACE_GET_BEGIN(hdr, cmd);
 
@@ -134,7 +163,7 @@ lcb_unlock3(lcb_t instance, const void *cookie, const lcb_CMDUNLOCK *cmd)
 
     rd = &pkt->u_rdata.reqdata;
     rd->cookie = cookie;
-    rd->start = gethrtime();
+    rd->start = lcbio_now_fine(instance->iotable);
 
     hdr.request.magic = PROTOCOL_BINARY_REQ;
     hdr.request.opcode = PROTOCOL_BINARY_CMD_UNLOCK_KEY;
@@ -323,7 +352,7 @@ lcb_rget3(lcb_t instance, const void *cookie, const lcb_CMDGETREPLICA *cmd)
     /* Initialize the cookie */
     rck = calloc(1, sizeof(*rck));
     rck->base.cookie = cookie;
-    rck->base.start = gethrtime();
+    rck->base.start = lcbio_now_fine(instance->iotable);
     rck->base.procs = &rget_procs;
     rck->strategy = cmd->strategy;
     rck->r_cur = r0;
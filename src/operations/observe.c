@@ -253,7 +253,7 @@ obs_ctxdone(lcb_MULTICMD_CTX *mctx, const void *cookie)
         TRACE_OBSERVE_BEGIN(&hdr, SPAN_BUFFER(&pkt->u_value.single));
     }
     destroy_requests(ctx);
-    ctx->base.start = gethrtime();
+    ctx->base.start = lcbio_now_fine(ctx->instance->iotable);
     ctx->base.cookie = cookie;
     ctx->base.procs = &obs_procs;
     return LCB_SUCCESS;
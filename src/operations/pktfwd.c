@@ -67,7 +67,7 @@ lcb_pktfwd3(lcb_t instance, const void *cookie, const lcb_CMDPKTFWD *cmd)
 
     /* set the cookie */
     packet->u_rdata.reqdata.cookie = cookie;
-    packet->u_rdata.reqdata.start = gethrtime();
+    packet->u_rdata.reqdata.start = lcbio_now_fine(instance->iotable);
     return err;
 }
 
@@ -16,6 +16,7 @@
  */
 
 #include "internal.h"
+#include "kvcache.h"
 #include "trace.h"
 
 LIBCOUCHBASE_API
@@ -47,9 +48,10 @@ lcb_remove3(lcb_t instance, const void *cookie, const lcb_CMDREMOVE * cmd)
     hdr.request.bodylen = htonl((lcb_uint32_t)ntohs(hdr.request.keylen));
 
     pkt->u_rdata.reqdata.cookie = cookie;
-    pkt->u_rdata.reqdata.start = gethrtime();
+    pkt->u_rdata.reqdata.start = lcbio_now_fine(instance->iotable);
     memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
     TRACE_REMOVE_BEGIN(&hdr, cmd);
+    lcb_kvcache_invalidate(instance, pkt);
     mcreq_sched_add(pl, pkt);
     return LCB_SUCCESS;
 }
@@ -115,7 +115,7 @@ lcb_stats3(lcb_t instance, const void *cookie, const lcb_CMDSTATS * cmd)
 
     ckwrap = calloc(1, sizeof(*ckwrap));
     ckwrap->base.cookie = cookie;
-    ckwrap->base.start = gethrtime();
+    ckwrap->base.start = lcbio_now_fine(instance->iotable);
     ckwrap->base.procs = &stats_procs;
 
     for (ii = 0; ii < cq->npipelines; ii++) {
@@ -229,7 +229,7 @@ pkt_bcast_simple(lcb_t instance, const void *cookie, lcb_CALLBACKTYPE type)
 
     ckwrap = calloc(1, sizeof(*ckwrap));
     ckwrap->base.cookie = cookie;
-    ckwrap->base.start = gethrtime();
+    ckwrap->base.start = lcbio_now_fine(instance->iotable);
     ckwrap->base.procs = &bcast_procs;
     ckwrap->type = type;
 
@@ -302,7 +302,7 @@ lcb_server_verbosity3(lcb_t instance, const void *cookie,
 
     ckwrap = calloc(1, sizeof(*ckwrap));
     ckwrap->base.cookie = cookie;
-    ckwrap->base.start = gethrtime();
+    ckwrap->base.start = lcbio_now_fine(instance->iotable);
     ckwrap->base.procs = &bcast_procs;
     ckwrap->type = LCB_CALLBACK_VERBOSITY;
 
@@ -15,6 +15,7 @@
  *   limitations under the License.
  */
 #include "internal.h"
+#include "kvcache.h"
 #include "mc/compress.h"
 #include "trace.h"
 
@@ -28,6 +29,24 @@ get_value_size(mc_PACKET *packet)
     }
 }
 
+static lcb_size_t
+get_cmd_value_size(const lcb_VALBUF *vbuf)
+{
+    if (vbuf->vtype == LCB_KV_IOV) {
+        unsigned ii;
+        lcb_size_t total = vbuf->u_buf.multi.total_length;
+        if (total) {
+            return total;
+        }
+        for (ii = 0; ii < vbuf->u_buf.multi.niov; ii++) {
+            total += vbuf->u_buf.multi.iov[ii].iov_len;
+        }
+        return total;
+    } else {
+        return vbuf->u_buf.contig.nbytes;
+    }
+}
+
 static lcb_error_t
 get_esize_and_opcode(
         lcb_storage_t ucmd, lcb_uint8_t *opcode, lcb_uint8_t *esize)
@@ -90,6 +109,8 @@ lcb_store3(lcb_t instance, const void *cookie, const lcb_CMDSTORE *cmd)
     mc_CMDQUEUE *cq = &instance->cmdq;
     int hsize;
     int should_compress = 0;
+    int pktopts = MCREQ_BASICPACKET_F_FALLBACKOK;
+    lcb_U32 bulk_thresh = LCBT_SETTING(instance, kv_bulk_threshold);
     lcb_error_t err;
 
     protocol_binary_request_set scmd;
@@ -123,8 +144,12 @@ lcb_store3(lcb_t instance, const void *cookie, const lcb_CMDSTORE *cmd)
 
     hsize = hdr->request.extlen + sizeof(*hdr);
 
+    if (bulk_thresh && get_cmd_value_size(&cmd->value) >= bulk_thresh) {
+        pktopts |= MCREQ_BASICPACKET_F_BULK;
+    }
+
     err = mcreq_basic_packet(cq, (const lcb_CMDBASE *)cmd, hdr,
-        hdr->request.extlen, &packet, &pipeline, MCREQ_BASICPACKET_F_FALLBACKOK);
+        hdr->request.extlen, &packet, &pipeline, pktopts);
 
     if (err != LCB_SUCCESS) {
         return err;
@@ -143,7 +168,7 @@ lcb_store3(lcb_t instance, const void *cookie, const lcb_CMDSTORE *cmd)
 
     rdata = &packet->u_rdata.reqdata;
     rdata->cookie = cookie;
-    rdata->start = gethrtime();
+    rdata->start = lcbio_now_fine(instance->iotable);
 
     scmd.message.body.expiration = htonl(cmd->exptime);
     scmd.message.body.flags = htonl(cmd->flags);
@@ -164,6 +189,7 @@ lcb_store3(lcb_t instance, const void *cookie, const lcb_CMDSTORE *cmd)
             + get_value_size(packet));
 
     memcpy(SPAN_BUFFER(&packet->kh_span), scmd.bytes, hsize);
+    lcb_kvcache_invalidate(instance, packet);
     mcreq_sched_add(pipeline, packet);
     TRACE_STORE_BEGIN(hdr, cmd);
     return LCB_SUCCESS;
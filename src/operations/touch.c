@@ -16,6 +16,7 @@
  */
 
 #include "internal.h"
+#include "kvcache.h"
 
 LIBCOUCHBASE_API
 lcb_error_t
@@ -46,7 +47,8 @@ lcb_touch3(lcb_t instance, const void *cookie, const lcb_CMDTOUCH *cmd)
     tcmd.message.body.expiration = htonl(cmd->exptime);
     memcpy(SPAN_BUFFER(&pkt->kh_span), tcmd.bytes, sizeof(tcmd.bytes));
     pkt->u_rdata.reqdata.cookie = cookie;
-    pkt->u_rdata.reqdata.start = gethrtime();
+    pkt->u_rdata.reqdata.start = lcbio_now_fine(instance->iotable);
+    lcb_kvcache_invalidate(instance, pkt);
     mcreq_sched_add(pl, pkt);
     return LCB_SUCCESS;
 }
@@ -207,6 +207,15 @@ rdb_bigalloc_new(void)
     return &alloc->base;
 }
 
+const rdb_BIGALLOC *
+rdb_bigalloc_cast(const rdb_ALLOCATOR *alloc)
+{
+    if (alloc && alloc->dump == dump_wrap) {
+        return (const rdb_BIGALLOC *)alloc;
+    }
+    return NULL;
+}
+
 void
 rdb_bigalloc_dump(rdb_BIGALLOC *alloc, FILE *fp)
 {
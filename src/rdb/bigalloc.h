@@ -66,6 +66,14 @@ typedef struct {
 void
 rdb_bigalloc_dump(rdb_BIGALLOC *alloc, FILE *fp);
 
+/**
+ * Get the allocator's state, if it was created by rdb_bigalloc_new()
+ * @param alloc any allocator
+ * @return the allocator, or NULL if it is of another kind
+ */
+const rdb_BIGALLOC *
+rdb_bigalloc_cast(const rdb_ALLOCATOR *alloc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,147 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "rdb/rope.h"
+
+typedef struct lcb_RESPBATCHAUX_st {
+    lcb_SIZE koffset; /**< Offset of the key within lcb_RESPBATCH::keys */
+    rdb_ROPESEG *seg; /**< Pinned segment holding the value, if any */
+    void *freeptr; /**< Buffer holding the value, if any */
+} batch_AUX;
+
+void
+lcb_respbatch_enter(lcb_t instance)
+{
+    if (instance->callbacks.getbatch) {
+        instance->respbatch.active = 1;
+    }
+}
+
+static int
+batch_reserve(lcb_RESPBATCH *batch)
+{
+    unsigned capacity;
+    lcb_RESPGET *resps;
+    batch_AUX *aux;
+
+    if (batch->nresps < batch->capacity) {
+        return 0;
+    }
+    capacity = batch->capacity ? batch->capacity * 2 : 16;
+    if ((resps = realloc(batch->resps, sizeof(*resps) * capacity)) == NULL) {
+        return -1;
+    }
+    batch->resps = resps;
+    if ((aux = realloc(batch->aux, sizeof(*aux) * capacity)) == NULL) {
+        return -1;
+    }
+    batch->aux = aux;
+    batch->capacity = capacity;
+    return 0;
+}
+
+int
+lcb_respbatch_add(lcb_t instance, const mc_PACKET *request,
+    const lcb_RESPGET *resp, void *freeptr)
+{
+    lcb_RESPBATCH *batch = &instance->respbatch;
+    batch_AUX *aux;
+
+    if (!batch->active || !instance->callbacks.getbatch) {
+        return 0;
+    }
+    if (request->flags & (MCREQ_F_INVOKED|MCREQ_F_PRIVCALLBACK)) {
+        return 0;
+    }
+    if (batch_reserve(batch) != 0) {
+        return 0;
+    }
+    aux = batch->aux + batch->nresps;
+    aux->koffset = batch->keys.nused;
+    if (lcb_string_append(&batch->keys, resp->key, resp->nkey) != 0) {
+        return 0;
+    }
+
+    aux->freeptr = freeptr;
+    aux->seg = NULL;
+    if (resp->nvalue && !freeptr && resp->bufh) {
+        aux->seg = resp->bufh;
+        rdb_seg_ref(aux->seg);
+    }
+    batch->resps[batch->nresps++] = *resp;
+    return 1;
+}
+
+static void
+batch_release(lcb_RESPBATCH *batch)
+{
+    unsigned ii;
+    for (ii = 0; ii < batch->nresps; ii++) {
+        if (batch->aux[ii].seg) {
+            rdb_seg_unref(batch->aux[ii].seg);
+        }
+        free(batch->aux[ii].freeptr);
+    }
+    batch->nresps = 0;
+    lcb_string_clear(&batch->keys);
+}
+
+void
+lcb_respbatch_leave(lcb_t instance)
+{
+    lcb_RESPBATCH *batch = &instance->respbatch;
+    unsigned ii;
+
+    if (!batch->active) {
+        return;
+    }
+    batch->active = 0;
+    if (!batch->nresps) {
+        return;
+    }
+
+    /* The key storage may have moved while the batch was filled */
+    for (ii = 0; ii < batch->nresps; ii++) {
+        batch->resps[ii].key = batch->keys.base + batch->aux[ii].koffset;
+    }
+    batch->nbatches++;
+    batch->nbatched += batch->nresps;
+    instance->callbacks.getbatch(instance, batch->resps, batch->nresps);
+    batch_release(batch);
+}
+
+void
+lcb_respbatch_cleanup(lcb_RESPBATCH *batch)
+{
+    batch_release(batch);
+    lcb_string_release(&batch->keys);
+    free(batch->resps);
+    free(batch->aux);
+    batch->resps = NULL;
+    batch->aux = NULL;
+    batch->capacity = 0;
+}
+
+LIBCOUCHBASE_API
+lcb_GETBATCHCALLBACK
+lcb_install_getbatch_callback(lcb_t instance, lcb_GETBATCHCALLBACK cb)
+{
+    lcb_GETBATCHCALLBACK ret = instance->callbacks.getbatch;
+    instance->callbacks.getbatch = cb;
+    return ret;
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_RESPBATCH_H
+#define LCB_RESPBATCH_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "simplestring.h"
+
+/**
+ * @file
+ * @brief Batched response delivery
+ *
+ * @defgroup lcb-respbatch Batched responses
+ *
+ * @details
+ * While a server's socket is being read (between lcb_respbatch_enter() and
+ * lcb_respbatch_leave()), GET responses are copied into the batch rather
+ * than delivered, if a batch callback is installed (see
+ * lcb_install_getbatch_callback()).
+ *
+ * The responses' keys point into the request packets, which are released
+ * once the response was handled, so they are copied. Their values point
+ * into the read buffer, whose segments are pinned (see rdb_seg_ref()) until
+ * the batch was delivered.
+ *
+ * @addtogroup lcb-respbatch
+ * @{
+ */
+
+struct lcb_RESPBATCHAUX_st;
+
+typedef struct {
+    lcb_RESPGET *resps;
+    struct lcb_RESPBATCHAUX_st *aux;
+    unsigned nresps;
+    unsigned capacity;
+    /** Storage for the keys of the responses */
+    lcb_string keys;
+    /** Whether responses are currently being batched */
+    int active;
+    /** Statistics: number of batches and responses delivered */
+    lcb_U64 nbatches;
+    lcb_U64 nbatched;
+} lcb_RESPBATCH;
+
+/** Start batching responses. This is a no-op if no batch callback is set */
+void
+lcb_respbatch_enter(lcb_t instance);
+
+/** Stop batching responses, and deliver those which were batched */
+void
+lcb_respbatch_leave(lcb_t instance);
+
+/**
+ * Add a response to the current batch.
+ * @param instance
+ * @param request the request the response is for
+ * @param resp the response
+ * @param freeptr a buffer holding the (inflated) value, if any. It is owned
+ * by the batch if the response was added
+ * @return nonzero if the response was added, zero if it should be
+ * delivered right away
+ */
+int
+lcb_respbatch_add(lcb_t instance, const mc_PACKET *request,
+    const lcb_RESPGET *resp, void *freeptr);
+
+void
+lcb_respbatch_cleanup(lcb_RESPBATCH *batch);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
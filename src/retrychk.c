@@ -34,6 +34,8 @@ lcb_should_retry(lcb_settings *settings, mc_PACKET *pkt, lcb_error_t err)
     case PROTOCOL_BINARY_CMD_STAT:
     case PROTOCOL_BINARY_CMD_VERBOSITY:
     case PROTOCOL_BINARY_CMD_VERSION:
+    /* A fence must stay behind the quiet packets it answers for */
+    case PROTOCOL_BINARY_CMD_NOOP:
         return 0;
     }
 
@@ -69,6 +71,7 @@ lcb_should_retry(lcb_settings *settings, mc_PACKET *pkt, lcb_error_t err)
 
     /* get is a safe operation which may be retried */
     case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GETQ:
     case PROTOCOL_BINARY_CMD_GETKQ:
         return policy & LCB_RETRY_CMDS_GET;
 
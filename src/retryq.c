@@ -43,6 +43,27 @@ typedef struct {
  */
 #define TIMEFUZZ_NS LCB_US2NS(LCB_MS2US(5))
 
+/** Retries for degraded nodes are this many times further apart */
+#define DEGRADED_BACKOFF_FACTOR 4
+
+/* Whether the node the packet currently maps to is degraded */
+static int
+target_degraded(lcb_RETRYQ *rq, mc_PACKET *pkt)
+{
+    protocol_binary_request_header hdr;
+    int srvix;
+
+    if (!rq->cq->config) {
+        return 0;
+    }
+    mcreq_read_hdr(pkt, &hdr);
+    srvix = lcbvb_vbmaster(rq->cq->config, ntohs(hdr.request.vbucket));
+    if (srvix < 0 || (unsigned)srvix >= rq->cq->npipelines) {
+        return 0;
+    }
+    return mcserver_is_degraded((mc_SERVER *)rq->cq->pipelines[srvix]);
+}
+
 static void
 update_trytime(lcb_RETRYQ *rq, lcb_RETRYOP *op, hrtime_t now)
 {
@@ -50,13 +71,18 @@ update_trytime(lcb_RETRYQ *rq, lcb_RETRYOP *op, hrtime_t now)
      * Estimate the next retry timestamp. This is:
      * Base interval + (Number of retries x Backoff factor)
      */
-    if (!now) {
-        now = gethrtime();
-    }
-    op->trytime = now + (hrtime_t) (
+    hrtime_t delay = (hrtime_t) (
             (float)RETRY_INTERVAL_NS(rq) *
             (float)op->pkt->retries *
             (float)rq->settings->retry_backoff);
+
+    if (!now) {
+        now = lcbio_now(rq->iot);
+    }
+    if (target_degraded(rq, op->pkt)) {
+        delay *= DEGRADED_BACKOFF_FACTOR;
+    }
+    op->trytime = now + delay;
 }
 
 /** Comparison routine for sorting by timeout */
@@ -115,8 +141,9 @@ assign_error(lcb_RETRYOP *op, lcb_error_t err)
 }
 
 static void
-clean_op(lcb_RETRYOP *op)
+clean_op(lcb_RETRYQ *rq, lcb_RETRYOP *op)
 {
+    rq->npending--;
     lcb_list_delete(&op->ll_sched);
     lcb_list_delete(&op->ll_tmo);
 }
@@ -144,7 +171,8 @@ bail_op(lcb_RETRYQ *rq, lcb_RETRYOP *op, lcb_error_t err)
     lcb_log(LOGARGS(rq, WARN), "Failing command (seq=%u) from retry queue with error code 0x%x", op->pkt->opaque, op->origerr);
     mcreq_dispatch_response(pltmp, op->pkt, &info, op->origerr);
     op->pkt->flags |= MCREQ_F_FLUSHED|MCREQ_F_INVOKED;
-    clean_op(op);
+    rq->nfailed++;
+    clean_op(rq, op);
     mcreq_packet_done(pltmp, op->pkt);
     lcb_maybe_breakout(rq->cq->cqdata);
 }
@@ -157,7 +185,7 @@ do_schedule(lcb_RETRYQ *q, hrtime_t now)
     lcb_RETRYOP *first_tmo, *first_sched;
 
     if (!now) {
-        now = gethrtime();
+        now = lcbio_now(q->iot);
     }
 
     if (LCB_LIST_IS_EMPTY(&q->schedops)) {
@@ -195,7 +223,7 @@ do_schedule(lcb_RETRYQ *q, hrtime_t now)
 static void
 rq_flush(lcb_RETRYQ *rq, int throttle)
 {
-    hrtime_t now = gethrtime();
+    hrtime_t now = lcbio_now(rq->iot);
     lcb_list_t *ll, *ll_next;
     lcb_list_t resched_next;
 
@@ -253,10 +281,11 @@ rq_flush(lcb_RETRYQ *rq, int throttle)
                 bail_op(rq, op, LCB_NO_MATCHING_SERVER);
             }
         } else {
-            mc_PIPELINE *newpl = rq->cq->pipelines[srvix];
+            mc_PIPELINE *newpl = mcreq_packet_lane(rq->cq->pipelines[srvix],
+                LCBVB_DISTTYPE(rq->cq->config), op->pkt);
             mcreq_enqueue_packet(newpl, op->pkt);
             newpl->flush_start(newpl);
-            clean_op(op);
+            clean_op(rq, op);
         }
     }
 
@@ -311,13 +340,15 @@ add_op(lcb_RETRYQ *rq, mc_EXPACKET *pkt, lcb_error_t err, int options)
     pkt->base.retries++;
     assign_error(op, err);
     if (options & RETRY_SCHED_IMM) {
-        op->trytime = gethrtime(); /* now */
+        op->trytime = lcbio_now(rq->iot); /* now */
     } else {
         update_trytime(rq, op, 0);
     }
 
     lcb_list_add_sorted(&rq->schedops, &op->ll_sched, cmpfn_retry);
     lcb_list_add_sorted(&rq->tmoops, &op->ll_tmo, cmpfn_tmo);
+    rq->npending++;
+    rq->nadded++;
 
     lcb_log(LOGARGS(rq, DEBUG), "Adding PKT=%p to retry queue. Try count=%u", (void*)pkt, pkt->base.retries);
     do_schedule(rq, 0);
@@ -346,6 +377,7 @@ lcb_retryq_new(mc_CMDQUEUE *cq, lcbio_pTABLE table, lcb_settings *settings)
     rq->settings = settings;
     rq->cq = cq;
     rq->timer = lcbio_timer_new(table, rq, rq_tick);
+    rq->iot = table;
 
     lcb_settings_ref(settings);
     lcb_list_init(&rq->tmoops);
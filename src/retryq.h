@@ -49,6 +49,14 @@ typedef struct lcb_RETRYQ {
     mc_CMDQUEUE *cq;
     lcb_settings *settings;
     lcbio_pTIMER timer;
+    /** Table the timer runs on, also used to read the clock */
+    lcbio_pTABLE iot;
+    /** Number of operations in the queue */
+    unsigned npending;
+    /** Number of times an operation was added to the queue */
+    lcb_U64 nadded;
+    /** Number of operations failed from the queue */
+    lcb_U64 nfailed;
 } lcb_RETRYQ;
 
 /**
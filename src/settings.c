@@ -16,7 +16,10 @@
  */
 
 #include "settings.h"
+#include "logging.h"
 #include <lcbio/ssl.h>
+#include <lcbio/faults.h>
+#include <lcbio/capture.h>
 #include <rdb/rope.h>
 
 LCB_INTERNAL_API
@@ -50,6 +53,11 @@ void lcb_default_settings(lcb_settings *settings)
     settings->detailed_neterr = 0;
     settings->refresh_on_hterr = 1;
     settings->sched_implicit_flush = 1;
+    settings->kv_nconns = LCB_DEFAULT_KV_NCONNS;
+    settings->kvcache_ttl = LCB_DEFAULT_KVCACHE_TTL;
+    settings->degraded_latency = LCB_DEFAULT_DEGRADED_LATENCY;
+    settings->nmv_config_interval = LCB_DEFAULT_NMV_CONFIG_INTERVAL;
+    settings->counteragg_maxbatch = LCB_DEFAULT_COUNTERAGG_MAXBATCH;
 }
 
 LCB_INTERNAL_API
@@ -74,9 +82,17 @@ lcb_settings_unref(lcb_settings *settings)
     free(settings->bucket);
     free(settings->sasl_mech_force);
     free(settings->certpath);
+    lcb_asynclog_destroy(settings);
     if (settings->ssl_ctx) {
         lcbio_ssl_free(settings->ssl_ctx);
     }
+    if (settings->faults) {
+        lcbio_faults_unref(settings->faults);
+    }
+    if (settings->capture) {
+        lcbio_capture_stop(settings->capture);
+        lcbio_capture_unref(settings->capture);
+    }
     if (settings->dtorcb) {
         settings->dtorcb(settings->dtorarg);
     }
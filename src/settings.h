@@ -78,6 +78,11 @@
 #define LCB_DEFAULT_NMVRETRY LCB_RETRY_CMDS_ALL
 #define LCB_DEFAULT_HTCONFIG_URLTYPE LCB_HTCONFIG_URLTYPE_TRYALL
 #define LCB_DEFAULT_COMPRESSOPTS LCB_COMPRESS_NONE
+#define LCB_DEFAULT_KV_NCONNS 1
+#define LCB_DEFAULT_KVCACHE_TTL LCB_MS2US(1000)
+#define LCB_DEFAULT_DEGRADED_LATENCY LCB_MS2US(1000)
+#define LCB_DEFAULT_NMV_CONFIG_INTERVAL LCB_MS2US(10)
+#define LCB_DEFAULT_COUNTERAGG_MAXBATCH 128
 
 #include "config.h"
 #include <libcouchbase/couchbase.h>
@@ -88,6 +93,8 @@ extern "C" {
 
 struct lcb_logprocs_st;
 struct lcbio_SSLCTX;
+struct lcbio_FAULTS;
+struct lcbio_CAPTURE;
 struct rdb_ALLOCATOR;
 
 /**
@@ -120,6 +127,57 @@ typedef struct lcb_settings_st {
      * updates. */
     lcb_U32 bc_http_stream_time;
 
+    /**Number of nodes to request the initial configuration from at once.
+     * If greater than one, the enabled providers are also tried at once */
+    lcb_U32 bc_race_nodes;
+
+    /** Number of memcached connections to open to each node */
+    lcb_U32 kv_nconns;
+
+    /**Values of at least this many bytes are stored over a dedicated
+     * connection (if kv_nconns > 1). 0 to disable */
+    lcb_U32 kv_bulk_threshold;
+
+    /** Maximum size of the client-side item cache, in bytes. 0 to disable */
+    lcb_SIZE kvcache_maxbytes;
+
+    /** Maximum age of an item in the client-side cache */
+    lcb_U32 kvcache_ttl;
+
+    /**Age after which a cached item is refreshed in the background when it
+     * is read. 0 to disable */
+    lcb_U32 kvcache_revalidate;
+
+    /**Time after which a GET not yet answered by the master is also sent
+     * to the replicas. 0 to disable */
+    lcb_U32 hedge_delay;
+
+    /**Average response time at which a node is considered degraded.
+     * 0 to only consider failures */
+    lcb_U32 degraded_latency;
+
+    /**Minimum interval between applying configurations received with
+     * NOT_MY_VBUCKET replies. 0 to apply each new configuration at once */
+    lcb_U32 nmv_config_interval;
+
+    /**Time for which the deltas of counter commands for the same key are
+     * summed before being sent. 0 to disable */
+    lcb_U32 counteragg_window;
+    /** Number of counter commands after which their sum is sent at once */
+    lcb_U32 counteragg_maxbatch;
+
+    /** Maximum number of packets queued to a single server. 0 for no limit */
+    lcb_U32 queue_maxpkts;
+    /** Maximum number of packets queued to all servers. 0 for no limit */
+    lcb_U32 queue_total_maxpkts;
+    /** Maximum number of bytes queued to a single server. 0 for no limit */
+    lcb_SIZE queue_maxbytes;
+    /** Maximum number of bytes queued to all servers. 0 for no limit */
+    lcb_SIZE queue_total_maxbytes;
+    /** What to do with commands once a queue limit is reached
+     * (lcb_QUEUEPOLICY) */
+    int queue_policy;
+
     unsigned bc_http_urltype : 4;
 
     /** Don't guess next vbucket server. Mainly for testing */
@@ -133,6 +191,12 @@ typedef struct lcb_settings_st {
     unsigned refresh_on_hterr : 1;
     unsigned sched_implicit_flush : 1;
     unsigned keep_guess_vbs : 1;
+    /** Whether configurations are shared with other instances in the process */
+    unsigned config_shared : 1;
+    /** Whether GETs scheduled together are sent as GETQ, followed by a NOOP */
+    unsigned get_quiet : 1;
+    /** Whether GETs for a key which is already being fetched are coalesced */
+    unsigned get_singleflight : 1;
     unsigned sslopts : 2;
     unsigned ipv6 : 2;
 
@@ -141,6 +205,9 @@ typedef struct lcb_settings_st {
 
     uint8_t retry[LCB_RETRY_ON_MAX];
     float retry_backoff;
+    /**If positive, GETs are hedged only once they are slower than this
+     * percentile of recent GET latencies (and at least hedge_delay) */
+    float hedge_percentile;
 
     char *username;
     char *password;
@@ -149,7 +216,18 @@ typedef struct lcb_settings_st {
     char *certpath;
     struct rdb_ALLOCATOR* (*allocator_factory)(void);
     struct lcbio_SSLCTX *ssl_ctx;
+    /** Faults injected into new connections, see lcbio_faults_wrap() */
+    struct lcbio_FAULTS *faults;
+    /** Traffic of new data connections is recorded here, see lcbio_ctx_capture() */
+    struct lcbio_CAPTURE *capture;
     struct lcb_logprocs_st *logger;
+
+    /** Messages below this severity are not passed to #logger */
+    lcb_U8 loglevel;
+
+    /**If set, messages are passed to #logger from a background thread
+     * rather than from within lcb_log() */
+    struct lcb_ASYNCLOG_st *asynclog;
     void (*dtorcb)(const void *);
     void *dtorarg;
 } lcb_settings;
@@ -0,0 +1,319 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "singleflight.h"
+#include "list.h"
+#include "contrib/genhash/genhash.h"
+
+/** Longest key (the protocol maximum), preceded by the vBucket */
+#define SF_MAXLKEY (250 + 2)
+
+typedef struct lcb_SFFLIGHT_st {
+    lcb_list_t llnode; /**< Node in the list of all flights */
+    lcb_list_t llstaged; /**< Node in the staged list, if #staged */
+    lcb_U32 opaque; /**< Opaque of the GET leading the flight */
+    /** Flight was touched within the current scheduling context */
+    unsigned staged : 1;
+    /** Leading GET was scheduled within the current scheduling context */
+    unsigned uncommitted : 1;
+    unsigned nwaiters;
+    unsigned ncommitted; /**< Waiters added in earlier scheduling contexts */
+    unsigned nalloc;
+    const void **cookies; /**< Cookies of the waiters */
+    lcb_SIZE nlkey;
+    char lkey[1]; /**< vBucket, followed by the key */
+} sf_FLIGHT;
+
+struct lcb_SINGLEFLIGHT_st {
+    genhash_t *ht;
+    lcb_list_t flights;
+    lcb_list_t staged;
+    lcb_SINGLEFLIGHTSTATS stats;
+};
+
+/* Lookup keys begin with the vBucket, and may therefore contain NUL bytes */
+static int
+lkey_hash(const void *k, lcb_size_t nk)
+{
+    const unsigned char *p = k;
+    lcb_U32 hv = 2166136261U;
+    lcb_size_t ii;
+    for (ii = 0; ii < nk; ii++) {
+        hv = (hv ^ p[ii]) * 16777619U;
+    }
+    return (int)(hv & 0x7fffffff);
+}
+
+static int
+lkey_eq(const void *a, lcb_size_t na, const void *b, lcb_size_t nb)
+{
+    return na == nb && memcmp(a, b, na) == 0;
+}
+
+static struct lcb_hash_ops lkey_hashops = {
+    lkey_hash, /* hashfunc */
+    lkey_eq, /* hasheq */
+    NULL, /* dupKey */
+    NULL, /* dupValue */
+    NULL, /* freeKey */
+    NULL /* freeValue */
+};
+
+static lcb_SINGLEFLIGHT *
+sf_get(lcb_t instance)
+{
+    lcb_SINGLEFLIGHT *sf = instance->singleflight;
+    if (sf) {
+        return sf;
+    }
+    sf = calloc(1, sizeof(*sf));
+    sf->ht = genhash_init(64, lkey_hashops);
+    lcb_list_init(&sf->flights);
+    lcb_list_init(&sf->staged);
+    instance->singleflight = sf;
+    return sf;
+}
+
+static lcb_SIZE
+make_lkey(char *buf, lcb_U16 vbid, const void *key, lcb_SIZE nkey)
+{
+    if (nkey > SF_MAXLKEY - 2) {
+        return 0;
+    }
+    buf[0] = (char)(vbid >> 8);
+    buf[1] = (char)(vbid & 0xff);
+    memcpy(buf + 2, key, nkey);
+    return nkey + 2;
+}
+
+static void
+flight_stage(lcb_SINGLEFLIGHT *sf, sf_FLIGHT *flight)
+{
+    if (!flight->staged) {
+        flight->staged = 1;
+        lcb_list_append(&sf->staged, &flight->llstaged);
+    }
+}
+
+static void
+flight_unlink(lcb_SINGLEFLIGHT *sf, sf_FLIGHT *flight)
+{
+    genhash_delete(sf->ht, flight->lkey, flight->nlkey);
+    lcb_list_delete(&flight->llnode);
+    if (flight->staged) {
+        lcb_list_delete(&flight->llstaged);
+        flight->staged = 0;
+    }
+}
+
+static void
+flight_free(sf_FLIGHT *flight)
+{
+    free(flight->cookies);
+    free(flight);
+}
+
+int
+lcb_singleflight_join(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd)
+{
+    lcb_SINGLEFLIGHT *sf = instance->singleflight;
+    sf_FLIGHT *flight;
+    const void *hk;
+    lcb_SIZE nhk, nlkey;
+    int vbid, srvix;
+    char lkey[SF_MAXLKEY];
+
+    if (!sf || LCB_LIST_IS_EMPTY(&sf->flights) || !LCBT_VBCONFIG(instance)) {
+        return 0;
+    }
+    if (cmd->key.type != LCB_KV_COPY && cmd->key.type != LCB_KV_CONTIG) {
+        return 0;
+    }
+    mcreq_extract_hashkey(&cmd->key, &cmd->_hashkey, MCREQ_PKT_BASESIZE,
+        &hk, &nhk);
+    lcbvb_map_key(LCBT_VBCONFIG(instance), hk, nhk, &vbid, &srvix);
+    nlkey = make_lkey(lkey, (lcb_U16)vbid,
+        cmd->key.contig.bytes, cmd->key.contig.nbytes);
+    if (!nlkey || (flight = genhash_find(sf->ht, lkey, nlkey)) == NULL) {
+        return 0;
+    }
+
+    if (flight->nwaiters == flight->nalloc) {
+        unsigned nalloc = flight->nalloc ? flight->nalloc * 2 : 4;
+        const void **cookies = realloc(
+            (void *)flight->cookies, sizeof(*cookies) * nalloc);
+        if (!cookies) {
+            return 0;
+        }
+        flight->cookies = cookies;
+        flight->nalloc = nalloc;
+    }
+    flight->cookies[flight->nwaiters++] = cookie;
+    flight_stage(sf, flight);
+    sf->stats.ncoalesced++;
+    return 1;
+}
+
+void
+lcb_singleflight_lead(lcb_t instance, const mc_PACKET *pkt)
+{
+    lcb_SINGLEFLIGHT *sf = sf_get(instance);
+    sf_FLIGHT *flight;
+    protocol_binary_request_header hdr;
+    const void *key;
+    lcb_SIZE nkey, nlkey;
+    char lkey[SF_MAXLKEY];
+
+    mcreq_read_hdr(pkt, &hdr);
+    mcreq_get_key(pkt, &key, &nkey);
+    nlkey = make_lkey(lkey, ntohs(hdr.request.vbucket), key, nkey);
+    if (!nlkey || genhash_find(sf->ht, lkey, nlkey)) {
+        return;
+    }
+
+    flight = calloc(1, sizeof(*flight) + nlkey);
+    flight->opaque = pkt->opaque;
+    flight->uncommitted = 1;
+    flight->nlkey = nlkey;
+    memcpy(flight->lkey, lkey, nlkey);
+    genhash_store(sf->ht, flight->lkey, nlkey, flight, 0);
+    lcb_list_append(&sf->flights, &flight->llnode);
+    flight_stage(sf, flight);
+    sf->stats.nflights++;
+}
+
+lcb_SFFLIGHT *
+lcb_singleflight_detach(lcb_t instance, const mc_PACKET *request)
+{
+    lcb_SINGLEFLIGHT *sf = instance->singleflight;
+    sf_FLIGHT *flight;
+    protocol_binary_request_header hdr;
+    const void *key;
+    lcb_SIZE nkey, nlkey;
+    char lkey[SF_MAXLKEY];
+
+    if (!sf || LCB_LIST_IS_EMPTY(&sf->flights)) {
+        return NULL;
+    }
+    mcreq_read_hdr(request, &hdr);
+    mcreq_get_key(request, &key, &nkey);
+    nlkey = make_lkey(lkey, ntohs(hdr.request.vbucket), key, nkey);
+    flight = nlkey ? genhash_find(sf->ht, lkey, nlkey) : NULL;
+    if (!flight || flight->opaque != request->opaque) {
+        return NULL;
+    }
+    flight_unlink(sf, flight);
+    return flight;
+}
+
+void
+lcb_singleflight_land(lcb_t instance, lcb_SFFLIGHT *flight,
+    const mc_PACKET *request, lcb_RESPGET *resp, int batched)
+{
+    unsigned ii;
+    if (!flight) {
+        return;
+    }
+    for (ii = 0; ii < flight->nwaiters; ii++) {
+        resp->cookie = (void *)flight->cookies[ii];
+        if (!batched || !lcb_respbatch_add(instance, request, resp, NULL)) {
+            lcb_find_callback(instance, LCB_CALLBACK_GET)(
+                instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+        }
+    }
+    flight_free(flight);
+}
+
+void
+lcb_singleflight_sched_leave(lcb_t instance)
+{
+    lcb_SINGLEFLIGHT *sf = instance->singleflight;
+    lcb_list_t *ll;
+
+    if (!sf) {
+        return;
+    }
+    while ((ll = lcb_list_shift(&sf->staged))) {
+        sf_FLIGHT *flight = LCB_LIST_ITEM(ll, sf_FLIGHT, llstaged);
+        flight->staged = 0;
+        flight->uncommitted = 0;
+        flight->ncommitted = flight->nwaiters;
+    }
+}
+
+void
+lcb_singleflight_sched_fail(lcb_t instance)
+{
+    lcb_SINGLEFLIGHT *sf = instance->singleflight;
+    lcb_list_t *ll;
+
+    if (!sf) {
+        return;
+    }
+    while ((ll = lcb_list_shift(&sf->staged))) {
+        sf_FLIGHT *flight = LCB_LIST_ITEM(ll, sf_FLIGHT, llstaged);
+        flight->staged = 0;
+        sf->stats.ncoalesced -= flight->nwaiters - flight->ncommitted;
+        flight->nwaiters = flight->ncommitted;
+        if (flight->uncommitted) {
+            /* The leading GET will never be sent */
+            sf->stats.nflights--;
+            flight_unlink(sf, flight);
+            flight_free(flight);
+        }
+    }
+}
+
+void
+lcb_singleflight_destroy(lcb_SINGLEFLIGHT *sf)
+{
+    lcb_list_t *ll;
+    while ((ll = LCB_LIST_HEAD(&sf->flights))) {
+        sf_FLIGHT *flight = LCB_LIST_ITEM(ll, sf_FLIGHT, llnode);
+        flight_unlink(sf, flight);
+        flight_free(flight);
+    }
+    genhash_free(sf->ht);
+    free(sf);
+}
+
+void
+lcb_singleflight_stats(lcb_t instance, lcb_SINGLEFLIGHTSTATS *stats)
+{
+    if (instance->singleflight) {
+        *stats = instance->singleflight->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void
+lcb_singleflight_dump(const lcb_SINGLEFLIGHT *sf, FILE *fp)
+{
+    lcb_list_t *ll;
+    unsigned nflights = 0, nwaiters = 0;
+
+    LCB_LIST_FOR(ll, &sf->flights) {
+        const sf_FLIGHT *flight = LCB_LIST_ITEM(ll, sf_FLIGHT, llnode);
+        nflights++;
+        nwaiters += flight->nwaiters;
+    }
+    fprintf(fp, "OUTSTANDING FLIGHTS: %u (%u WAITERS)\n", nflights, nwaiters);
+    fprintf(fp, "FLIGHTS: %lu\n", (unsigned long)sf->stats.nflights);
+    fprintf(fp, "COALESCED GETS: %lu\n", (unsigned long)sf->stats.ncoalesced);
+}
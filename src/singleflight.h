@@ -0,0 +1,135 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SINGLEFLIGHT_H
+#define LCB_SINGLEFLIGHT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <mc/mcreq.h>
+
+/**
+ * @file
+ * @brief Coalescing of duplicate GETs
+ *
+ * @defgroup lcb-singleflight Single-flight GETs
+ *
+ * @details
+ * When enabled, a plain GET packet (a "flight") is registered under its
+ * vBucket and key while it is outstanding. A plain GET for the same key which
+ * is scheduled in the meantime does not get a packet of its own; its cookie
+ * is added to the flight's waiters instead. When the flight's response
+ * arrives, it is delivered to the GET's own cookie first and then, unchanged,
+ * to each waiter's.
+ *
+ * GETs which are hedged (see @ref lcb-hedge) or which use an internal
+ * callback never lead a flight.
+ *
+ * If the scheduling context is failed (lcb_sched_fail()), the flights
+ * registered and the waiters added within it are discarded.
+ *
+ * @addtogroup lcb-singleflight
+ * @{
+ */
+
+typedef struct lcb_SINGLEFLIGHT_st lcb_SINGLEFLIGHT;
+
+/** Whether duplicate GETs are coalesced for the instance */
+#define LCB_SINGLEFLIGHT_ENABLED(instance) \
+    (LCBT_SETTING(instance, get_singleflight) != 0)
+
+/** Destroy the state. Waiters are discarded without invoking callbacks */
+void
+lcb_singleflight_destroy(lcb_SINGLEFLIGHT *sf);
+
+/**
+ * Attach a GET to an outstanding one for the same key, if any.
+ * @param instance
+ * @param cookie the cookie to deliver the response to
+ * @param cmd the command, which must be a plain GET
+ * @return nonzero if the GET was attached. Otherwise a packet should be
+ * scheduled for it as usual.
+ */
+int
+lcb_singleflight_join(lcb_t instance, const void *cookie, const lcb_CMDGET *cmd);
+
+/**
+ * Register a plain GET packet as outstanding, so that later GETs for the same
+ * key may be attached to it. This should be called once the packet's header
+ * has been written.
+ */
+void
+lcb_singleflight_lead(lcb_t instance, const mc_PACKET *pkt);
+
+/** A flight taken out of the outstanding ones by lcb_singleflight_detach() */
+typedef struct lcb_SFFLIGHT_st lcb_SFFLIGHT;
+
+/**
+ * Take the GETs attached to a request out of the outstanding flights, so that
+ * GETs for the same key scheduled from here on start a new flight. This
+ * should be called before the response is delivered to the request's own
+ * cookie, as its callback may schedule such a GET.
+ * @return the flight, or NULL if the request does not lead one. Pass it to
+ * lcb_singleflight_land()
+ */
+lcb_SFFLIGHT *
+lcb_singleflight_detach(lcb_t instance, const mc_PACKET *request);
+
+/**
+ * Deliver a GET response to the GETs of a detached flight, and free it.
+ * This should be called after the response has been delivered to the
+ * request's own cookie.
+ * @param instance
+ * @param flight the flight, from lcb_singleflight_detach(). May be NULL
+ * @param request the GET packet
+ * @param resp the response. Its cookie is modified
+ * @param batched whether the response was added to the response batch
+ * (see lcb_respbatch_add()). If so, the responses for the attached GETs are
+ * added to it as well.
+ */
+void
+lcb_singleflight_land(lcb_t instance, lcb_SFFLIGHT *flight,
+    const mc_PACKET *request, lcb_RESPGET *resp, int batched);
+
+/** Commit the flights and waiters added within the scheduling context */
+void
+lcb_singleflight_sched_leave(lcb_t instance);
+
+/** Discard the flights and waiters added within the scheduling context */
+void
+lcb_singleflight_sched_fail(lcb_t instance);
+
+/**
+ * Retrieve the counters
+ * @param instance
+ * @param[out] stats the counters. These are zero if no flight was ever
+ * registered
+ */
+void
+lcb_singleflight_stats(lcb_t instance, lcb_SINGLEFLIGHTSTATS *stats);
+
+void
+lcb_singleflight_dump(const lcb_SINGLEFLIGHT *sf, FILE *fp);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -15,6 +15,7 @@
  *   limitations under the License.
  */
 #include "internal.h"
+#include "metrics.h"
 
 /**
  * Timing data in libcouchbase is stored in a structure to make
@@ -183,3 +184,40 @@ void lcb_record_metrics(lcb_t instance,
     }
     (void)opcode;
 }
+
+lcb_SIZE
+lcb_histogram_buckets(const struct lcb_histogram_st *hg,
+                      lcb_METRICBUCKET *buckets, lcb_U64 *nsamples)
+{
+    lcb_SIZE nbuckets = 0;
+    unsigned ii;
+
+    #define ADD_BUCKET(count_, upper_) \
+        if (count_) { \
+            buckets[nbuckets].upper = upper_; \
+            buckets[nbuckets].count = count_; \
+            *nsamples += count_; \
+            nbuckets++; \
+        }
+
+    *nsamples = 0;
+    ADD_BUCKET(hg->nsec, 999)
+    for (ii = 0; ii < 100; ii++) {
+        ADD_BUCKET(hg->usec[ii], LCB_US2NS((ii + 1) * 10) - 1)
+    }
+    /* Samples of less than a millisecond never land in the first ten */
+    for (ii = 0; ii < 100; ii++) {
+        ADD_BUCKET(hg->lt10msec[ii], LCB_US2NS((ii + 1) * 100) - 1)
+    }
+    for (ii = 0; ii < 100; ii++) {
+        ADD_BUCKET(hg->msec[ii], LCB_US2NS((ii + 1) * 10000) - 1)
+    }
+    /* The first bucket holds the samples of ten seconds or more */
+    for (ii = 1; ii < 10; ii++) {
+        ADD_BUCKET(hg->sec[ii], LCB_S2NS(ii + 1) - 1)
+    }
+    ADD_BUCKET(hg->sec[0], (lcb_U64)-1)
+
+    #undef ADD_BUCKET
+    return nbuckets;
+}
@@ -23,11 +23,21 @@
 #include <libcouchbase/vbucket.h>
 #include "config.h"
 #include "contrib/cJSON/cJSON.h"
-#include "json-inl.h"
 #include "hash.h"
 #include "crc32.h"
 #include "simplestring.h"
 
+/* Each parser state is tagged with its role in the config (see below) */
+#define JSONSL_STATE_USER_FIELDS int vbrole;
+#if defined(__GNUC__)
+#define JSONSL_API static __attribute__((unused))
+#elif defined(_MSC_VER)
+#define JSONSL_API static __inline
+#else
+#define JSONSL_API static
+#endif
+#include "contrib/jsonsl/jsonsl.c"
+
 #define STRINGIFY_(X) #X
 #define STRINGIFY(X) STRINGIFY_(X)
 #define MAX_AUTHORITY_SIZE 100
@@ -40,69 +50,490 @@
  ** Core Parsing Routines                                                    **
  ******************************************************************************
  ******************************************************************************/
-static lcbvb_VBUCKET *
-build_vbmap(cJSON *cj, unsigned *nitems)
+
+/*
+ * The configuration is parsed in a single pass over the input using jsonsl.
+ * Each container is tagged with the role it plays within the config (derived
+ * from its parent's role and the key it appears under); values are extracted
+ * as they are popped and stored directly into a few growable arrays. Anything
+ * we do not recognize is skipped without invoking further callbacks.
+ */
+enum {
+    VBR_IGNORE = 0,
+    VBR_ROOT,
+    VBR_NODES, /* "nodes" */
+    VBR_NODESEXT, /* "nodesExt" */
+    VBR_NODE, /* element of "nodes" */
+    VBR_NODEEXT, /* element of "nodesExt" */
+    VBR_PORTS, /* "ports" within a "nodes" element */
+    VBR_SERVICES, /* "services" within a "nodesExt" element */
+    VBR_SRVMAP, /* "vBucketServerMap" */
+    VBR_SERVERLIST, /* "serverList" */
+    VBR_VBMAP, /* "vBucketMap" */
+    VBR_FFMAP, /* "vBucketMapForward" */
+    VBR_VBENTRY /* element of either map */
+};
+
+typedef struct {
+    lcbvb_SERVER srv;
+    char *capibase; /* couchApiBase, processed once the node list is chosen */
+    short has_ports;
+    short has_direct;
+    short has_services;
+} vbNODE;
+
+typedef struct {
+    vbNODE *nodes;
+    unsigned n;
+    unsigned nalloc;
+    int present;
+} vbNODELIST;
+
+typedef struct {
+    lcbvb_VBUCKET *vbs;
+    unsigned n;
+    unsigned nalloc;
+    int present;
+} vbVBLIST;
+
+typedef struct {
+    lcbvb_CONFIG *cfg;
+    const char *buf;
+    const char *key; /* last hash key, points into buf */
+    unsigned nkey;
+    vbNODELIST nodes;
+    vbNODELIST nodesext;
+    vbVBLIST vbmap;
+    vbVBLIST ffmap;
+    char **srvlist;
+    unsigned nsrvlist;
+    unsigned nalloc_srvlist;
+    int have_locator;
+    int have_srvmap;
+    int have_nrepl;
+    int have_srvlist;
+    int done;
+    int failed;
+} vbPARSER;
+
+#define KEY_IS(ctx, s) \
+    ((ctx)->nkey == sizeof(s)-1 && memcmp((ctx)->key, s, sizeof(s)-1) == 0)
+
+/* Stop processing the input; errstr should already be set */
+#define PARSE_FAIL(jsn, ctx) \
+    (ctx)->failed = 1; (jsn)->max_callback_level = 0;
+
+/* Grow an array (by doubling) so that it can hold at least one more item */
+static int
+grow_array(void **arr, unsigned n, unsigned *nalloc, size_t itemsize)
+{
+    void *tmp;
+    unsigned newalloc;
+    if (n < *nalloc) {
+        return 1;
+    }
+    newalloc = *nalloc ? *nalloc * 2 : 64;
+    if (!(tmp = realloc(*arr, newalloc * itemsize))) {
+        return 0;
+    }
+    *arr = tmp;
+    *nalloc = newalloc;
+    return 1;
+}
+
+/* Copy and unescape the current string value */
+static char *
+vb_strdup(jsonsl_t jsn, vbPARSER *ctx, const struct jsonsl_state_st *state)
 {
-    lcbvb_VBUCKET *vblist = NULL;
-    cJSON *jvb;
-    unsigned ii, nalloc;
+    static int unescape_all[128] = { 0 };
+    const char *s = ctx->buf + state->pos_begin + 1;
+    size_t n = jsn->pos - state->pos_begin - 1;
+    char *ret = malloc(n + 1);
 
-    /** FIXME: Realloc dynamically when too small */
-    if (!(nalloc = cJSON_GetArraySize(cj))) {
-        goto GT_ERR;
+    if (!ret) {
+        return NULL;
+    }
+    if (state->nescapes) {
+        jsonsl_error_t err = JSONSL_ERROR_SUCCESS;
+        if (!unescape_all['/']) {
+            const char *escs = "\"\\/bfnrtu";
+            for (; *escs; escs++) {
+                unescape_all[(int)*escs] = 1;
+            }
+        }
+        n = jsonsl_util_unescape(s, ret, n, unescape_all, &err);
+        if (err != JSONSL_ERROR_SUCCESS) {
+            free(ret);
+            return NULL;
+        }
+    } else {
+        memcpy(ret, s, n);
     }
+    ret[n] = '\0';
+    return ret;
+}
 
-    if (!(vblist = calloc(nalloc, sizeof(*vblist)))) {
-        goto GT_ERR;
+/* Get the current value as an integer. Returns 0 if not a number */
+static int
+vb_getint(vbPARSER *ctx, const struct jsonsl_state_st *state, int *value)
+{
+    if (state->type != JSONSL_T_SPECIAL ||
+            (state->special_flags & JSONSL_SPECIALf_NUMERIC) == 0) {
+        return 0;
+    }
+    if (state->special_flags & JSONSL_SPECIALf_NUMNOINT) {
+        *value = (int)strtod(ctx->buf + state->pos_begin, NULL);
+    } else if (state->special_flags & JSONSL_SPECIALf_SIGNED) {
+        *value = -(int)state->nelem;
+    } else {
+        *value = (int)state->nelem;
     }
+    return 1;
+}
 
-    /* Iterate over all the vbuckets */
-    jvb = cj->child;
-    for (ii = 0; ii < nalloc && jvb; ++ii, jvb = jvb->next) {
-        cJSON *jsix;
-        lcbvb_VBUCKET *cvb;
-        unsigned jj, nservers;
+static void
+free_nodelist(vbNODELIST *nl)
+{
+    unsigned ii;
+    for (ii = 0; ii < nl->n; ii++) {
+        free(nl->nodes[ii].srv.hostname);
+        free(nl->nodes[ii].capibase);
+    }
+    free(nl->nodes);
+    memset(nl, 0, sizeof(*nl));
+}
 
-        if (jvb->type != cJSON_Array) {
-            goto GT_ERR;
+static void
+vb_push_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbPARSER *ctx = jsn->data;
+    struct jsonsl_state_st *parent = jsonsl_last_state(jsn, state);
+    int prole = parent ? parent->vbrole : VBR_IGNORE;
+    int is_obj = state->type == JSONSL_T_OBJECT;
+    int is_list = state->type == JSONSL_T_LIST;
+    vbNODELIST *nl = NULL;
+    vbVBLIST *vl = NULL;
+
+    state->vbrole = VBR_IGNORE;
+    if (!JSONSL_STATE_IS_CONTAINER(state)) {
+        return;
+    }
+
+    if (parent == NULL) {
+        if (ctx->done) {
+            /* Like cJSON, ignore whatever follows the root object */
+            jsn->max_callback_level = 0;
+            return;
+        }
+        if (!is_obj) {
+            SET_ERRSTR(ctx->cfg, "Couldn't parse JSON");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        state->vbrole = VBR_ROOT;
+        return;
+    }
+
+    switch (prole) {
+    case VBR_ROOT:
+        if (is_list && KEY_IS(ctx, "nodes")) {
+            state->vbrole = VBR_NODES;
+            ctx->nodes.present = 1;
+        } else if (is_list && KEY_IS(ctx, "nodesExt")) {
+            state->vbrole = VBR_NODESEXT;
+            ctx->nodesext.present = 1;
+        } else if (is_obj && KEY_IS(ctx, "vBucketServerMap")) {
+            state->vbrole = VBR_SRVMAP;
+            ctx->have_srvmap = 1;
+        }
+        break;
+
+    case VBR_NODES:
+    case VBR_NODESEXT:
+        nl = prole == VBR_NODES ? &ctx->nodes : &ctx->nodesext;
+        if (!is_obj) {
+            SET_ERRSTR(ctx->cfg, "Failed to build server");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        if (!grow_array((void **)&nl->nodes, nl->n, &nl->nalloc,
+                sizeof(*nl->nodes))) {
+            SET_ERRSTR(ctx->cfg, "Couldn't allocate memory for server list");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        memset(nl->nodes + nl->n++, 0, sizeof(*nl->nodes));
+        state->vbrole = prole == VBR_NODES ? VBR_NODE : VBR_NODEEXT;
+        break;
+
+    case VBR_NODE:
+        if (is_obj && KEY_IS(ctx, "ports")) {
+            state->vbrole = VBR_PORTS;
+            ctx->nodes.nodes[ctx->nodes.n-1].has_ports = 1;
+        }
+        break;
+
+    case VBR_NODEEXT:
+        if (is_obj && KEY_IS(ctx, "services")) {
+            state->vbrole = VBR_SERVICES;
+            ctx->nodesext.nodes[ctx->nodesext.n-1].has_services = 1;
+        }
+        break;
+
+    case VBR_SRVMAP:
+        if (is_list && KEY_IS(ctx, "serverList")) {
+            state->vbrole = VBR_SERVERLIST;
+            ctx->have_srvlist = 1;
+        } else if (is_list && KEY_IS(ctx, "vBucketMap")) {
+            state->vbrole = VBR_VBMAP;
+            ctx->vbmap.present = 1;
+        } else if (is_list && KEY_IS(ctx, "vBucketMapForward")) {
+            state->vbrole = VBR_FFMAP;
+            ctx->ffmap.present = 1;
+        }
+        break;
+
+    case VBR_VBMAP:
+    case VBR_FFMAP:
+        vl = prole == VBR_VBMAP ? &ctx->vbmap : &ctx->ffmap;
+        if (!is_list) {
+            SET_ERRSTR(ctx->cfg, "Expected array in vBucket map");
+            PARSE_FAIL(jsn, ctx);
+            return;
         }
+        if (!grow_array((void **)&vl->vbs, vl->n, &vl->nalloc,
+                sizeof(*vl->vbs))) {
+            SET_ERRSTR(ctx->cfg, "Couldn't allocate vBucket map");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        memset(vl->vbs + vl->n++, 0, sizeof(*vl->vbs));
+        state->vbrole = VBR_VBENTRY;
+        break;
+
+    default:
+        break;
+    }
 
-        nservers = cJSON_GetArraySize(jvb);
-        jsix = jvb->child;
-        cvb = vblist + ii;
+    if (state->vbrole == VBR_IGNORE) {
+        /* Skip this subtree entirely */
+        state->ignore_callback = 1;
+    }
+    (void)action; (void)at;
+}
 
-        /* Iterate over each index in the vbucket */
-        for (jj = 0; jj < nservers && jsix; ++jj, jsix = jsix->next) {
-            if (jsix->type != cJSON_Number) {
-                goto GT_ERR;
+static void
+vb_pop_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbPARSER *ctx = jsn->data;
+    lcbvb_CONFIG *cfg = ctx->cfg;
+    struct jsonsl_state_st *parent;
+    int is_str = state->type == JSONSL_T_STRING;
+    int itmp;
+    char **strp = NULL;
+
+    if (state->type == JSONSL_T_HKEY) {
+        ctx->key = ctx->buf + state->pos_begin + 1;
+        ctx->nkey = jsn->pos - state->pos_begin - 1;
+        return;
+    }
+
+    if (JSONSL_STATE_IS_CONTAINER(state)) {
+        if (state->vbrole == VBR_ROOT) {
+            ctx->done = 1;
+        }
+        return;
+    }
+
+    if ((parent = jsonsl_last_state(jsn, state)) == NULL) {
+        return;
+    }
+
+    switch (parent->vbrole) {
+    case VBR_ROOT:
+        if (is_str && KEY_IS(ctx, "name")) {
+            strp = &cfg->bname;
+        } else if (is_str && KEY_IS(ctx, "uuid")) {
+            strp = &cfg->buuid;
+        } else if (is_str && KEY_IS(ctx, "nodeLocator")) {
+            const char *s = ctx->buf + state->pos_begin + 1;
+            ctx->have_locator = 1;
+            if (jsn->pos - state->pos_begin == 7 && !memcmp(s, "ketama", 6)) {
+                cfg->dtype = LCBVB_DIST_KETAMA;
+            } else {
+                cfg->dtype = LCBVB_DIST_VBUCKET;
             }
-            cvb->servers[jj] = jsix->valueint;
+        } else if (KEY_IS(ctx, "rev") && vb_getint(ctx, state, &itmp)) {
+            cfg->revid = itmp;
+        }
+        break;
+
+    case VBR_NODE:
+    case VBR_NODEEXT: {
+        vbNODELIST *nl = parent->vbrole == VBR_NODE ? &ctx->nodes : &ctx->nodesext;
+        vbNODE *node = nl->nodes + nl->n - 1;
+        if (is_str && KEY_IS(ctx, "hostname")) {
+            strp = &node->srv.hostname;
+        } else if (is_str && parent->vbrole == VBR_NODE &&
+                KEY_IS(ctx, "couchApiBase")) {
+            strp = &node->capibase;
         }
+        break;
     }
 
-    *nitems = nalloc;
-    return vblist;
+    case VBR_PORTS:
+        if (KEY_IS(ctx, "direct") && vb_getint(ctx, state, &itmp)) {
+            vbNODE *node = ctx->nodes.nodes + ctx->nodes.n - 1;
+            node->srv.svc.data = itmp;
+            node->has_direct = 1;
+        }
+        break;
 
-    GT_ERR:
-    free(vblist);
-    return NULL;
+    case VBR_SERVICES: {
+        lcbvb_SERVER *srv = &ctx->nodesext.nodes[ctx->nodesext.n-1].srv;
+        lcbvb_SERVICES *svc = &srv->svc;
+        unsigned nkey = ctx->nkey;
+        if (!vb_getint(ctx, state, &itmp)) {
+            break;
+        }
+        if (nkey > 3 && !memcmp(ctx->key + nkey - 3, "SSL", 3)) {
+            svc = &srv->svc_ssl;
+            nkey -= 3;
+        }
+        if (nkey == 2 && !memcmp(ctx->key, "kv", 2)) {
+            svc->data = itmp;
+        } else if (nkey == 4 && !memcmp(ctx->key, "mgmt", 4)) {
+            svc->mgmt = itmp;
+        } else if (nkey == 4 && !memcmp(ctx->key, "capi", 4)) {
+            svc->views = itmp;
+        }
+        break;
+    }
+
+    case VBR_SRVMAP:
+        if (KEY_IS(ctx, "numReplicas") && vb_getint(ctx, state, &itmp)) {
+            if (itmp < 0 || itmp > 3) {
+                SET_ERRSTR(cfg, "Invalid 'numReplicas'");
+                PARSE_FAIL(jsn, ctx);
+                return;
+            }
+            cfg->nrepl = itmp;
+            ctx->have_nrepl = 1;
+        }
+        break;
+
+    case VBR_SERVERLIST:
+        if (!is_str) {
+            SET_ERRSTR(cfg, "Expected string in serverList");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        if (!grow_array((void **)&ctx->srvlist, ctx->nsrvlist,
+                &ctx->nalloc_srvlist, sizeof(*ctx->srvlist))) {
+            SET_ERRSTR(cfg, "Couldn't allocate memory for server list");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        ctx->srvlist[ctx->nsrvlist] = NULL;
+        strp = ctx->srvlist + ctx->nsrvlist++;
+        break;
+
+    case VBR_VBENTRY: {
+        vbVBLIST *vl;
+        /* jsonsl has already counted this element in the parent */
+        unsigned ix = (unsigned)parent->nelem - 1;
+        if (!vb_getint(ctx, state, &itmp) || ix >= 4) {
+            SET_ERRSTR(cfg, "Invalid vBucket map entry");
+            PARSE_FAIL(jsn, ctx);
+            return;
+        }
+        vl = jsn->stack[parent->level - 1].vbrole == VBR_VBMAP
+                ? &ctx->vbmap : &ctx->ffmap;
+        vl->vbs[vl->n-1].servers[ix] = itmp;
+        break;
+    }
+
+    case VBR_NODES:
+    case VBR_NODESEXT:
+        SET_ERRSTR(cfg, "Failed to build server");
+        PARSE_FAIL(jsn, ctx);
+        return;
+
+    case VBR_VBMAP:
+    case VBR_FFMAP:
+        SET_ERRSTR(cfg, "Expected array in vBucket map");
+        PARSE_FAIL(jsn, ctx);
+        return;
+
+    default:
+        break;
+    }
+
+    if (strp) {
+        free(*strp);
+        if (!(*strp = vb_strdup(jsn, ctx, state))) {
+            SET_ERRSTR(cfg, "Couldn't allocate string");
+            PARSE_FAIL(jsn, ctx);
+        }
+    }
+    (void)action; (void)at;
+}
+
+static int
+vb_error_callback(jsonsl_t jsn, jsonsl_error_t error,
+    struct jsonsl_state_st *state, jsonsl_char_t *at)
+{
+    vbPARSER *ctx = jsn->data;
+    if (ctx->done) {
+        /* Trailing data after the root object, e.g. the cache file's magic */
+        return 0;
+    }
+    SET_ERRSTR(ctx->cfg, "Couldn't parse JSON");
+    ctx->failed = 1;
+    (void)error; (void)state; (void)at;
+    return 0;
 }
 
 static lcbvb_SERVER *
-find_server_memd(lcbvb_SERVER *servers, unsigned n, const char *s)
+find_server_memd(lcbvb_SERVER *servers, unsigned n, unsigned hint,
+    const char *s)
 {
     unsigned ii;
+    /* The serverList is usually in the same order as the nodes */
+    if (hint < n && servers[hint].authority &&
+            !strcmp(servers[hint].authority, s)) {
+        return servers + hint;
+    }
     for (ii = 0; ii < n; ii++) {
-        char buf[4096] = { 0 };
         lcbvb_SERVER *cur = servers + ii;
-        snprintf(buf, sizeof(buf), "%s:%d", cur->hostname, cur->svc.data);
-        if (!strncmp(s, buf, sizeof(buf))) {
+        if (cur->authority && !strcmp(cur->authority, s)) {
             return cur;
         }
     }
     return NULL;
 }
 
+static void
+free_service_strs(lcbvb_SERVICES *svc)
+{
+    unsigned ii;
+    for (ii = 0; ii < LCBVB_SVCTYPE__MAX; ii++) {
+        free(svc->hoststrs[ii]);
+    }
+    free(svc->views_base_);
+}
+
+static void
+free_server_strs(lcbvb_SERVER *srv)
+{
+    free(srv->hostname);
+    free(srv->viewpath);
+    free_service_strs(&srv->svc);
+    free_service_strs(&srv->svc_ssl);
+}
+
 static int
 assign_dumy_server(lcbvb_CONFIG *cfg, lcbvb_SERVER *dst, const char *s)
 {
@@ -124,10 +555,12 @@ assign_dumy_server(lcbvb_CONFIG *cfg, lcbvb_SERVER *dst, const char *s)
     }
 
     dst->svc.data = itmp;
+    dst->svc.hoststrs[LCBVB_SVCTYPE_DATA] = dst->authority;
     return 1;
 
     GT_ERR:
     free(dst->authority);
+    dst->authority = NULL;
     return 0;
 }
 
@@ -142,7 +575,7 @@ set_vb_count(lcbvb_CONFIG *cfg, lcbvb_VBUCKET *vbs)
     for (ii = 0; ii < cfg->nvb; ++ii) {
         for (jj = 0; jj < cfg->nrepl+1; ++jj) {
             int ix = vbs[ii].servers[jj];
-            if (ix < 0 || (unsigned)ix > cfg->nsrv) {
+            if (ix < 0 || (unsigned)ix >= cfg->nsrv) {
                 continue;
             }
             cfg->servers[ix].nvbs++;
@@ -150,94 +583,90 @@ set_vb_count(lcbvb_CONFIG *cfg, lcbvb_VBUCKET *vbs)
     }
 }
 
+/**
+ * Reorder the servers according to the 2.x 'serverList', which is what the
+ * indexes in the vBucket map refer to.
+ */
 static int
-pair_server_list(lcbvb_CONFIG *cfg, cJSON *vbconfig)
+pair_server_list(lcbvb_CONFIG *cfg, char **srvlist, unsigned nsrv)
 {
-    cJSON *servers;
-    lcbvb_SERVER *newlist = NULL;
-    unsigned ii, nsrv;
-
-    if (!get_jarray(vbconfig, "serverList", &servers)) {
-        SET_ERRSTR(cfg, "Couldn't find serverList");
-        goto GT_ERROR;
-    }
-
-    nsrv = cJSON_GetArraySize(servers);
-
-    if (nsrv > cfg->nsrv) {
-        /* nodes in serverList which are not in nodes/nodesExt */
-        void *tmp = realloc(cfg->servers, sizeof(*cfg->servers) * nsrv);
-        if (!tmp) {
-            SET_ERRSTR(cfg, "Couldn't allocate memory for server list");
-            goto GT_ERROR;
-        }
-        cfg->servers = tmp;
-        cfg->nsrv = nsrv;
-    }
+    lcbvb_SERVER *newlist;
+    unsigned ii;
+    int rv = 1;
 
     /* allocate an array for the reordered server list */
-    newlist = malloc(sizeof(*cfg->servers) * nsrv);
+    if (!(newlist = calloc(nsrv ? nsrv : 1, sizeof(*cfg->servers)))) {
+        SET_ERRSTR(cfg, "Couldn't allocate memory for server list");
+        return 0;
+    }
 
     for (ii = 0; ii < nsrv; ii++) {
-        char *tmp;
-        cJSON *jst;
         lcbvb_SERVER *cur;
-        jst = cJSON_GetArrayItem(servers, ii);
-        tmp = jst->valuestring;
-        cur = find_server_memd(cfg->servers, cfg->nsrv, tmp);
+        cur = find_server_memd(cfg->servers, cfg->nsrv, ii, srvlist[ii]);
 
         if (cur) {
             newlist[ii] = *cur;
-        } else {
+            /* the new list owns the strings now */
+            memset(cur, 0, sizeof(*cur));
+        } else if (!assign_dumy_server(cfg, &newlist[ii], srvlist[ii])) {
             /* found server inside serverList but not in nodes? */
-            if (!assign_dumy_server(cfg, &newlist[ii], tmp)) {
-                goto GT_ERROR;
-            }
+            rv = 0;
+            break;
         }
     }
 
+    /* free any nodes which were not part of serverList */
+    for (nsrv = ii, ii = 0; ii < cfg->nsrv; ii++) {
+        free_server_strs(cfg->servers + ii);
+    }
     free(cfg->servers);
     cfg->servers = newlist;
-    return 1;
-
-    GT_ERROR:
-    free(newlist);
-    return 0;
-
+    cfg->nsrv = nsrv;
+    return rv;
 }
 
 static int
-parse_vbucket(lcbvb_CONFIG *cfg, cJSON *cj)
+parse_vbucket(lcbvb_CONFIG *cfg, vbPARSER *ctx)
 {
-    cJSON *vbconfig, *vbmap, *ffmap = NULL;
-
-    if (!get_jobj(cj, "vBucketServerMap", &vbconfig)) {
+    if (!ctx->have_srvmap) {
         SET_ERRSTR(cfg, "Expected top-level 'vBucketServerMap'");
         goto GT_ERROR;
     }
 
-    if (!get_juint(vbconfig, "numReplicas", &cfg->nrepl)) {
+    if (!ctx->have_nrepl) {
         SET_ERRSTR(cfg, "'numReplicas' missing");
         goto GT_ERROR;
     }
 
-    if (!get_jarray(vbconfig, "vBucketMap", &vbmap)) {
+    if (!ctx->vbmap.present) {
         SET_ERRSTR(cfg, "Missing 'vBucketMap'");
         goto GT_ERROR;
     }
 
-    get_jarray(vbconfig, "vBucketMapForward", &ffmap);
-
-    if ((cfg->vbuckets = build_vbmap(vbmap, &cfg->nvb)) == NULL) {
+    if (!ctx->vbmap.n) {
+        SET_ERRSTR(cfg, "Empty 'vBucketMap'");
         goto GT_ERROR;
     }
 
-    if (ffmap && (cfg->ffvbuckets = build_vbmap(ffmap, &cfg->nvb)) == NULL) {
+    if (ctx->ffmap.present && ctx->ffmap.n != ctx->vbmap.n) {
+        SET_ERRSTR(cfg, "'vBucketMapForward' size differs from 'vBucketMap'");
         goto GT_ERROR;
     }
 
+    cfg->nvb = ctx->vbmap.n;
+    cfg->vbuckets = ctx->vbmap.vbs;
+    ctx->vbmap.vbs = NULL;
+    if (ctx->ffmap.present) {
+        cfg->ffvbuckets = ctx->ffmap.vbs;
+        ctx->ffmap.vbs = NULL;
+    }
+
     if (!cfg->is3x) {
-        if (!pair_server_list(cfg, vbconfig)) {
+        if (!ctx->have_srvlist) {
+            SET_ERRSTR(cfg, "Couldn't find serverList");
+            goto GT_ERROR;
+        }
+        if (!pair_server_list(cfg, ctx->srvlist, ctx->nsrvlist)) {
             goto GT_ERROR;
         }
     }
@@ -307,28 +736,6 @@ parse_ketama(lcbvb_CONFIG *cfg)
     return 1;
 }
 
-static int
-extract_services(lcbvb_CONFIG *cfg, cJSON *jsvc, lcbvb_SERVICES *svc, int is_ssl)
-{
-    int itmp;
-    int rv;
-    const char *key;
-
-    #define EXTRACT_SERVICE(k, fld) \
-        key = is_ssl ? k"SSL" : k; \
-        rv = get_jint(jsvc, key, &itmp); \
-        if (rv) { svc->fld = itmp; } else { svc->fld = 0; }
-
-    EXTRACT_SERVICE("kv", data);
-    EXTRACT_SERVICE("mgmt", mgmt);
-    EXTRACT_SERVICE("capi", views);
-
-    #undef EXTRACT_SERVICE
-
-    (void)cfg;
-    return 1;
-}
-
 static int
 build_server_strings(lcbvb_CONFIG *cfg, lcbvb_SERVER *server)
 {
@@ -351,38 +758,26 @@ build_server_strings(lcbvb_CONFIG *cfg, lcbvb_SERVER *server)
 }
 
 /**
- * Parse a node from the 'nodesExt' array
+ * Finish a node from the 'nodesExt' array
  * @param cfg
- * @param server
- * @param js
+ * @param node the parsed node
  * @return
  */
 static int
-build_server_3x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
+build_server_3x(lcbvb_CONFIG *cfg, vbNODE *node)
 {
-    cJSON *jsvcs;
-    char *htmp;
+    lcbvb_SERVER *server = &node->srv;
 
-    if (!get_jstr(js, "hostname", &htmp)) {
-        htmp = "$HOST";
-    }
-    if (!(server->hostname = strdup(htmp))) {
+    if (!server->hostname && !(server->hostname = strdup("$HOST"))) {
         SET_ERRSTR(cfg, "Couldn't allocate memory");
         goto GT_ERR;
     }
 
-    if (!get_jobj(js, "services", &jsvcs)) {
+    if (!node->has_services) {
         SET_ERRSTR(cfg, "Couldn't find 'services'");
         goto GT_ERR;
     }
 
-    if (!extract_services(cfg, jsvcs, &server->svc, 0)) {
-        goto GT_ERR;
-    }
-    if (!extract_services(cfg, jsvcs, &server->svc_ssl, 1)) {
-        goto GT_ERR;
-    }
-
     if (!build_server_strings(cfg, server)) {
         goto GT_ERR;
     }
@@ -394,26 +789,21 @@ build_server_3x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
 }
 
 /**
- * Initialize a server from a JSON Object
+ * Finish a node from the 'nodes' array
  * @param server The server to initialize
- * @param js The object which contains the server information
+ * @param node The parsed node information
  * @return nonzero on success, 0 on failure.
  */
 static int
-build_server_2x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
+build_server_2x(lcbvb_CONFIG *cfg, vbNODE *node)
 {
-    char *tmp = NULL, *colon;
+    lcbvb_SERVER *server = &node->srv;
+    char *tmp, *colon;
     int itmp;
-    cJSON *jsports;
-
-    if (!get_jstr(js, "hostname", &tmp)) {
-        SET_ERRSTR(cfg, "Couldn't find hostname");
-        goto GT_ERR;
-    }
 
     /** Hostname is the _rest_ API host, e.g. '8091' */
-    if ((server->hostname = strdup(tmp)) == NULL) {
-        SET_ERRSTR(cfg, "Couldn't allocate hostname");
+    if (!server->hostname) {
+        SET_ERRSTR(cfg, "Couldn't find hostname");
         goto GT_ERR;
     }
 
@@ -432,7 +822,7 @@ build_server_2x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
     *colon = '\0';
 
     /** Handle the views name */
-    if (get_jstr(js, "couchApiBase", &tmp)) {
+    if ((tmp = node->capibase) != NULL) {
         /** Have views */
         char *path_begin;
         colon = strrchr(tmp, ':');
@@ -458,15 +848,13 @@ build_server_2x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
     }
 
     /* get the 'ports' dictionary */
-    if (!get_jobj(js, "ports", &jsports)) {
+    if (!node->has_ports) {
         SET_ERRSTR(cfg, "Expected 'ports' dictionary");
         goto GT_ERR;
     }
 
     /* memcached port */
-    if (get_jint(jsports, "direct", &itmp)) {
-        server->svc.data = itmp;
-    } else {
+    if (!node->has_direct) {
         SET_ERRSTR(cfg, "Expected 'direct' field in 'ports'");
         goto GT_ERR;
     }
@@ -484,87 +872,107 @@ build_server_2x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
 int
 lcbvb_load_json(lcbvb_CONFIG *cfg, const char *data)
 {
-    cJSON *cj = NULL, *jnodes = NULL;
-    char *tmp = NULL;
+    jsonsl_t jsn = NULL;
+    vbPARSER ctx;
+    vbNODELIST *nl;
     unsigned ii;
+    int rv = -1;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.cfg = cfg;
+    ctx.buf = data;
+    cfg->revid = -1;
+
+    if ((jsn = jsonsl_new(64)) == NULL) {
+        SET_ERRSTR(cfg, "Couldn't allocate parser");
+        goto GT_DONE;
+    }
+    jsn->data = &ctx;
+    jsn->action_callback_PUSH = vb_push_callback;
+    jsn->action_callback_POP = vb_pop_callback;
+    jsn->error_callback = vb_error_callback;
+    jsonsl_enable_all_callbacks(jsn);
+    jsonsl_feed(jsn, data, strlen(data));
 
-    if ((cj = cJSON_Parse(data)) == NULL) {
+    if (ctx.failed) {
+        goto GT_DONE;
+    }
+    if (!ctx.done) {
         SET_ERRSTR(cfg, "Couldn't parse JSON");
-        goto GT_ERROR;
+        goto GT_DONE;
     }
 
-    if (!get_jstr(cj, "name", &tmp)) {
+    if (!cfg->bname) {
         SET_ERRSTR(cfg, "Expected 'name' key");
-        goto GT_ERROR;
+        goto GT_DONE;
     }
-    cfg->bname = strdup(tmp);
 
-    if (!get_jstr(cj, "nodeLocator", &tmp)) {
+    if (!ctx.have_locator) {
         SET_ERRSTR(cfg, "Expected 'nodeLocator' key");
-        goto GT_ERROR;
+        goto GT_DONE;
     }
 
-    if (get_jarray(cj, "nodesExt", &jnodes)) {
+    if (ctx.nodesext.present) {
         cfg->is3x = 1;
-    } else if (!get_jarray(cj, "nodes", &jnodes)) {
-        SET_ERRSTR(cfg, "expected 'nodesExt' or 'nodes' array");
-        goto GT_ERROR;
-    }
-
-    if (!strcmp(tmp, "ketama")) {
-        cfg->dtype = LCBVB_DIST_KETAMA;
+        nl = &ctx.nodesext;
+    } else if (ctx.nodes.present) {
+        nl = &ctx.nodes;
     } else {
-        cfg->dtype = LCBVB_DIST_VBUCKET;
-    }
-
-    if (get_jstr(cj, "uuid", &tmp)) {
-        cfg->buuid = strdup(tmp);
+        SET_ERRSTR(cfg, "expected 'nodesExt' or 'nodes' array");
+        goto GT_DONE;
     }
 
-    if (!get_jint(cj, "rev", &cfg->revid)) {
-        cfg->revid = -1;
+    /** Move the servers into the config; it owns their strings from now on */
+    cfg->nsrv = nl->n;
+    cfg->servers = calloc(nl->n ? nl->n : 1, sizeof(*cfg->servers));
+    if (!cfg->servers) {
+        cfg->nsrv = 0;
+        SET_ERRSTR(cfg, "Couldn't allocate memory for server list");
+        goto GT_DONE;
     }
-
-    /** Get the number of nodes. This traverses the list. Yuck */
-    cfg->nsrv = cJSON_GetArraySize(jnodes);
-
-    /** Allocate a temporary one on the heap */
-    cfg->servers = calloc(cfg->nsrv, sizeof(*cfg->servers));
     for (ii = 0; ii < cfg->nsrv; ii++) {
-        int rv;
-        cJSON *jsrv = cJSON_GetArrayItem(jnodes, ii);
+        int brv;
+        vbNODE *node = nl->nodes + ii;
 
         if (cfg->is3x) {
-            rv = build_server_3x(cfg, cfg->servers + ii, jsrv);
+            brv = build_server_3x(cfg, node);
         } else {
-            rv = build_server_2x(cfg, cfg->servers + ii, jsrv);
+            brv = build_server_2x(cfg, node);
         }
+        cfg->servers[ii] = node->srv;
+        memset(&node->srv, 0, sizeof(node->srv));
 
-        if (!rv) {
+        if (!brv) {
             SET_ERRSTR(cfg, "Failed to build server");
-            goto GT_ERROR;
+            goto GT_DONE;
         }
     }
 
     if (cfg->dtype == LCBVB_DIST_VBUCKET) {
-        if (!parse_vbucket(cfg, cj)) {
+        if (!parse_vbucket(cfg, &ctx)) {
             SET_ERRSTR(cfg, "Failed to parse vBucket map");
-            goto GT_ERROR;
+            goto GT_DONE;
         }
     } else {
         if (!parse_ketama(cfg)) {
             SET_ERRSTR(cfg, "Failed to establish ketama continuums");
         }
     }
-    cfg->servers = realloc(cfg->servers, sizeof(*cfg->servers) * cfg->nsrv);
-    cJSON_Delete(cj);
-    return 0;
+    rv = 0;
 
-    GT_ERROR:
-    if (cj) {
-        cJSON_Delete(cj);
+    GT_DONE:
+    if (jsn) {
+        jsonsl_destroy(jsn);
     }
-    return -1;
+    free_nodelist(&ctx.nodes);
+    free_nodelist(&ctx.nodesext);
+    free(ctx.vbmap.vbs);
+    free(ctx.ffmap.vbs);
+    for (ii = 0; ii < ctx.nsrvlist; ii++) {
+        free(ctx.srvlist[ii]);
+    }
+    free(ctx.srvlist);
+    return rv;
 }
 
 static void
@@ -640,26 +1048,12 @@ lcbvb_create(void)
     return calloc(1, sizeof(lcbvb_CONFIG));
 }
 
-static void
-free_service_strs(lcbvb_SERVICES *svc)
-{
-    unsigned ii;
-    for (ii = 0; ii < LCBVB_SVCTYPE__MAX; ii++) {
-        free(svc->hoststrs[ii]);
-    }
-    free(svc->views_base_);
-}
-
 void
 lcbvb_destroy(lcbvb_CONFIG *conf)
 {
     unsigned ii;
     for (ii = 0; ii < conf->nsrv; ii++) {
-        lcbvb_SERVER *srv = conf->servers + ii;
-        free(srv->hostname);
-        free(srv->viewpath);
-        free_service_strs(&srv->svc);
-        free_service_strs(&srv->svc_ssl);
+        free_server_strs(conf->servers + ii);
     }
     free(conf->servers);
     free(conf->continuum);
@@ -755,6 +1149,349 @@ lcbvb_save_json(lcbvb_CONFIG *cfg)
     return ret;
 }
 
+/******************************************************************************
+ ******************************************************************************
+ ** Binary Serialization                                                     **
+ ******************************************************************************
+ ******************************************************************************/
+
+/*
+ * The binary format is a header followed by fixed-size arrays and a string
+ * table. The vBucket map and continuum are stored exactly as they are held
+ * in memory, so loading them is a single copy each. All offsets are from the
+ * start of the buffer and are multiples of 4. Integers are in host byte order;
+ * the `bom` field allows a buffer from a different host to be rejected.
+ */
+#define BIN_MAGIC "LCBVBIN"
+#define BIN_BOM 0x01020304U
+#define BIN_NOSTR 0xffffffffU
+#define BIN_ALIGN(n) (((n) + 3) & ~3U)
+
+typedef struct {
+    char magic[8];
+    lcb_U32 version;
+    lcb_U32 bom;
+    lcb_U32 nbytes; /* total size of the buffer */
+    lcb_S32 revid;
+    lcb_U32 dtype;
+    lcb_U32 nvb;
+    lcb_U32 nsrv;
+    lcb_U32 nrepl;
+    lcb_U32 ncontinuum;
+    lcb_U32 is3x;
+    lcb_U32 has_ffmap;
+    lcb_U32 off_servers;
+    lcb_U32 off_vbuckets;
+    lcb_U32 off_ffvbuckets;
+    lcb_U32 off_continuum;
+    lcb_U32 off_strings;
+    lcb_U32 nstrings;
+    lcb_U32 s_bname;
+    lcb_U32 s_buuid;
+} bin_HEADER;
+
+typedef struct {
+    lcb_U16 ports[6]; /* data, mgmt, views; plain then SSL */
+    lcb_U32 nvbs;
+    lcb_U32 s_hostname;
+    lcb_U32 s_viewpath;
+} bin_SERVER;
+
+static lcb_U32
+bin_strsize(const char *s)
+{
+    return s ? strlen(s) + 1 : 0;
+}
+
+/* Append a string to the table. The table is sized in advance */
+static lcb_U32
+bin_addstr(char *strs, lcb_U32 *nused, const char *s)
+{
+    lcb_U32 off = *nused, len;
+    if (s == NULL) {
+        return BIN_NOSTR;
+    }
+    len = strlen(s) + 1;
+    memcpy(strs + off, s, len);
+    *nused += len;
+    return off;
+}
+
+LIBCOUCHBASE_API
+void *
+lcbvb_save_binary(lcbvb_CONFIG *cfg, lcb_SIZE *nbytes)
+{
+    unsigned ii;
+    char *strs = NULL;
+    lcb_U32 nstrs = 0;
+    bin_HEADER hdr;
+    bin_SERVER *servers;
+    lcb_SIZE nvbmap = 0;
+    char *ret = NULL;
+
+    memset(&hdr, 0, sizeof hdr);
+    if (cfg->dtype == LCBVB_DIST_VBUCKET) {
+        nvbmap = sizeof(*cfg->vbuckets) * cfg->nvb;
+    }
+
+    nstrs = bin_strsize(cfg->bname) + bin_strsize(cfg->buuid);
+    for (ii = 0; ii < cfg->nsrv; ii++) {
+        nstrs += bin_strsize(cfg->servers[ii].hostname);
+        nstrs += bin_strsize(cfg->servers[ii].viewpath);
+    }
+
+    servers = calloc(cfg->nsrv ? cfg->nsrv : 1, sizeof(*servers));
+    strs = malloc(nstrs ? nstrs : 1);
+    if (!servers || !strs) {
+        goto GT_DONE;
+    }
+    nstrs = 0;
+    for (ii = 0; ii < cfg->nsrv; ii++) {
+        const lcbvb_SERVER *srv = cfg->servers + ii;
+        bin_SERVER *dst = servers + ii;
+        dst->ports[0] = srv->svc.data;
+        dst->ports[1] = srv->svc.mgmt;
+        dst->ports[2] = srv->svc.views;
+        dst->ports[3] = srv->svc_ssl.data;
+        dst->ports[4] = srv->svc_ssl.mgmt;
+        dst->ports[5] = srv->svc_ssl.views;
+        dst->nvbs = srv->nvbs;
+        dst->s_hostname = bin_addstr(strs, &nstrs, srv->hostname);
+        dst->s_viewpath = bin_addstr(strs, &nstrs, srv->viewpath);
+    }
+
+    memcpy(hdr.magic, BIN_MAGIC, sizeof BIN_MAGIC);
+    hdr.version = LCBVB_BINARY_VERSION;
+    hdr.bom = BIN_BOM;
+    hdr.revid = cfg->revid;
+    hdr.dtype = cfg->dtype;
+    hdr.nvb = cfg->nvb;
+    hdr.nsrv = cfg->nsrv;
+    hdr.nrepl = cfg->nrepl;
+    hdr.ncontinuum = cfg->ncontinuum;
+    hdr.is3x = cfg->is3x;
+    hdr.has_ffmap = nvbmap && cfg->ffvbuckets != NULL;
+    hdr.s_bname = bin_addstr(strs, &nstrs, cfg->bname);
+    hdr.s_buuid = bin_addstr(strs, &nstrs, cfg->buuid);
+
+    hdr.off_servers = BIN_ALIGN(sizeof hdr);
+    hdr.off_vbuckets = hdr.off_servers + sizeof(*servers) * cfg->nsrv;
+    hdr.off_ffvbuckets = hdr.off_vbuckets + nvbmap;
+    hdr.off_continuum = hdr.off_ffvbuckets + (hdr.has_ffmap ? nvbmap : 0);
+    hdr.off_strings = hdr.off_continuum +
+            sizeof(*cfg->continuum) * cfg->ncontinuum;
+    hdr.nstrings = nstrs;
+    hdr.nbytes = BIN_ALIGN(hdr.off_strings + hdr.nstrings);
+
+    if (!(ret = calloc(1, hdr.nbytes))) {
+        goto GT_DONE;
+    }
+    memcpy(ret, &hdr, sizeof hdr);
+    memcpy(ret + hdr.off_servers, servers, sizeof(*servers) * cfg->nsrv);
+    if (nvbmap) {
+        memcpy(ret + hdr.off_vbuckets, cfg->vbuckets, nvbmap);
+    }
+    if (hdr.has_ffmap) {
+        memcpy(ret + hdr.off_ffvbuckets, cfg->ffvbuckets, nvbmap);
+    }
+    if (cfg->ncontinuum) {
+        memcpy(ret + hdr.off_continuum, cfg->continuum,
+            sizeof(*cfg->continuum) * cfg->ncontinuum);
+    }
+    memcpy(ret + hdr.off_strings, strs, nstrs);
+    *nbytes = hdr.nbytes;
+
+    GT_DONE:
+    free(servers);
+    free(strs);
+    return ret;
+}
+
+/* Get a string from the table. Returns 1 if it is valid (including NULL) */
+static int
+bin_getstr(const bin_HEADER *hdr, const char *buf, lcb_U32 off, char **out)
+{
+    const char *begin;
+    *out = NULL;
+    if (off == BIN_NOSTR) {
+        return 1;
+    }
+    if (off >= hdr->nstrings) {
+        return 0;
+    }
+    begin = buf + hdr->off_strings + off;
+    if (memchr(begin, '\0', hdr->nstrings - off) == NULL) {
+        return 0;
+    }
+    *out = strdup(begin);
+    return *out != NULL;
+}
+
+static int
+bin_check_region(const bin_HEADER *hdr, lcb_U32 off, lcb_SIZE nbytes)
+{
+    return off % 4 == 0 && off <= hdr->nbytes && nbytes <= hdr->nbytes - off;
+}
+
+LIBCOUCHBASE_API
+int
+lcbvb_load_binary(lcbvb_CONFIG *cfg, const void *data, lcb_SIZE nbytes)
+{
+    unsigned ii;
+    bin_HEADER hdr;
+    const char *buf = data;
+    const bin_SERVER *servers;
+    lcb_SIZE nvbmap;
+
+    if (nbytes < sizeof hdr) {
+        SET_ERRSTR(cfg, "Buffer too small");
+        return -1;
+    }
+    memcpy(&hdr, buf, sizeof hdr);
+    if (memcmp(hdr.magic, BIN_MAGIC, sizeof BIN_MAGIC) != 0 ||
+            hdr.bom != BIN_BOM || hdr.version != LCBVB_BINARY_VERSION) {
+        SET_ERRSTR(cfg, "Not a binary configuration of this version");
+        return -1;
+    }
+
+    nvbmap = hdr.dtype == LCBVB_DIST_VBUCKET ?
+            (lcb_SIZE)sizeof(*cfg->vbuckets) * hdr.nvb : 0;
+    if (hdr.nbytes > nbytes || hdr.nsrv == 0 ||
+            hdr.nsrv > hdr.nbytes / sizeof(*servers) ||
+            hdr.nvb > hdr.nbytes / sizeof(*cfg->vbuckets) ||
+            hdr.ncontinuum > hdr.nbytes / sizeof(*cfg->continuum) ||
+            hdr.nrepl >= sizeof(cfg->vbuckets->servers) / sizeof(int) ||
+            !bin_check_region(&hdr, hdr.off_servers,
+                (lcb_SIZE)sizeof(*servers) * hdr.nsrv) ||
+            !bin_check_region(&hdr, hdr.off_vbuckets, nvbmap) ||
+            (hdr.has_ffmap &&
+                    !bin_check_region(&hdr, hdr.off_ffvbuckets, nvbmap)) ||
+            !bin_check_region(&hdr, hdr.off_continuum,
+                (lcb_SIZE)sizeof(*cfg->continuum) * hdr.ncontinuum) ||
+            hdr.off_strings > hdr.nbytes ||
+            hdr.nstrings > hdr.nbytes - hdr.off_strings) {
+        SET_ERRSTR(cfg, "Corrupt binary configuration");
+        return -1;
+    }
+
+    cfg->dtype = hdr.dtype == LCBVB_DIST_KETAMA ?
+            LCBVB_DIST_KETAMA : LCBVB_DIST_VBUCKET;
+    cfg->nrepl = hdr.nrepl;
+    cfg->is3x = hdr.is3x;
+    cfg->revid = hdr.revid;
+    if (!bin_getstr(&hdr, buf, hdr.s_bname, &cfg->bname) ||
+            !bin_getstr(&hdr, buf, hdr.s_buuid, &cfg->buuid) ||
+            cfg->bname == NULL) {
+        SET_ERRSTR(cfg, "Corrupt string table");
+        return -1;
+    }
+
+    cfg->servers = calloc(hdr.nsrv, sizeof(*cfg->servers));
+    if (!cfg->servers) {
+        SET_ERRSTR(cfg, "Couldn't allocate servers");
+        return -1;
+    }
+    servers = (const bin_SERVER *)(buf + hdr.off_servers);
+    for (ii = 0; ii < hdr.nsrv; ii++) {
+        const bin_SERVER *src = servers + ii;
+        lcbvb_SERVER *srv = cfg->servers + ii;
+
+        /* nsrv tracks the servers which need to be freed on error */
+        cfg->nsrv = ii + 1;
+        srv->svc.data = src->ports[0];
+        srv->svc.mgmt = src->ports[1];
+        srv->svc.views = src->ports[2];
+        srv->svc_ssl.data = src->ports[3];
+        srv->svc_ssl.mgmt = src->ports[4];
+        srv->svc_ssl.views = src->ports[5];
+        srv->nvbs = src->nvbs;
+        if (!bin_getstr(&hdr, buf, src->s_hostname, &srv->hostname) ||
+                !bin_getstr(&hdr, buf, src->s_viewpath, &srv->viewpath) ||
+                srv->hostname == NULL) {
+            SET_ERRSTR(cfg, "Corrupt string table");
+            return -1;
+        }
+        if (!build_server_strings(cfg, srv)) {
+            return -1;
+        }
+    }
+
+    if (cfg->dtype == LCBVB_DIST_VBUCKET && nvbmap == 0) {
+        SET_ERRSTR(cfg, "vBucket configuration without vBuckets");
+        return -1;
+    }
+
+    if (nvbmap) {
+        cfg->vbuckets = malloc(nvbmap);
+        if (!cfg->vbuckets) {
+            SET_ERRSTR(cfg, "Couldn't allocate vBucket map");
+            return -1;
+        }
+        memcpy(cfg->vbuckets, buf + hdr.off_vbuckets, nvbmap);
+        cfg->nvb = hdr.nvb;
+        if (hdr.has_ffmap) {
+            cfg->ffvbuckets = malloc(nvbmap);
+            if (!cfg->ffvbuckets) {
+                SET_ERRSTR(cfg, "Couldn't allocate vBucket map");
+                return -1;
+            }
+            memcpy(cfg->ffvbuckets, buf + hdr.off_ffvbuckets, nvbmap);
+        }
+    }
+
+    if (hdr.ncontinuum) {
+        lcb_SIZE ncont = sizeof(*cfg->continuum) * hdr.ncontinuum;
+        cfg->continuum = malloc(ncont);
+        if (!cfg->continuum) {
+            SET_ERRSTR(cfg, "Couldn't allocate continuum");
+            return -1;
+        }
+        memcpy(cfg->continuum, buf + hdr.off_continuum, ncont);
+        cfg->ncontinuum = hdr.ncontinuum;
+    } else if (cfg->dtype == LCBVB_DIST_KETAMA) {
+        SET_ERRSTR(cfg, "Ketama configuration without continuum");
+        return -1;
+    }
+
+    /* Don't let a corrupt map index past the server list */
+    for (ii = 0; ii < cfg->nvb; ii++) {
+        unsigned jj;
+        for (jj = 0; jj < cfg->nrepl + 1; jj++) {
+            int ix = cfg->vbuckets[ii].servers[jj];
+            int ffix = cfg->ffvbuckets ? cfg->ffvbuckets[ii].servers[jj] : -1;
+            if (ix < -1 || ix >= (int)cfg->nsrv ||
+                    ffix < -1 || ffix >= (int)cfg->nsrv) {
+                SET_ERRSTR(cfg, "Corrupt vBucket map");
+                return -1;
+            }
+        }
+    }
+    for (ii = 0; ii < cfg->ncontinuum; ii++) {
+        if (cfg->continuum[ii].index >= cfg->nsrv) {
+            SET_ERRSTR(cfg, "Corrupt continuum");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+LIBCOUCHBASE_API
+int
+lcbvb_peek_binary_revision(const void *data, lcb_SIZE nbytes, int *revid)
+{
+    bin_HEADER hdr;
+    if (nbytes < sizeof hdr) {
+        return -1;
+    }
+    memcpy(&hdr, data, sizeof hdr);
+    if (memcmp(hdr.magic, BIN_MAGIC, sizeof BIN_MAGIC) != 0 ||
+            hdr.bom != BIN_BOM || hdr.version != LCBVB_BINARY_VERSION) {
+        return -1;
+    }
+    *revid = hdr.revid;
+    return 0;
+}
+
 /******************************************************************************
  ******************************************************************************
  ** Mapping Routines                                                         **
@@ -32,10 +32,16 @@ has_pending(lcb_t instance)
     }
 
     for (ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        unsigned jj;
         mc_SERVER *ss = LCBT_GET_SERVER(instance, ii);
         if (mcserver_has_pending(ss)) {
             return 1;
         }
+        for (jj = 0; jj < MCSERVER_NLANES(ss); jj++) {
+            if (mcserver_has_pending(MCSERVER_LANE(ss, jj))) {
+                return 1;
+            }
+        }
     }
     return 0;
 }
@@ -0,0 +1,182 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include <string>
+
+using std::string;
+
+static int npaused;
+static int nresumed;
+
+extern "C" {
+static void backpressure_callback(lcb_t, int paused)
+{
+    if (paused) {
+        npaused++;
+    } else {
+        nresumed++;
+    }
+}
+}
+
+class Admission : public PipelineTest
+{
+protected:
+    void SetUp() {
+        PipelineTest::SetUp();
+        lcb_set_backpressure_callback(instance, backpressure_callback);
+        npaused = nresumed = 0;
+    }
+
+    void setLimit(int cmd, lcb_U32 value) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, cmd, &value));
+    }
+
+    void setPolicy(int policy) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_QUEUE_POLICY, &policy));
+    }
+
+    lcb_QUEUESTATS getStats() {
+        lcb_QUEUESTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_QUEUE_STATS, &stats));
+        return stats;
+    }
+
+    lcb_error_t get(const string& key) {
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        lcb_error_t rc = lcb_get3(instance, NULL, &cmd);
+        lcb_sched_leave(instance);
+        return rc;
+    }
+};
+
+TEST_F(Admission, testCounters)
+{
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    mc_PIPELINE *pl = pipelineFor("foo");
+    ASSERT_EQ(2, pl->nqpkts);
+
+    lcb_QUEUESTATS stats = getStats();
+    ASSERT_EQ(2, stats.npkts);
+    ASSERT_EQ(2, stats.max_pipeline_pkts);
+    ASSERT_EQ(stats.nbytes, stats.max_pipeline_bytes);
+    ASSERT_EQ(2 * (24 + 3), stats.nbytes);
+
+    releasePacket(pl, takePacket(pl));
+    releasePacket(pl, takePacket(pl));
+    stats = getStats();
+    ASSERT_EQ(0, stats.npkts);
+    ASSERT_EQ(0, stats.nbytes);
+    ASSERT_EQ(0, pl->nqbytes);
+
+    // Packets which are not scheduled are not counted
+    lcb_sched_enter(instance);
+    lcb_CMDGET cmd = { 0 };
+    LCB_CMD_SET_KEY(&cmd, "foo", 3);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, NULL, &cmd));
+    ASSERT_EQ(1, getStats().npkts);
+    lcb_sched_fail(instance);
+    ASSERT_EQ(0, getStats().npkts);
+}
+
+TEST_F(Admission, testFailFast)
+{
+    setLimit(LCB_CNTL_QUEUE_MAXPKTS, 4);
+    mc_PIPELINE *pl = pipelineFor("foo");
+    for (int ii = 0; ii < 4; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    }
+    ASSERT_EQ(0, npaused);
+    ASSERT_EQ(LCB_EQUEUEFULL, get("foo"));
+    ASSERT_EQ(1, npaused);
+    ASSERT_EQ(4, pl->nqpkts);
+
+    lcb_QUEUESTATS stats = getStats();
+    ASSERT_EQ(1, stats.nrejected);
+    ASSERT_EQ(1, stats.npauses);
+    ASSERT_NE(0, stats.paused);
+
+    // Other servers are not affected by the per-server limit
+    string other = "bar";
+    while (pipelineFor(other) == pl) {
+        other += "x";
+    }
+    ASSERT_EQ(LCB_SUCCESS, get(other));
+
+    // Resumed once drained to half the limit
+    releasePacket(pl, takePacket(pl));
+    ASSERT_EQ(0, nresumed);
+    releasePacket(pl, takePacket(pl));
+    ASSERT_EQ(1, nresumed);
+    ASSERT_EQ(0, getStats().paused);
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+}
+
+TEST_F(Admission, testInternal)
+{
+    setLimit(LCB_CNTL_QUEUE_MAXPKTS, 2);
+    mc_PIPELINE *pl = pipelineFor("foo");
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+
+    // Commands issued by the library itself are counted, but neither
+    // rejected nor cause a pause
+    lcb_CMDGET gcmd = { 0 };
+    LCB_CMD_SET_KEY(&gcmd, "foo", 3);
+    gcmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+    lcb_CMDCOUNTER ccmd = { 0 };
+    LCB_CMD_SET_KEY(&ccmd, "foo", 3);
+    ccmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+    ccmd.delta = 1;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, NULL, &gcmd));
+    ASSERT_EQ(LCB_SUCCESS, lcb_counter3(instance, NULL, &ccmd));
+    lcb_sched_leave(instance);
+    ASSERT_EQ(4, pl->nqpkts);
+    ASSERT_EQ(0, npaused);
+    lcb_QUEUESTATS stats = getStats();
+    ASSERT_EQ(0, stats.nrejected);
+    ASSERT_EQ(0, stats.npauses);
+
+    // Commands from the application are still subject to the limit
+    ASSERT_EQ(LCB_EQUEUEFULL, get("foo"));
+    ASSERT_EQ(1, getStats().nrejected);
+}
+
+TEST_F(Admission, testNotify)
+{
+    setLimit(LCB_CNTL_QUEUE_TOTAL_MAXPKTS, 2);
+    setPolicy(LCB_QUEUE_POLICY_NOTIFY);
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(0, npaused);
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(LCB_SUCCESS, get("foo"));
+    ASSERT_EQ(1, npaused);
+
+    lcb_QUEUESTATS stats = getStats();
+    ASSERT_EQ(4, stats.npkts);
+    ASSERT_EQ(0, stats.nrejected);
+
+    // Removing the limit resumes the instance
+    setLimit(LCB_CNTL_QUEUE_TOTAL_MAXPKTS, 0);
+    ASSERT_EQ(1, nresumed);
+    ASSERT_EQ(0, getStats().paused);
+}
+
+TEST_F(Admission, testStrings)
+{
+    lcb_U32 maxpkts = 0;
+    int policy = -1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "queue_max_pkts", "100"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "queue_policy", "1"));
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUEUE_MAXPKTS, &maxpkts);
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUEUE_POLICY, &policy);
+    ASSERT_EQ(100, maxpkts);
+    ASSERT_EQ(LCB_QUEUE_POLICY_NOTIFY, policy);
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl_string(instance, "queue_policy", "5"));
+}
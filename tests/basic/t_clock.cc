@@ -0,0 +1,97 @@
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include <lcbio/iotable.h>
+
+class Clock : public ::testing::Test
+{
+protected:
+    lcb_t instance;
+    lcbio_TABLE *iot;
+
+    void SetUp() {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, NULL));
+        iot = instance->iotable;
+    }
+
+    void TearDown() {
+        lcb_destroy(instance);
+    }
+
+    lcb_error_t setFlags(int flags) {
+        return lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CLOCK, &flags);
+    }
+
+    // Wait until the system clock is past the given time
+    void waitPast(lcb_U64 ts) {
+        while (gethrtime() <= ts + 1000) {
+        }
+    }
+};
+
+TEST_F(Clock, testFlags)
+{
+    int flags = -1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CLOCK, &flags));
+    ASSERT_EQ(0, flags);
+    ASSERT_NE(LCB_SUCCESS, setFlags(0x10));
+    ASSERT_EQ(LCB_SUCCESS, setFlags(LCB_CLOCK_F_CACHED));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "clock", "0"));
+    ASSERT_EQ(0, iot->clock.flags);
+}
+
+TEST_F(Clock, testUncached)
+{
+    LCBIO_CLOCK_ENTER(iot);
+    lcb_U64 first = lcbio_now(iot);
+    waitPast(first);
+    ASSERT_GT(lcbio_now(iot), first);
+    LCBIO_CLOCK_LEAVE(iot);
+}
+
+TEST_F(Clock, testCached)
+{
+    ASSERT_EQ(LCB_SUCCESS, setFlags(LCB_CLOCK_F_CACHED));
+
+    // Outside of handlers the clock is always read
+    lcb_U64 first = lcbio_now(iot);
+    waitPast(first);
+    ASSERT_GT(lcbio_now(iot), first);
+
+    LCBIO_CLOCK_ENTER(iot);
+    first = lcbio_now(iot);
+    waitPast(first);
+    ASSERT_EQ(first, lcbio_now(iot));
+    ASSERT_GT(lcbio_now_fine(iot), first);
+
+    // Nested handlers share the cached time
+    LCBIO_CLOCK_ENTER(iot);
+    ASSERT_EQ(first, lcbio_now(iot));
+    LCBIO_CLOCK_LEAVE(iot);
+    ASSERT_EQ(first, lcbio_now(iot));
+    LCBIO_CLOCK_LEAVE(iot);
+
+    // Each handler reads the clock anew
+    LCBIO_CLOCK_ENTER(iot);
+    ASSERT_GT(lcbio_now(iot), first);
+    LCBIO_CLOCK_LEAVE(iot);
+}
+
+TEST_F(Clock, testTsc)
+{
+    if (setFlags(LCB_CLOCK_F_TSC) == LCB_NOT_SUPPORTED) {
+        fprintf(stderr, "Timestamp counter not usable. Skipping\n");
+        return;
+    }
+    // The counter is converted to the system clock's time base
+    lcb_U64 prev = 0;
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        lcb_U64 sys = gethrtime();
+        lcb_U64 tsc = lcbio_now_fine(iot);
+        lcb_U64 diff = tsc > sys ? tsc - sys : sys - tsc;
+        ASSERT_LT(diff, LCB_US2NS(1000));
+        ASSERT_GE(tsc, prev);
+        prev = tsc;
+    }
+}
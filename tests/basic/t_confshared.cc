@@ -0,0 +1,88 @@
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "bucketconfig/clconfig.h"
+
+class ConfigShared : public ::testing::Test
+{
+protected:
+    lcb_t createInstance(const char *connstr) {
+        lcb_t instance = NULL;
+        lcb_create_st cropts;
+        memset(&cropts, 0, sizeof cropts);
+        cropts.version = 3;
+        cropts.v.v3.connstr = connstr;
+        EXPECT_EQ(LCB_SUCCESS, lcb_create(&instance, &cropts));
+        return instance;
+    }
+
+    clconfig_provider *getProvider(lcb_t instance, clconfig_method_t type) {
+        return lcb_confmon_get_provider(instance->confmon, type);
+    }
+
+    // Deliver a configuration as if it was received from the network
+    void receiveConfig(lcb_t instance, int revid) {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig(vbc, 4, 1, 64));
+        vbc->revid = revid;
+        clconfig_info *info = lcb_clconfig_create(vbc, LCB_CLCONFIG_CCCP);
+        lcb_confmon_provider_success(getProvider(instance, LCB_CLCONFIG_CCCP), info);
+        lcb_clconfig_decref(info);
+    }
+
+    clconfig_info *getShared(lcb_t instance) {
+        clconfig_provider *shared = getProvider(instance, LCB_CLCONFIG_SHARED);
+        return shared->get_cached(shared);
+    }
+};
+
+TEST_F(ConfigShared, testDisabled)
+{
+    lcb_t instance = createInstance("couchbase://foo.com/default");
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIG_SHARED, &enabled));
+    ASSERT_EQ(0, enabled);
+    ASSERT_EQ(0, getProvider(instance, LCB_CLCONFIG_SHARED)->enabled);
+    lcb_destroy(instance);
+}
+
+TEST_F(ConfigShared, testSharing)
+{
+    const char *connstr = "couchbase://foo.com,bar.com/default?config_shared=true";
+    lcb_t first = createInstance(connstr);
+    lcb_t second = createInstance(connstr);
+    lcb_t other = createInstance("couchbase://foo.com,bar.com/other?config_shared=true");
+
+    ASSERT_NE(0, getProvider(first, LCB_CLCONFIG_SHARED)->enabled);
+    ASSERT_TRUE(getShared(second) == NULL);
+
+    receiveConfig(first, 10);
+    clconfig_info *info = getShared(second);
+    ASSERT_FALSE(info == NULL);
+    ASSERT_EQ(LCB_CLCONFIG_SHARED, info->origin);
+    ASSERT_EQ(10, info->vbc->revid);
+    ASSERT_EQ(4, LCBVB_NSERVERS(info->vbc));
+    ASSERT_TRUE(getShared(other) == NULL);
+
+    // Older configurations do not replace newer ones
+    lcb_t third = createInstance(connstr);
+    receiveConfig(third, 5);
+    ASSERT_EQ(10, getShared(third)->vbc->revid);
+
+    // The configuration outlives the instance which received it
+    lcb_destroy(first);
+    receiveConfig(second, 11);
+    ASSERT_EQ(11, getShared(third)->vbc->revid);
+
+    // Disabling detaches the instance from the shared configuration
+    int enabled = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(third, LCB_CNTL_SET, LCB_CNTL_CONFIG_SHARED, &enabled));
+    ASSERT_EQ(0, getProvider(third, LCB_CLCONFIG_SHARED)->enabled);
+    receiveConfig(second, 12);
+    ASSERT_EQ(11, getShared(third)->vbc->revid);
+
+    lcb_destroy(second);
+    lcb_destroy(third);
+    lcb_destroy(other);
+}
@@ -0,0 +1,352 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include "packetutils.h"
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct CounterInfo {
+    int ncalled;
+    lcb_error_t rc;
+    string key;
+    lcb_U64 value;
+    CounterInfo() : ncalled(0), rc(LCB_SUCCESS), value(0) {}
+};
+
+// Cookies, in the order their callbacks were invoked
+static vector<CounterInfo *> counter_order;
+
+extern "C" {
+static void counter_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPCOUNTER *resp = (const lcb_RESPCOUNTER *)rb;
+    CounterInfo *info = (CounterInfo *)resp->cookie;
+    info->ncalled++;
+    info->rc = resp->rc;
+    info->key.assign((const char *)resp->key, resp->nkey);
+    info->value = resp->value;
+    counter_order.push_back(info);
+}
+}
+
+class CounterAgg : public PipelineTest
+{
+protected:
+    void SetUp() {
+        PipelineTest::SetUp();
+        lcb_install_callback3(instance, LCB_CALLBACK_COUNTER, counter_callback);
+        counter_order.clear();
+    }
+
+    void setWindow(lcb_U32 us) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_COUNTERAGG_WINDOW, &us));
+    }
+
+    void setMaxBatch(lcb_U32 n) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_COUNTERAGG_MAXBATCH, &n));
+    }
+
+    lcb_COUNTERAGGSTATS getStats() {
+        lcb_COUNTERAGGSTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_COUNTERAGG_STATS, &stats));
+        return stats;
+    }
+
+    // Schedule a counter command within the current scheduling context
+    void schedCounter(const string& key, lcb_S64 delta, CounterInfo *info,
+        int create = 0, lcb_U64 initial = 0) {
+        lcb_CMDCOUNTER cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        cmd.delta = delta;
+        cmd.create = create;
+        cmd.initial = initial;
+        EXPECT_EQ(LCB_SUCCESS, lcb_counter3(instance, info, &cmd));
+    }
+
+    // Schedule a counter command, and return the pipeline for its key
+    mc_PIPELINE *counter(const string& key, lcb_S64 delta, CounterInfo *info,
+        int create = 0, lcb_U64 initial = 0) {
+        lcb_sched_enter(instance);
+        schedCounter(key, delta, info, create, initial);
+        lcb_sched_leave(instance);
+        return pipelineFor(key);
+    }
+
+    // Check the opcode and delta of the first packet in the pipeline
+    void expectDelta(mc_PIPELINE *pl, lcb_uint8_t opcode, lcb_U64 delta) {
+        mc_PACKET *pkt = (mc_PACKET *)SLLIST_FIRST(&pl->requests);
+        ASSERT_FALSE(pkt == NULL);
+        protocol_binary_request_incr req;
+        memcpy(req.bytes, SPAN_BUFFER(&pkt->kh_span), sizeof req.bytes);
+        ASSERT_EQ(opcode, req.message.header.request.opcode);
+        ASSERT_EQ(delta, ntohll(req.message.body.delta));
+    }
+
+    // Check the initial value sent with the first packet in the pipeline
+    void expectInitial(mc_PIPELINE *pl, lcb_U64 initial) {
+        mc_PACKET *pkt = (mc_PACKET *)SLLIST_FIRST(&pl->requests);
+        ASSERT_FALSE(pkt == NULL);
+        protocol_binary_request_incr req;
+        memcpy(req.bytes, SPAN_BUFFER(&pkt->kh_span), sizeof req.bytes);
+        ASSERT_EQ(initial, ntohll(req.message.body.initial));
+    }
+
+    // Respond to the first packet in the pipeline with the given value
+    void respond(mc_PIPELINE *pl, lcb_U64 value) {
+        mc_PACKET *pkt = takePacket(pl);
+        ASSERT_FALSE(pkt == NULL);
+        char buf[24 + 8];
+        packet_info info;
+        memset(&info, 0, sizeof info);
+        info.res.response.magic = PROTOCOL_BINARY_RES;
+        info.res.response.opcode = PROTOCOL_BINARY_CMD_INCREMENT;
+        info.res.response.bodylen = htonl(8);
+        info.res.response.opaque = pkt->opaque;
+        memcpy(buf, info.res.bytes, 24);
+        value = htonll(value);
+        memcpy(buf + 24, &value, 8);
+        info.payload = buf + 24;
+        mcreq_dispatch_response(pl, pkt, &info, LCB_SUCCESS);
+        releasePacket(pl, pkt);
+    }
+
+    // Fail the first packet in the pipeline
+    void fail(mc_PIPELINE *pl, lcb_error_t err) {
+        mc_PACKET *pkt = takePacket(pl);
+        ASSERT_FALSE(pkt == NULL);
+        packet_info info;
+        memset(&info, 0, sizeof info);
+        mcreq_dispatch_response(pl, pkt, &info, err);
+        releasePacket(pl, pkt);
+    }
+};
+
+TEST_F(CounterAgg, testDisabled)
+{
+    CounterInfo i1, i2;
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    counter("foo", 1, &i2);
+    ASSERT_EQ(2, countPackets(pl));
+    ASSERT_TRUE(instance->counteragg == NULL);
+}
+
+TEST_F(CounterAgg, testAggregate)
+{
+    CounterInfo i1, i2, i3, other;
+    setWindow(1000);
+
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    counter("foo", 2, &i2);
+    counter("foo", 4, &i3);
+    mc_PIPELINE *otherpl = counter("bar", 10, &other);
+    ASSERT_EQ(0, countPackets(pl));
+    ASSERT_EQ(0, countPackets(otherpl));
+
+    // Sent once the window has elapsed
+    lcb_run_loop(instance);
+    ASSERT_EQ(otherpl == pl ? 2 : 1, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 7);
+    respond(pl, 40);
+    ASSERT_EQ(3, counter_order.size());
+    ASSERT_EQ(&i1, counter_order[0]);
+    ASSERT_EQ(&i2, counter_order[1]);
+    ASSERT_EQ(&i3, counter_order[2]);
+    ASSERT_EQ(LCB_SUCCESS, i3.rc);
+    ASSERT_EQ(40, i1.value);
+    ASSERT_EQ(40, i3.value);
+    ASSERT_EQ("foo", i3.key);
+
+    lcb_COUNTERAGGSTATS stats = getStats();
+    ASSERT_EQ(4, stats.naggregated);
+    ASSERT_EQ(2, stats.nbatches);
+}
+
+TEST_F(CounterAgg, testCreateNotMixed)
+{
+    CounterInfo i1, i2, i3;
+    setWindow(1000);
+
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    counter("foo", 2, &i2, 1);
+    counter("foo", 3, &i3, 1);
+    lcb_run_loop(instance);
+
+    // The batches are sent in the order they were started
+    ASSERT_EQ(2, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 1);
+    respond(pl, 1);
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 5);
+    respond(pl, 6);
+    ASSERT_EQ(1, i1.value);
+    ASSERT_EQ(6, i2.value);
+    ASSERT_EQ(6, i3.value);
+}
+
+TEST_F(CounterAgg, testCreateInitial)
+{
+    CounterInfo i1, i2, i3;
+    setWindow(1000);
+
+    // Applied one by one to a missing counter: 10, then 12, then 15
+    mc_PIPELINE *pl = counter("foo", 5, &i1, 1, 10);
+    counter("foo", 2, &i2, 1, 10);
+    counter("foo", 3, &i3, 1, 10);
+    lcb_run_loop(instance);
+    ASSERT_EQ(1, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 10);
+    expectInitial(pl, 15);
+    respond(pl, 15);
+
+    // Decrements stop at 0: 1, then 0, then 0
+    counter("foo", -1, &i1, 1, 1);
+    counter("foo", -2, &i2, 1, 1);
+    counter("foo", -3, &i3, 1, 1);
+    lcb_run_loop(instance);
+    ASSERT_EQ(1, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_DECREMENT, 6);
+    expectInitial(pl, 0);
+    respond(pl, 0);
+}
+
+TEST_F(CounterAgg, testSignNotMixed)
+{
+    CounterInfo i1, i2, i3, i4;
+    setWindow(1000);
+
+    // 5, then 0 (not -5), then 3: a sum of -2 would stop at 0
+    mc_PIPELINE *pl = counter("foo", 5, &i1);
+    counter("foo", -10, &i2);
+    counter("foo", 3, &i3);
+    // A zero delta goes along with either sign
+    counter("foo", 0, &i4);
+    lcb_run_loop(instance);
+
+    ASSERT_EQ(3, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 5);
+    respond(pl, 5);
+    expectDelta(pl, PROTOCOL_BINARY_CMD_DECREMENT, 10);
+    respond(pl, 0);
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 3);
+    respond(pl, 3);
+    ASSERT_EQ(5, i1.value);
+    ASSERT_EQ(0, i2.value);
+    ASSERT_EQ(3, i3.value);
+    ASSERT_EQ(3, i4.value);
+    ASSERT_EQ(3, getStats().nbatches);
+}
+
+TEST_F(CounterAgg, testMaxBatch)
+{
+    CounterInfo i1, i2, i3;
+    setWindow(10000000);
+    setMaxBatch(2);
+
+    // A full batch is sent without waiting for the window
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    counter("foo", 1, &i2);
+    lcb_run_loop(instance);
+    ASSERT_EQ(1, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 2);
+
+    // Discarded when the instance is destroyed
+    counter("foo", 1, &i3);
+    ASSERT_EQ(1, countPackets(pl));
+    ASSERT_EQ(3, getStats().naggregated);
+    ASSERT_EQ(1, getStats().nbatches);
+}
+
+TEST_F(CounterAgg, testErrors)
+{
+    CounterInfo i1, i2;
+    setWindow(1000);
+
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    counter("foo", 1, &i2);
+    lcb_run_loop(instance);
+    fail(pl, LCB_ETIMEDOUT);
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(LCB_ETIMEDOUT, i1.rc);
+    ASSERT_EQ(1, i2.ncalled);
+    ASSERT_EQ(LCB_ETIMEDOUT, i2.rc);
+}
+
+TEST_F(CounterAgg, testQueueFull)
+{
+    CounterInfo i1, i2;
+    lcb_U32 maxpkts = 1;
+    setWindow(1000);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_QUEUE_TOTAL_MAXPKTS, &maxpkts));
+
+    // Commands with a hashkey are sent right away, filling the queue
+    lcb_CMDCOUNTER cmd = { 0 };
+    LCB_CMD_SET_KEY(&cmd, "foo", 3);
+    LCB_KREQ_SIMPLE(&cmd._hashkey, "foo", 3);
+    cmd.delta = 1;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_counter3(instance, &i1, &cmd));
+    lcb_sched_leave(instance);
+
+    // The batch holds commands which were already accepted, and is sent
+    // regardless of the queue limits
+    mc_PIPELINE *pl = counter("foo", 1, &i2);
+    ASSERT_EQ(1, countPackets(pl));
+    lcb_run_loop(instance);
+    ASSERT_EQ(2, countPackets(pl));
+    ASSERT_EQ(0, i2.ncalled);
+    ASSERT_EQ(1, getStats().nbatches);
+
+    lcb_QUEUESTATS qstats;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+        LCB_CNTL_QUEUE_STATS, &qstats));
+    ASSERT_EQ(0, qstats.nrejected);
+}
+
+TEST_F(CounterAgg, testScheduleFailure)
+{
+    CounterInfo i1;
+    setWindow(1000);
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    ASSERT_EQ(0, countPackets(pl));
+
+    // No configuration by the time the batch is sent
+    lcbvb_CONFIG *config = instance->cmdq.config;
+    instance->cmdq.config = NULL;
+    lcb_run_loop(instance);
+    instance->cmdq.config = config;
+    ASSERT_EQ(0, countPackets(pl));
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(LCB_CLIENT_ETMPFAIL, i1.rc);
+    ASSERT_EQ("foo", i1.key);
+    ASSERT_EQ(0, getStats().nbatches);
+}
+
+TEST_F(CounterAgg, testSchedFail)
+{
+    CounterInfo i1, i2, i3;
+    setWindow(1000);
+
+    lcb_sched_enter(instance);
+    schedCounter("foo", 1, &i1);
+    lcb_sched_fail(instance);
+    ASSERT_EQ(0, getStats().naggregated);
+
+    mc_PIPELINE *pl = counter("foo", 1, &i1);
+    lcb_sched_enter(instance);
+    schedCounter("foo", 10, &i2);
+    lcb_sched_fail(instance);
+    counter("foo", 2, &i3);
+
+    lcb_run_loop(instance);
+    ASSERT_EQ(1, countPackets(pl));
+    expectDelta(pl, PROTOCOL_BINARY_CMD_INCREMENT, 3);
+    respond(pl, 3);
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(0, i2.ncalled);
+    ASSERT_EQ(1, i3.ncalled);
+}
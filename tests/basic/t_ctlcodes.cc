@@ -83,5 +83,40 @@ TEST_F(CtlTest, testStringCtls)
     ASSERT_EQ(LCB_COMPRESS_IN,
         getSetting<lcb_COMPRESSOPTS>(instance, LCB_CNTL_COMPRESSION_OPTS));
 
+    err = lcb_cntl_string(instance, "http_pool_minidle", "3");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(3, getSetting<lcb_SIZE>(instance, LCB_CNTL_HTTP_POOL_MINIDLE));
+
+    err = lcb_cntl_string(instance, "kv_connections", "4");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(4, lcb_cntl_getu32(instance, LCB_CNTL_KV_NCONNS));
+    err = lcb_cntl_string(instance, "kv_connections", "0");
+    ASSERT_EQ(LCB_EINVAL, err);
+
+    err = lcb_cntl_string(instance, "kvcache_max_bytes", "1048576");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1048576, getSetting<lcb_SIZE>(instance, LCB_CNTL_KVCACHE_MAXBYTES));
+    err = lcb_cntl_string(instance, "kvcache_ttl", "0.5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(500000, lcb_cntl_getu32(instance, LCB_CNTL_KVCACHE_TTL));
+
+    err = lcb_cntl_string(instance, "log_minlevel", "3");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(LCB_LOG_WARN, getSetting<int>(instance, LCB_CNTL_LOGLEVEL));
+
+    err = lcb_cntl_string(instance, "fault_script", "latency=10,jitter=5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_STREQ("latency=10,jitter=5",
+        getSetting<const char *>(instance, LCB_CNTL_FAULT_SCRIPT));
+    err = lcb_cntl_string(instance, "fault_script", "latency=soon");
+    ASSERT_NE(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "fault_script", "");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_TRUE(getSetting<const char *>(instance, LCB_CNTL_FAULT_SCRIPT) == NULL);
+
+    err = lcb_cntl_string(instance, "capture_path", "/nonexistent/capture");
+    ASSERT_NE(LCB_SUCCESS, err);
+    ASSERT_TRUE(getSetting<const char *>(instance, LCB_CNTL_CAPTURE_PATH) == NULL);
+
     lcb_destroy(instance);
 }
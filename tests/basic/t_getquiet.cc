@@ -0,0 +1,184 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include "bucketconfig/clconfig.h"
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+extern "C" {
+static void count_misses(mc_PIPELINE *, mc_PACKET *, lcb_error_t err, void *arg)
+{
+    EXPECT_EQ(LCB_KEY_ENOENT, err);
+    (*(int *)arg)++;
+}
+}
+
+class GetQuiet : public PipelineTest
+{
+protected:
+    void setQuiet(int enabled) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_GET_QUIET, &enabled));
+    }
+
+    // Generate keys which all map to the same pipeline
+    vector<string> genKeys(unsigned n, mc_PIPELINE **pl) {
+        vector<string> keys;
+        char buf[32];
+        for (unsigned ii = 0; keys.size() < n; ii++) {
+            sprintf(buf, "key_%u", ii);
+            if (pipelineFor(buf) == pipelineFor("key_0")) {
+                keys.push_back(buf);
+            }
+        }
+        *pl = pipelineFor("key_0");
+        return keys;
+    }
+
+    void getMulti(const vector<string>& keys) {
+        lcb_sched_enter(instance);
+        for (size_t ii = 0; ii < keys.size(); ii++) {
+            lcb_CMDGET cmd = { 0 };
+            LCB_CMD_SET_KEY(&cmd, keys[ii].c_str(), keys[ii].size());
+            ASSERT_EQ(LCB_SUCCESS, lcb_get3(instance, NULL, &cmd));
+        }
+        lcb_sched_leave(instance);
+    }
+
+    vector<mc_PACKET *> listPackets(mc_PIPELINE *pl) {
+        vector<mc_PACKET *> ret;
+        sllist_node *ll;
+        SLLIST_FOREACH(&pl->requests, ll) {
+            ret.push_back(SLLIST_ITEM(ll, mc_PACKET, slnode));
+        }
+        return ret;
+    }
+
+    int opcodeOf(mc_PACKET *pkt) {
+        protocol_binary_request_header hdr;
+        mcreq_read_hdr(pkt, &hdr);
+        return hdr.request.opcode;
+    }
+};
+
+TEST_F(GetQuiet, testDisabled)
+{
+    mc_PIPELINE *pl;
+    vector<string> keys = genKeys(3, &pl);
+    getMulti(keys);
+    vector<mc_PACKET *> pkts = listPackets(pl);
+    ASSERT_EQ(3, pkts.size());
+    for (size_t ii = 0; ii < pkts.size(); ii++) {
+        ASSERT_EQ(PROTOCOL_BINARY_CMD_GET, opcodeOf(pkts[ii]));
+    }
+}
+
+TEST_F(GetQuiet, testSingle)
+{
+    mc_PIPELINE *pl;
+    setQuiet(1);
+    getMulti(genKeys(1, &pl));
+    vector<mc_PACKET *> pkts = listPackets(pl);
+    ASSERT_EQ(1, pkts.size());
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GET, opcodeOf(pkts[0]));
+    ASSERT_EQ(0, pkts[0]->flags & MCREQ_F_QUIET);
+}
+
+TEST_F(GetQuiet, testFence)
+{
+    mc_PIPELINE *pl;
+    setQuiet(1);
+    getMulti(genKeys(3, &pl));
+    vector<mc_PACKET *> pkts = listPackets(pl);
+    ASSERT_EQ(4, pkts.size());
+    for (size_t ii = 0; ii < 3; ii++) {
+        ASSERT_EQ(PROTOCOL_BINARY_CMD_GETQ, opcodeOf(pkts[ii]));
+        ASSERT_NE(0, pkts[ii]->flags & MCREQ_F_QUIET);
+    }
+    mc_PACKET *fence = pkts[3];
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_NOOP, opcodeOf(fence));
+
+    // Quiet packets scheduled later are not affected by the fence
+    mc_PIPELINE *other;
+    getMulti(genKeys(2, &other));
+    ASSERT_EQ(pl, other);
+    ASSERT_EQ(7, listPackets(pl).size());
+
+    // The second GET was a hit
+    mc_PACKET *hit = mcreq_pipeline_remove(pl, pkts[1]->opaque);
+    ASSERT_TRUE(hit == pkts[1]);
+    releasePacket(pl, hit);
+
+    ASSERT_TRUE(mcreq_pipeline_remove(pl, fence->opaque) == fence);
+    int nmisses = 0;
+    ASSERT_EQ(2, mcreq_pipeline_quiet_misses(pl, fence, count_misses, &nmisses));
+    ASSERT_EQ(2, nmisses);
+    releasePacket(pl, fence);
+    ASSERT_EQ(3, listPackets(pl).size());
+}
+
+TEST_F(GetQuiet, testRenew)
+{
+    mc_PIPELINE *pl;
+    setQuiet(1);
+    getMulti(genKeys(2, &pl));
+    mc_PACKET *orig = listPackets(pl)[0];
+    ASSERT_NE(0, orig->flags & MCREQ_F_QUIET);
+
+    // Retried packets are no longer followed by the fence
+    mc_PACKET *copy = mcreq_renew_packet(orig);
+    ASSERT_EQ(0, copy->flags & MCREQ_F_QUIET);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GET, opcodeOf(copy));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GETQ, opcodeOf(orig));
+    mcreq_wipe_packet(NULL, copy);
+    mcreq_release_packet(NULL, copy);
+}
+
+TEST_F(GetQuiet, testConfigUpdate)
+{
+    // The servers are kept across the update if their addresses still match
+    for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+        servers[ii].datahost = (char *)lcbvb_get_hostport(vbc, ii,
+            LCBVB_SVCTYPE_DATA, LCBVB_SVCMODE_PLAIN);
+    }
+    lcbvb_CONFIG *cur = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(cur, NPIPELINES, 1, 64));
+    instance->cur_configinfo = lcb_clconfig_create(cur, LCB_CLCONFIG_USER);
+
+    // Quiet GETs whose vBuckets are not moved by the new config
+    mc_PIPELINE *pl = pipelineFor("key_0");
+    vector<string> keys;
+    char buf[32];
+    for (unsigned ii = 0; keys.size() < 3; ii++) {
+        int vbid, srvix;
+        sprintf(buf, "key_%u", ii);
+        lcbvb_map_key(vbc, buf, strlen(buf), &vbid, &srvix);
+        if (vbid != 0 && pipelines[srvix] == pl) {
+            keys.push_back(buf);
+        }
+    }
+    setQuiet(1);
+    getMulti(keys);
+    vector<mc_PACKET *> pkts = listPackets(pl);
+    ASSERT_EQ(4, pkts.size());
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_NOOP, opcodeOf(pkts[3]));
+
+    // The fence itself has vBucket 0, which moves to another server
+    lcbvb_CONFIG *next = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(next, NPIPELINES, 1, 64));
+    next->revid = 2;
+    next->vbuckets[0].servers[0] = (pl->index + 1) % NPIPELINES;
+    clconfig_info *info = lcb_clconfig_create(next, LCB_CLCONFIG_USER);
+    lcb_update_vbconfig(instance, info);
+    lcb_clconfig_decref(info);
+
+    // The fence must stay behind the quiet packets it answers for
+    ASSERT_EQ(pkts, listPackets(pl));
+    for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+        if (pipelines[ii] != pl) {
+            ASSERT_EQ(0, countPackets(pipelines[ii]));
+        }
+    }
+}
@@ -0,0 +1,240 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include "hedge.h"
+#include <string>
+
+using std::string;
+
+class Hedge : public PipelineTest
+{
+protected:
+    void setDelay(lcb_U32 us) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_HEDGE_DELAY, &us));
+    }
+
+    void setPercentile(float pctl) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_HEDGE_PERCENTILE, &pctl));
+    }
+
+    lcb_HEDGESTATS getStats() {
+        lcb_HEDGESTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_HEDGE_STATS, &stats));
+        return stats;
+    }
+
+    // Schedule a GET, and return the pipeline it was sent to
+    mc_PIPELINE *get(const string& key, void *cookie) {
+        lcb_CMDGET cmd = { 0 };
+        int vbid, srvix;
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, cookie, &cmd));
+        lcb_sched_leave(instance);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        return pipelines[srvix];
+    }
+
+    // Return the pipeline holding a replica read, if any
+    mc_PIPELINE *findReplica(mc_PIPELINE *master) {
+        for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+            if (pipelines[ii] != master && !SLLIST_IS_EMPTY(&pipelines[ii]->requests)) {
+                return pipelines[ii];
+            }
+        }
+        return NULL;
+    }
+
+    // Simulate a response to the packet, as dispatched by H_get/H_getreplica
+    void respond(mc_PIPELINE *pl, lcb_error_t rc, const string& value) {
+        mc_PACKET *pkt = takePacket(pl);
+        ASSERT_FALSE(pkt == NULL);
+        ASSERT_NE(0, pkt->flags & MCREQ_F_REQEXT);
+        lcb_RESPGET resp = { 0 };
+        resp.rc = rc;
+        resp.cookie = (void *)MCREQ_PKT_COOKIE(pkt);
+        mcreq_get_key(pkt, &resp.key, &resp.nkey);
+        if (rc == LCB_SUCCESS) {
+            resp.value = value.c_str();
+            resp.nvalue = value.size();
+        }
+        pkt->u_rdata.exdata->procs->handler(pl, pkt, rc, &resp);
+        releasePacket(pl, pkt);
+    }
+
+    // Have the master answer a GET as if it had taken `us` microseconds
+    void respondAfter(mc_PIPELINE *pl, lcb_U32 us) {
+        sllist_node *ll = SLLIST_FIRST(&pl->requests);
+        ASSERT_FALSE(ll == NULL);
+        mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+        pkt->u_rdata.exdata->start =
+                lcbio_now_fine(instance->iotable) - LCB_US2NS(us);
+        respond(pl, LCB_SUCCESS, "bar");
+    }
+};
+
+struct GetInfo {
+    int ncalled;
+    lcb_error_t rc;
+    string value;
+    int rflags;
+    GetInfo() : ncalled(0), rc(LCB_SUCCESS), rflags(0) {}
+};
+
+extern "C" {
+static void get_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+    GetInfo *info = (GetInfo *)resp->cookie;
+    info->ncalled++;
+    info->rc = resp->rc;
+    info->rflags = resp->rflags;
+    info->value.assign((const char *)resp->value, resp->nvalue);
+}
+}
+
+TEST_F(Hedge, testDisabled)
+{
+    GetInfo info;
+    mc_PIPELINE *master = get("foo", &info);
+    mc_PACKET *pkt = takePacket(master);
+    ASSERT_FALSE(pkt == NULL);
+    ASSERT_EQ(0, pkt->flags & MCREQ_F_REQEXT);
+    releasePacket(master, pkt);
+    ASSERT_EQ(0, getStats().fired);
+}
+
+TEST_F(Hedge, testMasterFirst)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1000000);
+
+    mc_PIPELINE *master = get("foo", &info);
+    respond(master, LCB_SUCCESS, "bar");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ("bar", info.value);
+    ASSERT_EQ(0, info.rflags & LCB_RESP_F_REPLICA);
+
+    // Nothing is hedged once the master has responded
+    lcb_run_loop(instance);
+    ASSERT_TRUE(findReplica(master) == NULL);
+    ASSERT_EQ(0, getStats().fired);
+}
+
+TEST_F(Hedge, testReplicaWins)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1);
+
+    mc_PIPELINE *master = get("foo", &info);
+    lcb_run_loop(instance);
+    mc_PIPELINE *replica = findReplica(master);
+    ASSERT_FALSE(replica == NULL);
+    ASSERT_EQ(1, getStats().fired);
+
+    respond(replica, LCB_SUCCESS, "stale");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ("stale", info.value);
+    ASSERT_NE(0, info.rflags & LCB_RESP_F_REPLICA);
+
+    // The master's response is discarded
+    respond(master, LCB_SUCCESS, "bar");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(1, getStats().won);
+}
+
+TEST_F(Hedge, testMasterAuthoritative)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1);
+
+    mc_PIPELINE *master = get("foo", &info);
+    lcb_run_loop(instance);
+    mc_PIPELINE *replica = findReplica(master);
+    ASSERT_FALSE(replica == NULL);
+
+    // A missing key is reported even if the replica still has it
+    respond(master, LCB_KEY_ENOENT, "");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(LCB_KEY_ENOENT, info.rc);
+    respond(replica, LCB_SUCCESS, "stale");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(0, getStats().won);
+}
+
+TEST_F(Hedge, testAllFail)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1);
+
+    mc_PIPELINE *master = get("foo", &info);
+    lcb_run_loop(instance);
+    mc_PIPELINE *replica = findReplica(master);
+    ASSERT_FALSE(replica == NULL);
+
+    // The master's error is held until the replica responds
+    respond(master, LCB_ETIMEDOUT, "");
+    ASSERT_EQ(0, info.ncalled);
+    respond(replica, LCB_KEY_ENOENT, "");
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(LCB_ETIMEDOUT, info.rc);
+}
+
+TEST_F(Hedge, testDegradedMaster)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1000000);
+
+    // Hedged right away, without waiting for the delay
+    mc_PIPELINE *master = get("foo", &info);
+    mc_SERVER *server = (mc_SERVER *)master;
+    server->nfailures = 10;
+    server->ewma_errors = 1000;
+    ASSERT_NE(0, mcserver_is_degraded(server));
+    respond(master, LCB_ETIMEDOUT, "");
+
+    master = get("foo", &info);
+    lcb_run_loop(instance);
+    ASSERT_FALSE(findReplica(master) == NULL);
+    ASSERT_EQ(1, getStats().fired);
+}
+
+TEST_F(Hedge, testPercentile)
+{
+    GetInfo info;
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    setDelay(1);
+    setPercentile(50);
+
+    // The delay is recomputed every 64 samples, each latency being rounded
+    // up to the end of its bucket: 900us to 1024us, 50000us to 57344us
+    for (unsigned ii = 0; ii < 63; ii++) {
+        respondAfter(get("foo", &info), ii % 2 ? 50000 : 900);
+    }
+    ASSERT_EQ(1, getStats().delay);
+    respondAfter(get("foo", &info), 50000);
+    ASSERT_EQ(1024, getStats().delay);
+
+    // The fixed delay is used if it is larger
+    setDelay(5000);
+    ASSERT_EQ(5000, getStats().delay);
+
+    setPercentile(99);
+    for (unsigned ii = 0; ii < 64; ii++) {
+        respondAfter(get("foo", &info), ii % 2 ? 50000 : 900);
+    }
+    ASSERT_EQ(57344, getStats().delay);
+    ASSERT_EQ(128, info.ncalled);
+    ASSERT_EQ(0, getStats().fired);
+
+    // And is used alone once the percentile is disabled
+    setPercentile(0);
+    ASSERT_EQ(5000, getStats().delay);
+}
@@ -0,0 +1,235 @@
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "kvcache.h"
+#include <string>
+
+using std::string;
+
+class KVCache : public ::testing::Test
+{
+protected:
+    lcb_t instance;
+    lcbvb_CONFIG *vbc;
+    mc_PIPELINE pipeline;
+
+    void SetUp() {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, NULL));
+        vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig(vbc, 4, 1, 64));
+        // No pipelines: the cache only needs the vBucket map
+        instance->cmdq.config = vbc;
+        mcreq_pipeline_init(&pipeline);
+        pipeline.parent = &instance->cmdq;
+    }
+
+    void TearDown() {
+        instance->cmdq.config = NULL;
+        lcb_destroy(instance);
+        lcbvb_destroy(vbc);
+        mcreq_pipeline_cleanup(&pipeline);
+    }
+
+    void setMaxBytes(lcb_SIZE nbytes) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_KVCACHE_MAXBYTES, &nbytes));
+    }
+
+    lcb_KVCACHESTATS getStats() {
+        lcb_KVCACHESTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_KVCACHE_STATS, &stats));
+        return stats;
+    }
+
+    // Create a request packet for the key, as it would have been scheduled
+    mc_PACKET *makePacket(const string& key, lcb_U8 opcode) {
+        protocol_binary_request_header hdr;
+        lcb_KEYBUF kb;
+        int vbid, srvix;
+        mc_PACKET *pkt = mcreq_allocate_packet(&pipeline);
+
+        LCB_KREQ_SIMPLE(&kb, key.c_str(), key.size());
+        mcreq_reserve_key(&pipeline, pkt, sizeof(hdr), &kb);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.request.magic = PROTOCOL_BINARY_REQ;
+        hdr.request.opcode = opcode;
+        hdr.request.keylen = htons(key.size());
+        hdr.request.vbucket = htons(vbid);
+        memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr));
+        pkt->u_rdata.reqdata.start = lcbio_now_fine(instance->iotable);
+        return pkt;
+    }
+
+    void releasePacket(mc_PACKET *pkt) {
+        mcreq_wipe_packet(&pipeline, pkt);
+        mcreq_release_packet(&pipeline, pkt);
+    }
+
+    // Simulate a GET response for the key
+    void respond(const string& key, const string& value, lcb_CAS cas,
+                 hrtime_t start = 0) {
+        mc_PACKET *pkt = makePacket(key, PROTOCOL_BINARY_CMD_GET);
+        lcb_RESPGET resp = { 0 };
+        if (start) {
+            pkt->u_rdata.reqdata.start = start;
+        }
+        resp.key = key.c_str();
+        resp.nkey = key.size();
+        resp.cas = cas;
+        resp.value = value.c_str();
+        resp.nvalue = value.size();
+        lcb_kvcache_update(instance, pkt, &resp);
+        releasePacket(pkt);
+    }
+
+    // Simulate a mutation of the key
+    void mutate(const string& key) {
+        mc_PACKET *pkt = makePacket(key, PROTOCOL_BINARY_CMD_SET);
+        lcb_kvcache_invalidate(instance, pkt);
+        releasePacket(pkt);
+    }
+
+    int lookup(const string& key, const void *cookie = NULL) {
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        return lcb_kvcache_get3(instance, cookie, &cmd);
+    }
+};
+
+struct HitInfo {
+    int ncalled;
+    lcb_U64 cas;
+    string value;
+    int rflags;
+    HitInfo() : ncalled(0), cas(0), rflags(0) {}
+};
+
+extern "C" {
+static void hit_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+    HitInfo *info = (HitInfo *)resp->cookie;
+    EXPECT_EQ(LCB_SUCCESS, resp->rc);
+    info->ncalled++;
+    info->cas = resp->cas;
+    info->rflags = resp->rflags;
+    info->value.assign((const char *)resp->value, resp->nvalue);
+}
+}
+
+TEST_F(KVCache, testDisabled)
+{
+    respond("foo", "bar", 1);
+    ASSERT_EQ(0, lookup("foo"));
+    lcb_KVCACHESTATS stats = getStats();
+    ASSERT_EQ(0, stats.misses);
+    ASSERT_EQ(0, stats.nitems);
+}
+
+TEST_F(KVCache, testHitDelivery)
+{
+    HitInfo info;
+    setMaxBytes(65536);
+    lcb_install_callback3(instance, LCB_CALLBACK_GET, hit_callback);
+
+    ASSERT_EQ(0, lookup("foo", &info));
+    respond("foo", "bar", 42);
+    ASSERT_EQ(1, getStats().nitems);
+
+    // Hits are dropped when the scheduling context fails
+    lcb_sched_enter(instance);
+    ASSERT_NE(0, lookup("foo", &info));
+    lcb_sched_fail(instance);
+
+    lcb_sched_enter(instance);
+    ASSERT_NE(0, lookup("foo", &info));
+    lcb_sched_leave(instance);
+    ASSERT_EQ(0, info.ncalled);
+    lcb_wait(instance);
+
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(42, info.cas);
+    ASSERT_EQ("bar", info.value);
+    ASSERT_NE(0, info.rflags & LCB_RESP_F_CACHED);
+
+    lcb_KVCACHESTATS stats = getStats();
+    ASSERT_EQ(2, stats.hits);
+    ASSERT_EQ(1, stats.misses);
+    ASSERT_EQ(1, stats.stores);
+}
+
+TEST_F(KVCache, testInvalidation)
+{
+    setMaxBytes(65536);
+    respond("foo", "bar", 1);
+    ASSERT_NE(0, lookup("foo"));
+    lcb_sched_fail(instance);
+
+    // A GET sent before the mutation must not repopulate the cache
+    hrtime_t before = lcbio_now_fine(instance->iotable);
+    mutate("foo");
+    ASSERT_EQ(0, lookup("foo"));
+    respond("foo", "bar", 1, before);
+    ASSERT_EQ(0, lookup("foo"));
+
+    // But one sent afterwards does
+    respond("foo", "baz", 2);
+    ASSERT_NE(0, lookup("foo"));
+    lcb_sched_fail(instance);
+
+    lcb_KVCACHESTATS stats = getStats();
+    ASSERT_EQ(1, stats.invalidations);
+    ASSERT_EQ(2, stats.stores);
+    ASSERT_EQ(1, stats.nitems);
+
+    // Disabling the cache frees its contents
+    setMaxBytes(0);
+    ASSERT_EQ(0, getStats().nbytes);
+}
+
+TEST_F(KVCache, testExpiry)
+{
+    lcb_U32 ttl = 1;
+    setMaxBytes(65536);
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_KVCACHE_TTL, &ttl);
+    respond("foo", "bar", 1);
+
+    hrtime_t now = lcbio_now_fine(instance->iotable);
+    while (lcbio_now_fine(instance->iotable) - now < LCB_US2NS(10)) {
+        // Wait for the item to expire
+    }
+    ASSERT_EQ(0, lookup("foo"));
+    lcb_KVCACHESTATS stats = getStats();
+    ASSERT_EQ(1, stats.expirations);
+    ASSERT_EQ(0, stats.nitems);
+}
+
+TEST_F(KVCache, testEviction)
+{
+    const lcb_SIZE maxbytes = 8192;
+    string value(512, '*');
+    setMaxBytes(maxbytes);
+
+    for (int ii = 0; ii < 100; ii++) {
+        char kbuf[64];
+        sprintf(kbuf, "key_%d", ii);
+        respond(kbuf, value, ii + 1);
+        ASSERT_LE(getStats().nbytes, maxbytes);
+    }
+
+    lcb_KVCACHESTATS stats = getStats();
+    ASSERT_GT(stats.evictions, 0);
+    ASSERT_EQ(100, stats.nitems + stats.evictions);
+
+    // The most recently stored item is kept, the oldest is not
+    ASSERT_NE(0, lookup("key_99"));
+    ASSERT_EQ(0, lookup("key_0"));
+    lcb_sched_fail(instance);
+
+    // Items larger than an eighth of the cache are not stored
+    respond("big", string(maxbytes / 4, '*'), 1);
+    ASSERT_EQ(0, lookup("big"));
+}
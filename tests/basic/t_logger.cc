@@ -63,3 +63,69 @@ TEST_F(Logger, testLogger)
 
     lcb_destroy(instance);
 }
+
+TEST_F(Logger, testMinLevel)
+{
+    lcb_t instance;
+    lcb_create(&instance, NULL);
+    MyLogprocs procs;
+    lcb_logprocs *ptrprocs = static_cast<lcb_logprocs *>(&procs);
+    memset(ptrprocs, 0, sizeof(*ptrprocs));
+    procs.v.v0.callback = fallback_logger;
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, ptrprocs);
+
+    int level = LCB_LOG_WARN;
+    ASSERT_EQ(LCB_SUCCESS,
+        lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGLEVEL, &level));
+    lcb_settings *settings = instance->getSettings();
+    lcb_log(settings, "test", LCB_LOG_DEBUG, __FILE__, __LINE__, "debug");
+    lcb_log(settings, "test", LCB_LOG_ERROR, __FILE__, __LINE__, "error");
+    ASSERT_EQ(1, procs.messages.size());
+    ASSERT_FALSE(procs.messages.find("error") == procs.messages.end());
+
+    level = LCB_LOG_MAX + 1;
+    ASSERT_NE(LCB_SUCCESS,
+        lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGLEVEL, &level));
+    lcb_destroy(instance);
+}
+
+TEST_F(Logger, testAsync)
+{
+    lcb_t instance;
+    lcb_create(&instance, NULL);
+    MyLogprocs procs;
+    lcb_logprocs *ptrprocs = static_cast<lcb_logprocs *>(&procs);
+    memset(ptrprocs, 0, sizeof(*ptrprocs));
+    procs.v.v0.callback = fallback_logger;
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, ptrprocs);
+
+    int enabled = 1;
+    lcb_error_t err = lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOG_ASYNC, &enabled);
+    if (err == LCB_NOT_SUPPORTED) {
+        lcb_destroy(instance);
+        return;
+    }
+    ASSERT_EQ(LCB_SUCCESS, err);
+
+    // Messages are delivered by the background thread; destroying the
+    // instance waits for all of them.
+    for (int ii = 0; ii < 100; ii++) {
+        lcb_log(instance->getSettings(), "test", LCB_LOG_INFO, __FILE__,
+            __LINE__, "message %d", ii);
+    }
+    lcb_destroy(instance);
+
+    set<string>& msgs = procs.messages;
+    ASSERT_FALSE(msgs.find("message 0") == msgs.end());
+    ASSERT_FALSE(msgs.find("message 99") == msgs.end());
+    // Either every message was delivered, or the dropped ones were reported
+    if (msgs.size() != 100) {
+        bool reported = false;
+        for (set<string>::iterator it = msgs.begin(); it != msgs.end(); ++it) {
+            if (it->find("log messages were dropped") != string::npos) {
+                reported = true;
+            }
+        }
+        ASSERT_TRUE(reported);
+    }
+}
@@ -0,0 +1,260 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <string>
+
+using std::string;
+
+struct ReadInfo {
+    int ncalled;
+    lcb_error_t rc;
+    ReadInfo() : ncalled(0), rc(LCB_SUCCESS) {}
+};
+
+extern "C" {
+static void get_callback(lcb_t, int, const lcb_RESPBASE *rb)
+{
+    ReadInfo *info = (ReadInfo *)rb->cookie;
+    info->ncalled++;
+    info->rc = rb->rc;
+}
+}
+
+/* Feeds responses to servers without a connection */
+class McServerRead : public PipelineTest
+{
+protected:
+    lcb_host_t hosts[NPIPELINES];
+    // For commands which are still retried when the instance is destroyed
+    ReadInfo retried;
+
+    void SetUp() {
+        PipelineTest::SetUp();
+        memset(hosts, 0, sizeof hosts);
+        for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+            strcpy(hosts[ii].host, "localhost");
+            sprintf(hosts[ii].port, "%u", 11210 + ii);
+            servers[ii].curhost = &hosts[ii];
+            servers[ii].instance = instance;
+        }
+        lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+    }
+
+    // Schedule a GET and flush it, returning the server it was sent to
+    mc_SERVER *get(const string& key, ReadInfo *info) {
+        lcb_CMDGET cmd = { 0 };
+        int vbid, srvix;
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, info, &cmd));
+        lcb_sched_leave(instance);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+
+        mc_PIPELINE *pl = pipelines[srvix];
+        nb_IOV iov;
+        unsigned toflush;
+        while ((toflush = mcreq_flush_iov_fill(pl, &iov, 1, NULL))) {
+            mcreq_flush_done(pl, toflush, toflush);
+        }
+        return &servers[srvix];
+    }
+
+    // Have the server reply to its first packet with the given status
+    void respond(mc_SERVER *server, lcb_U16 status, const string& body = "") {
+        sllist_node *ll = SLLIST_FIRST(&server->pipeline.requests);
+        ASSERT_FALSE(ll == NULL);
+        mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+
+        protocol_binary_response_header res;
+        memset(&res, 0, sizeof res);
+        res.response.magic = PROTOCOL_BINARY_RES;
+        res.response.opcode = PROTOCOL_BINARY_CMD_GET;
+        res.response.status = htons(status);
+        res.response.opaque = pkt->opaque;
+        res.response.bodylen = htonl(body.size());
+
+        rdb_IOROPE ior;
+        rdb_init(&ior, rdb_libcalloc_new());
+        rdb_copywrite(&ior, res.bytes, sizeof res.bytes);
+        if (!body.empty()) {
+            rdb_copywrite(&ior, (void *)body.c_str(), body.size());
+        }
+        mcserver__read_responses(server, &ior);
+        EXPECT_EQ(0, rdb_get_nused(&ior));
+        rdb_cleanup(&ior);
+    }
+
+    // NOT_MY_VBUCKET replies carry the configuration, which spares a refresh
+    void respondNmv(mc_SERVER *server) {
+        char *json = lcbvb_save_json(vbc);
+        respond(server, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, json);
+        free(json);
+    }
+
+    // Pretend the server's first packet was sent `us` microseconds earlier
+    void age(mc_SERVER *server, lcb_U32 us) {
+        sllist_node *ll = SLLIST_FIRST(&server->pipeline.requests);
+        ASSERT_FALSE(ll == NULL);
+        MCREQ_PKT_RDATA(SLLIST_ITEM(ll, mc_PACKET, slnode))->start -= LCB_US2NS(us);
+    }
+
+    lcb_SERVERHEALTH getHealth(mc_SERVER *server) {
+        lcb_SERVERHEALTH health;
+        memset(&health, 0, sizeof health);
+        health.index = server - servers;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_SERVER_HEALTH, &health));
+        return health;
+    }
+
+    // Whether every packet of the pipeline has been released
+    void assertReleased(mc_PIPELINE *pl) {
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+        ASSERT_EQ(0, pl->nqpkts);
+        ASSERT_NE(0, netbuf_is_clean(&pl->reqpool));
+        ASSERT_NE(0, netbuf_is_clean(&pl->nbmgr));
+    }
+};
+
+TEST_F(McServerRead, testSuccess)
+{
+    ReadInfo info;
+    mc_SERVER *server = get("foo", &info);
+    respond(server, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(LCB_KEY_ENOENT, info.rc);
+    assertReleased(&server->pipeline);
+}
+
+TEST_F(McServerRead, testNotMyVbucket)
+{
+    ReadInfo info;
+    lcb_U32 mode = LCB_RETRYOPT_CREATE(LCB_RETRY_ON_VBMAPERR, LCB_RETRY_CMDS_NONE);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_RETRYMODE, &mode));
+
+    mc_SERVER *server = get("foo", &info);
+    respondNmv(server);
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(LCB_NOT_MY_VBUCKET, info.rc);
+    assertReleased(&server->pipeline);
+}
+
+TEST_F(McServerRead, testNotMyVbucketRetried)
+{
+    mc_SERVER *server = get("foo", &retried);
+    respondNmv(server);
+
+    // The command is retried from a copy; the original is released
+    ASSERT_EQ(0, retried.ncalled);
+    ASSERT_FALSE(lcb_retryq_empty(instance->retryq));
+    assertReleased(&server->pipeline);
+}
+
+TEST_F(McServerRead, testHealthErrors)
+{
+    ReadInfo info;
+    mc_SERVER *server = get("foo", &retried);
+    respond(server, PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+    lcb_SERVERHEALTH health = getHealth(server);
+    ASSERT_EQ(0, health.nresponses);
+    ASSERT_EQ(1, health.nfailures);
+    // Each sample weighs 1/8: 0 + (1000 - 0) / 8
+    ASSERT_EQ(125, health.errors);
+
+    respond(get("foo", &info), PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    health = getHealth(server);
+    ASSERT_EQ(1, health.nresponses);
+    ASSERT_EQ(1, health.nfailures);
+    // 125 + (0 - 125) / 8
+    ASSERT_EQ(110, health.errors);
+}
+
+TEST_F(McServerRead, testHealthLatency)
+{
+    ReadInfo info;
+    mc_SERVER *server = get("foo", &info);
+    age(server, 100000);
+    respond(server, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    // The first sample is taken as is
+    lcb_U32 first = getHealth(server).latency;
+    ASSERT_GE(first, 100000U);
+    ASSERT_LT(first, 100000U + 10000000U);
+
+    // A fast response only moves the average by 1/8 of the difference
+    respond(get("foo", &info), PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    lcb_U32 second = getHealth(server).latency;
+    ASSERT_LT(second, first);
+    ASSERT_GE(second, first - first / 8 - 1);
+    ASSERT_EQ(0, getHealth(server).errors);
+}
+
+TEST_F(McServerRead, testDegradedErrors)
+{
+    mc_SERVER *server = NULL;
+    // Over the threshold after six failures, but eight samples are needed
+    for (unsigned ii = 0; ii < 7; ii++) {
+        server = get("foo", &retried);
+        respond(server, PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+    }
+    ASSERT_GE(getHealth(server).errors, 500U);
+    ASSERT_EQ(0, getHealth(server).degraded);
+    ASSERT_EQ(0, mcserver_is_degraded(server));
+
+    respond(get("foo", &retried), PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+    ASSERT_EQ(1, getHealth(server).degraded);
+    ASSERT_NE(0, mcserver_is_degraded(server));
+
+    // The other nodes are not affected
+    for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+        if (&servers[ii] != server) {
+            ASSERT_EQ(0, getHealth(&servers[ii]).degraded);
+        }
+    }
+}
+
+TEST_F(McServerRead, testDegradedLatency)
+{
+    ReadInfo info;
+    lcb_U32 maxlat = 50000;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_DEGRADED_LATENCY, &maxlat));
+
+    mc_SERVER *server = NULL;
+    for (unsigned ii = 0; ii < 8; ii++) {
+        server = get("foo", &info);
+        age(server, 100000);
+        respond(server, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+    }
+    lcb_SERVERHEALTH health = getHealth(server);
+    ASSERT_EQ(8, health.nresponses);
+    ASSERT_EQ(0, health.errors);
+    ASSERT_EQ(1, health.degraded);
+
+    // With no latency threshold, only failures count
+    maxlat = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_DEGRADED_LATENCY, &maxlat));
+    ASSERT_EQ(0, getHealth(server).degraded);
+}
+
+TEST_F(McServerRead, testHealthCntl)
+{
+    // Without LCB_CNTL_DETAILED_ERRCODES, the generic codes are returned
+    lcb_SERVERHEALTH health;
+    memset(&health, 0, sizeof health);
+    health.index = NPIPELINES;
+    ASSERT_EQ(LCB_EINVAL, lcb_cntl(instance, LCB_CNTL_GET,
+        LCB_CNTL_SERVER_HEALTH, &health));
+    health.index = -1;
+    ASSERT_EQ(LCB_EINVAL, lcb_cntl(instance, LCB_CNTL_GET,
+        LCB_CNTL_SERVER_HEALTH, &health));
+    health.index = 0;
+    ASSERT_EQ(LCB_NOT_SUPPORTED, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_SERVER_HEALTH, &health));
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+        LCB_CNTL_SERVER_HEALTH, &health));
+    ASSERT_EQ(0, health.nresponses);
+    ASSERT_EQ(0, health.nfailures);
+    ASSERT_EQ(0, health.degraded);
+}
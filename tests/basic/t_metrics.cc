@@ -0,0 +1,121 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include <string>
+
+using std::string;
+
+class Metrics : public PipelineTest
+{
+protected:
+    // Pipelines are only added by the tests which need them
+    void SetUp() {
+        createInstance();
+    }
+
+    lcb_METRICS snapshot() {
+        lcb_METRICS metrics = { 0 };
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_METRICS, &metrics));
+        return metrics;
+    }
+
+    const lcb_METRIC *find(const lcb_METRICS& metrics, const string& subsystem,
+        const string& name, int server) {
+        for (lcb_SIZE ii = 0; ii < metrics.nmetrics; ii++) {
+            const lcb_METRIC *metric = metrics.metrics + ii;
+            if (subsystem == metric->subsystem && name == metric->name &&
+                    server == metric->server) {
+                return metric;
+            }
+        }
+        return NULL;
+    }
+
+    // Schedule a GET, and return the index of the server it was sent to
+    int get(const string& key) {
+        lcb_CMDGET cmd = { 0 };
+        int vbid, srvix;
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, NULL, &cmd));
+        lcb_sched_leave(instance);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        return srvix;
+    }
+};
+
+TEST_F(Metrics, testInstance)
+{
+    lcb_METRICS metrics = snapshot();
+    ASSERT_NE(0, metrics.nmetrics);
+
+    const lcb_METRIC *metric = find(metrics, "queue", "npkts", -1);
+    ASSERT_FALSE(metric == NULL);
+    ASSERT_EQ(LCB_METRIC_GAUGE, metric->type);
+    ASSERT_EQ(0, metric->value);
+    metric = find(metrics, "retryq", "nadded", -1);
+    ASSERT_FALSE(metric == NULL);
+    ASSERT_EQ(LCB_METRIC_COUNTER, metric->type);
+
+    // Without servers there are no per-server metrics
+    ASSERT_TRUE(find(metrics, "queue", "npkts", 0) == NULL);
+    // Latencies are only collected once timings are enabled
+    ASSERT_TRUE(find(metrics, "kv", "latency", -1) == NULL);
+
+    int dummy = 0;
+    ASSERT_EQ(LCB_NOT_SUPPORTED, lcb_cntl(instance, LCB_CNTL_SET,
+        LCB_CNTL_METRICS, &dummy));
+}
+
+TEST_F(Metrics, testServers)
+{
+    addPipelines();
+    int srvix = get("foo");
+
+    lcb_METRICS metrics = snapshot();
+    for (int ii = 0; ii < NPIPELINES; ii++) {
+        const lcb_METRIC *npkts = find(metrics, "queue", "npkts", ii);
+        ASSERT_FALSE(npkts == NULL);
+        ASSERT_EQ(ii == srvix ? 1 : 0, npkts->value);
+        ASSERT_FALSE(find(metrics, "server", "nresponses", ii) == NULL);
+        ASSERT_FALSE(find(metrics, "pool", "nconnect", ii) == NULL);
+        ASSERT_FALSE(find(metrics, "rope", "nmalloc", ii) == NULL);
+    }
+    ASSERT_EQ(1, find(metrics, "queue", "npkts", -1)->value);
+
+    const lcb_METRIC *nbytes = find(metrics, "netbuf", "nbytes", srvix);
+    ASSERT_FALSE(nbytes == NULL);
+    ASSERT_NE(0, nbytes->value);
+    ASSERT_NE(0, find(metrics, "netbuf", "nallocs", srvix)->value);
+}
+
+TEST_F(Metrics, testHistogram)
+{
+    ASSERT_EQ(LCB_SUCCESS, lcb_enable_timings(instance));
+    lcb_record_metrics(instance, 500, 0);
+    lcb_record_metrics(instance, LCB_US2NS(55), 0);
+    lcb_record_metrics(instance, LCB_US2NS(57), 0);
+    lcb_record_metrics(instance, LCB_S2NS(20), 0);
+
+    lcb_METRICS metrics = snapshot();
+    const lcb_METRIC *metric = find(metrics, "kv", "latency", -1);
+    ASSERT_FALSE(metric == NULL);
+    ASSERT_EQ(LCB_METRIC_HISTOGRAM, metric->type);
+    ASSERT_EQ(4, metric->value);
+    ASSERT_EQ(3, metric->nbuckets);
+    ASSERT_EQ(999, metric->buckets[0].upper);
+    ASSERT_EQ(1, metric->buckets[0].count);
+    ASSERT_EQ(LCB_US2NS(60) - 1, metric->buckets[1].upper);
+    ASSERT_EQ(2, metric->buckets[1].count);
+    ASSERT_EQ((lcb_U64)-1, metric->buckets[2].upper);
+    ASSERT_EQ(1, metric->buckets[2].count);
+    lcb_disable_timings(instance);
+}
+
+TEST_F(Metrics, testReuse)
+{
+    lcb_METRICS first = snapshot();
+    lcb_METRICS second = snapshot();
+    ASSERT_EQ(first.metrics, second.metrics);
+    ASSERT_EQ(first.nmetrics, second.nmetrics);
+}
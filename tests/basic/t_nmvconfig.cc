@@ -0,0 +1,134 @@
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "bucketconfig/clconfig.h"
+#include <string>
+
+using std::string;
+
+class NmvConfig : public ::testing::Test
+{
+protected:
+    lcb_t instance;
+    clconfig_provider *cccp;
+
+    void SetUp() {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, NULL));
+        cccp = lcb_confmon_get_provider(instance->confmon, LCB_CLCONFIG_CCCP);
+        ASSERT_NE(0, cccp->enabled);
+    }
+
+    void TearDown() {
+        lcb_destroy(instance);
+    }
+
+    void setInterval(lcb_U32 us) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_NMV_CONFIG_INTERVAL, &us));
+    }
+
+    string genConfig(int revid, unsigned nservers = 4) {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        EXPECT_EQ(0, lcbvb_genconfig(vbc, nservers, 1, 64));
+        vbc->revid = revid;
+        char *json = lcbvb_save_json(vbc);
+        string ret(json);
+        free(json);
+        lcbvb_destroy(vbc);
+        return ret;
+    }
+
+    void receive(const string& json) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_cccp_update_nmv(cccp, "localhost",
+            json.c_str(), json.size()));
+    }
+
+    lcb_NMVSTATS getStats() {
+        lcb_NMVSTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_NMV_STATS, &stats));
+        return stats;
+    }
+
+    int currentRev() {
+        clconfig_info *info = cccp->get_cached(cccp);
+        return info ? info->vbc->revid : -1;
+    }
+};
+
+TEST_F(NmvConfig, testDedupe)
+{
+    setInterval(0);
+    receive(genConfig(10));
+    ASSERT_EQ(10, currentRev());
+    receive(genConfig(10));
+    receive(genConfig(9));
+    receive(genConfig(11));
+    ASSERT_EQ(11, currentRev());
+
+    lcb_NMVSTATS stats = getStats();
+    ASSERT_EQ(4, stats.nseen);
+    ASSERT_EQ(2, stats.nduplicate);
+    ASSERT_EQ(2, stats.napplied);
+    ASSERT_EQ(0, stats.ncoalesced);
+}
+
+TEST_F(NmvConfig, testNoRevision)
+{
+    setInterval(0);
+    receive(genConfig(-1, 4));
+    receive(genConfig(-1, 4));
+    receive(genConfig(-1, 3));
+
+    lcb_NMVSTATS stats = getStats();
+    ASSERT_EQ(1, stats.nduplicate);
+    ASSERT_EQ(2, stats.napplied);
+}
+
+TEST_F(NmvConfig, testBadRevision)
+{
+    setInterval(0);
+    // Too large to be a revision: compared by their contents instead
+    string body = genConfig(5);
+    size_t pos = body.find("\"rev\":5");
+    ASSERT_NE(string::npos, pos);
+    body.replace(pos, 7, "\"rev\":99999999999999999999999");
+    receive(body);
+    receive(body);
+    ASSERT_EQ(1, getStats().nduplicate);
+
+    receive(genConfig(10));
+    ASSERT_EQ(10, currentRev());
+    ASSERT_EQ(2, getStats().napplied);
+}
+
+TEST_F(NmvConfig, testCoalesce)
+{
+    // Long enough never to elapse during the test
+    setInterval(3600000000U);
+    receive(genConfig(10));
+    receive(genConfig(11));
+    receive(genConfig(12));
+    receive(genConfig(12));
+    ASSERT_EQ(10, currentRev());
+
+    lcb_NMVSTATS stats = getStats();
+    ASSERT_EQ(1, stats.napplied);
+    ASSERT_EQ(1, stats.ncoalesced);
+    ASSERT_EQ(1, stats.nduplicate);
+
+    // Only the newest configuration is applied once the interval elapses
+    ASSERT_NE(0, lcb_cccp_flush_nmv(cccp));
+    ASSERT_EQ(12, currentRev());
+    ASSERT_EQ(0, lcb_cccp_flush_nmv(cccp));
+    ASSERT_EQ(2, getStats().napplied);
+}
+
+TEST_F(NmvConfig, testStrings)
+{
+    lcb_U32 interval = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "nmv_config_interval", "0.5"));
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NMV_CONFIG_INTERVAL, &interval);
+    ASSERT_EQ(500000, interval);
+}
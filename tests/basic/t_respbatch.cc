@@ -0,0 +1,124 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct BatchInfo {
+    int ncalled;
+    vector<string> keys;
+    vector<string> values;
+    BatchInfo() : ncalled(0) {}
+};
+
+static BatchInfo *batch_info;
+
+extern "C" {
+static void batch_callback(lcb_t, const lcb_RESPGET *resps, lcb_SIZE nresps)
+{
+    batch_info->ncalled++;
+    for (lcb_SIZE ii = 0; ii < nresps; ii++) {
+        batch_info->keys.push_back(string((const char *)resps[ii].key, resps[ii].nkey));
+        batch_info->values.push_back(string((const char *)resps[ii].value, resps[ii].nvalue));
+    }
+}
+}
+
+class RespBatch : public PipelineTest
+{
+protected:
+    BatchInfo info;
+
+    void SetUp() {
+        PipelineTest::SetUp();
+        batch_info = &info;
+    }
+
+    // Schedule a GET and return its packet, taken out of its pipeline
+    mc_PACKET *get(const string& key, mc_PIPELINE **pl) {
+        lcb_CMDGET cmd = { 0 };
+        int vbid, srvix;
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, NULL, &cmd));
+        lcb_sched_leave(instance);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        *pl = pipelines[srvix];
+        sllist_node *ll = SLLIST_FIRST(&(*pl)->requests);
+        sllist_remove_head(&(*pl)->requests);
+        return SLLIST_ITEM(ll, mc_PACKET, slnode);
+    }
+
+    // Handle a response to a GET, as H_get does, and release the packet
+    int respond(const string& key, const char *value) {
+        mc_PIPELINE *pl;
+        mc_PACKET *pkt = get(key, &pl);
+        lcb_RESPGET resp = { 0 };
+        mcreq_get_key(pkt, &resp.key, &resp.nkey);
+        resp.value = value;
+        resp.nvalue = strlen(value);
+        char *freeptr = strdup(value);
+        int rv = lcb_respbatch_add(instance, pkt, &resp, freeptr);
+        if (!rv) {
+            free(freeptr);
+        }
+        mcreq_wipe_packet(pl, pkt);
+        mcreq_release_packet(pl, pkt);
+        return rv;
+    }
+};
+
+TEST_F(RespBatch, testDisabled)
+{
+    lcb_respbatch_enter(instance);
+    ASSERT_EQ(0, respond("foo", "bar"));
+    lcb_respbatch_leave(instance);
+    ASSERT_EQ(0, info.ncalled);
+}
+
+TEST_F(RespBatch, testBatch)
+{
+    ASSERT_TRUE(lcb_install_getbatch_callback(instance, batch_callback) == NULL);
+
+    // Only responses received while reading are batched
+    ASSERT_EQ(0, respond("foo", "bar"));
+
+    lcb_respbatch_enter(instance);
+    ASSERT_NE(0, respond("foo", "bar"));
+    ASSERT_NE(0, respond("hello", "world"));
+    ASSERT_NE(0, respond("key", ""));
+    ASSERT_EQ(0, info.ncalled);
+    lcb_respbatch_leave(instance);
+
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(3, info.keys.size());
+    ASSERT_EQ("foo", info.keys[0]);
+    ASSERT_EQ("bar", info.values[0]);
+    ASSERT_EQ("hello", info.keys[1]);
+    ASSERT_EQ("world", info.values[1]);
+    ASSERT_EQ("key", info.keys[2]);
+    ASSERT_EQ("", info.values[2]);
+
+    // Empty batches are not delivered
+    lcb_respbatch_enter(instance);
+    lcb_respbatch_leave(instance);
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(3, instance->respbatch.nbatched);
+}
+
+TEST_F(RespBatch, testLarge)
+{
+    char key[32];
+    lcb_install_getbatch_callback(instance, batch_callback);
+    lcb_respbatch_enter(instance);
+    for (unsigned ii = 0; ii < 100; ii++) {
+        sprintf(key, "key_%u", ii);
+        ASSERT_NE(0, respond(key, "value"));
+    }
+    lcb_respbatch_leave(instance);
+    ASSERT_EQ(1, info.ncalled);
+    ASSERT_EQ(100, info.keys.size());
+    ASSERT_EQ("key_99", info.keys[99]);
+}
@@ -0,0 +1,231 @@
+#include "config.h"
+#include "mc/pipelinetest.h"
+#include "packetutils.h"
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct FlightInfo {
+    int ncalled;
+    lcb_error_t rc;
+    string key;
+    string value;
+    FlightInfo *refetch; // GET to schedule from the callback, if any
+    FlightInfo() : ncalled(0), rc(LCB_SUCCESS), refetch(NULL) {}
+};
+
+// Cookies, in the order their callbacks were invoked
+static vector<FlightInfo *> call_order;
+
+extern "C" {
+static void get_callback(lcb_t instance, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+    FlightInfo *info = (FlightInfo *)resp->cookie;
+    info->ncalled++;
+    info->rc = resp->rc;
+    info->key.assign((const char *)resp->key, resp->nkey);
+    info->value.assign((const char *)resp->value, resp->nvalue);
+    call_order.push_back(info);
+    if (info->refetch) {
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, resp->key, resp->nkey);
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, info->refetch, &cmd));
+        lcb_sched_leave(instance);
+        info->refetch = NULL;
+    }
+}
+}
+
+class SingleFlight : public PipelineTest
+{
+protected:
+    void SetUp() {
+        PipelineTest::SetUp();
+        lcb_install_callback3(instance, LCB_CALLBACK_GET, get_callback);
+        call_order.clear();
+    }
+
+    void enable() {
+        int enabled = 1;
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET,
+            LCB_CNTL_GET_SINGLEFLIGHT, &enabled));
+    }
+
+    lcb_SINGLEFLIGHTSTATS getStats() {
+        lcb_SINGLEFLIGHTSTATS stats;
+        EXPECT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET,
+            LCB_CNTL_SINGLEFLIGHT_STATS, &stats));
+        return stats;
+    }
+
+    // Schedule a GET within the current scheduling context
+    void schedGet(const string& key, FlightInfo *info, lcb_U32 exptime = 0) {
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        cmd.exptime = exptime;
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, info, &cmd));
+    }
+
+    // Schedule a GET, and return the pipeline it was sent to
+    mc_PIPELINE *get(const string& key, FlightInfo *info, lcb_U32 exptime = 0) {
+        int vbid, srvix;
+        lcb_sched_enter(instance);
+        schedGet(key, info, exptime);
+        lcb_sched_leave(instance);
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        return pipelines[srvix];
+    }
+
+    // Respond to the first packet in the pipeline with the given value
+    void respond(mc_PIPELINE *pl, const string& value) {
+        mc_PACKET *pkt = takePacket(pl);
+        ASSERT_FALSE(pkt == NULL);
+        vector<char> buf(24 + 4 + value.size());
+        packet_info info;
+        memset(&info, 0, sizeof info);
+        info.res.response.magic = PROTOCOL_BINARY_RES;
+        info.res.response.opcode = PROTOCOL_BINARY_CMD_GET;
+        info.res.response.extlen = 4;
+        info.res.response.bodylen = htonl(4 + value.size());
+        info.res.response.opaque = pkt->opaque;
+        memcpy(&buf[0], info.res.bytes, 24);
+        if (!value.empty()) {
+            memcpy(&buf[28], value.c_str(), value.size());
+        }
+        info.payload = &buf[24];
+        mcreq_dispatch_response(pl, pkt, &info, LCB_SUCCESS);
+        releasePacket(pl, pkt);
+    }
+
+    // Fail the first packet in the pipeline
+    void fail(mc_PIPELINE *pl, lcb_error_t err) {
+        mc_PACKET *pkt = takePacket(pl);
+        ASSERT_FALSE(pkt == NULL);
+        packet_info info;
+        memset(&info, 0, sizeof info);
+        mcreq_dispatch_response(pl, pkt, &info, err);
+        releasePacket(pl, pkt);
+    }
+};
+
+TEST_F(SingleFlight, testDisabled)
+{
+    FlightInfo i1, i2;
+    mc_PIPELINE *pl = get("foo", &i1);
+    get("foo", &i2);
+    ASSERT_EQ(2, countPackets(pl));
+    ASSERT_TRUE(instance->singleflight == NULL);
+}
+
+TEST_F(SingleFlight, testCoalesce)
+{
+    FlightInfo i1, i2, i3, other;
+    enable();
+
+    mc_PIPELINE *pl = get("foo", &i1);
+    get("foo", &i2);
+    get("foo", &i3);
+    mc_PIPELINE *otherpl = get("bar", &other);
+    ASSERT_EQ(otherpl == pl ? 2 : 1, countPackets(pl));
+
+    respond(pl, "value");
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(1, i2.ncalled);
+    ASSERT_EQ(1, i3.ncalled);
+    ASSERT_EQ("value", i3.value);
+    ASSERT_EQ("foo", i3.key);
+    ASSERT_EQ(3, call_order.size());
+    ASSERT_EQ(&i1, call_order[0]);
+    ASSERT_EQ(&i2, call_order[1]);
+    ASSERT_EQ(&i3, call_order[2]);
+
+    lcb_SINGLEFLIGHTSTATS stats = getStats();
+    ASSERT_EQ(2, stats.ncoalesced);
+
+    // A later GET is sent anew
+    FlightInfo i4;
+    unsigned npackets = countPackets(pl);
+    get("foo", &i4);
+    ASSERT_EQ(npackets + 1, countPackets(pl));
+}
+
+TEST_F(SingleFlight, testErrors)
+{
+    FlightInfo i1, i2;
+    enable();
+    mc_PIPELINE *pl = get("foo", &i1);
+    get("foo", &i2);
+    ASSERT_EQ(1, countPackets(pl));
+    fail(pl, LCB_ETIMEDOUT);
+    ASSERT_EQ(LCB_ETIMEDOUT, i1.rc);
+    ASSERT_EQ(LCB_ETIMEDOUT, i2.rc);
+    ASSERT_EQ(1, i2.ncalled);
+}
+
+TEST_F(SingleFlight, testTouchNotCoalesced)
+{
+    FlightInfo i1, i2, i3;
+    enable();
+    mc_PIPELINE *pl = get("foo", &i1, 10);
+    get("foo", &i2);
+    get("foo", &i3, 10);
+    ASSERT_EQ(3, countPackets(pl));
+    ASSERT_EQ(0, getStats().ncoalesced);
+}
+
+TEST_F(SingleFlight, testSchedFail)
+{
+    FlightInfo i1, i2, i3;
+    enable();
+
+    // Both the flight and its waiter are discarded
+    lcb_sched_enter(instance);
+    schedGet("foo", &i1);
+    schedGet("foo", &i2);
+    lcb_sched_fail(instance);
+    ASSERT_EQ(0, getStats().ncoalesced);
+    ASSERT_EQ(0, getStats().nflights);
+
+    mc_PIPELINE *pl = get("foo", &i1);
+    ASSERT_EQ(1, countPackets(pl));
+
+    // Only the waiter is discarded
+    lcb_sched_enter(instance);
+    schedGet("foo", &i2);
+    lcb_sched_fail(instance);
+    get("foo", &i3);
+    ASSERT_EQ(1, countPackets(pl));
+
+    respond(pl, "value");
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(0, i2.ncalled);
+    ASSERT_EQ(1, i3.ncalled);
+}
+
+TEST_F(SingleFlight, testRefetchFromCallback)
+{
+    FlightInfo i1, i2, i3;
+    enable();
+    mc_PIPELINE *pl = get("foo", &i1);
+    get("foo", &i2);
+    ASSERT_EQ(1, countPackets(pl));
+
+    // The GET scheduled by the leader's callback is sent anew rather than
+    // given the response being delivered
+    i1.refetch = &i3;
+    respond(pl, "old");
+    ASSERT_EQ(1, i2.ncalled);
+    ASSERT_EQ("old", i2.value);
+    ASSERT_EQ(0, i3.ncalled);
+    ASSERT_EQ(1, countPackets(pl));
+
+    respond(pl, "new");
+    ASSERT_EQ(1, i3.ncalled);
+    ASSERT_EQ("new", i3.value);
+    ASSERT_EQ(1, i1.ncalled);
+    ASSERT_EQ(1, i2.ncalled);
+}
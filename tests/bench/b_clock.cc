@@ -0,0 +1,38 @@
+#include "bench.h"
+#include "internal.h"
+#include <lcbio/iotable.h>
+
+// Reads of the coarse clock (lcbio_now()) inside a handler, in each mode
+static void readClock(BenchState& state, int flags)
+{
+    lcb_t instance;
+    lcb_create(&instance, NULL);
+    if (lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CLOCK, &flags) != LCB_SUCCESS) {
+        state.skip("clock not usable");
+    } else {
+        lcbio_TABLE *iot = instance->iotable;
+        LCBIO_CLOCK_ENTER(iot);
+        state.resetTimer();
+        for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+            bench_sink += lcbio_now(iot);
+        }
+        state.stopTimer();
+        LCBIO_CLOCK_LEAVE(iot);
+    }
+    lcb_destroy(instance);
+}
+
+BENCHMARK(clock, system)
+{
+    readClock(state, 0);
+}
+
+BENCHMARK(clock, tsc)
+{
+    readClock(state, LCB_CLOCK_F_TSC);
+}
+
+BENCHMARK(clock, cached)
+{
+    readClock(state, LCB_CLOCK_F_CACHED);
+}
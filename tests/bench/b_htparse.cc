@@ -0,0 +1,31 @@
+#include "bench.h"
+#include <lcbht/lcbht.h>
+#include "settings.h"
+#include <string>
+
+using std::string;
+
+// A view response's headers and body, parsed in a single call
+BENCHMARK(htparse, response)
+{
+    string body(1024, 'x');
+    char clen[64];
+    sprintf(clen, "Content-Length: %u\r\n", (unsigned)body.size());
+    string resp = string("HTTP/1.1 200 OK\r\n"
+        "Server: Couchbase Server\r\n"
+        "Date: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+        "Content-Type: application/json\r\n"
+        "Cache-Control: must-revalidate\r\n") + clen + "\r\n" + body;
+
+    lcb_settings *settings = lcb_settings_new();
+    lcbht_pPARSER parser = lcbht_new(settings);
+    state.setBytes(resp.size());
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        bench_sink += lcbht_parse(parser, resp.c_str(), resp.size());
+        lcbht_reset(parser);
+    }
+    state.stopTimer();
+    lcbht_free(parser);
+    lcb_settings_unref(settings);
+}
@@ -0,0 +1,195 @@
+#include "bench.h"
+#include <mc/mcreq.h>
+#include <mc/compress.h>
+#include "sllist-inl.h"
+#include <string>
+#include <vector>
+
+#define NPIPELINES 4
+#define NINFLIGHT 64
+
+using std::string;
+using std::vector;
+
+/** A command queue with its own pipelines, which are never flushed */
+struct BenchQueue : mc_CMDQUEUE {
+    lcbvb_CONFIG *vbc;
+
+    BenchQueue() {
+        mc_PIPELINE *pipelines[NPIPELINES];
+        vbc = lcbvb_create();
+        lcbvb_genconfig(vbc, NPIPELINES, 1, 1024);
+        for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+            pipelines[ii] = (mc_PIPELINE *)calloc(1, sizeof(mc_PIPELINE));
+            mcreq_pipeline_init(pipelines[ii]);
+        }
+        mcreq_queue_init(this);
+        mcreq_queue_add_pipelines(this, pipelines, NPIPELINES, vbc);
+    }
+
+    ~BenchQueue() {
+        for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+            mc_PIPELINE *pl = pipelines[ii];
+            sllist_iterator iter;
+            SLLIST_ITERFOR(&pl->requests, &iter) {
+                mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+                sllist_iter_remove(&pl->requests, &iter);
+                mcreq_wipe_packet(pl, pkt);
+                mcreq_release_packet(pl, pkt);
+            }
+            mcreq_pipeline_cleanup(pl);
+            free(pl);
+        }
+        mcreq_queue_cleanup(this);
+        lcbvb_destroy(vbc);
+    }
+
+    // Allocate a GET for the key, as done by lcb_get3()
+    lcb_error_t build(const string& key, mc_PACKET **pkt, mc_PIPELINE **pl) {
+        lcb_CMDBASE cmd;
+        protocol_binary_request_header hdr;
+        memset(&cmd, 0, sizeof cmd);
+        memset(&hdr, 0, sizeof hdr);
+        cmd.key.contig.bytes = key.c_str();
+        cmd.key.contig.nbytes = key.size();
+        lcb_error_t rc = mcreq_basic_packet(this, &cmd, &hdr, 0, pkt, pl, 0);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        hdr.request.magic = PROTOCOL_BINARY_REQ;
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+        hdr.request.opaque = (*pkt)->opaque;
+        memcpy(SPAN_BUFFER(&(*pkt)->kh_span), hdr.bytes, sizeof hdr.bytes);
+        return LCB_SUCCESS;
+    }
+
+private:
+    BenchQueue(const BenchQueue&);
+};
+
+static vector<string> makeKeys(unsigned n)
+{
+    vector<string> keys;
+    for (unsigned ii = 0; ii < n; ii++) {
+        char buf[64];
+        sprintf(buf, "user::%08u", ii);
+        keys.push_back(buf);
+    }
+    return keys;
+}
+
+// Mapping, allocation and header encoding of a GET, then its release
+BENCHMARK(mcreq, build_packet)
+{
+    BenchQueue q;
+    vector<string> keys = makeKeys(1024);
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        mc_PACKET *pkt;
+        mc_PIPELINE *pl;
+        q.build(keys[ii % keys.size()], &pkt, &pl);
+        mcreq_wipe_packet(pl, pkt);
+        mcreq_release_packet(pl, pkt);
+    }
+}
+
+// Lookup of a response's packet by its opaque, with NINFLIGHT packets queued
+BENCHMARK(mcreq, pipeline_find)
+{
+    BenchQueue q;
+    vector<string> keys = makeKeys(NINFLIGHT * NPIPELINES * 4);
+    vector<lcb_U32> opaques;
+    mc_PIPELINE *pl = q.pipelines[0];
+
+    for (unsigned ii = 0; ii < keys.size() && opaques.size() < NINFLIGHT; ii++) {
+        mc_PACKET *pkt;
+        mc_PIPELINE *cur;
+        q.build(keys[ii], &pkt, &cur);
+        if (cur != pl) {
+            mcreq_wipe_packet(cur, pkt);
+            mcreq_release_packet(cur, pkt);
+            continue;
+        }
+        mcreq_enqueue_packet(pl, pkt);
+        opaques.push_back(pkt->opaque);
+    }
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        bench_sink += (size_t)mcreq_pipeline_find(pl, opaques[ii % opaques.size()]);
+    }
+}
+
+static string makeDocument(size_t n)
+{
+    string doc = "{";
+    for (unsigned ii = 0; doc.size() < n; ii++) {
+        char buf[64];
+        sprintf(buf, "\"field%u\":\"value of field %u\",", ii % 16, ii);
+        doc += buf;
+    }
+    doc[doc.size() - 1] = '}';
+    return doc;
+}
+
+#define DOCSIZE 4096
+
+BENCHMARK(compress, snappy_compress)
+{
+    if (!mcreq_compression_supported()) {
+        state.skip("built without snappy");
+        return;
+    }
+    BenchQueue q;
+    string doc = makeDocument(DOCSIZE);
+    lcb_CONTIGBUF vbuf = { doc.c_str(), doc.size() };
+
+    state.setBytes(doc.size());
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        mc_PACKET *pkt;
+        mc_PIPELINE *pl;
+        state.stopTimer();
+        q.build("key", &pkt, &pl);
+        state.startTimer();
+        mcreq_compress_value(pl, pkt, &vbuf);
+        state.stopTimer();
+        mcreq_wipe_packet(pl, pkt);
+        mcreq_release_packet(pl, pkt);
+        state.startTimer();
+    }
+}
+
+BENCHMARK(compress, snappy_inflate)
+{
+    if (!mcreq_compression_supported()) {
+        state.skip("built without snappy");
+        return;
+    }
+    BenchQueue q;
+    string doc = makeDocument(DOCSIZE);
+    lcb_CONTIGBUF vbuf = { doc.c_str(), doc.size() };
+    mc_PACKET *pkt;
+    mc_PIPELINE *pl;
+
+    q.build("key", &pkt, &pl);
+    if (mcreq_compress_value(pl, pkt, &vbuf) != 0) {
+        state.skip("compression failed");
+        return;
+    }
+    string compressed((const char *)SPAN_BUFFER(&pkt->u_value.single),
+        pkt->u_value.single.size);
+    mcreq_wipe_packet(pl, pkt);
+    mcreq_release_packet(pl, pkt);
+
+    state.setBytes(doc.size());
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        const void *bytes;
+        lcb_SIZE nbytes;
+        void *freeptr = NULL;
+        mcreq_inflate_value(compressed.c_str(), compressed.size(),
+            &bytes, &nbytes, &freeptr);
+        bench_sink += nbytes;
+        free(freeptr);
+    }
+}
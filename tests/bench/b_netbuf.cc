@@ -0,0 +1,49 @@
+#include "bench.h"
+#include <netbuf/netbuf.h>
+
+#define NSPANS 32
+#define SPANSIZE 128
+
+// Allocation and release of a packet-sized span
+BENCHMARK(netbuf, reserve_release)
+{
+    nb_MGR mgr;
+    netbuf_init(&mgr, NULL);
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        nb_SPAN span;
+        span.size = SPANSIZE;
+        netbuf_mblock_reserve(&mgr, &span);
+        netbuf_mblock_release(&mgr, &span);
+    }
+    state.stopTimer();
+    netbuf_cleanup(&mgr);
+}
+
+// A batch of spans enqueued, flushed and released, as with pipelined commands
+BENCHMARK(netbuf, reserve_flush)
+{
+    nb_MGR mgr;
+    nb_SPAN spans[NSPANS];
+    nb_IOV iov[NSPANS];
+
+    netbuf_init(&mgr, NULL);
+    state.setBytes(NSPANS * SPANSIZE);
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        unsigned jj;
+        nb_SIZE nflush;
+        for (jj = 0; jj < NSPANS; jj++) {
+            spans[jj].size = SPANSIZE;
+            netbuf_mblock_reserve(&mgr, spans + jj);
+            memset(SPAN_BUFFER(spans + jj), jj, 24);
+            netbuf_enqueue_span(&mgr, spans + jj);
+        }
+        while ((nflush = netbuf_start_flush(&mgr, iov, NSPANS, NULL)) != 0) {
+            netbuf_end_flush(&mgr, nflush);
+        }
+        for (jj = 0; jj < NSPANS; jj++) {
+            netbuf_mblock_release(&mgr, spans + jj);
+        }
+    }
+    state.stopTimer();
+    netbuf_cleanup(&mgr);
+}
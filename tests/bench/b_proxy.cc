@@ -0,0 +1,143 @@
+#include "bench.h"
+#ifdef LCB_HAVE_KVSERVER
+#include "kvserver/kvserver.h"
+#include "kvserver/proxyutil.h"
+#endif
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#ifdef LCB_HAVE_KVSERVER
+using namespace LCBTest;
+
+#define NITEMS 1000
+#define VALUE_SIZE 128
+
+/*
+ * cbc-proxy forwarding to a KVServer. Both are started on the first use and
+ * shared by the benchmarks; each iteration is one request made through the
+ * proxy, so the results include the server's and the loopback's cost.
+ */
+class ProxyEnv {
+public:
+    ProxyEnv() : server(NULL), started(false) {}
+    ~ProxyEnv() {
+        conn.close();
+        proxy.stop();
+        delete server;
+    }
+
+    McConnection *get(BenchState& state) {
+        if (!started) {
+            started = true;
+            KVServerOptions options;
+            options.nnodes = 4;
+            server = new KVServer(options);
+            if (!server->start()) {
+                error = server->getError();
+            } else if (!proxy.start(server->getConnstr())) {
+                error = proxy.getError();
+            } else if (!conn.connect(proxy.getPort())) {
+                error = "Couldn't connect to the proxy";
+            } else if (!populate()) {
+                error = "Couldn't store the items";
+            }
+        }
+        if (!error.empty()) {
+            state.skip(error);
+            return NULL;
+        }
+        return &conn;
+    }
+
+private:
+    KVServer *server;
+    ProxyProcess proxy;
+    McConnection conn;
+    bool started;
+    string error;
+
+    bool populate() {
+        vector<char> out;
+        string value(VALUE_SIZE, 'x');
+        for (unsigned ii = 0; ii < NITEMS; ii++) {
+            char key[64];
+            sprintf(key, "cbc-proxy-%u", ii);
+            McConnection::appendRequest(out, PROTOCOL_BINARY_CMD_SET, key, value, ii);
+        }
+        if (!conn.send(out)) {
+            return false;
+        }
+        for (unsigned ii = 0; ii < NITEMS; ii++) {
+            McResponse res;
+            if (!conn.recv(res) || res.status() != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static ProxyEnv env;
+
+// `depth` GETs are sent before their responses are read
+static void getThroughProxy(BenchState& state, unsigned depth)
+{
+    McConnection *conn = env.get(state);
+    if (!conn) {
+        return;
+    }
+
+    vector<char> out;
+    McResponse res;
+    lcb_U32 opaque = 0;
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii += depth) {
+        unsigned nreqs = depth;
+        if (state.iterations - ii < depth) {
+            nreqs = state.iterations - ii;
+        }
+        out.clear();
+        for (unsigned jj = 0; jj < nreqs; jj++) {
+            char key[64];
+            sprintf(key, "cbc-proxy-%u", (unsigned)((ii + jj) % NITEMS));
+            McConnection::appendRequest(out, PROTOCOL_BINARY_CMD_GET, key, "", ++opaque);
+        }
+        if (!conn->send(out)) {
+            state.skip("Connection to the proxy failed");
+            return;
+        }
+        for (unsigned jj = 0; jj < nreqs; jj++) {
+            if (!conn->recv(res)) {
+                state.skip("Connection to the proxy failed");
+                return;
+            }
+            bench_sink += res.body.size();
+        }
+    }
+    state.stopTimer();
+}
+#endif
+
+// One request at a time: the round trip through the proxy
+BENCHMARK(proxy, get)
+{
+#ifdef LCB_HAVE_KVSERVER
+    getThroughProxy(state, 1);
+#else
+    state.skip("Requires the KVServer (Linux only)");
+#endif
+}
+
+// Pipelined requests, spread over the nodes and returned in order
+BENCHMARK(proxy, get_pipelined)
+{
+#ifdef LCB_HAVE_KVSERVER
+    getThroughProxy(state, 32);
+#else
+    state.skip("Requires the KVServer (Linux only)");
+#endif
+}
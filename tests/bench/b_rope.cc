@@ -0,0 +1,60 @@
+#include "bench.h"
+#include <rdb/rope.h>
+#include <vector>
+
+#define READSIZE 8192
+#define PKTSIZE 200
+
+/**
+ * Socket reads of READSIZE bytes, each followed by the consumption of the
+ * complete packets in the rope as done by the memcached reader: copy out
+ * the header, then consolidate and consume the rest of the packet. Packets
+ * straddle reads, as they would on a busy connection.
+ */
+static void
+readConsolidate(BenchState& state, rdb_ALLOCATOR *allocator)
+{
+    rdb_IOROPE ior;
+    std::vector<char> input(READSIZE, 'x');
+
+    rdb_init(&ior, allocator);
+    ior.rdsize = READSIZE;
+    state.setBytes(READSIZE);
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        nb_IOV iov[32];
+        unsigned niov = rdb_rdstart(&ior, iov, 32);
+        unsigned nr = 0;
+
+        for (unsigned jj = 0; jj < niov && nr < READSIZE; jj++) {
+            unsigned ncopy = READSIZE - nr;
+            if (ncopy > iov[jj].iov_len) {
+                ncopy = iov[jj].iov_len;
+            }
+            memcpy(iov[jj].iov_base, &input[nr], ncopy);
+            nr += ncopy;
+        }
+        rdb_rdend(&ior, nr);
+
+        while (ior.recvd.nused >= PKTSIZE) {
+            char hdr[24];
+            rdb_copyread(&ior, hdr, sizeof hdr);
+            rdb_consolidate(&ior, PKTSIZE);
+            bench_sink += rdb_get_consolidated(&ior, PKTSIZE)[PKTSIZE - 1] + hdr[0];
+            rdb_consumed(&ior, PKTSIZE);
+        }
+    }
+    state.stopTimer();
+    rdb_cleanup(&ior);
+}
+
+// The allocator used for connections
+BENCHMARK(rope, read_consolidate)
+{
+    readConsolidate(state, rdb_bigalloc_new());
+}
+
+// Small segments, so that every packet must be copied to be consolidated
+BENCHMARK(rope, read_consolidate_fragmented)
+{
+    readConsolidate(state, rdb_chunkalloc_new(64));
+}
@@ -0,0 +1,113 @@
+#include "bench.h"
+#include <libcouchbase/vbucket.h>
+#include "vbucket/legacyconfig.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define NKEYS 1024
+
+static void mapKeys(BenchState& state, lcbvb_CONFIG *vbc)
+{
+    vector<string> keys;
+    for (unsigned ii = 0; ii < NKEYS; ii++) {
+        char buf[64];
+        sprintf(buf, "user::%08u", ii);
+        keys.push_back(buf);
+    }
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        const string& key = keys[ii % NKEYS];
+        int vbid, srvix;
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        bench_sink += srvix;
+    }
+    state.stopTimer();
+    lcbvb_destroy(vbc);
+}
+
+// CRC32 of the key, then a lookup in the vBucket map
+BENCHMARK(vbucket, map_key)
+{
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    lcbvb_genconfig(vbc, 4, 1, 1024);
+    mapKeys(state, vbc);
+}
+
+// MD5 of the key, then a binary search of the continuum
+BENCHMARK(vbucket, map_key_ketama)
+{
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    lcbvb_genconfig(vbc, 4, 1, 1024);
+    lcbvb_make_ketama(vbc);
+    mapKeys(state, vbc);
+}
+
+// Loading the cached configuration at startup (see bc_file.c), from the JSON
+// file or from its binary copy
+static void loadCache(BenchState& state, bool binary)
+{
+    lcbvb_CONFIG *orig = lcbvb_create();
+    lcbvb_genconfig(orig, 8, 2, 1024);
+    char *js = lcbvb_save_json(orig);
+    lcb_SIZE nbytes;
+    void *data = lcbvb_save_binary(orig, &nbytes);
+    lcbvb_destroy(orig);
+
+    state.setBytes(binary ? nbytes : strlen(js));
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        int rv = binary ? lcbvb_load_binary(vbc, data, nbytes) :
+            lcbvb_load_json(vbc, js);
+        bench_sink += rv + vbc->nsrv;
+        lcbvb_destroy(vbc);
+    }
+    state.stopTimer();
+    free(js);
+    free(data);
+}
+
+BENCHMARK(vbucket, load_json)
+{
+    loadCache(state, false);
+}
+
+BENCHMARK(vbucket, load_binary)
+{
+    loadCache(state, true);
+}
+
+// Parsing a 1000-node configuration, in each of its two forms
+static void loadLarge(BenchState& state, const string& json)
+{
+    state.setBytes(json.size());
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        bench_sink += lcbvb_load_json(vbc, json.c_str()) + vbc->nsrv;
+        lcbvb_destroy(vbc);
+    }
+    state.stopTimer();
+}
+
+// The `nodesExt` form, as generated by lcbvb_save_json()
+BENCHMARK(vbucket, load_large)
+{
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    lcbvb_genconfig(vbc, 1000, 2, 1024);
+    char *js = lcbvb_save_json(vbc);
+    lcbvb_destroy(vbc);
+    loadLarge(state, js);
+    free(js);
+}
+
+// The 2.x `nodes` and `serverList` form, matched up by hostname
+BENCHMARK(vbucket, load_large_legacy)
+{
+    loadLarge(state, genLegacyConfig(1000, 2, 1024));
+}
@@ -0,0 +1,48 @@
+#include "bench.h"
+#include "views/parser.h"
+#include <string>
+
+using std::string;
+
+#define NROWS 100
+#define CHUNKSIZE 4096
+
+extern "C" {
+static void row_callback(lcbvrow_PARSER *parser, const lcbvrow_ROW *row)
+{
+    if (row->type == LCB_VRESP_ROW) {
+        lcbvrow_ROW copy = *row;
+        lcbvrow_parse_row(parser, &copy);
+        bench_sink += copy.docid.iov_len + copy.key.iov_len + copy.value.iov_len;
+    }
+}
+}
+
+// A view response fed in network-sized chunks, with each row split into its
+// id, key and value as done for the view callback
+BENCHMARK(viewrow, parse)
+{
+    string resp = "{\"total_rows\":100,\"rows\":[";
+    for (unsigned ii = 0; ii < NROWS; ii++) {
+        char buf[256];
+        sprintf(buf, "%s{\"id\":\"user::%08u\",\"key\":[\"user\",%u],"
+            "\"value\":{\"name\":\"User %u\",\"age\":%u,\"active\":true}}",
+            ii ? "," : "", ii, ii, ii, ii % 90);
+        resp += buf;
+    }
+    resp += "]}";
+
+    lcbvrow_PARSER *parser = lcbvrow_create();
+    parser->callback = row_callback;
+    state.setBytes(resp.size());
+    state.resetTimer();
+    for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+        for (size_t off = 0; off < resp.size(); off += CHUNKSIZE) {
+            size_t n = resp.size() - off;
+            lcbvrow_feed(parser, resp.c_str() + off, n < CHUNKSIZE ? n : CHUNKSIZE);
+        }
+        lcbvrow_reset(parser);
+    }
+    state.stopTimer();
+    lcbvrow_free(parser);
+}
@@ -0,0 +1,191 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+volatile lcb_U64 bench_sink = 0;
+
+struct BenchEntry {
+    const char *name;
+    BenchFunc fn;
+};
+
+struct BenchResult {
+    string name;
+    lcb_U64 iterations;
+    double ns_per_op;
+    double mb_per_sec;
+    string skipped;
+};
+
+// Registrars run during static initialization, in no particular order
+static vector<BenchEntry>& registry()
+{
+    static vector<BenchEntry> entries;
+    return entries;
+}
+
+BenchRegistrar::BenchRegistrar(const char *name, BenchFunc fn)
+{
+    BenchEntry entry = { name, fn };
+    registry().push_back(entry);
+}
+
+static bool byName(const BenchEntry& a, const BenchEntry& b)
+{
+    return strcmp(a.name, b.name) < 0;
+}
+
+/**
+ * Run a benchmark with an increasing number of iterations until a run takes
+ * at least `mintime`, predicting the count from the previous run's rate
+ * (but growing it by no more than 100x at a time)
+ */
+static void runOnce(const BenchEntry& entry, hrtime_t mintime, BenchResult& res)
+{
+    lcb_U64 niters = 1;
+    for (;;) {
+        BenchState state(niters);
+        entry.fn(state);
+        state.stopTimer();
+        if (!state.skipped.empty()) {
+            res.skipped = state.skipped;
+            return;
+        }
+        if (state.elapsed >= mintime || niters >= 1000000000) {
+            double nsop = (double)state.elapsed / niters;
+            if (res.iterations == 0 || nsop < res.ns_per_op) {
+                res.iterations = niters;
+                res.ns_per_op = nsop;
+                res.mb_per_sec = 0;
+                if (state.bytes && state.elapsed) {
+                    res.mb_per_sec = (double)state.bytes * niters * 1000 /
+                        state.elapsed;
+                }
+            }
+            return;
+        }
+        lcb_U64 next = niters * 100;
+        if (state.elapsed) {
+            lcb_U64 predicted = (lcb_U64)((double)mintime * 1.2 * niters / state.elapsed);
+            if (predicted < next) {
+                next = predicted;
+            }
+        }
+        niters = next > niters ? next : niters + 1;
+    }
+}
+
+static void writeJson(FILE *fp, const vector<BenchResult>& results)
+{
+    fprintf(fp, "{\n  \"version\": \"%s\",\n  \"benchmarks\": [", lcb_get_version(NULL));
+    for (size_t ii = 0; ii < results.size(); ii++) {
+        const BenchResult& res = results[ii];
+        fprintf(fp, "%s\n    { \"name\": \"%s\"", ii ? "," : "", res.name.c_str());
+        if (!res.skipped.empty()) {
+            fprintf(fp, ", \"skipped\": \"%s\" }", res.skipped.c_str());
+            continue;
+        }
+        fprintf(fp, ", \"iterations\": %llu, \"ns_per_op\": %.2f",
+            (unsigned long long)res.iterations, res.ns_per_op);
+        if (res.mb_per_sec) {
+            fprintf(fp, ", \"mb_per_sec\": %.2f", res.mb_per_sec);
+        }
+        fprintf(fp, " }");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --filter SUBSTR   Only run benchmarks whose name contains SUBSTR\n"
+        "  --list            List the benchmarks and exit\n"
+        "  --min-time MS     Minimum duration of a measured run (default 200)\n"
+        "  --repeat N        Measured runs per benchmark; the fastest is reported (default 3)\n"
+        "  --output FILE     Write the JSON results to FILE instead of stdout\n",
+        argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL, *output = NULL;
+    unsigned mintime_ms = 200, nrepeat = 3;
+    bool list = false;
+
+    for (int ii = 1; ii < argc; ii++) {
+        string arg = argv[ii];
+        bool hasval = ii + 1 < argc;
+        if (arg == "--filter" && hasval) {
+            filter = argv[++ii];
+        } else if (arg == "--output" && hasval) {
+            output = argv[++ii];
+        } else if (arg == "--min-time" && hasval) {
+            mintime_ms = atoi(argv[++ii]);
+        } else if (arg == "--repeat" && hasval) {
+            nrepeat = atoi(argv[++ii]);
+        } else if (arg == "--list") {
+            list = true;
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (nrepeat == 0) {
+        nrepeat = 1;
+    }
+
+    vector<BenchEntry> entries = registry();
+    std::sort(entries.begin(), entries.end(), byName);
+
+    vector<BenchResult> results;
+    for (size_t ii = 0; ii < entries.size(); ii++) {
+        const BenchEntry& entry = entries[ii];
+        if (filter && strstr(entry.name, filter) == NULL) {
+            continue;
+        }
+        if (list) {
+            printf("%s\n", entry.name);
+            continue;
+        }
+
+        BenchResult res;
+        res.name = entry.name;
+        res.iterations = 0;
+        res.ns_per_op = 0;
+        res.mb_per_sec = 0;
+        for (unsigned jj = 0; jj < nrepeat && res.skipped.empty(); jj++) {
+            runOnce(entry, (hrtime_t)mintime_ms * 1000000, res);
+        }
+        if (!res.skipped.empty()) {
+            fprintf(stderr, "%-32s skipped: %s\n", entry.name, res.skipped.c_str());
+        } else if (res.mb_per_sec) {
+            fprintf(stderr, "%-32s %12llu %12.1f ns/op %10.1f MB/s\n", entry.name,
+                (unsigned long long)res.iterations, res.ns_per_op, res.mb_per_sec);
+        } else {
+            fprintf(stderr, "%-32s %12llu %12.1f ns/op\n", entry.name,
+                (unsigned long long)res.iterations, res.ns_per_op);
+        }
+        results.push_back(res);
+    }
+    if (list) {
+        return EXIT_SUCCESS;
+    }
+
+    FILE *fp = stdout;
+    if (output && (fp = fopen(output, "w")) == NULL) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    writeJson(fp, results);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+#ifndef LCB_BENCH_H
+#define LCB_BENCH_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <string>
+
+/**
+ * State of a running benchmark. The benchmark function performs its
+ * operation #iterations times; it is called again with more iterations until
+ * the run takes long enough to be measured reliably (see bench.cc).
+ *
+ * Work done before the loop (building inputs, allocating the objects under
+ * test) should be excluded with resetTimer(), and work inside the loop which
+ * is not part of the operation with stopTimer()/startTimer().
+ */
+class BenchState {
+public:
+    BenchState(lcb_U64 iterations) : iterations(iterations), bytes(0),
+        elapsed(0), begin(gethrtime()), running(true) {}
+
+    const lcb_U64 iterations;
+
+    void resetTimer() {
+        elapsed = 0;
+        begin = gethrtime();
+    }
+    void stopTimer() {
+        if (running) {
+            elapsed += gethrtime() - begin;
+            running = false;
+        }
+    }
+    void startTimer() {
+        if (!running) {
+            begin = gethrtime();
+            running = true;
+        }
+    }
+
+    /** Bytes processed by each iteration, to report the throughput */
+    void setBytes(lcb_U64 n) { bytes = n; }
+
+    /** Do not report the benchmark, e.g. if the feature is not compiled in */
+    void skip(const std::string& why) { skipped = why; }
+
+    lcb_U64 bytes;
+    hrtime_t elapsed;
+    std::string skipped;
+
+private:
+    hrtime_t begin;
+    bool running;
+    BenchState(const BenchState&);
+};
+
+typedef void (*BenchFunc)(BenchState&);
+
+struct BenchRegistrar {
+    BenchRegistrar(const char *name, BenchFunc fn);
+};
+
+/**
+ * Define a benchmark, named `group.name` in the results:
+ *
+ *     BENCHMARK(netbuf, reserve) {
+ *         for (lcb_U64 ii = 0; ii < state.iterations; ii++) {
+ *             ...
+ *         }
+ *     }
+ */
+#define BENCHMARK(group, name) \
+    static void bench_##group##_##name(BenchState&); \
+    static BenchRegistrar bench_reg_##group##_##name( \
+        #group "." #name, bench_##group##_##name); \
+    static void bench_##group##_##name(BenchState& state)
+
+/** Values stored here are not optimized away */
+extern volatile lcb_U64 bench_sink;
+
+#endif
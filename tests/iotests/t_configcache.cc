@@ -19,6 +19,7 @@
 #include "iotests.h"
 
 #include <cstdio>
+#include <string>
 
 class ConfigCacheUnitTest : public MockUnitTest
 {
@@ -62,6 +63,12 @@ TEST_F(ConfigCacheUnitTest, testConfigCache)
     err = lcb_wait(instance);
     ASSERT_EQ(err, LCB_SUCCESS);
 
+    // A binary copy is written alongside the JSON
+    std::string binfile = std::string(filename) + ".bin";
+    FILE *fp = fopen(binfile.c_str(), "rb");
+    ASSERT_TRUE(fp != NULL);
+    fclose(fp);
+
     // now try another one
     lcb_destroy(instance);
     doLcbCreate(&instance, &cropts, MockEnvironment::getInstance());
@@ -99,5 +106,25 @@ TEST_F(ConfigCacheUnitTest, testConfigCache)
     ASSERT_EQ(LCB_SUCCESS, err);
     ASSERT_NE(0, is_loaded);
     lcb_destroy(instance);
+
+    // A corrupt binary copy is ignored in favor of the JSON
+    fp = fopen(binfile.c_str(), "r+b");
+    ASSERT_TRUE(fp != NULL);
+    fseek(fp, 20, SEEK_SET);
+    fputs("garbage", fp);
+    fclose(fp);
+
+    doLcbCreate(&instance, &cropts, MockEnvironment::getInstance());
+    err = lcb_cntl_string(instance, "config_cache", filename);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    err = lcb_connect(instance);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    lcb_wait(instance);
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONFIG_CACHE_LOADED, &is_loaded);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_NE(0, is_loaded);
+    lcb_destroy(instance);
+
     remove(filename);
+    remove(binfile.c_str());
 }
@@ -239,3 +239,34 @@ TEST_F(Confmon, testBootstrapMethods)
     ASSERT_NE(0, lcb_confmon_is_refreshing(instance->confmon));
     lcb_confmon_stop(instance->confmon);
 }
+
+TEST_F(Confmon, testBootstrapRace)
+{
+    SKIP_UNLESS_MOCK();
+    lcb_t instance;
+    HandleWrap hw;
+    MockEnvironment::getInstance()->createConnection(hw, instance);
+
+    lcb_U32 tmo = LCB_MS2US(5000), nrace = 3;
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIG_NODE_TIMEOUT, &tmo);
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_BOOTSTRAP_RACE, &nrace);
+    lcb_confmon_set_provider_active(instance->confmon, LCB_CLCONFIG_HTTP, 0);
+
+    // The first node does not respond at all
+    hostlist_t nodes = hostlist_create();
+    hostlist_add_stringz(nodes, "10.255.255.1:11210", 11210);
+    for (unsigned ii = 0; ii < instance->mc_nodes->nentries; ii++) {
+        hostlist_add_host(nodes, instance->mc_nodes->entries + ii);
+    }
+    instance->settings->randomize_bootstrap_nodes = 0;
+    clconfig_provider *cccp = lcb_confmon_get_provider(instance->confmon, LCB_CLCONFIG_CCCP);
+    cccp->configure_nodes(cccp, nodes);
+    hostlist_destroy(nodes);
+
+    hrtime_t begin = gethrtime();
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    ASSERT_LT(LCB_NS2US(gethrtime() - begin), tmo);
+    ASSERT_EQ(LCB_CLCONFIG_CCCP, instance->cur_configinfo->origin);
+}
@@ -0,0 +1,967 @@
+#include "kvserver.h"
+#include <libcouchbase/vbucket.h>
+#include <memcached/protocol_binary.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace LCBTest {
+
+#define NSHARDS 256
+#define MAXEVENTS 64
+#define READSIZE 65536
+/** Expiration times larger than this are absolute, as in memcached */
+#define RELTIME_MAX (60 * 60 * 24 * 30)
+/** Status byte of OBSERVE for keys which exist; see lcb_observe_t */
+#define OBS_PERSISTED 0x01
+#define OBS_NOT_FOUND 0x80
+
+struct Item {
+    string value;
+    lcb_U32 flags;
+    lcb_U64 cas;
+    time_t exptime;
+};
+
+/** Items sharded by key, each shard with its own lock */
+class Store {
+public:
+    struct Shard {
+        pthread_mutex_t mutex;
+        map<string, Item> items;
+    };
+
+    class Lock {
+    public:
+        Lock(Shard& shard) : shard(shard) { pthread_mutex_lock(&shard.mutex); }
+        ~Lock() { pthread_mutex_unlock(&shard.mutex); }
+    private:
+        Shard& shard;
+    };
+
+    Store() : cas_seq(0) {
+        for (unsigned ii = 0; ii < NSHARDS; ii++) {
+            pthread_mutex_init(&shards[ii].mutex, NULL);
+        }
+    }
+
+    ~Store() {
+        for (unsigned ii = 0; ii < NSHARDS; ii++) {
+            pthread_mutex_destroy(&shards[ii].mutex);
+        }
+    }
+
+    Shard& getShard(const string& key) {
+        lcb_U32 hash = 2166136261U;
+        for (size_t ii = 0; ii < key.size(); ii++) {
+            hash = (hash ^ (lcb_U8)key[ii]) * 16777619U;
+        }
+        return shards[hash % NSHARDS];
+    }
+
+    /** Look up an item, removing it if it has expired. Shard must be locked */
+    static Item *find(Shard& shard, const string& key) {
+        map<string, Item>::iterator it = shard.items.find(key);
+        if (it == shard.items.end()) {
+            return NULL;
+        }
+        if (it->second.exptime && it->second.exptime <= time(NULL)) {
+            shard.items.erase(it);
+            return NULL;
+        }
+        return &it->second;
+    }
+
+    lcb_U64 nextCas() {
+        return __sync_add_and_fetch(&cas_seq, 1);
+    }
+
+    void flush() {
+        for (unsigned ii = 0; ii < NSHARDS; ii++) {
+            Lock lock(shards[ii]);
+            shards[ii].items.clear();
+        }
+    }
+
+private:
+    Shard shards[NSHARDS];
+    volatile lcb_U64 cas_seq;
+};
+
+struct Request {
+    lcb_U8 opcode;
+    lcb_U16 vbid;
+    lcb_U32 opaque;
+    lcb_U64 cas;
+    const char *ext;
+    lcb_U8 next;
+    string key;
+    const char *value;
+    lcb_U32 nvalue;
+};
+
+/** A listening socket, or a client's connection */
+struct Conn {
+    int fd;
+    unsigned node;
+    bool listener;
+    bool closing;
+    bool polling_out;
+    vector<char> rbuf;
+    size_t rlen;
+    string wbuf;
+    size_t woff;
+
+    Conn(int fd, unsigned node, bool listener) : fd(fd), node(node),
+        listener(listener), closing(false), polling_out(false), rlen(0), woff(0) {}
+};
+
+class KVServerImpl;
+
+class Worker {
+public:
+    Worker(KVServerImpl *parent) : parent(parent), epfd(-1), started(false),
+        nconns(0), ncmds(0), nnmv(0), nkeyed(0) {}
+    ~Worker();
+
+    bool addListener(int fd, unsigned node);
+    bool start(int stopfd);
+    void join();
+
+    KVServerImpl *parent;
+    int epfd;
+    pthread_t thr;
+    bool started;
+    vector<Conn *> listeners;
+    map<int, Conn *> conns;
+
+    volatile lcb_U64 nconns;
+    volatile lcb_U64 ncmds;
+    volatile lcb_U64 nnmv;
+    lcb_U64 nkeyed;
+
+private:
+    static void *threadMain(void *arg);
+    void run();
+    void acceptClients(Conn *listener);
+    void readConn(Conn *conn);
+    void flushConn(Conn *conn);
+    void closeConn(Conn *conn);
+    void dispatch(Conn *conn, Request& req);
+    bool checkVbucket(Conn *conn, Request& req);
+};
+
+class KVServerImpl {
+public:
+    KVServerImpl(const KVServerOptions& options) : options(options), vbc(NULL),
+        stopfd(-1) {}
+    ~KVServerImpl() { stop(); }
+
+    bool start();
+    void stop();
+    bool fail(const char *what) {
+        char buf[256];
+        snprintf(buf, sizeof buf, "%s: %s", what, strerror(errno));
+        error = buf;
+        return false;
+    }
+
+    KVServerOptions options;
+    string error;
+    lcbvb_CONFIG *vbc;
+    string config;
+    vector<unsigned short> ports;
+    vector<Worker *> workers;
+    Store store;
+    int stopfd;
+};
+
+static void put16(string& s, lcb_U16 v) {
+    v = htons(v);
+    s.append((const char *)&v, 2);
+}
+static void put32(string& s, lcb_U32 v) {
+    v = htonl(v);
+    s.append((const char *)&v, 4);
+}
+static void put64(string& s, lcb_U64 v) {
+    put32(s, (lcb_U32)(v >> 32));
+    put32(s, (lcb_U32)v);
+}
+static lcb_U16 get16(const char *p) {
+    lcb_U16 v;
+    memcpy(&v, p, 2);
+    return ntohs(v);
+}
+static lcb_U32 get32(const char *p) {
+    lcb_U32 v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+static lcb_U64 get64(const char *p) {
+    return ((lcb_U64)get32(p) << 32) | get32(p + 4);
+}
+
+static time_t absTime(lcb_U32 exptime) {
+    if (exptime == 0 || exptime > RELTIME_MAX) {
+        return exptime;
+    }
+    return time(NULL) + exptime;
+}
+
+static bool isQuiet(lcb_U8 opcode) {
+    switch (opcode) {
+    case PROTOCOL_BINARY_CMD_GETQ:
+    case PROTOCOL_BINARY_CMD_GETKQ:
+    case PROTOCOL_BINARY_CMD_SETQ:
+    case PROTOCOL_BINARY_CMD_ADDQ:
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+    case PROTOCOL_BINARY_CMD_DELETEQ:
+    case PROTOCOL_BINARY_CMD_INCREMENTQ:
+    case PROTOCOL_BINARY_CMD_DECREMENTQ:
+    case PROTOCOL_BINARY_CMD_QUITQ:
+    case PROTOCOL_BINARY_CMD_FLUSHQ:
+    case PROTOCOL_BINARY_CMD_APPENDQ:
+    case PROTOCOL_BINARY_CMD_PREPENDQ:
+    case PROTOCOL_BINARY_CMD_GATQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void respond(Conn *conn, const Request& req, lcb_U16 status,
+    lcb_U64 cas = 0, const string& ext = string(), const string& key = string(),
+    const char *value = NULL, size_t nvalue = 0)
+{
+    string& out = conn->wbuf;
+    out += (char)PROTOCOL_BINARY_RES;
+    out += (char)req.opcode;
+    put16(out, key.size());
+    out += (char)ext.size();
+    out += (char)0;
+    put16(out, status);
+    put32(out, ext.size() + key.size() + nvalue);
+    out.append((const char *)&req.opaque, 4);
+    put64(out, cas);
+    out += ext;
+    out += key;
+    if (nvalue) {
+        out.append(value, nvalue);
+    }
+}
+
+static void respondValue(Conn *conn, const Request& req, const string& value) {
+    respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, string(), string(),
+        value.c_str(), value.size());
+}
+
+/* Parse a counter's value, as memcached does */
+static bool parseCounter(const string& value, lcb_U64 *out) {
+    if (value.empty() || value.size() > 20) {
+        return false;
+    }
+    lcb_U64 v = 0;
+    for (size_t ii = 0; ii < value.size(); ii++) {
+        if (value[ii] < '0' || value[ii] > '9') {
+            return false;
+        }
+        v = v * 10 + (value[ii] - '0');
+    }
+    *out = v;
+    return true;
+}
+
+Worker::~Worker()
+{
+    for (size_t ii = 0; ii < listeners.size(); ii++) {
+        close(listeners[ii]->fd);
+        delete listeners[ii];
+    }
+    for (map<int, Conn *>::iterator it = conns.begin(); it != conns.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    if (epfd != -1) {
+        close(epfd);
+    }
+}
+
+bool Worker::addListener(int fd, unsigned node)
+{
+    if (epfd == -1 && (epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        return false;
+    }
+    Conn *conn = new Conn(fd, node, true);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    listeners.push_back(conn);
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool Worker::start(int stopfd)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, stopfd, &ev) != 0) {
+        return false;
+    }
+    if ((errno = pthread_create(&thr, NULL, threadMain, this)) != 0) {
+        return false;
+    }
+    started = true;
+    return true;
+}
+
+void Worker::join()
+{
+    if (started) {
+        pthread_join(thr, NULL);
+        started = false;
+    }
+}
+
+void *Worker::threadMain(void *arg)
+{
+    ((Worker *)arg)->run();
+    return NULL;
+}
+
+void Worker::run()
+{
+    struct epoll_event events[MAXEVENTS];
+    for (;;) {
+        int nev = epoll_wait(epfd, events, MAXEVENTS, -1);
+        if (nev < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        for (int ii = 0; ii < nev; ii++) {
+            Conn *conn = (Conn *)events[ii].data.ptr;
+            if (conn == NULL) {
+                return;
+            } else if (conn->listener) {
+                acceptClients(conn);
+                continue;
+            }
+            if (events[ii].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) {
+                readConn(conn);
+            } else if (events[ii].events & EPOLLOUT) {
+                flushConn(conn);
+            }
+        }
+    }
+}
+
+void Worker::acceptClients(Conn *listener)
+{
+    int fd;
+    while ((fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        Conn *conn = new Conn(fd, listener->node, false);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        conns[fd] = conn;
+        nconns++;
+    }
+}
+
+void Worker::closeConn(Conn *conn)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conns.erase(conn->fd);
+    delete conn;
+}
+
+void Worker::readConn(Conn *conn)
+{
+    if (conn->rbuf.size() < conn->rlen + READSIZE) {
+        conn->rbuf.resize(conn->rlen + READSIZE);
+    }
+    ssize_t nr = recv(conn->fd, &conn->rbuf[conn->rlen], READSIZE, 0);
+    if (nr == 0 || (nr < 0 && errno != EAGAIN && errno != EINTR)) {
+        closeConn(conn);
+        return;
+    } else if (nr < 0) {
+        return;
+    }
+    conn->rlen += nr;
+
+    size_t pos = 0;
+    while (conn->rlen - pos >= 24 && !conn->closing) {
+        const char *hdr = &conn->rbuf[pos];
+        lcb_U32 nbody = get32(hdr + 8);
+        if (conn->rlen - pos < 24 + (size_t)nbody) {
+            break;
+        }
+        Request req;
+        lcb_U16 nkey = get16(hdr + 2);
+        req.opcode = hdr[1];
+        req.next = hdr[4];
+        req.vbid = get16(hdr + 6);
+        memcpy(&req.opaque, hdr + 12, 4);
+        req.cas = get64(hdr + 16);
+        req.ext = hdr + 24;
+        if ((lcb_U8)hdr[0] != PROTOCOL_BINARY_REQ || req.next + nkey > nbody) {
+            closeConn(conn);
+            return;
+        }
+        req.key.assign(req.ext + req.next, nkey);
+        req.value = req.ext + req.next + nkey;
+        req.nvalue = nbody - req.next - nkey;
+        dispatch(conn, req);
+        ncmds++;
+        pos += 24 + nbody;
+    }
+    if (pos) {
+        memmove(&conn->rbuf[0], &conn->rbuf[pos], conn->rlen - pos);
+        conn->rlen -= pos;
+    }
+    flushConn(conn);
+}
+
+void Worker::flushConn(Conn *conn)
+{
+    while (conn->woff < conn->wbuf.size()) {
+        ssize_t nw = send(conn->fd, conn->wbuf.data() + conn->woff,
+            conn->wbuf.size() - conn->woff, MSG_NOSIGNAL);
+        if (nw < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            closeConn(conn);
+            return;
+        }
+        conn->woff += nw;
+    }
+
+    bool pending = conn->woff < conn->wbuf.size();
+    if (!pending) {
+        conn->wbuf.clear();
+        conn->woff = 0;
+        if (conn->closing) {
+            closeConn(conn);
+            return;
+        }
+    }
+    if (pending != conn->polling_out) {
+        struct epoll_event ev;
+        ev.events = pending ? EPOLLIN|EPOLLOUT : EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->polling_out = pending;
+    }
+}
+
+/**
+ * Reject commands for vBuckets the node does not own, and inject
+ * NOT_MY_VBUCKET replies if requested
+ */
+bool Worker::checkVbucket(Conn *conn, Request& req)
+{
+    lcbvb_CONFIG *vbc = parent->vbc;
+    bool owned = false;
+
+    if (req.vbid < (unsigned)vbc->nvb) {
+        if (req.opcode == PROTOCOL_BINARY_CMD_GET_REPLICA) {
+            for (unsigned ii = 0; ii < vbc->nrepl; ii++) {
+                owned |= lcbvb_vbreplica(vbc, req.vbid, ii) == (int)conn->node;
+            }
+        } else {
+            owned = lcbvb_vbmaster(vbc, req.vbid) == (int)conn->node;
+        }
+    }
+    if (owned && parent->options.nmv_every &&
+            ++nkeyed % parent->options.nmv_every == 0) {
+        owned = false;
+    }
+    if (!owned) {
+        const string& config = parent->config;
+        respond(conn, req, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, 0,
+            string(), string(), config.c_str(), config.size());
+        nnmv++;
+    }
+    return owned;
+}
+
+void Worker::dispatch(Conn *conn, Request& req)
+{
+    Store& store = parent->store;
+    bool quiet = isQuiet(req.opcode);
+
+    switch (req.opcode) {
+    case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GETQ:
+    case PROTOCOL_BINARY_CMD_GETK:
+    case PROTOCOL_BINARY_CMD_GETKQ:
+    case PROTOCOL_BINARY_CMD_GET_REPLICA:
+    case PROTOCOL_BINARY_CMD_GAT:
+    case PROTOCOL_BINARY_CMD_GATQ:
+    case PROTOCOL_BINARY_CMD_TOUCH: {
+        bool touch = req.opcode == PROTOCOL_BINARY_CMD_GAT ||
+            req.opcode == PROTOCOL_BINARY_CMD_GATQ ||
+            req.opcode == PROTOCOL_BINARY_CMD_TOUCH;
+        if ((touch && req.next != 4) || (!touch && req.next != 0)) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_EINVAL);
+            break;
+        }
+        if (!checkVbucket(conn, req)) {
+            break;
+        }
+        bool withkey = req.opcode == PROTOCOL_BINARY_CMD_GETK ||
+            req.opcode == PROTOCOL_BINARY_CMD_GETKQ;
+        string ext, value;
+        lcb_U64 cas;
+        {
+            Store::Shard& shard = store.getShard(req.key);
+            Store::Lock lock(shard);
+            Item *item = Store::find(shard, req.key);
+            if (!item) {
+                if (!quiet) {
+                    respond(conn, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0,
+                        string(), withkey ? req.key : string());
+                }
+                break;
+            }
+            if (touch) {
+                item->exptime = absTime(get32(req.ext));
+            }
+            if (req.opcode != PROTOCOL_BINARY_CMD_TOUCH) {
+                put32(ext, item->flags);
+                value = item->value;
+            }
+            cas = item->cas;
+        }
+        respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, cas, ext,
+            withkey ? req.key : string(), value.data(), value.size());
+        break;
+    }
+
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_SETQ:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_ADDQ:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+    case PROTOCOL_BINARY_CMD_APPEND:
+    case PROTOCOL_BINARY_CMD_APPENDQ:
+    case PROTOCOL_BINARY_CMD_PREPEND:
+    case PROTOCOL_BINARY_CMD_PREPENDQ: {
+        lcb_U8 op = req.opcode;
+        bool concat = op == PROTOCOL_BINARY_CMD_APPEND ||
+            op == PROTOCOL_BINARY_CMD_APPENDQ ||
+            op == PROTOCOL_BINARY_CMD_PREPEND ||
+            op == PROTOCOL_BINARY_CMD_PREPENDQ;
+        if (req.next != (concat ? 0 : 8) || req.key.empty()) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_EINVAL);
+            break;
+        }
+        if (!checkVbucket(conn, req)) {
+            break;
+        }
+        lcb_U16 status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        lcb_U64 cas = 0;
+        {
+            Store::Shard& shard = store.getShard(req.key);
+            Store::Lock lock(shard);
+            Item *item = Store::find(shard, req.key);
+            if (req.cas && (!item || item->cas != req.cas)) {
+                status = item ? PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS :
+                    PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+            } else if (concat) {
+                if (!item) {
+                    status = PROTOCOL_BINARY_RESPONSE_NOT_STORED;
+                } else if (op == PROTOCOL_BINARY_CMD_APPEND ||
+                        op == PROTOCOL_BINARY_CMD_APPENDQ) {
+                    item->value.append(req.value, req.nvalue);
+                } else {
+                    item->value.insert(0, req.value, req.nvalue);
+                }
+            } else if (item && (op == PROTOCOL_BINARY_CMD_ADD ||
+                    op == PROTOCOL_BINARY_CMD_ADDQ)) {
+                status = PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS;
+            } else if (!item && (op == PROTOCOL_BINARY_CMD_REPLACE ||
+                    op == PROTOCOL_BINARY_CMD_REPLACEQ)) {
+                status = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+            } else {
+                if (!item) {
+                    item = &shard.items[req.key];
+                }
+                item->value.assign(req.value, req.nvalue);
+                item->flags = get32(req.ext);
+                item->exptime = absTime(get32(req.ext + 4));
+            }
+            if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                cas = item->cas = store.nextCas();
+            }
+        }
+        if (!quiet || status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            respond(conn, req, status, cas);
+        }
+        break;
+    }
+
+    case PROTOCOL_BINARY_CMD_DELETE:
+    case PROTOCOL_BINARY_CMD_DELETEQ: {
+        if (req.next != 0 || req.key.empty()) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_EINVAL);
+            break;
+        }
+        if (!checkVbucket(conn, req)) {
+            break;
+        }
+        lcb_U16 status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        lcb_U64 cas = 0;
+        {
+            Store::Shard& shard = store.getShard(req.key);
+            Store::Lock lock(shard);
+            Item *item = Store::find(shard, req.key);
+            if (!item) {
+                status = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+            } else if (req.cas && item->cas != req.cas) {
+                status = PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS;
+            } else {
+                shard.items.erase(req.key);
+                cas = store.nextCas();
+            }
+        }
+        if (!quiet || status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            respond(conn, req, status, cas);
+        }
+        break;
+    }
+
+    case PROTOCOL_BINARY_CMD_INCREMENT:
+    case PROTOCOL_BINARY_CMD_INCREMENTQ:
+    case PROTOCOL_BINARY_CMD_DECREMENT:
+    case PROTOCOL_BINARY_CMD_DECREMENTQ: {
+        if (req.next != 20 || req.key.empty()) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_EINVAL);
+            break;
+        }
+        if (!checkVbucket(conn, req)) {
+            break;
+        }
+        bool incr = req.opcode == PROTOCOL_BINARY_CMD_INCREMENT ||
+            req.opcode == PROTOCOL_BINARY_CMD_INCREMENTQ;
+        lcb_U64 delta = get64(req.ext), initial = get64(req.ext + 8);
+        lcb_U32 exptime = get32(req.ext + 16);
+        lcb_U16 status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        lcb_U64 cas = 0, value = 0;
+        {
+            Store::Shard& shard = store.getShard(req.key);
+            Store::Lock lock(shard);
+            Item *item = Store::find(shard, req.key);
+            if (req.cas && (!item || item->cas != req.cas)) {
+                status = item ? PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS :
+                    PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+            } else if (!item && exptime == 0xffffffff) {
+                status = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
+            } else if (!item) {
+                item = &shard.items[req.key];
+                item->flags = 0;
+                item->exptime = absTime(exptime);
+                value = initial;
+            } else if (!parseCounter(item->value, &value)) {
+                status = PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL;
+            } else if (incr) {
+                value += delta;
+            } else {
+                value = value < delta ? 0 : value - delta;
+            }
+            if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                char buf[32];
+                snprintf(buf, sizeof buf, "%llu", (unsigned long long)value);
+                item->value = buf;
+                cas = item->cas = store.nextCas();
+            }
+        }
+        if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            respond(conn, req, status);
+        } else if (!quiet) {
+            string body;
+            put64(body, value);
+            respond(conn, req, status, cas, string(), string(),
+                body.data(), body.size());
+        }
+        break;
+    }
+
+    case PROTOCOL_BINARY_CMD_OBSERVE: {
+        const char *cur = req.value, *end = req.value + req.nvalue;
+        string body;
+        while (end - cur >= 4) {
+            lcb_U16 vbid = get16(cur), nkey = get16(cur + 2);
+            if (end - cur - 4 < nkey) {
+                break;
+            }
+            string key(cur + 4, nkey);
+            cur += 4 + nkey;
+
+            lcb_U8 status = OBS_NOT_FOUND;
+            lcb_U64 cas = 0;
+            {
+                Store::Shard& shard = store.getShard(key);
+                Store::Lock lock(shard);
+                Item *item = Store::find(shard, key);
+                if (item) {
+                    status = OBS_PERSISTED;
+                    cas = item->cas;
+                }
+            }
+            put16(body, vbid);
+            put16(body, nkey);
+            body += key;
+            body += (char)status;
+            put64(body, cas);
+        }
+        respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, 0, string(),
+            string(), body.data(), body.size());
+        break;
+    }
+
+    case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG:
+        respondValue(conn, req, parent->config);
+        break;
+
+    case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+        respondValue(conn, req, "PLAIN");
+        break;
+
+    case PROTOCOL_BINARY_CMD_SASL_AUTH:
+    case PROTOCOL_BINARY_CMD_SASL_STEP:
+        respondValue(conn, req, "Authenticated");
+        break;
+
+    case PROTOCOL_BINARY_CMD_VERSION:
+        respondValue(conn, req, "kvserver");
+        break;
+
+    case PROTOCOL_BINARY_CMD_FLUSH:
+    case PROTOCOL_BINARY_CMD_FLUSHQ:
+        store.flush();
+        if (!quiet) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+        }
+        break;
+
+    case PROTOCOL_BINARY_CMD_QUIT:
+    case PROTOCOL_BINARY_CMD_QUITQ:
+        if (!quiet) {
+            respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+        }
+        conn->closing = true;
+        break;
+
+    /* No statistics; only the terminating packet is sent */
+    case PROTOCOL_BINARY_CMD_STAT:
+    case PROTOCOL_BINARY_CMD_NOOP:
+    case PROTOCOL_BINARY_CMD_HELLO:
+    case PROTOCOL_BINARY_CMD_VERBOSITY:
+        respond(conn, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+        break;
+
+    default:
+        respond(conn, req, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND);
+        break;
+    }
+}
+
+static int newListener(const string& host, unsigned short port, bool reuseport)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if ((reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof one) != 0) ||
+            bind(fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+            listen(fd, 1024) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+bool KVServerImpl::start()
+{
+    unsigned nthreads = options.nthreads;
+    if (nthreads == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpus > 0 ? ncpus : 1;
+    }
+    if (options.nnodes == 0 || options.nreplicas >= options.nnodes ||
+            options.nvbuckets == 0) {
+        error = "Need more nodes than replicas, and at least one vBucket";
+        return false;
+    }
+
+    for (unsigned ii = 0; ii < nthreads; ii++) {
+        workers.push_back(new Worker(this));
+    }
+    for (unsigned ii = 0; ii < options.nnodes; ii++) {
+        for (unsigned jj = 0; jj < nthreads; jj++) {
+            unsigned short port = options.port ? options.port + ii : 0;
+            if (jj) {
+                port = ports[ii];
+            }
+            int fd = newListener(options.host, port, nthreads > 1);
+            if (fd == -1) {
+                return fail("Couldn't listen");
+            }
+            if (jj == 0) {
+                struct sockaddr_in addr;
+                socklen_t naddr = sizeof addr;
+                getsockname(fd, (struct sockaddr *)&addr, &naddr);
+                ports.push_back(ntohs(addr.sin_port));
+            }
+            if (!workers[jj]->addListener(fd, ii)) {
+                close(fd);
+                return fail("Couldn't poll");
+            }
+        }
+    }
+
+    vector<lcbvb_SERVER> servers(options.nnodes);
+    for (unsigned ii = 0; ii < options.nnodes; ii++) {
+        memset(&servers[ii], 0, sizeof servers[ii]);
+        servers[ii].hostname = (char *)options.host.c_str();
+        servers[ii].svc.data = ports[ii];
+    }
+    vbc = lcbvb_create();
+    if (lcbvb_genconfig_ex(vbc, "default", NULL, &servers[0], options.nnodes,
+            options.nreplicas, options.nvbuckets) != 0) {
+        error = lcbvb_get_error(vbc);
+        return false;
+    }
+    char *json = lcbvb_save_json(vbc);
+    config = json;
+    free(json);
+
+    if ((stopfd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) == -1) {
+        return fail("Couldn't create eventfd");
+    }
+    for (unsigned ii = 0; ii < nthreads; ii++) {
+        if (!workers[ii]->start(stopfd)) {
+            fail("Couldn't start worker");
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void KVServerImpl::stop()
+{
+    if (stopfd != -1) {
+        lcb_U64 one = 1;
+        if (write(stopfd, &one, sizeof one) != sizeof one) {
+            perror("kvserver: Couldn't stop workers");
+        }
+    }
+    for (size_t ii = 0; ii < workers.size(); ii++) {
+        workers[ii]->join();
+        delete workers[ii];
+    }
+    workers.clear();
+    if (stopfd != -1) {
+        close(stopfd);
+        stopfd = -1;
+    }
+    if (vbc) {
+        lcbvb_destroy(vbc);
+        vbc = NULL;
+    }
+}
+
+KVServer::KVServer(const KVServerOptions& options)
+    : impl(new KVServerImpl(options))
+{
+}
+
+KVServer::~KVServer()
+{
+    delete impl;
+}
+
+bool KVServer::start()
+{
+    return impl->start();
+}
+
+void KVServer::stop()
+{
+    impl->stop();
+}
+
+const string& KVServer::getError() const
+{
+    return impl->error;
+}
+
+unsigned short KVServer::getPort(unsigned node) const
+{
+    return node < impl->ports.size() ? impl->ports[node] : 0;
+}
+
+string KVServer::getConnstr() const
+{
+    char buf[256];
+    snprintf(buf, sizeof buf, "couchbase://%s:%u=mcd/default?bootstrap_on=cccp",
+        impl->options.host.c_str(), getPort(0));
+    return buf;
+}
+
+KVServerStats KVServer::getStats() const
+{
+    KVServerStats stats;
+    memset(&stats, 0, sizeof stats);
+    for (size_t ii = 0; ii < impl->workers.size(); ii++) {
+        const Worker *worker = impl->workers[ii];
+        stats.nconns += worker->nconns;
+        stats.ncmds += worker->ncmds;
+        stats.nnmv += worker->nnmv;
+    }
+    return stats;
+}
+
+} // namespace LCBTest
@@ -0,0 +1,82 @@
+/**
+ * @file
+ * A multi-threaded, in-memory stand-in for a Couchbase cluster's data nodes,
+ * speaking enough of the memcached binary protocol for the library to
+ * bootstrap (via CCCP) and run KV workloads against it. It is meant for
+ * measuring the client's throughput on a single machine, and is not a
+ * reference implementation of the server.
+ *
+ * Each node of the generated cluster map listens on its own port; all nodes
+ * share one store, so replica reads and OBSERVE on replicas see the master's
+ * data. Connections are spread over the worker threads by the kernel (each
+ * worker listens on every port with SO_REUSEPORT), and every worker runs its
+ * own epoll loop. Linux only.
+ */
+
+#ifndef LCB_KVSERVER_H
+#define LCB_KVSERVER_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <string>
+#include <vector>
+
+namespace LCBTest {
+
+struct KVServerOptions {
+    /** Address to listen on */
+    std::string host;
+    /** Port of the first node; the others use the following ports. If 0, the
+     * ports are chosen by the system */
+    unsigned short port;
+    unsigned nnodes;
+    unsigned nreplicas;
+    unsigned nvbuckets;
+    /** Number of worker threads; 0 for one per CPU */
+    unsigned nthreads;
+    /** If nonzero, every Nth keyed command is rejected with NOT_MY_VBUCKET
+     * (with the current configuration in the body), as during a rebalance */
+    unsigned nmv_every;
+
+    KVServerOptions() : host("127.0.0.1"), port(0), nnodes(1), nreplicas(0),
+        nvbuckets(64), nthreads(0), nmv_every(0) {}
+};
+
+struct KVServerStats {
+    lcb_U64 nconns; /**< Connections accepted */
+    lcb_U64 ncmds; /**< Commands processed */
+    lcb_U64 nnmv; /**< NOT_MY_VBUCKET replies, injected or not */
+};
+
+class KVServerImpl;
+
+class KVServer {
+public:
+    KVServer(const KVServerOptions& options = KVServerOptions());
+    ~KVServer();
+
+    /**
+     * Bind the ports and start the workers
+     * @return false on failure; see getError()
+     */
+    bool start();
+
+    /** Stop the workers and close all connections. Called by the destructor */
+    void stop();
+
+    const std::string& getError() const;
+    unsigned short getPort(unsigned node = 0) const;
+
+    /** Connection string which bootstraps the library from this server */
+    std::string getConnstr() const;
+
+    KVServerStats getStats() const;
+
+private:
+    KVServerImpl *impl;
+    KVServer(const KVServer&);
+    KVServer& operator=(const KVServer&);
+};
+
+} // namespace LCBTest
+#endif
@@ -0,0 +1,85 @@
+#include "kvserver.h"
+#include <signal.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace LCBTest;
+using std::string;
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --host ADDR       Address to listen on (default 127.0.0.1)\n"
+        "  --port PORT       Port of the first node (default: chosen by the system)\n"
+        "  --nodes N         Number of nodes; each listens on its own port (default 1)\n"
+        "  --replicas N      Number of replicas in the cluster map (default 0)\n"
+        "  --vbuckets N      Number of vBuckets (default 64)\n"
+        "  --threads N       Worker threads (default: one per CPU)\n"
+        "  --nmv-every N     Reply NOT_MY_VBUCKET to every Nth keyed command of\n"
+        "                    each thread (default 0, never)\n"
+        "\n"
+        "Runs until interrupted. Point clients (e.g. cbc-pillowfight -U) at the\n"
+        "connection string which is printed on startup.\n",
+        argv0);
+}
+
+int main(int argc, char **argv)
+{
+    KVServerOptions options;
+
+    for (int ii = 1; ii < argc; ii++) {
+        string arg = argv[ii];
+        bool hasval = ii + 1 < argc;
+        if (arg == "--host" && hasval) {
+            options.host = argv[++ii];
+        } else if (arg == "--port" && hasval) {
+            options.port = atoi(argv[++ii]);
+        } else if (arg == "--nodes" && hasval) {
+            options.nnodes = atoi(argv[++ii]);
+        } else if (arg == "--replicas" && hasval) {
+            options.nreplicas = atoi(argv[++ii]);
+        } else if (arg == "--vbuckets" && hasval) {
+            options.nvbuckets = atoi(argv[++ii]);
+        } else if (arg == "--threads" && hasval) {
+            options.nthreads = atoi(argv[++ii]);
+        } else if (arg == "--nmv-every" && hasval) {
+            options.nmv_every = atoi(argv[++ii]);
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // Blocked in the workers too, so that only sigwait() sees them
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    KVServer server(options);
+    if (!server.start()) {
+        fprintf(stderr, "%s\n", server.getError().c_str());
+        return EXIT_FAILURE;
+    }
+    printf("Listening on %s, ports", options.host.c_str());
+    for (unsigned ii = 0; ii < options.nnodes; ii++) {
+        printf(" %u", server.getPort(ii));
+    }
+    printf("\n");
+    printf("%s\n", server.getConnstr().c_str());
+    fflush(stdout);
+
+    int sig;
+    sigwait(&sigs, &sig);
+
+    KVServerStats stats = server.getStats();
+    server.stop();
+    fprintf(stderr, "Connections: %llu, commands: %llu, NOT_MY_VBUCKET: %llu\n",
+        (unsigned long long)stats.nconns, (unsigned long long)stats.ncmds,
+        (unsigned long long)stats.nnmv);
+    return EXIT_SUCCESS;
+}
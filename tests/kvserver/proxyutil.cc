@@ -0,0 +1,198 @@
+#include "proxyutil.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace LCBTest;
+using std::string;
+using std::vector;
+
+#ifndef CBC_PROXY_PATH
+#error "CBC_PROXY_PATH must point to the cbc-proxy binary"
+#endif
+
+/* How long to wait for the proxy to bootstrap and start listening */
+#define PROXY_START_TIMEOUT_MS 10000
+
+bool
+ProxyProcess::start(const string& connstr)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        error = string("pipe: ") + strerror(errno);
+        return false;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        error = string("fork: ") + strerror(errno);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDERR_FILENO);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        execl(CBC_PROXY_PATH, CBC_PROXY_PATH, "-U", connstr.c_str(),
+            "--bind", "127.0.0.1", "--port", "0", (char *)NULL);
+        fprintf(stderr, "exec %s: %s\n", CBC_PROXY_PATH, strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    ::close(fds[1]);
+
+    // Wait for "[cbc-proxy] Listening on 127.0.0.1:PORT"
+    string output;
+    for (;;) {
+        struct pollfd pfd = { fds[0], POLLIN, 0 };
+        int rv = poll(&pfd, 1, PROXY_START_TIMEOUT_MS);
+        if (rv == -1 && errno == EINTR) {
+            continue;
+        } else if (rv == 0) {
+            error = "Timed out waiting for the proxy: " + output;
+            break;
+        }
+
+        char buf[256];
+        ssize_t nr = read(fds[0], buf, sizeof buf);
+        if (nr <= 0) {
+            error = "Proxy exited: " + output;
+            break;
+        }
+        output.append(buf, nr);
+
+        size_t pos = output.find("Listening on ");
+        if (pos != string::npos && output.find('\n', pos) != string::npos) {
+            unsigned p = 0;
+            size_t colon = output.find(':', pos);
+            if (colon != string::npos) {
+                p = strtoul(output.c_str() + colon + 1, NULL, 10);
+            }
+            port = p;
+            break;
+        }
+    }
+
+    // The proxy ignores SIGPIPE, so later log messages are simply dropped
+    ::close(fds[0]);
+    if (!port) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void
+ProxyProcess::stop()
+{
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    pid = -1;
+    port = 0;
+}
+
+bool
+McConnection::connect(unsigned short port, const string& host)
+{
+    close();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        return false;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1 || ::connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        close();
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return true;
+}
+
+void
+McConnection::close()
+{
+    if (fd != -1) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void
+McConnection::appendRequest(vector<char>& out, lcb_U8 opcode,
+    const string& key, const string& value, lcb_U32 opaque)
+{
+    protocol_binary_request_header hdr;
+    lcb_U8 extlen = value.empty() ? 0 : 8;
+    memset(&hdr, 0, sizeof hdr);
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.keylen = htons(key.size());
+    hdr.request.extlen = extlen;
+    hdr.request.bodylen = htonl(extlen + key.size() + value.size());
+    hdr.request.opaque = opaque;
+    out.insert(out.end(), hdr.bytes, hdr.bytes + sizeof hdr.bytes);
+    out.insert(out.end(), extlen, 0);
+    out.insert(out.end(), key.begin(), key.end());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static bool
+read_all(int fd, char *buf, size_t n)
+{
+    while (n) {
+        ssize_t nr = ::recv(fd, buf, n, 0);
+        if (nr <= 0) {
+            if (nr == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += nr;
+        n -= nr;
+    }
+    return true;
+}
+
+bool
+McConnection::send(const vector<char>& out)
+{
+    const char *buf = &out[0];
+    size_t n = out.size();
+    while (n) {
+        ssize_t nw = ::send(fd, buf, n, MSG_NOSIGNAL);
+        if (nw <= 0) {
+            if (nw == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += nw;
+        n -= nw;
+    }
+    return true;
+}
+
+bool
+McConnection::recv(McResponse& res)
+{
+    if (!read_all(fd, (char *)res.hdr.bytes, sizeof res.hdr.bytes)) {
+        return false;
+    }
+    res.body.resize(ntohl(res.hdr.response.bodylen));
+    return res.body.empty() || read_all(fd, &res.body[0], res.body.size());
+}
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * Helpers for exercising cbc-proxy against a KVServer: running the proxy in
+ * a child process, and a blocking memcached binary protocol connection to
+ * talk to it. Linux only, like the KVServer itself.
+ */
+
+#ifndef LCB_PROXYUTIL_H
+#define LCB_PROXYUTIL_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <memcached/protocol_binary.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+
+namespace LCBTest {
+
+/** A cbc-proxy process listening on a free port of 127.0.0.1 */
+class ProxyProcess {
+public:
+    ProxyProcess() : pid(-1), port(0) {}
+    ~ProxyProcess() { stop(); }
+
+    /**
+     * Start the proxy and wait until it is listening
+     * @param connstr the cluster to forward requests to
+     * @return false on failure; see getError()
+     */
+    bool start(const std::string& connstr);
+
+    /** Terminate the proxy. Called by the destructor */
+    void stop();
+
+    unsigned short getPort() const { return port; }
+    const std::string& getError() const { return error; }
+
+private:
+    pid_t pid;
+    unsigned short port;
+    std::string error;
+    ProxyProcess(const ProxyProcess&);
+    ProxyProcess& operator=(const ProxyProcess&);
+};
+
+struct McResponse {
+    protocol_binary_response_header hdr;
+    std::string body;
+
+    lcb_U16 status() const { return ntohs(hdr.response.status); }
+    /** Body without the extras and key, e.g. the value of a GET */
+    std::string value() const {
+        return body.substr(hdr.response.extlen + ntohs(hdr.response.keylen));
+    }
+};
+
+/** Blocking memcached binary protocol client connection */
+class McConnection {
+public:
+    McConnection() : fd(-1) {}
+    ~McConnection() { close(); }
+
+    bool connect(unsigned short port, const std::string& host = "127.0.0.1");
+    void close();
+
+    /**
+     * Append a request to a buffer. A non-empty value is sent along with the
+     * extras of a SET (flags and expiry, both 0)
+     */
+    static void appendRequest(std::vector<char>& out, lcb_U8 opcode,
+        const std::string& key, const std::string& value, lcb_U32 opaque);
+
+    bool send(const std::vector<char>& buf);
+    bool recv(McResponse& res);
+
+private:
+    int fd;
+    McConnection(const McConnection&);
+    McConnection& operator=(const McConnection&);
+};
+
+} // namespace LCBTest
+#endif
@@ -0,0 +1,224 @@
+#include "kvserver.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/api3.h>
+#include <string>
+
+using namespace LCBTest;
+using std::string;
+
+struct KVResult {
+    int ncalled;
+    lcb_error_t rc;
+    lcb_U64 cas;
+    lcb_U64 value;
+    string body;
+    int nreplicated;
+    KVResult() : ncalled(0), rc(LCB_SUCCESS), cas(0), value(0), nreplicated(0) {}
+};
+
+extern "C" {
+static void kv_callback(lcb_t, int cbtype, const lcb_RESPBASE *rb)
+{
+    KVResult *res = (KVResult *)rb->cookie;
+    res->ncalled++;
+    res->rc = rb->rc;
+    res->cas = rb->cas;
+    if (cbtype == LCB_CALLBACK_GET || cbtype == LCB_CALLBACK_GETREPLICA) {
+        const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
+        res->body.assign((const char *)resp->value, resp->nvalue);
+    } else if (cbtype == LCB_CALLBACK_COUNTER) {
+        res->value = ((const lcb_RESPCOUNTER *)rb)->value;
+    } else if (cbtype == LCB_CALLBACK_ENDURE) {
+        res->nreplicated = ((const lcb_RESPENDURE *)rb)->nreplicated;
+    }
+}
+}
+
+class KVServerTest : public ::testing::Test
+{
+protected:
+    KVServer *server;
+    lcb_t instance;
+
+    void SetUp() {
+        server = NULL;
+        instance = NULL;
+    }
+
+    void TearDown() {
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        delete server;
+    }
+
+    void start(const KVServerOptions& options) {
+        server = new KVServer(options);
+        ASSERT_TRUE(server->start()) << server->getError();
+
+        string connstr = server->getConnstr();
+        lcb_create_st cropts;
+        memset(&cropts, 0, sizeof cropts);
+        cropts.version = 3;
+        cropts.v.v3.connstr = connstr.c_str();
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, &cropts));
+        ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+        lcb_wait(instance);
+        ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+        lcb_install_callback3(instance, LCB_CALLBACK_DEFAULT, kv_callback);
+    }
+
+    KVResult store(const string& key, const string& value,
+        lcb_storage_t op = LCB_SET, lcb_U64 cas = 0) {
+        KVResult res;
+        lcb_CMDSTORE cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        LCB_CMD_SET_VALUE(&cmd, value.c_str(), value.size());
+        cmd.operation = op;
+        cmd.cas = cas;
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_store3(instance, &res, &cmd));
+        lcb_sched_leave(instance);
+        lcb_wait(instance);
+        EXPECT_EQ(1, res.ncalled);
+        return res;
+    }
+
+    KVResult get(const string& key) {
+        KVResult res;
+        lcb_CMDGET cmd = { 0 };
+        LCB_CMD_SET_KEY(&cmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        EXPECT_EQ(LCB_SUCCESS, lcb_get3(instance, &res, &cmd));
+        lcb_sched_leave(instance);
+        lcb_wait(instance);
+        EXPECT_EQ(1, res.ncalled);
+        return res;
+    }
+};
+
+TEST_F(KVServerTest, testBasic)
+{
+    KVServerOptions options;
+    options.nnodes = 2;
+    options.nthreads = 2;
+    start(options);
+
+    KVResult res = store("foo", "bar");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_NE(0, res.cas);
+    lcb_U64 cas = res.cas;
+
+    res = get("foo");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("bar", res.body);
+    ASSERT_EQ(cas, res.cas);
+
+    ASSERT_EQ(LCB_KEY_EEXISTS, store("foo", "baz", LCB_ADD).rc);
+    ASSERT_EQ(LCB_KEY_EEXISTS, store("foo", "baz", LCB_SET, cas + 1).rc);
+    ASSERT_EQ(LCB_SUCCESS, store("foo", "baz", LCB_SET, cas).rc);
+    ASSERT_EQ(LCB_SUCCESS, store("foo", "!", LCB_APPEND).rc);
+    ASSERT_EQ("baz!", get("foo").body);
+    ASSERT_EQ(LCB_KEY_ENOENT, store("nonexist", "", LCB_REPLACE).rc);
+
+    lcb_CMDREMOVE rmcmd = { 0 };
+    LCB_CMD_SET_KEY(&rmcmd, "foo", 3);
+    res = KVResult();
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_remove3(instance, &res, &rmcmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(LCB_KEY_ENOENT, get("foo").rc);
+}
+
+TEST_F(KVServerTest, testCounter)
+{
+    start(KVServerOptions());
+
+    lcb_CMDCOUNTER cmd = { 0 };
+    LCB_CMD_SET_KEY(&cmd, "counter", 7);
+    cmd.delta = 5;
+    cmd.initial = 100;
+    cmd.create = 1;
+    KVResult res;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_counter3(instance, &res, &cmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(100, res.value);
+
+    res = KVResult();
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_counter3(instance, &res, &cmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(105, res.value);
+    ASSERT_EQ("105", get("counter").body);
+
+    store("text", "abc");
+    LCB_CMD_SET_KEY(&cmd, "text", 4);
+    res = KVResult();
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_counter3(instance, &res, &cmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_DELTA_BADVAL, res.rc);
+}
+
+TEST_F(KVServerTest, testReplicas)
+{
+    KVServerOptions options;
+    options.nnodes = 3;
+    options.nreplicas = 1;
+    start(options);
+    ASSERT_EQ(LCB_SUCCESS, store("foo", "bar").rc);
+
+    KVResult res;
+    lcb_CMDGETREPLICA rcmd = { 0 };
+    LCB_CMD_SET_KEY(&rcmd, "foo", 3);
+    rcmd.strategy = LCB_REPLICA_FIRST;
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_rget3(instance, &res, &rcmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("bar", res.body);
+
+    // Items are reported as persisted and replicated right away
+    lcb_durability_opts_t dopts;
+    memset(&dopts, 0, sizeof dopts);
+    dopts.v.v0.persist_to = 2;
+    dopts.v.v0.replicate_to = 1;
+    lcb_error_t err;
+    lcb_MULTICMD_CTX *mctx = lcb_endure3_ctxnew(instance, &dopts, &err);
+    ASSERT_FALSE(mctx == NULL);
+    lcb_CMDENDURE ecmd = { 0 };
+    LCB_CMD_SET_KEY(&ecmd, "foo", 3);
+    ASSERT_EQ(LCB_SUCCESS, mctx->addcmd(mctx, &ecmd));
+    res = KVResult();
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, mctx->done(mctx, &res));
+    lcb_sched_leave(instance);
+    lcb_wait(instance);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(1, res.nreplicated);
+}
+
+TEST_F(KVServerTest, testNotMyVbucket)
+{
+    KVServerOptions options;
+    options.nnodes = 2;
+    options.nthreads = 1;
+    options.nmv_every = 3;
+    start(options);
+
+    // Every rejected command is retried by the library
+    for (unsigned ii = 0; ii < 10; ii++) {
+        char key[32];
+        sprintf(key, "key%u", ii);
+        ASSERT_EQ(LCB_SUCCESS, store(key, "value").rc);
+    }
+    ASSERT_GT(server->getStats().nnmv, 0U);
+}
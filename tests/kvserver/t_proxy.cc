@@ -0,0 +1,102 @@
+#include "kvserver.h"
+#include "proxyutil.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace LCBTest;
+using std::string;
+using std::vector;
+
+/* Runs cbc-proxy in front of a KVServer */
+class ProxyTest : public ::testing::Test
+{
+protected:
+    KVServer *server;
+    ProxyProcess proxy;
+    McConnection conn;
+
+    void SetUp() {
+        KVServerOptions options;
+        options.nnodes = 4;
+        options.nthreads = 2;
+        server = new KVServer(options);
+        ASSERT_TRUE(server->start()) << server->getError();
+        ASSERT_TRUE(proxy.start(server->getConnstr())) << proxy.getError();
+        ASSERT_TRUE(conn.connect(proxy.getPort()));
+    }
+
+    void TearDown() {
+        conn.close();
+        proxy.stop();
+        delete server;
+    }
+
+    void request(lcb_U8 opcode, const string& key, const string& value,
+        lcb_U32 opaque, McResponse& res) {
+        vector<char> out;
+        McConnection::appendRequest(out, opcode, key, value, opaque);
+        ASSERT_TRUE(conn.send(out));
+        ASSERT_TRUE(conn.recv(res));
+        ASSERT_EQ(opcode, res.hdr.response.opcode);
+        ASSERT_EQ(opaque, res.hdr.response.opaque);
+    }
+};
+
+TEST_F(ProxyTest, testStoreAndGet)
+{
+    McResponse res;
+    request(PROTOCOL_BINARY_CMD_GET, "foo", "", 1, res);
+    ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, res.status());
+
+    request(PROTOCOL_BINARY_CMD_SET, "foo", "bar", 2, res);
+    ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, res.status());
+    ASSERT_NE(0, res.hdr.response.cas);
+
+    request(PROTOCOL_BINARY_CMD_GET, "foo", "", 3, res);
+    ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, res.status());
+    ASSERT_EQ("bar", res.value());
+}
+
+TEST_F(ProxyTest, testLocalReplies)
+{
+    McResponse res;
+    request(PROTOCOL_BINARY_CMD_NOOP, "", "", 0xdeadbeef, res);
+    ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, res.status());
+
+    // Quiet commands would have no response to keep the order with
+    request(PROTOCOL_BINARY_CMD_GETQ, "foo", "", 42, res);
+    ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, res.status());
+}
+
+TEST_F(ProxyTest, testPipelineOrder)
+{
+    // Keys are spread over every node, yet the responses must come back in
+    // the order of the requests
+    const unsigned nreqs = 256;
+    vector<char> out;
+    for (unsigned ii = 0; ii < nreqs; ii++) {
+        char key[32];
+        sprintf(key, "key-%u", ii % 64);
+        if (ii < 64) {
+            McConnection::appendRequest(out, PROTOCOL_BINARY_CMD_SET, key, key, ii);
+        } else if (ii % 16 == 0) {
+            McConnection::appendRequest(out, PROTOCOL_BINARY_CMD_NOOP, "", "", ii);
+        } else {
+            McConnection::appendRequest(out, PROTOCOL_BINARY_CMD_GET, key, "", ii);
+        }
+    }
+    ASSERT_TRUE(conn.send(out));
+
+    for (unsigned ii = 0; ii < nreqs; ii++) {
+        McResponse res;
+        ASSERT_TRUE(conn.recv(res));
+        ASSERT_EQ(ii, res.hdr.response.opaque);
+        ASSERT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS, res.status());
+        if (res.hdr.response.opcode == PROTOCOL_BINARY_CMD_GET) {
+            char key[32];
+            sprintf(key, "key-%u", ii % 64);
+            ASSERT_EQ(key, res.value());
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef LCB_PIPELINETEST_H
+#define LCB_PIPELINETEST_H
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "sllist-inl.h"
+#include <string>
+
+#define NPIPELINES 4
+
+extern "C" {
+static void pipelinetest_noop_flush(mc_PIPELINE *) {}
+}
+
+/**
+ * Fixture for tests of an instance without any connection: its command queue
+ * is given NPIPELINES servers which never flush, so scheduled packets are
+ * left in the pipelines' queues for the test to inspect, answer or fail.
+ *
+ * Tests which need no pipelines, or need to configure the instance first,
+ * override SetUp() and call createInstance() and addPipelines() themselves.
+ */
+class PipelineTest : public ::testing::Test
+{
+protected:
+    lcb_t instance;
+    lcbvb_CONFIG *vbc;
+    mc_SERVER servers[NPIPELINES];
+    mc_PIPELINE *pipelines[NPIPELINES];
+
+    virtual void SetUp() {
+        createInstance();
+        addPipelines();
+    }
+
+    void createInstance() {
+        instance = NULL;
+        vbc = NULL;
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, NULL));
+    }
+
+    void addPipelines() {
+        vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig(vbc, NPIPELINES, 1, 64));
+        memset(servers, 0, sizeof servers);
+        for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+            servers[ii].settings = instance->settings;
+            pipelines[ii] = &servers[ii].pipeline;
+            mcreq_pipeline_init(pipelines[ii]);
+            pipelines[ii]->flush_start = pipelinetest_noop_flush;
+        }
+        mcreq_queue_add_pipelines(&instance->cmdq, pipelines, NPIPELINES, vbc);
+    }
+
+    virtual void TearDown() {
+        if (vbc) {
+            for (unsigned ii = 0; ii < NPIPELINES; ii++) {
+                mc_PACKET *pkt;
+                while ((pkt = takePacket(pipelines[ii])) != NULL) {
+                    releasePacket(pipelines[ii], pkt);
+                }
+                mcreq_pipeline_cleanup(pipelines[ii]);
+            }
+            // The servers are not the instance's to destroy
+            instance->cmdq.config = NULL;
+            instance->cmdq.npipelines = 0;
+            instance->cmdq._npipelines_ex = 0;
+        }
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        if (vbc) {
+            lcbvb_destroy(vbc);
+        }
+    }
+
+    mc_PIPELINE *pipelineFor(const std::string& key) {
+        int vbid, srvix;
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        return pipelines[srvix];
+    }
+
+    unsigned countPackets(mc_PIPELINE *pl) {
+        unsigned n = 0;
+        sllist_iterator iter;
+        SLLIST_ITERFOR(&pl->requests, &iter) {
+            n++;
+        }
+        return n;
+    }
+
+    /** Remove the first packet from the pipeline's queue */
+    mc_PACKET *takePacket(mc_PIPELINE *pl) {
+        sllist_node *ll = SLLIST_FIRST(&pl->requests);
+        if (!ll) {
+            return NULL;
+        }
+        sllist_remove_head(&pl->requests);
+        return SLLIST_ITEM(ll, mc_PACKET, slnode);
+    }
+
+    void releasePacket(mc_PIPELINE *pl, mc_PACKET *pkt) {
+        mcreq_wipe_packet(pl, pkt);
+        mcreq_release_packet(pl, pkt);
+    }
+};
+
+#endif
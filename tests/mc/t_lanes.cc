@@ -0,0 +1,192 @@
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+
+#define NUM_LANES 2
+
+class McLanes : public ::testing::Test {};
+
+struct LanedCQ : CQWrap {
+    LanedCQ() {
+        unsigned count;
+        mc_PIPELINE **pll = mcreq_queue_take_pipelines(this, &count);
+        for (unsigned ii = 0; ii < count; ii++) {
+            mc_PIPELINE *pl = pll[ii];
+            pl->lanes = (mc_PIPELINE **)calloc(NUM_LANES, sizeof(*pl->lanes));
+            for (unsigned jj = 0; jj < NUM_LANES; jj++) {
+                mc_PIPELINE *lane = (mc_PIPELINE *)calloc(1, sizeof(*lane));
+                mcreq_pipeline_init(lane);
+                pl->lanes[jj] = lane;
+            }
+            pl->nlanes = NUM_LANES;
+        }
+        mcreq_queue_add_pipelines(this, pll, count, CQWrap::config);
+        free(pll);
+    }
+
+    ~LanedCQ() {
+        for (unsigned ii = 0; ii < npipelines; ii++) {
+            mc_PIPELINE *pl = pipelines[ii];
+            for (unsigned jj = 0; jj < pl->nlanes; jj++) {
+                mc_PIPELINE *lane = pl->lanes[jj];
+                clearPipeline(lane);
+                EXPECT_NE(0, netbuf_is_clean(&lane->nbmgr));
+                EXPECT_NE(0, netbuf_is_clean(&lane->reqpool));
+                mcreq_pipeline_cleanup(lane);
+                free(lane);
+            }
+            free(pl->lanes);
+            pl->lanes = NULL;
+            pl->nlanes = 0;
+        }
+    }
+
+    void clearPipeline(mc_PIPELINE *pipeline) {
+        sllist_iterator iter;
+        nb_IOV iov;
+        unsigned toFlush;
+        while ((toFlush = mcreq_flush_iov_fill(pipeline, &iov, 1, NULL))) {
+            mcreq_flush_done(pipeline, toFlush, toFlush);
+        }
+        SLLIST_ITERFOR(&pipeline->requests, &iter) {
+            mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+            sllist_iter_remove(&pipeline->requests, &iter);
+            mcreq_wipe_packet(pipeline, pkt);
+            mcreq_release_packet(pipeline, pkt);
+        }
+    }
+};
+
+TEST_F(McLanes, testLaneSelection)
+{
+    LanedCQ cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+
+    for (unsigned jj = 0; jj < NUM_LANES; jj++) {
+        ASSERT_EQ(pl->index, pl->lanes[jj]->index);
+        ASSERT_EQ((mc_CMDQUEUE *)&cq, pl->lanes[jj]->parent);
+    }
+
+    // Pipeline itself, followed by each lane, in order
+    ASSERT_EQ(pl, mcreq_pipeline_lane(pl, 0, 0));
+    ASSERT_EQ(pl->lanes[0], mcreq_pipeline_lane(pl, 1, 0));
+    ASSERT_EQ(pl->lanes[1], mcreq_pipeline_lane(pl, 2, 0));
+    ASSERT_EQ(pl, mcreq_pipeline_lane(pl, 3, 0));
+
+    // Without a bulk lane, the bulk flag is ignored
+    ASSERT_EQ(pl->lanes[0], mcreq_pipeline_lane(pl, 1, MCREQ_BASICPACKET_F_BULK));
+
+    // With a bulk lane, the last lane only receives bulk packets
+    pl->bulk_lane = 1;
+    for (int vb = 0; vb < 16; vb++) {
+        ASSERT_NE(pl->lanes[1], mcreq_pipeline_lane(pl, vb, 0));
+        ASSERT_EQ(pl->lanes[1], mcreq_pipeline_lane(pl, vb, MCREQ_BASICPACKET_F_BULK));
+    }
+    pl->bulk_lane = 0;
+
+    // No lanes: always the pipeline
+    mc_PIPELINE *other = cq.pipelines[1];
+    unsigned nlanes = other->nlanes;
+    other->nlanes = 0;
+    ASSERT_EQ(other, mcreq_pipeline_lane(other, 5, MCREQ_BASICPACKET_F_BULK));
+    other->nlanes = nlanes;
+}
+
+TEST_F(McLanes, testScheduleToLanes)
+{
+    LanedCQ cq;
+    unsigned total = 0;
+    bool usedLane = false;
+
+    mcreq_sched_enter(&cq);
+    for (int ii = 0; ii < 64; ii++) {
+        PacketWrap pw;
+        char kbuf[128];
+        sprintf(kbuf, "key_%d", ii);
+        pw.setCopyKey(kbuf);
+        ASSERT_TRUE(pw.reservePacket(&cq));
+        pw.setHeaderSize();
+        pw.copyHeader();
+
+        // The packet must be allocated from the lane for its vBucket
+        mc_PIPELINE *primary = cq.pipelines[pw.pipeline->index];
+        ASSERT_EQ(mcreq_pipeline_lane(primary, ntohs(pw.hdr.request.vbucket), 0),
+                  pw.pipeline);
+        if (pw.pipeline != primary) {
+            usedLane = true;
+        }
+        mcreq_sched_add(pw.pipeline, pw.pkt);
+    }
+    mcreq_sched_leave(&cq, 0);
+    ASSERT_TRUE(usedLane);
+
+    // Every packet must have been moved to its lane's request list
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        mc_PIPELINE *pl = cq.pipelines[ii];
+        sllist_iterator iter;
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->ctxqueued));
+        SLLIST_ITERFOR(&pl->requests, &iter) {
+            total++;
+        }
+        for (unsigned jj = 0; jj < pl->nlanes; jj++) {
+            mc_PIPELINE *lane = pl->lanes[jj];
+            ASSERT_TRUE(SLLIST_IS_EMPTY(&lane->ctxqueued));
+            SLLIST_ITERFOR(&lane->requests, &iter) {
+                mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+                protocol_binary_request_header hdr;
+                mcreq_read_hdr(pkt, &hdr);
+                ASSERT_EQ(lane, mcreq_pipeline_lane(pl, ntohs(hdr.request.vbucket), 0));
+                total++;
+            }
+        }
+    }
+    ASSERT_EQ(64, total);
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        cq.clearPipeline(cq.pipelines[ii]);
+    }
+}
+
+TEST_F(McLanes, testPacketLane)
+{
+    LanedCQ cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mc_PIPELINE *other = cq.pipelines[1];
+
+    // Memcached buckets have no vBuckets; the lane only depends on the key
+    ASSERT_EQ(mcreq_key_lane(pl, LCBVB_DIST_KETAMA, 0, "foo", 3, 0),
+              mcreq_key_lane(pl, LCBVB_DIST_KETAMA, 1, "foo", 3, 0));
+    ASSERT_EQ(mcreq_pipeline_lane(pl, 1, 0),
+              mcreq_key_lane(pl, LCBVB_DIST_VBUCKET, 1, "foo", 3, 0));
+
+    // A rescheduled packet is placed the same way as when it was scheduled,
+    // including in the bulk lane
+    pl->bulk_lane = other->bulk_lane = 1;
+    for (int bulk = 0; bulk < 2; bulk++) {
+        for (int ii = 0; ii < 16; ii++) {
+            PacketWrap pw;
+            char kbuf[128];
+            int options = bulk ? MCREQ_BASICPACKET_F_BULK : 0;
+            sprintf(kbuf, "key_%d", ii);
+            pw.setCopyKey(kbuf);
+            ASSERT_EQ(LCB_SUCCESS, mcreq_basic_packet(&cq, &pw.cmd, &pw.hdr, 0,
+                &pw.pkt, &pw.pipeline, options));
+            pw.setHeaderSize();
+            pw.copyHeader();
+            ASSERT_EQ(bulk != 0, (pw.pkt->flags & MCREQ_F_BULK) != 0);
+
+            mc_PIPELINE *primary = cq.pipelines[pw.pipeline->index];
+            ASSERT_EQ(pw.pipeline,
+                mcreq_packet_lane(primary, LCBVB_DIST_VBUCKET, pw.pkt));
+            mc_PIPELINE *newpl = primary == pl ? other : pl;
+            ASSERT_EQ(mcreq_pipeline_lane(newpl,
+                ntohs(pw.hdr.request.vbucket), options),
+                mcreq_packet_lane(newpl, LCBVB_DIST_VBUCKET, pw.pkt));
+            ASSERT_EQ(mcreq_key_lane(newpl, LCBVB_DIST_KETAMA, 0, kbuf,
+                strlen(kbuf), options),
+                mcreq_packet_lane(newpl, LCBVB_DIST_KETAMA, pw.pkt));
+
+            mcreq_wipe_packet(pw.pipeline, pw.pkt);
+            mcreq_release_packet(pw.pipeline, pw.pkt);
+        }
+    }
+    pl->bulk_lane = other->bulk_lane = 0;
+}
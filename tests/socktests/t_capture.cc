@@ -0,0 +1,176 @@
+#include "socktest.h"
+#include <lcbio/capture.h>
+#include <cstdio>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+using namespace LCBTest;
+using std::string;
+
+class SockCaptureTest : public SockTest {};
+
+// Create an empty file for the capture, which opens it again by name
+static bool
+makeTempFile(string& filename)
+{
+#ifdef _WIN32
+    char buf[L_tmpnam];
+    if (tmpnam(buf) == NULL) {
+        return false;
+    }
+#else
+    char buf[] = "/tmp/lcb-capture-XXXXXX";
+    int fd = mkstemp(buf);
+    if (fd == -1) {
+        return false;
+    }
+    close(fd);
+#endif
+    filename = buf;
+    return true;
+}
+
+struct CaptureRecord {
+    unsigned connid;
+    unsigned type;
+    string payload;
+};
+
+static bool
+getVarint(const string& data, size_t& pos, lcb_U64& value)
+{
+    value = 0;
+    for (unsigned shift = 0; pos < data.size() && shift < 64; shift += 7) {
+        unsigned char cur = data[pos++];
+        value |= (lcb_U64)(cur & 0x7f) << shift;
+        if (!(cur & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+readCapture(const char *path, std::vector<CaptureRecord>& records)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    string data;
+    char buf[4096];
+    size_t nr;
+    while ((nr = fread(buf, 1, sizeof buf, fp)) > 0) {
+        data.append(buf, nr);
+    }
+    fclose(fp);
+
+    size_t pos = sizeof(LCBIO_CAPTURE_MAGIC) - 1;
+    if (data.compare(0, pos, LCBIO_CAPTURE_MAGIC) != 0) {
+        return false;
+    }
+    while (pos < data.size()) {
+        lcb_U64 elapsed, connkey, nbytes;
+        if (!getVarint(data, pos, elapsed) || !getVarint(data, pos, connkey) ||
+                !getVarint(data, pos, nbytes) || nbytes > data.size() - pos) {
+            return false;
+        }
+        CaptureRecord rec;
+        rec.connid = (unsigned)(connkey >> 2);
+        rec.type = (unsigned)(connkey & 3);
+        rec.payload = data.substr(pos, nbytes);
+        records.push_back(rec);
+        pos += nbytes;
+    }
+    return true;
+}
+
+TEST_F(SockCaptureTest, testRecord)
+{
+    string filename;
+    ASSERT_TRUE(makeTempFile(filename));
+    lcbio_CAPTURE *capture = lcbio_capture_new(filename.c_str());
+    ASSERT_FALSE(capture == NULL);
+    ASSERT_STREQ(filename.c_str(), lcbio_capture_path(capture));
+
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.ctx == NULL);
+    lcbio_ctx_capture(sock.ctx, capture);
+
+    RecvFuture rf(6);
+    FutureBreakCondition wbc(&rf);
+    sock.put("Hello "); sock.schedule();
+    sock.conn->setRecv(&rf);
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_EQ("Hello ", rf.getString());
+
+    string expected("World!");
+    SendFuture sf(expected);
+    ReadBreakCondition rbc(&sock, expected.size());
+    sock.conn->setSend(&sf);
+    sock.reqrd(expected.size());
+    sock.schedule();
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    ASSERT_EQ(expected, sock.getReceived());
+
+    lcb_host_t host;
+    loop->populateHost(&host);
+    sock.close();
+    lcbio_capture_unref(capture);
+
+    std::vector<CaptureRecord> records;
+    ASSERT_TRUE(readCapture(filename.c_str(), records));
+    remove(filename.c_str());
+    ASSERT_GE(records.size(), 4U);
+
+    string sent, received;
+    for (size_t ii = 0; ii < records.size(); ii++) {
+        ASSERT_EQ(0, records[ii].connid);
+        if (records[ii].type == LCBIO_CAPTURE_SEND) {
+            sent += records[ii].payload;
+        } else if (records[ii].type == LCBIO_CAPTURE_RECV) {
+            received += records[ii].payload;
+        }
+    }
+    ASSERT_EQ(LCBIO_CAPTURE_OPEN, records.front().type);
+    ASSERT_EQ(string(host.host) + ":" + host.port, records.front().payload);
+    ASSERT_EQ(LCBIO_CAPTURE_CLOSE, records.back().type);
+    ASSERT_EQ("Hello ", sent);
+    ASSERT_EQ(expected, received);
+}
+
+TEST_F(SockCaptureTest, testStop)
+{
+    string filename;
+    ASSERT_TRUE(makeTempFile(filename));
+    lcbio_CAPTURE *capture = lcbio_capture_new(filename.c_str());
+    ASSERT_FALSE(capture == NULL);
+
+    ESocket sock;
+    loop->connect(&sock);
+    lcbio_ctx_capture(sock.ctx, capture);
+
+    // Nothing is recorded once the capture is stopped, even though the
+    // context still refers to it
+    lcbio_capture_stop(capture);
+    RecvFuture rf(5);
+    FutureBreakCondition wbc(&rf);
+    sock.put("Hello"); sock.schedule();
+    sock.conn->setRecv(&rf);
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    sock.close();
+    lcbio_capture_unref(capture);
+
+    std::vector<CaptureRecord> records;
+    ASSERT_TRUE(readCapture(filename.c_str(), records));
+    remove(filename.c_str());
+    ASSERT_EQ(1, records.size());
+    ASSERT_EQ(LCBIO_CAPTURE_OPEN, records[0].type);
+}
@@ -0,0 +1,121 @@
+#include "socktest.h"
+#include <lcbio/faults.h>
+using namespace LCBTest;
+using std::string;
+
+class SockFaultsTest : public SockTest {
+protected:
+    /** Inject faults into new connections, if the plugin supports it */
+    bool inject(const string& script) {
+        if (!IOT_IS_EVENT(loop->iot)) {
+            fprintf(stderr, "Faults need an event-based plugin. Skipping\n");
+            return false;
+        }
+        loop->settings->faults = lcbio_faults_new(script.c_str());
+        EXPECT_FALSE(loop->settings->faults == NULL);
+        return loop->settings->faults != NULL;
+    }
+
+    lcbio_FAULTSTATS getStats() {
+        lcbio_FAULTSTATS stats;
+        lcbio_faults_stats(loop->settings->faults, &stats);
+        return stats;
+    }
+
+    /** Read a string sent by the server */
+    string roundtrip(ESocket *sock, const string& expected) {
+        SendFuture sf(expected);
+        ReadBreakCondition rbc(sock, expected.size());
+        sock->conn->setSend(&sf);
+        sock->reqrd(expected.size());
+        sock->schedule();
+        loop->setBreakCondition(&rbc);
+        loop->start();
+        sf.wait();
+        return sock->getReceived();
+    }
+};
+
+TEST_F(SockFaultsTest, testParse)
+{
+    const char *invalid[] = {
+        "latency", "latency=", "latency=abc", "latency=-1", "partial=1.5",
+        "bogus=1", "port=http", "latency=10,,jitter=5", NULL
+    };
+    for (const char **cur = invalid; *cur; cur++) {
+        lcbio_FAULTS *faults = lcbio_faults_new(*cur);
+        ASSERT_TRUE(faults == NULL) << *cur;
+    }
+
+    const char *script = "host=127.0.0.1,port=11210,latency=5;partial=0.5;seed=3";
+    lcbio_FAULTS *faults = lcbio_faults_new(script);
+    ASSERT_FALSE(faults == NULL);
+    ASSERT_STREQ(script, lcbio_faults_script(faults));
+    lcbio_faults_unref(faults);
+}
+
+TEST_F(SockFaultsTest, testPartial)
+{
+    if (!inject("partial=1")) {
+        return;
+    }
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == NULL);
+
+    string expected;
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        expected += (char)('a' + ii % 26);
+    }
+    ASSERT_EQ(expected, roundtrip(&sock, expected));
+    ASSERT_GT(getStats().npartial, 0U);
+    ASSERT_EQ(0, getStats().nresets);
+}
+
+TEST_F(SockFaultsTest, testLatency)
+{
+    if (!inject("latency=50")) {
+        return;
+    }
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == NULL);
+
+    hrtime_t begin = gethrtime();
+    ASSERT_EQ("Hello World!", roundtrip(&sock, "Hello World!"));
+    ASSERT_GE(gethrtime() - begin, LCB_US2NS(LCB_MS2US(50)));
+    ASSERT_GT(getStats().ndelayed, 0U);
+}
+
+TEST_F(SockFaultsTest, testReset)
+{
+    if (!inject("reset=1")) {
+        return;
+    }
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_TRUE(sock.sock == NULL);
+    ASSERT_NE(LCB_SUCCESS, sock.lasterr);
+    ASSERT_EQ(1, getStats().nresets);
+}
+
+TEST_F(SockFaultsTest, testNoMatch)
+{
+    lcb_host_t host;
+    loop->populateHost(&host);
+    string script = "host=";
+    script += host.host;
+    script += ",port=1,reset=1";
+    if (!inject(script)) {
+        return;
+    }
+
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == NULL);
+    ASSERT_EQ("Hello World!", roundtrip(&sock, "Hello World!"));
+    lcbio_FAULTSTATS stats = getStats();
+    ASSERT_EQ(0, stats.nresets);
+    ASSERT_EQ(0, stats.ndelayed);
+    ASSERT_EQ(0, stats.npartial);
+}
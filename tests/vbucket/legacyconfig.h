@@ -0,0 +1,41 @@
+#ifndef LCB_TEST_LEGACYCONFIG_H
+#define LCB_TEST_LEGACYCONFIG_H
+
+#include <sstream>
+#include <string>
+
+// Build a 2.x style (nodes + serverList) configuration for 'nsrv' servers
+static std::string
+genLegacyConfig(unsigned nsrv, unsigned nrepl, unsigned nvb)
+{
+    std::stringstream ss;
+    ss << "{\"name\":\"default\",\"nodeLocator\":\"vbucket\",\"rev\":42,";
+    ss << "\"nodes\":[";
+    for (unsigned ii = 0; ii < nsrv; ii++) {
+        ss << (ii ? "," : "") << "{\"couchApiBase\":\"http:\\/\\/10.0."
+           << ii / 256 << "." << ii % 256 << ":8092\\/default\","
+           << "\"hostname\":\"10.0." << ii / 256 << "." << ii % 256
+           << ":8091\",\"thisNode\":false,\"status\":\"healthy\","
+           << "\"ports\":{\"proxy\":11211,\"direct\":11210}}";
+    }
+    ss << "],\"vBucketServerMap\":{\"hashAlgorithm\":\"CRC\",";
+    ss << "\"numReplicas\":" << nrepl << ",\"serverList\":[";
+    // List the servers in reverse order, to exercise the pairing
+    for (unsigned ii = 0; ii < nsrv; ii++) {
+        unsigned ix = nsrv - ii - 1;
+        ss << (ii ? "," : "") << "\"10.0." << ix / 256 << "." << ix % 256
+           << ":11210\"";
+    }
+    ss << "],\"vBucketMap\":[";
+    for (unsigned ii = 0; ii < nvb; ii++) {
+        ss << (ii ? "," : "") << "[" << ii % nsrv;
+        for (unsigned jj = 0; jj < nrepl; jj++) {
+            ss << "," << (jj ? -1 : (int)((ii + 1) % nsrv));
+        }
+        ss << "]";
+    }
+    ss << "]}}";
+    return ss.str();
+}
+
+#endif
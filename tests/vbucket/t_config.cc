@@ -1,6 +1,7 @@
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/vbucket.h>
 #include <gtest/gtest.h>
+#include "vbucket/legacyconfig.h"
 #include <sstream>
 #include <iostream>
 #include <fstream>
@@ -197,4 +198,213 @@ TEST_F(ConfigTest, testBadInput)
     ASSERT_EQ(-1, rc);
     lcbvb_destroy(cfg);
 
+    // Truncated input
+    string js = getConfigFile("terse_30.json");
+    cfg = lcbvb_create();
+    rc = lcbvb_load_json(cfg, js.substr(0, js.size() / 2).c_str());
+    ASSERT_EQ(-1, rc);
+    lcbvb_destroy(cfg);
+
+    // Malformed vBucket map entries
+    const char *badmaps[] = { "[[0,\"1\"]]", "[[0,1,2,3,4]]", "[0]", "[]" };
+    for (size_t ii = 0; ii < sizeof(badmaps) / sizeof(badmaps[0]); ii++) {
+        string badjs = "{\"name\":\"default\",\"nodeLocator\":\"vbucket\","
+            "\"nodesExt\":[{\"services\":{\"kv\":11210}}],"
+            "\"vBucketServerMap\":{\"numReplicas\":1,\"vBucketMap\":";
+        badjs += badmaps[ii];
+        badjs += "}}";
+        cfg = lcbvb_create();
+        rc = lcbvb_load_json(cfg, badjs.c_str());
+        ASSERT_EQ(-1, rc) << badmaps[ii];
+        lcbvb_destroy(cfg);
+    }
+
+}
+
+TEST_F(ConfigTest, testTrailingData)
+{
+    // The config cache file has a magic string after the JSON
+    string js = getConfigFile("terse_30.json");
+    const char *trailers[] = {
+        "{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}", "\n", "garbage", "]"
+    };
+    for (size_t ii = 0; ii < sizeof(trailers) / sizeof(trailers[0]); ii++) {
+        lcbvb_CONFIG *cfg = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_load_json(cfg, (js + trailers[ii]).c_str())) << trailers[ii];
+        ASSERT_EQ(LCBVB_DIST_VBUCKET, lcbvb_get_distmode(cfg));
+        ASSERT_EQ(1024, cfg->nvb);
+        lcbvb_destroy(cfg);
+    }
+}
+
+static void
+compareConfigs(lcbvb_CONFIG *a, lcbvb_CONFIG *b)
+{
+    ASSERT_EQ(a->dtype, b->dtype);
+    ASSERT_EQ(a->nvb, b->nvb);
+    ASSERT_EQ(a->nsrv, b->nsrv);
+    ASSERT_EQ(a->nrepl, b->nrepl);
+    ASSERT_EQ(a->ncontinuum, b->ncontinuum);
+    ASSERT_EQ(a->revid, b->revid);
+    ASSERT_STREQ(a->bname, b->bname);
+    ASSERT_EQ(a->buuid == NULL, b->buuid == NULL);
+    if (a->buuid) {
+        ASSERT_STREQ(a->buuid, b->buuid);
+    }
+    for (unsigned ii = 0; ii < a->nsrv; ii++) {
+        lcbvb_SERVER *s1 = LCBVB_GET_SERVER(a, ii), *s2 = LCBVB_GET_SERVER(b, ii);
+        ASSERT_STREQ(s1->hostname, s2->hostname);
+        ASSERT_STREQ(s1->authority, s2->authority);
+        ASSERT_EQ(s1->svc.data, s2->svc.data);
+        ASSERT_EQ(s1->svc.views, s2->svc.views);
+        ASSERT_EQ(s1->svc_ssl.mgmt, s2->svc_ssl.mgmt);
+        ASSERT_EQ(s1->nvbs, s2->nvbs);
+        ASSERT_EQ(s1->viewpath == NULL, s2->viewpath == NULL);
+    }
+    // Slots past the replica count are unused, and not always initialized
+    for (unsigned ii = 0; ii < a->nvb; ii++) {
+        ASSERT_EQ(0, memcmp(a->vbuckets[ii].servers, b->vbuckets[ii].servers,
+            sizeof(int) * (a->nrepl + 1))) << "vBucket " << ii;
+    }
+    if (a->ncontinuum) {
+        ASSERT_EQ(0, memcmp(a->continuum, b->continuum,
+            sizeof(*a->continuum) * a->ncontinuum));
+    }
+
+    // Keys must map to the same place
+    for (unsigned ii = 0; ii < 100; ii++) {
+        char key[32];
+        int vb1, vb2, ix1, ix2;
+        sprintf(key, "key_%u", ii);
+        lcbvb_map_key(a, key, strlen(key), &vb1, &ix1);
+        lcbvb_map_key(b, key, strlen(key), &vb2, &ix2);
+        ASSERT_EQ(vb1, vb2);
+        ASSERT_EQ(ix1, ix2);
+    }
+}
+
+TEST_F(ConfigTest, testBinaryRoundtrip)
+{
+    const char *files[] = { "full_25.json", "terse_25.json", "memd_25.json",
+        "terse_30.json", "memd_30.json" };
+    for (size_t ii = 0; ii < sizeof(files) / sizeof(files[0]); ii++) {
+        string testData = getConfigFile(files[ii]);
+        lcbvb_CONFIG *orig = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_load_json(orig, testData.c_str()));
+
+        lcb_SIZE nbytes = 0;
+        void *data = lcbvb_save_binary(orig, &nbytes);
+        ASSERT_TRUE(data != NULL);
+        ASSERT_GT(nbytes, 0);
+
+        int revid = -2;
+        ASSERT_EQ(0, lcbvb_peek_binary_revision(data, nbytes, &revid));
+        ASSERT_EQ(orig->revid, revid);
+
+        lcbvb_CONFIG *copy = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_load_binary(copy, data, nbytes)) << files[ii];
+        compareConfigs(orig, copy);
+        lcbvb_destroy(orig);
+        lcbvb_destroy(copy);
+        free(data);
+    }
+}
+
+TEST_F(ConfigTest, testBinaryBadInput)
+{
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    lcbvb_genconfig(cfg, 4, 1, 64);
+    lcb_SIZE nbytes;
+    char *data = (char *)lcbvb_save_binary(cfg, &nbytes);
+    lcbvb_destroy(cfg);
+
+    // Truncated
+    cfg = lcbvb_create();
+    ASSERT_NE(0, lcbvb_load_binary(cfg, data, nbytes - 4));
+    lcbvb_destroy(cfg);
+
+    // Not a binary config
+    string js = getConfigFile("terse_30.json");
+    cfg = lcbvb_create();
+    ASSERT_NE(0, lcbvb_load_binary(cfg, js.c_str(), js.size()));
+    lcbvb_destroy(cfg);
+
+    // Random corruption must be rejected, or at least produce a usable config
+    srand(0);
+    for (unsigned ii = 0; ii < 1000; ii++) {
+        std::vector<char> copy(data, data + nbytes);
+        copy[rand() % nbytes] ^= (1 << (rand() % 8));
+        cfg = lcbvb_create();
+        if (lcbvb_load_binary(cfg, &copy[0], copy.size()) == 0) {
+            int vbid, srvix;
+            lcbvb_map_key(cfg, "Hello", 5, &vbid, &srvix);
+            ASSERT_LT(srvix, (int)cfg->nsrv);
+        }
+        lcbvb_destroy(cfg);
+    }
+    free(data);
+}
+
+// The file configuration provider loads either copy of the cache; both must
+// give the same configuration. See tests/bench for how long each takes.
+TEST_F(ConfigTest, testBinaryMatchesJson)
+{
+    lcbvb_CONFIG *orig = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(orig, 8, 2, 1024));
+    char *js = lcbvb_save_json(orig);
+    lcb_SIZE nbytes;
+    void *data = lcbvb_save_binary(orig, &nbytes);
+    lcbvb_destroy(orig);
+
+    lcbvb_CONFIG *fromJson = lcbvb_create();
+    lcbvb_CONFIG *fromBinary = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(fromJson, js));
+    ASSERT_EQ(0, lcbvb_load_binary(fromBinary, data, nbytes));
+    compareConfigs(fromJson, fromBinary);
+    lcbvb_destroy(fromJson);
+    lcbvb_destroy(fromBinary);
+    free(js);
+    free(data);
+}
+
+// Both forms of a 1000-node configuration. See tests/bench for how long
+// each takes to load.
+TEST_F(ConfigTest, testLargeConfig)
+{
+    const unsigned nsrv = 1000;
+    lcbvb_CONFIG *orig = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(orig, nsrv, 2, 1024));
+    char *js = lcbvb_save_json(orig);
+    string legacy = genLegacyConfig(nsrv, 2, 1024);
+
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, js));
+    ASSERT_EQ(orig->nsrv, cfg->nsrv);
+    ASSERT_EQ(orig->nvb, cfg->nvb);
+    for (unsigned jj = 0; jj < cfg->nvb; jj++) {
+        ASSERT_EQ(0, memcmp(orig->vbuckets[jj].servers,
+            cfg->vbuckets[jj].servers, sizeof(int) * 3));
+    }
+    for (unsigned jj = 0; jj < nsrv; jj++) {
+        ASSERT_STREQ(orig->servers[jj].authority, cfg->servers[jj].authority);
+        ASSERT_EQ(orig->servers[jj].nvbs, cfg->servers[jj].nvbs);
+    }
+    lcbvb_destroy(cfg);
+
+    cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, legacy.c_str()));
+    ASSERT_EQ(nsrv, cfg->nsrv);
+    ASSERT_EQ(1024, cfg->nvb);
+    ASSERT_EQ(42, cfg->revid);
+    // serverList was reversed, so index 0 is the last node
+    lcbvb_SERVER *srv = LCBVB_GET_SERVER(cfg, 0);
+    ASSERT_STREQ("10.0.3.231:11210", srv->authority);
+    ASSERT_STREQ("/default", srv->viewpath);
+    ASSERT_EQ(8092, srv->svc.views);
+    ASSERT_EQ(8091, srv->svc.mgmt);
+    ASSERT_EQ(-1, cfg->vbuckets[0].servers[2]);
+    lcbvb_destroy(cfg);
+
+    free(js);
+    lcbvb_destroy(orig);
 }
@@ -15,6 +15,7 @@
  *   limitations under the License.
  */
 #include "config.h"
+#include "common/my_inttypes.h"
 #include <sys/types.h>
 #include <libcouchbase/couchbase.h>
 #include <errno.h>
@@ -23,6 +24,8 @@
 #include <sstream>
 #include <queue>
 #include <list>
+#include <vector>
+#include <cmath>
 #include <cstring>
 #include <cassert>
 #include <cstdio>
@@ -36,6 +39,7 @@
 #include <cstdarg>
 #include "common/options.h"
 #include "common/histogram.h"
+#include "common/hdrhistogram.h"
 
 using namespace std;
 using namespace cbc;
@@ -79,7 +83,21 @@ public:
         o_pauseAtEnd("pause-at-end"),
         o_numCycles("num-cycles"),
         o_sequential("sequential"),
-        o_startAt("start-at")
+        o_startAt("start-at"),
+        o_rate("rate"),
+        o_reportInterval("report-interval"),
+        o_outputFormat("output-format"),
+        o_keyDist("key-distribution"),
+        o_zipfTheta("zipf-theta"),
+        o_hotKeys("hotspot-keys"),
+        o_hotAccess("hotspot-access"),
+        o_deletePercent("delete-pct"),
+        o_counterPercent("counter-pct"),
+        o_touchPercent("touch-pct"),
+        o_expiry("expiry"),
+        o_valueType("value-type"),
+        o_jsonTemplate("json-template"),
+        o_getBatch("get-batch")
     {
         o_multiSize.setDefault(100).abbrev('B').description("Number of operations to batch");
         o_numItems.setDefault(1000).abbrev('I').description("Number of items to operate on");
@@ -94,13 +112,87 @@ public:
         o_numCycles.setDefault(-1).abbrev('c').description("Number of cycles to be run until exiting. Set to -1 to loop infinitely");
         o_sequential.setDefault(false).description("Use sequential access (instead of random)");
         o_startAt.setDefault(0).description("For sequential access, set the first item");
+        o_rate.setDefault(0).description("Open-loop mode: target operations per second, per thread. 0 runs closed-loop batches");
+        o_reportInterval.setDefault(1).description("Open-loop mode: seconds between latency reports");
+        o_outputFormat.setDefault("text").argdesc("text|csv|json").description("Open-loop mode: format of latency reports");
+        o_keyDist.setDefault("uniform").argdesc("uniform|sequential|zipfian|hotspot|latest").description("Distribution of keys accessed");
+        o_zipfTheta.setDefault(0.99).description("Skew of the zipfian and latest distributions (0 < theta < 1)");
+        o_hotKeys.setDefault(20).description("For hotspot distribution, the percentage of items which are hot");
+        o_hotAccess.setDefault(80).description("For hotspot distribution, the percentage of operations on hot items");
+        o_deletePercent.setDefault(0).description("The percentage of operations which should be deletions");
+        o_counterPercent.setDefault(0).description("The percentage of operations which should be counter increments");
+        o_touchPercent.setDefault(0).description("The percentage of operations which should be touches");
+        o_expiry.setDefault(0).description("Expiration time (seconds) for stores and touches");
+        o_valueType.setDefault("pattern").argdesc("pattern|random|text|json").description("How values are generated");
+        o_jsonTemplate.description("Template for JSON values. Implies --value-type=json");
+        o_getBatch.setDefault(1).description("Number of keys to fetch in each retrieval");
     }
 
     void processOptions() {
         opsPerCycle = o_multiSize.result();
         prefix = o_keyPrefix.result();
         setprc = o_setPercent.result();
+        delprc = o_deletePercent.result();
+        ctrprc = o_counterPercent.result();
+        touchprc = o_touchPercent.result();
         shouldPopulate = !o_noPopulate.result();
+        getBatch = o_getBatch.result() ? o_getBatch.result() : 1;
+
+        if (setprc + delprc + ctrprc + touchprc > 100) {
+            fprintf(stderr, "The sum of --set-pct, --delete-pct, --counter-pct and --touch-pct may not exceed 100\n");
+            exit(EXIT_FAILURE);
+        }
+
+        string dist = o_keyDist.result();
+        if (o_sequential.result()) {
+            dist = "sequential";
+        }
+        if (dist == "uniform") {
+            keyDist = KEYDIST_UNIFORM;
+        } else if (dist == "sequential") {
+            keyDist = KEYDIST_SEQUENTIAL;
+        } else if (dist == "zipfian") {
+            keyDist = KEYDIST_ZIPFIAN;
+        } else if (dist == "hotspot") {
+            keyDist = KEYDIST_HOTSPOT;
+        } else if (dist == "latest") {
+            keyDist = KEYDIST_LATEST;
+        } else {
+            fprintf(stderr, "Unrecognized --key-distribution `%s`\n", dist.c_str());
+            exit(EXIT_FAILURE);
+        }
+
+        zipfTheta = o_zipfTheta.result();
+        if (zipfTheta <= 0 || zipfTheta >= 1) {
+            fprintf(stderr, "--zipf-theta must be greater than 0 and less than 1\n");
+            exit(EXIT_FAILURE);
+        }
+        if (o_hotKeys.result() > 100 || o_hotAccess.result() > 100) {
+            fprintf(stderr, "--hotspot-keys and --hotspot-access are percentages\n");
+            exit(EXIT_FAILURE);
+        }
+
+        string vtype = o_valueType.result();
+        jsonTemplate = o_jsonTemplate.result();
+        if (!jsonTemplate.empty()) {
+            vtype = "json";
+        }
+        if (vtype == "pattern") {
+            valueType = VALUE_PATTERN;
+        } else if (vtype == "random") {
+            valueType = VALUE_RANDOM;
+        } else if (vtype == "text") {
+            valueType = VALUE_TEXT;
+        } else if (vtype == "json") {
+            valueType = VALUE_JSON;
+            if (jsonTemplate.empty()) {
+                jsonTemplate = "{\"key\":\"{{key}}\",\"seqno\":{{seqno}},"
+                        "\"rand\":{{rand}},\"padding\":\"{{padding}}\"}";
+            }
+        } else {
+            fprintf(stderr, "Unrecognized --value-type `%s`\n", vtype.c_str());
+            exit(EXIT_FAILURE);
+        }
         setPayloadSizes(o_minSize.result(), o_maxSize.result());
 
         if (depr.loop.passed()) {
@@ -114,6 +206,21 @@ public:
             fprintf(stderr, "The --num-iterations/-I option is deprecated. Use --batch-size\n");
             opsPerCycle = depr.iterations.result();
         }
+
+        string fmt = o_outputFormat.result();
+        if (fmt == "csv") {
+            outputFormat = OUTPUT_CSV;
+        } else if (fmt == "json") {
+            outputFormat = OUTPUT_JSON;
+        } else if (fmt == "text") {
+            outputFormat = OUTPUT_TEXT;
+        } else {
+            fprintf(stderr, "Unrecognized --output-format `%s`. Use text, csv or json\n", fmt.c_str());
+            exit(EXIT_FAILURE);
+        }
+        if (o_reportInterval.result() == 0) {
+            o_reportInterval.setDefault(1);
+        }
     }
 
     void addOptions(Parser& parser) {
@@ -130,6 +237,20 @@ public:
         parser.addOption(o_numCycles);
         parser.addOption(o_sequential);
         parser.addOption(o_startAt);
+        parser.addOption(o_rate);
+        parser.addOption(o_reportInterval);
+        parser.addOption(o_outputFormat);
+        parser.addOption(o_keyDist);
+        parser.addOption(o_zipfTheta);
+        parser.addOption(o_hotKeys);
+        parser.addOption(o_hotAccess);
+        parser.addOption(o_deletePercent);
+        parser.addOption(o_counterPercent);
+        parser.addOption(o_touchPercent);
+        parser.addOption(o_expiry);
+        parser.addOption(o_valueType);
+        parser.addOption(o_jsonTemplate);
+        parser.addOption(o_getBatch);
         params.addToParser(parser);
         depr.addOptions(parser);
     }
@@ -138,6 +259,11 @@ public:
         delete []static_cast<char *>(data);
     }
 
+    // Values are taken as slices of this buffer. For random and text values
+    // the buffer is larger than the maximum size so that each value can
+    // start at a different offset and values are not identical.
+    static const size_t VALUE_POOL_SLACK = 8192;
+
     void setPayloadSizes(uint32_t minsz, uint32_t maxsz) {
         if (minsz > maxsz) {
             minsz = maxsz;
@@ -150,17 +276,63 @@ public:
             delete []static_cast<char *>(data);
         }
 
-        data = static_cast<void *>(new char[maxSize]);
+        dataSize = maxSize;
+        if (valueType != VALUE_PATTERN) {
+            dataSize += VALUE_POOL_SLACK;
+        }
+        data = static_cast<void *>(new char[dataSize]);
+
+        if (valueType == VALUE_RANDOM) {
+            fillRandom(static_cast<char *>(data), dataSize);
+        } else if (valueType == VALUE_TEXT || valueType == VALUE_JSON) {
+            fillText(static_cast<char *>(data), dataSize);
+        } else {
+            fillPattern(static_cast<char *>(data), dataSize);
+        }
+    }
+
+    static void fillPattern(char *buf, size_t n) {
         /* fill data array with pattern */
-        uint32_t *iptr = static_cast<uint32_t *>(data);
-        for (uint32_t ii = 0; ii < maxSize / sizeof(uint32_t); ++ii) {
+        uint32_t *iptr = reinterpret_cast<uint32_t *>(buf);
+        for (uint32_t ii = 0; ii < n / sizeof(uint32_t); ++ii) {
             iptr[ii] = 0xdeadbeef;
         }
         /* pad rest bytes with zeros */
-        size_t rest = maxSize % sizeof(uint32_t);
+        size_t rest = n % sizeof(uint32_t);
         if (rest > 0) {
-            char *cptr = static_cast<char *>(data) + (maxSize / sizeof(uint32_t));
-            memset(cptr, 0, rest);
+            memset(buf + (n - rest), 0, rest);
+        }
+    }
+
+    // Incompressible
+    void fillRandom(char *buf, size_t n) {
+        uint64_t state = 0x9E3779B97F4A7C15ULL ^ getRandomSeed();
+        for (size_t ii = 0; ii < n; ++ii) {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            buf[ii] = (char)((state * 0x2545F4914F6CDD1DULL) >> 56);
+        }
+    }
+
+    // Compressible, JSON-safe text made of a small vocabulary
+    void fillText(char *buf, size_t n) {
+        static const char *words[] = {
+            "couchbase", "document", "value", "bucket", "node", "cluster",
+            "replica", "active", "pillow", "fight", "latency", "the", "of",
+            "and", "a", "to", "in", "is", "that", "for"
+        };
+        static const size_t nwords = sizeof(words) / sizeof(words[0]);
+        size_t pos = 0, ix = getRandomSeed();
+        while (pos < n) {
+            const char *w = words[(ix * 7 + ix / 3) % nwords];
+            ix++;
+            for (; *w && pos < n; w++) {
+                buf[pos++] = *w;
+            }
+            if (pos < n) {
+                buf[pos++] = ' ';
+            }
         }
     }
 
@@ -192,14 +364,43 @@ public:
     uint32_t getNumThreads() { return o_numThreads; }
     string& getKeyPrefix() { return prefix; }
     bool shouldPauseAtEnd() { return o_pauseAtEnd; }
-    bool sequentialAccess() { return o_sequential; }
     unsigned firstKeyOffset() { return o_startAt; }
     uint32_t getNumItems() { return o_numItems; }
+    uint32_t getRate() { return o_rate; }
+    bool isOpenLoop() { return o_rate.result() != 0; }
+    uint32_t getReportInterval() { return o_reportInterval; }
+    uint32_t getHotKeysPercent() { return o_hotKeys; }
+    uint32_t getHotAccessPercent() { return o_hotAccess; }
+    uint32_t getExpiry() { return o_expiry; }
+
+    // Total operations to issue in open-loop mode; 0 means unlimited
+    uint64_t getOpenLoopLimit() {
+        if (maxCycles == -1) {
+            return 0;
+        }
+        return (uint64_t)maxCycles * opsPerCycle;
+    }
+
+    enum OutputFormat { OUTPUT_TEXT, OUTPUT_CSV, OUTPUT_JSON };
+    enum KeyDistribution {
+        KEYDIST_UNIFORM, KEYDIST_SEQUENTIAL, KEYDIST_ZIPFIAN, KEYDIST_HOTSPOT,
+        KEYDIST_LATEST
+    };
+    enum ValueType { VALUE_PATTERN, VALUE_RANDOM, VALUE_TEXT, VALUE_JSON };
 
     void *data;
+    size_t dataSize;
 
     uint32_t opsPerCycle;
     unsigned setprc;
+    unsigned delprc;
+    unsigned ctrprc;
+    unsigned touchprc;
+    unsigned getBatch;
+    KeyDistribution keyDist;
+    float zipfTheta;
+    ValueType valueType;
+    string jsonTemplate;
     string prefix;
     uint32_t maxSize;
     uint32_t minSize;
@@ -207,6 +408,7 @@ public:
     bool dgm;
     bool shouldPopulate;
     uint32_t waitTime;
+    OutputFormat outputFormat;
     ConnParams params;
 
 private:
@@ -224,6 +426,20 @@ private:
     IntOption o_numCycles;
     BoolOption o_sequential;
     UIntOption o_startAt;
+    UIntOption o_rate;
+    UIntOption o_reportInterval;
+    StringOption o_outputFormat;
+    StringOption o_keyDist;
+    FloatOption o_zipfTheta;
+    UIntOption o_hotKeys;
+    UIntOption o_hotAccess;
+    UIntOption o_deletePercent;
+    UIntOption o_counterPercent;
+    UIntOption o_touchPercent;
+    UIntOption o_expiry;
+    StringOption o_valueType;
+    StringOption o_jsonTemplate;
+    UIntOption o_getBatch;
     DeprecatedOptions depr;
 } config;
 
@@ -284,40 +500,239 @@ private:
     Histogram hg;
 };
 
+// Small, fast per-thread PRNG (xorshift64*). rand() is neither thread-safe
+// nor uniform enough for skewed distributions.
+class Random {
+public:
+    Random(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    // Returns a value in [0, 1)
+    double nextDouble() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    uint32_t nextBelow(uint32_t n) {
+        return n ? (uint32_t)(next() % n) : 0;
+    }
+
+private:
+    uint64_t state;
+};
+
+// Zipfian distribution over [0, n), as described in "Quickly Generating
+// Billion-Record Synthetic Databases" (Gray et al). Lower numbers are the
+// most popular. This is the same algorithm used by YCSB.
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint32_t n, double theta) : items(n ? n : 1) {
+        zetan = zeta(items, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2 / zetan);
+        halfPowTheta = 1.0 + pow(0.5, theta);
+    }
+
+    uint32_t next(Random& rnd) {
+        double u = rnd.nextDouble();
+        double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < halfPowTheta) {
+            return 1 < items ? 1 : 0;
+        }
+        uint32_t ret = (uint32_t)(items * pow(eta * u - eta + 1, alpha));
+        return ret < items ? ret : items - 1;
+    }
+
+private:
+    static double zeta(uint32_t n, double theta) {
+        double sum = 0;
+        for (uint32_t ii = 0; ii < n; ++ii) {
+            sum += 1.0 / pow(ii + 1.0, theta);
+        }
+        return sum;
+    }
+
+    uint32_t items;
+    double zetan;
+    double alpha;
+    double eta;
+    double halfPowTheta;
+};
+
+// Pre-parsed form of --json-template. The template is split into literal
+// text and placeholders, which are substituted for each generated value:
+//  {{key}} - the document ID
+//  {{seqno}} - the numeric item index
+//  {{rand}} - a random number
+//  {{padding}} - filler text; sized so that the document is roughly the
+//                size selected by --min-size and --max-size
+class JsonTemplate {
+public:
+    void parse(const string& tmpl) {
+        size_t pos = 0;
+        while (pos < tmpl.size()) {
+            size_t begin = tmpl.find("{{", pos);
+            if (begin == string::npos) {
+                addLiteral(tmpl.substr(pos));
+                break;
+            }
+            size_t end = tmpl.find("}}", begin);
+            if (end == string::npos) {
+                addLiteral(tmpl.substr(pos));
+                break;
+            }
+            addLiteral(tmpl.substr(pos, begin - pos));
+            string name = tmpl.substr(begin + 2, end - begin - 2);
+            Segment seg;
+            if (name == "key") {
+                seg.type = SEG_KEY;
+            } else if (name == "seqno") {
+                seg.type = SEG_SEQNO;
+            } else if (name == "rand") {
+                seg.type = SEG_RAND;
+            } else if (name == "padding") {
+                seg.type = SEG_PADDING;
+            } else {
+                // Not a placeholder we know about. Keep it verbatim
+                addLiteral(tmpl.substr(begin, end + 2 - begin));
+                pos = end + 2;
+                continue;
+            }
+            segments.push_back(seg);
+            pos = end + 2;
+        }
+    }
+
+    void render(const string& key, uint32_t seqno, Random& rnd,
+        size_t target, string& out) const {
+        char buf[32];
+        size_t npadding = 0;
+        size_t fixedlen = 0;
+
+        out.clear();
+        // Two passes: the first to compute the fixed length (to size the
+        // padding), the second to emit the value.
+        for (size_t pass = 0; pass < 2; ++pass) {
+            for (size_t ii = 0; ii < segments.size(); ++ii) {
+                const Segment& seg = segments[ii];
+                if (seg.type == SEG_LITERAL) {
+                    if (pass) { out += seg.text; } else { fixedlen += seg.text.size(); }
+                } else if (seg.type == SEG_KEY) {
+                    if (pass) { out += key; } else { fixedlen += key.size(); }
+                } else if (seg.type == SEG_SEQNO || seg.type == SEG_RAND) {
+                    if (!pass) {
+                        fixedlen += 10; // Approximate
+                        continue;
+                    }
+                    uint32_t n = seg.type == SEG_SEQNO ? seqno : (uint32_t)rnd.next();
+                    snprintf(buf, sizeof buf, "%u", n);
+                    out += buf;
+                } else if (seg.type == SEG_PADDING) {
+                    if (!pass) {
+                        npadding++;
+                        continue;
+                    }
+                    size_t padlen = target > fixedlen ? (target - fixedlen) / npadding : 0;
+                    if (padlen > config.dataSize - Configuration::VALUE_POOL_SLACK) {
+                        padlen = config.dataSize - Configuration::VALUE_POOL_SLACK;
+                    }
+                    size_t off = rnd.nextBelow(Configuration::VALUE_POOL_SLACK);
+                    out.append(static_cast<const char *>(config.data) + off, padlen);
+                }
+            }
+        }
+    }
+
+private:
+    enum SegmentType { SEG_LITERAL, SEG_KEY, SEG_SEQNO, SEG_RAND, SEG_PADDING };
+    struct Segment {
+        Segment() : type(SEG_LITERAL) {}
+        SegmentType type;
+        string text;
+    };
+
+    void addLiteral(const string& text) {
+        if (text.empty()) {
+            return;
+        }
+        Segment seg;
+        seg.text = text;
+        segments.push_back(seg);
+    }
+
+    vector<Segment> segments;
+};
+
+enum OpType { OP_GET, OP_SET, OP_DELETE, OP_COUNTER, OP_TOUCH };
+
 struct NextOp {
-    NextOp() : seqno(0), valsize(0), isStore(false) {}
+    NextOp() : seqno(0), valsize(0), value(NULL), type(OP_GET) {}
 
     string key;
+    // Additional keys to retrieve when --get-batch is greater than 1
+    vector<string> batchKeys;
     uint32_t seqno;
     size_t valsize;
-    bool isStore;
+    const void *value;
+    string valueBuf;
+    OpType type;
 };
 
 class KeyGenerator {
 public:
     KeyGenerator(int ix) :
-        currSeqno(0), rnum(0), ngenerated(0), isSequential(false),
-        isPopulate(config.shouldPopulate)
+        currSeqno(0), rnum(0), ngenerated(0), latest(0), rnd(0), zipf(NULL),
+        isSequential(false), isPopulate(config.shouldPopulate)
 {
         srand(config.getRandomSeed());
         for (int ii = 0; ii < 8192; ++ii) {
             seqPool[ii] = rand();
         }
+        rnd = Random(((uint64_t)config.getRandomSeed() << 32) ^ (ix + 1));
         if (isPopulate) {
             isSequential = true;
         } else {
-            isSequential = config.sequentialAccess();
+            isSequential = config.keyDist == Configuration::KEYDIST_SEQUENTIAL;
         }
 
 
         // Maximum number of keys for this thread
         maxKey = config.getNumItems() /  config.getNumThreads();
+        if (maxKey == 0) {
+            maxKey = 1;
+        }
+
+        if (config.keyDist == Configuration::KEYDIST_ZIPFIAN ||
+                config.keyDist == Configuration::KEYDIST_LATEST) {
+            zipf = new ZipfianGenerator(maxKey, config.zipfTheta);
+        }
+        hotKeys = (uint32_t)(((uint64_t)maxKey * config.getHotKeysPercent()) / 100);
+        if (hotKeys == 0) {
+            hotKeys = 1;
+        }
+
+        if (config.valueType == Configuration::VALUE_JSON) {
+            jsonTemplate.parse(config.jsonTemplate);
+        }
 
         offset = config.firstKeyOffset();
         offset += maxKey * ix;
         id = ix;
     }
 
+    ~KeyGenerator() {
+        delete zipf;
+    }
+
     void setNextOp(NextOp& op) {
         bool store_override = false;
 
@@ -327,30 +742,26 @@ public:
             } else {
                 printf("Thread %d has finished populating.\n", id);
                 isPopulate = false;
-                isSequential = config.sequentialAccess();
+                isSequential = config.keyDist == Configuration::KEYDIST_SEQUENTIAL;
             }
         }
 
-        if (isSequential) {
-            rnum++;
-            rnum %= maxKey;
-        } else {
-            rnum += seqPool[currSeqno];
-            currSeqno++;
-            if (currSeqno > 8191) {
-                currSeqno = 0;
-            }
-        }
-
-        op.seqno = rnum;
-
         if (store_override) {
-            op.isStore = true;
+            op.type = OP_SET;
         } else {
-            op.isStore = shouldStore(op.seqno);
+            op.type = nextOpType();
         }
 
-        if (op.isStore) {
+        op.seqno = nextSeqno(op.type != OP_GET);
+        generateKey(op.seqno, op.key);
+
+        op.batchKeys.clear();
+        if (op.type == OP_GET) {
+            for (unsigned ii = 1; ii < config.getBatch; ++ii) {
+                op.batchKeys.push_back(string());
+                generateKey(nextSeqno(false), op.batchKeys.back());
+            }
+        } else if (op.type == OP_SET) {
             size_t size;
             if (config.minSize == config.maxSize) {
                 size = config.minSize;
@@ -358,29 +769,99 @@ public:
                 size = config.minSize + op.seqno % (config.maxSize - config.minSize);
             }
             op.valsize = size;
+            generateValue(op);
+        } else if (op.type == OP_COUNTER) {
+            // Counters live in their own keyspace so they do not clobber
+            // (or fail on) non-numeric documents
+            op.key += ":counter";
         }
-        generateKey(op);
     }
 
-    bool shouldStore(uint32_t seqno) {
-        if (config.setprc == 0) {
-            return false;
+    OpType nextOpType() {
+        uint32_t n = rnd.nextBelow(100);
+        if (n < config.setprc) {
+            return OP_SET;
+        }
+        n -= config.setprc;
+        if (n < config.delprc) {
+            return OP_DELETE;
+        }
+        n -= config.delprc;
+        if (n < config.ctrprc) {
+            return OP_COUNTER;
+        }
+        n -= config.ctrprc;
+        if (n < config.touchprc) {
+            return OP_TOUCH;
+        }
+        return OP_GET;
+    }
+
+    uint32_t nextSeqno(bool isWrite) {
+        if (isSequential) {
+            rnum++;
+            rnum %= maxKey;
+            return rnum;
         }
 
-        float seqno_f = seqno % 100;
-        float pct_f = seqno_f / config.setprc;
-        return pct_f < 1;
+        switch (config.keyDist) {
+        case Configuration::KEYDIST_ZIPFIAN:
+            return zipf->next(rnd);
+
+        case Configuration::KEYDIST_HOTSPOT:
+            if (rnd.nextBelow(100) < config.getHotAccessPercent() || hotKeys >= maxKey) {
+                return rnd.nextBelow(hotKeys);
+            }
+            return hotKeys + rnd.nextBelow(maxKey - hotKeys);
+
+        case Configuration::KEYDIST_LATEST:
+            // Writes advance through the keyspace. Reads favor the most
+            // recently written items.
+            if (isWrite) {
+                latest = (latest + 1) % maxKey;
+                return latest;
+            }
+            return (latest + maxKey - zipf->next(rnd)) % maxKey;
+
+        default:
+            rnum += seqPool[currSeqno];
+            currSeqno++;
+            if (currSeqno > 8191) {
+                currSeqno = 0;
+            }
+            return rnum;
+        }
     }
 
-    void generateKey(NextOp& op) {
-        uint32_t seqno = op.seqno;
+    void generateKey(uint32_t seqno, string& key) {
         seqno %= maxKey;
         seqno += offset-1;
 
         char buffer[21];
         snprintf(buffer, sizeof(buffer), "%020d", seqno);
-        op.key.assign(config.getKeyPrefix() + buffer);
+        key.assign(config.getKeyPrefix() + buffer);
+    }
+
+    void generateValue(NextOp& op) {
+        const char *base = static_cast<const char *>(config.data);
+        switch (config.valueType) {
+        case Configuration::VALUE_JSON:
+            jsonTemplate.render(op.key, op.seqno, rnd, op.valsize, op.valueBuf);
+            op.value = op.valueBuf.c_str();
+            op.valsize = op.valueBuf.size();
+            break;
+        case Configuration::VALUE_RANDOM:
+        case Configuration::VALUE_TEXT:
+            op.value = base + rnd.nextBelow(Configuration::VALUE_POOL_SLACK);
+            break;
+        default:
+            op.value = base;
+            break;
+        }
     }
+
+    bool isPopulating() const { return isPopulate; }
+
     const char *getStageString() const {
         if (isPopulate) {
             return "Populate";
@@ -395,20 +876,176 @@ private:
     uint32_t rnum;
     uint32_t offset;
     uint32_t maxKey;
+    uint32_t hotKeys;
     size_t ngenerated;
+    uint32_t latest;
     int id;
+    Random rnd;
+    ZipfianGenerator *zipf;
+    JsonTemplate jsonTemplate;
 
     bool isSequential;
     bool isPopulate;
 };
 
+class ThreadContext;
+
+// Cookie passed for each scheduled operation. In closed-loop mode every
+// operation shares the thread's own cookie (with `intended` set to 0). In
+// open-loop mode each operation carries the time at which it was supposed
+// to be sent, so that latency includes any time spent queued behind slow
+// responses (avoiding coordinated omission).
+// When an operation consists of several commands (see --get-batch),
+// `remaining` counts the responses still outstanding.
+struct OpCookie {
+    OpCookie(ThreadContext *c, uint64_t t) : ctx(c), intended(t), remaining(0) {}
+    ThreadContext *ctx;
+    uint64_t intended;
+    unsigned remaining;
+};
+
+static void
+writeReportHeader()
+{
+    if (config.outputFormat == Configuration::OUTPUT_CSV) {
+        printf("time,thread,stage,ops,errors,ops_sec,"
+            "min_us,mean_us,p50_us,p90_us,p99_us,p999_us,p9999_us,max_us\n");
+        fflush(stdout);
+    }
+}
+
+static void
+writeReport(int thrid, const char *stage, double elapsed, uint64_t nerrors,
+    const HdrHistogram& h)
+{
+    double now = lcb_nstime() / 1000000000.0;
+    double opsSec = elapsed > 0 ? (double)h.count() / elapsed : 0;
+    double vals[] = {
+        h.min() / 1000.0, h.mean() / 1000.0, h.percentile(50) / 1000.0,
+        h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+        h.percentile(99.9) / 1000.0, h.percentile(99.99) / 1000.0,
+        h.max() / 1000.0
+    };
+
+    // Each report is emitted using a single stdio call so that lines from
+    // different threads do not interleave.
+    if (config.outputFormat == Configuration::OUTPUT_CSV) {
+        printf("%f,%d,%s,%" PRIu64 ",%" PRIu64 ",%.1f,"
+            "%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+            now, thrid, stage, h.count(), nerrors, opsSec,
+            vals[0], vals[1], vals[2], vals[3], vals[4], vals[5], vals[6], vals[7]);
+    } else if (config.outputFormat == Configuration::OUTPUT_JSON) {
+        printf("{\"time\":%f,\"thread\":%d,\"stage\":\"%s\",\"ops\":%" PRIu64 ","
+            "\"errors\":%" PRIu64 ",\"ops_sec\":%.1f,\"latency_us\":{"
+            "\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+            "\"p99.9\":%.1f,\"p99.99\":%.1f,\"max\":%.1f}}\n",
+            now, thrid, stage, h.count(), nerrors, opsSec,
+            vals[0], vals[1], vals[2], vals[3], vals[4], vals[5], vals[6], vals[7]);
+    } else {
+        printf("[%f] Thread %d %s: %" PRIu64 " ops (%.1f/sec), %" PRIu64 " errors\n"
+            "    Latency(us) min=%.1f mean=%.1f p50=%.1f p90=%.1f p99=%.1f "
+            "p99.9=%.1f p99.99=%.1f max=%.1f\n",
+            now, thrid, stage, h.count(), opsSec, nerrors,
+            vals[0], vals[1], vals[2], vals[3], vals[4], vals[5], vals[6], vals[7]);
+    }
+    fflush(stdout);
+}
+
+extern "C" {
+static void pacerCallback(lcb_timer_t, lcb_t, const void *);
+}
+
+// The pacing timer is built on the (deprecated) standalone timer API, which
+// is the only public way to get periodic callbacks from the instance's loop.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+static lcb_timer_t
+createPacer(lcb_t instance, const void *cookie, uint32_t usec)
+{
+    lcb_error_t err = LCB_SUCCESS;
+    lcb_timer_t tm = lcb_timer_create(instance, cookie, usec, 1, pacerCallback, &err);
+    if (err != LCB_SUCCESS) {
+        log("Couldn't create pacing timer: %s", lcb_strerror(instance, err));
+        exit(EXIT_FAILURE);
+    }
+    return tm;
+}
+
+static void
+destroyPacer(lcb_t instance, lcb_timer_t tm)
+{
+    lcb_timer_destroy(instance, tm);
+}
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
 class ThreadContext
 {
 public:
-    ThreadContext(lcb_t handle, int ix) : kgen(ix), niter(0), instance(handle) {
+    ThreadContext(lcb_t handle, int ix) : kgen(ix), niter(0), instance(handle),
+        id(ix), selfCookie(this, 0), pacer(NULL), sendInterval(0), nextSend(0),
+        nissued(0), intervalStart(0), runStart(0), intervalErrors(0),
+        totalErrors(0)
+    {
 
     }
 
+    lcb_error_t scheduleOp(const NextOp& opinfo, OpCookie *cookie) {
+        lcb_error_t rc;
+        switch (opinfo.type) {
+        case OP_SET: {
+            lcb_CMDSTORE scmd = { 0 };
+            scmd.operation = LCB_SET;
+            scmd.exptime = config.getExpiry();
+            LCB_CMD_SET_KEY(&scmd, opinfo.key.c_str(), opinfo.key.size());
+            LCB_CMD_SET_VALUE(&scmd, opinfo.value, opinfo.valsize);
+            rc = lcb_store3(instance, cookie, &scmd);
+            break;
+        }
+        case OP_DELETE: {
+            lcb_CMDREMOVE rcmd = { 0 };
+            LCB_CMD_SET_KEY(&rcmd, opinfo.key.c_str(), opinfo.key.size());
+            rc = lcb_remove3(instance, cookie, &rcmd);
+            break;
+        }
+        case OP_COUNTER: {
+            lcb_CMDCOUNTER ccmd = { 0 };
+            ccmd.delta = 1;
+            ccmd.initial = 0;
+            ccmd.create = 1;
+            LCB_CMD_SET_KEY(&ccmd, opinfo.key.c_str(), opinfo.key.size());
+            rc = lcb_counter3(instance, cookie, &ccmd);
+            break;
+        }
+        case OP_TOUCH: {
+            lcb_CMDTOUCH tcmd = { 0 };
+            tcmd.exptime = config.getExpiry();
+            LCB_CMD_SET_KEY(&tcmd, opinfo.key.c_str(), opinfo.key.size());
+            rc = lcb_touch3(instance, cookie, &tcmd);
+            break;
+        }
+        default: {
+            lcb_CMDGET gcmd = { 0 };
+            LCB_CMD_SET_KEY(&gcmd, opinfo.key.c_str(), opinfo.key.size());
+            rc = lcb_get3(instance, cookie, &gcmd);
+            for (size_t ii = 0; ii < opinfo.batchKeys.size() && rc == LCB_SUCCESS; ++ii) {
+                cookie->remaining++;
+                const string& k = opinfo.batchKeys[ii];
+                LCB_CMD_SET_KEY(&gcmd, k.c_str(), k.size());
+                rc = lcb_get3(instance, cookie, &gcmd);
+            }
+            break;
+        }
+        }
+        if (rc == LCB_SUCCESS) {
+            cookie->remaining++;
+        }
+        return rc;
+    }
+
     void singleLoop() {
         bool hasItems = false;
         lcb_sched_enter(instance);
@@ -416,18 +1053,7 @@ public:
 
         for (size_t ii = 0; ii < config.opsPerCycle; ++ii) {
             kgen.setNextOp(opinfo);
-            if (opinfo.isStore) {
-                lcb_CMDSTORE scmd = { 0 };
-                scmd.operation = LCB_SET;
-                LCB_CMD_SET_KEY(&scmd, opinfo.key.c_str(), opinfo.key.size());
-                LCB_CMD_SET_VALUE(&scmd, config.data, opinfo.valsize);
-                error = lcb_store3(instance, this, &scmd);
-
-            } else {
-                lcb_CMDGET gcmd = { 0 };
-                LCB_CMD_SET_KEY(&gcmd, opinfo.key.c_str(), opinfo.key.size());
-                error = lcb_get3(instance, this, &gcmd);
-            }
+            error = scheduleOp(opinfo, &selfCookie);
             if (error != LCB_SUCCESS) {
                 hasItems = false;
                 log("Failed to schedule operation: [0x%x] %s", error, lcb_strerror(instance, error));
@@ -447,6 +1073,15 @@ public:
     }
 
     bool run() {
+        if (config.isOpenLoop()) {
+            // Population is always done as fast as possible
+            while (kgen.isPopulating() && config.maxCycles != 0) {
+                singleLoop();
+            }
+            runOpenLoop();
+            return true;
+        }
+
         do {
             singleLoop();
             if (config.isTimings()) {
@@ -463,6 +1098,85 @@ public:
         return true;
     }
 
+    // Open-loop mode. Operations are issued at fixed intervals derived from
+    // the target rate regardless of whether previous operations have
+    // completed. A periodic timer wakes up and sends every operation whose
+    // intended send time has passed.
+    void runOpenLoop() {
+        uint32_t rate = config.getRate();
+        sendInterval = 1000000000ULL / rate;
+        if (sendInterval == 0) {
+            sendInterval = 1;
+        }
+
+        // Tick at the send interval, but at least once per millisecond
+        uint32_t tickUsec = (uint32_t)(sendInterval / 1000);
+        if (tickUsec > 1000) {
+            tickUsec = 1000;
+        } else if (tickUsec == 0) {
+            tickUsec = 1;
+        }
+
+        runStart = intervalStart = nextSend = lcb_nstime();
+        pacer = createPacer(instance, this, tickUsec);
+        lcb_wait(instance);
+
+        double elapsed = (lcb_nstime() - runStart) / 1000000000.0;
+        writeReport(id, "total", elapsed, totalErrors, totalHist);
+        if (config.params.shouldDump()) {
+            lcb_dump(instance, stderr, LCB_DUMP_ALL);
+        }
+    }
+
+    void tick() {
+        uint64_t now = lcb_nstime();
+        uint64_t limit = config.getOpenLoopLimit();
+
+        if (config.maxCycles == 0 || (limit && nissued >= limit)) {
+            // Stop sending. lcb_wait() returns once in-flight ops complete
+            destroyPacer(instance, pacer);
+            pacer = NULL;
+        } else if (nextSend <= now) {
+            NextOp opinfo;
+            lcb_sched_enter(instance);
+            while (nextSend <= now && (!limit || nissued < limit)) {
+                kgen.setNextOp(opinfo);
+                OpCookie *cookie = new OpCookie(this, nextSend);
+                lcb_error_t rc = scheduleOp(opinfo, cookie);
+                if (rc != LCB_SUCCESS) {
+                    intervalErrors++;
+                    totalErrors++;
+                    if (!cookie->remaining) {
+                        delete cookie;
+                    }
+                }
+                nextSend += sendInterval;
+                nissued++;
+            }
+            lcb_sched_leave(instance);
+        }
+
+        uint64_t reportNs = (uint64_t)config.getReportInterval() * 1000000000ULL;
+        if (now - intervalStart >= reportNs) {
+            double elapsed = (now - intervalStart) / 1000000000.0;
+            writeReport(id, "interval", elapsed, intervalErrors, intervalHist);
+            intervalHist.reset();
+            intervalErrors = 0;
+            intervalStart = now;
+        }
+    }
+
+    void recordLatency(const OpCookie *cookie, lcb_error_t rc) {
+        uint64_t now = lcb_nstime();
+        uint64_t latency = now > cookie->intended ? now - cookie->intended : 0;
+        if (rc != LCB_SUCCESS && rc != LCB_KEY_ENOENT) {
+            intervalErrors++;
+            totalErrors++;
+        }
+        intervalHist.record(latency);
+        totalHist.record(latency);
+    }
+
 #ifndef WIN32
     pthread_t thr;
 #endif
@@ -479,20 +1193,46 @@ private:
     size_t niter;
     lcb_error_t error;
     lcb_t instance;
+    int id;
+    OpCookie selfCookie;
+
+    // Open-loop state
+    lcb_timer_t pacer;
+    uint64_t sendInterval;
+    uint64_t nextSend;
+    uint64_t nissued;
+    uint64_t intervalStart;
+    uint64_t runStart;
+    uint64_t intervalErrors;
+    uint64_t totalErrors;
+    HdrHistogram intervalHist;
+    HdrHistogram totalHist;
 };
 
+static void pacerCallback(lcb_timer_t, lcb_t, const void *cookie)
+{
+    ThreadContext *tc = const_cast<ThreadContext *>(reinterpret_cast<const ThreadContext *>(cookie));
+    tc->tick();
+}
+
 static void operationCallback(lcb_t, int, const lcb_RESPBASE *resp)
 {
+    OpCookie *cookie;
     ThreadContext *tc;
 
-    tc = const_cast<ThreadContext *>(reinterpret_cast<const ThreadContext *>(resp->cookie));
+    cookie = const_cast<OpCookie *>(reinterpret_cast<const OpCookie *>(resp->cookie));
+    tc = cookie->ctx;
     tc->setError(resp->rc);
+    if (cookie->intended && --cookie->remaining == 0) {
+        tc->recordLatency(cookie, resp->rc);
+        delete cookie;
+    }
 
 #ifndef WIN32
     static volatile unsigned long nops = 1;
     static time_t start_time = time(NULL);
     static int is_tty = isatty(STDOUT_FILENO);
-    if (is_tty) {
+    if (is_tty && !config.isOpenLoop()) {
         if (++nops % 1000 == 0) {
             time_t now = time(NULL);
             time_t nsecs = now - start_time;
@@ -593,6 +1333,9 @@ int main(int argc, char **argv)
     config.processOptions();
     size_t nthreads = config.getNumThreads();
     log("Running. Press Ctrl-C to terminate...");
+    if (config.isOpenLoop()) {
+        writeReportHeader();
+    }
 
 #ifdef WIN32
     if (nthreads > 1) {
@@ -615,6 +1358,9 @@ int main(int argc, char **argv)
         }
         lcb_install_callback3(instance, LCB_CALLBACK_STORE, operationCallback);
         lcb_install_callback3(instance, LCB_CALLBACK_GET, operationCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_REMOVE, operationCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_COUNTER, operationCallback);
+        lcb_install_callback3(instance, LCB_CALLBACK_TOUCH, operationCallback);
         cp.doCtls(instance);
 
         new InstanceCookie(instance);
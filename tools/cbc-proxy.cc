@@ -0,0 +1,836 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Memcached protocol proxy.
+ *
+ * Accepts plain memcached binary protocol connections from clients which know
+ * nothing about vBuckets, and forwards each request to the cluster using
+ * lcb_pktfwd3(). Request packets are handed to the library directly out of
+ * the buffers they were received into, and responses are written back to the
+ * client directly out of the library's read buffers: the only modification
+ * made to either is restoring the client's `opaque` in the response header.
+ *
+ * Responses are returned to each client in the order its requests were
+ * received, regardless of which node serviced them.
+ */
+
+#include "config.h"
+#include "common/my_inttypes.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/api3.h>
+#include <libcouchbase/pktfwd.h>
+#include <memcached/protocol_binary.h>
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include "common/options.h"
+
+using namespace cbc;
+using namespace cliopts;
+using std::vector;
+using std::string;
+
+#define HDRLEN sizeof(protocol_binary_request_header)
+
+/* Size of each receive buffer. Packets larger than this get their own */
+#define CHUNK_SIZE 65536
+
+/* Largest request body accepted from a client */
+#define MAX_BODYLEN (20 * 1024 * 1024 + 1024)
+
+/* Stop reading from a client with this many requests outstanding */
+#define MAX_PENDING 4096
+
+/* Maximum number of IOVs written in a single writev() */
+#define MAX_WRITE_IOVS 64
+
+static void
+log(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buffer, sizeof buffer, format, args);
+    std::cerr << "[cbc-proxy] " << buffer << std::endl;
+    va_end(args);
+}
+
+class Configuration
+{
+public:
+    Configuration() :
+        o_bind("bind"),
+        o_port("port")
+    {
+        o_bind.setDefault("127.0.0.1").argdesc("ADDRESS").description("Address to listen on");
+        o_port.setDefault(11211).description("Port to listen on (0 for any free port)");
+    }
+
+    void addOptions(Parser& parser) {
+        parser.addOption(o_bind);
+        parser.addOption(o_port);
+        params.addToParser(parser);
+    }
+
+    StringOption o_bind;
+    UIntOption o_port;
+    ConnParams params;
+};
+
+static Configuration config;
+
+/**
+ * Reference counted receive buffer. Requests forwarded without copying keep
+ * a reference on the buffer(s) containing them until the library signals
+ * (via the pktflushed callback) that it no longer needs them.
+ */
+struct Chunk {
+    char *data;
+    size_t capacity;
+    size_t used;
+    unsigned refcount;
+
+    static Chunk *create(size_t capacity) {
+        Chunk *chunk = new Chunk;
+        chunk->data = new char[capacity];
+        chunk->capacity = capacity;
+        chunk->used = 0;
+        chunk->refcount = 1;
+        return chunk;
+    }
+    void ref() { refcount++; }
+    void unref() {
+        if (!--refcount) {
+            delete[] data;
+            delete this;
+        }
+    }
+};
+
+class Client;
+
+/**
+ * A single request from a client, and (once received) its response.
+ *
+ * The request is referenced by the client's queue (until its response is
+ * written), by the library's response callback, and - if the packet was not
+ * copied - by the library's flushed callback.
+ */
+struct Request {
+    Client *client;
+    lcb_U8 opcode;
+    lcb_U32 opaque; /* network order, as received */
+    unsigned refcount;
+    bool ready;
+
+    Chunk *chunks[2];
+    unsigned nchunks;
+
+    vector<lcb_IOV> iovs;
+    vector<lcb_BACKBUF> bufs;
+    protocol_binary_response_header synth;
+
+    Request(Client *c, const protocol_binary_request_header& hdr) :
+        client(c), opcode(hdr.request.opcode), opaque(hdr.request.opaque),
+        refcount(1), ready(false), nchunks(0) {
+    }
+
+    void holdChunk(Chunk *chunk) {
+        chunk->ref();
+        chunks[nchunks++] = chunk;
+    }
+
+    void releaseChunks() {
+        for (unsigned ii = 0; ii < nchunks; ii++) {
+            chunks[ii]->unref();
+        }
+        nchunks = 0;
+    }
+
+    void releaseResponse() {
+        for (size_t ii = 0; ii < bufs.size(); ii++) {
+            lcb_backbuf_unref(bufs[ii]);
+        }
+        bufs.clear();
+        iovs.clear();
+    }
+
+    void unref() {
+        if (!--refcount) {
+            releaseChunks();
+            releaseResponse();
+            delete this;
+        }
+    }
+
+    /** Complete the request locally, with an empty response */
+    void setStatus(lcb_U16 status) {
+        memset(&synth, 0, sizeof synth);
+        synth.response.magic = PROTOCOL_BINARY_RES;
+        synth.response.opcode = opcode;
+        synth.response.status = htons(status);
+        synth.response.opaque = opaque;
+        lcb_IOV iov;
+        iov.iov_base = synth.bytes;
+        iov.iov_len = sizeof synth.bytes;
+        iovs.push_back(iov);
+        ready = true;
+    }
+};
+
+class Proxy;
+
+class Client {
+public:
+    Client(Proxy *proxy, int fd);
+    void onEvent(short events);
+    void onResponse();
+
+private:
+    Proxy *proxy;
+    int fd;
+    void *event;
+    short watching;
+
+    /* Receive buffers. `head` contains the start of the first unprocessed
+     * packet (at `hoff`) and `tail` is where data is received into. A packet
+     * is never split across more than these two buffers */
+    Chunk *head;
+    Chunk *tail;
+    size_t hoff;
+
+    std::deque<Request *> pending;
+    size_t woff; /* bytes of the front response already written */
+
+    void readInput();
+    void processInput();
+    void dispatch(size_t pktlen);
+    void forward(Request *req, size_t pktlen);
+    size_t available() const;
+    void peek(char *buf, size_t n) const;
+    void consume(size_t n);
+    void flushOutput();
+    void updateWatch();
+    void close();
+    friend class Proxy;
+};
+
+class Proxy {
+public:
+    lcb_t instance;
+    lcb_io_opt_t io;
+    lcb_ev_procs ev;
+    lcb_loop_procs loop;
+    size_t nclients;
+    lcb_U64 nforwarded;
+    lcb_U64 nlocal;
+
+    Proxy(lcb_t instance);
+    bool listen(const string& address, unsigned port);
+    /** Port actually listened on, if 0 was passed to listen() */
+    unsigned getPort() const { return lsnport; }
+    void run() { loop.start(io); }
+    void accept();
+
+private:
+    int lsnfd;
+    unsigned lsnport;
+    void *lsnev;
+};
+
+extern "C" {
+static void
+client_event(lcb_socket_t, short events, void *arg)
+{
+    reinterpret_cast<Client *>(arg)->onEvent(events);
+}
+
+static void
+listener_event(lcb_socket_t, short, void *arg)
+{
+    reinterpret_cast<Proxy *>(arg)->accept();
+}
+}
+
+static bool
+set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+Proxy::Proxy(lcb_t instance_) :
+    instance(instance_), io(NULL), nclients(0), nforwarded(0), nlocal(0),
+    lsnfd(-1), lsnport(0), lsnev(NULL)
+{
+    memset(&ev, 0, sizeof ev);
+    memset(&loop, 0, sizeof loop);
+}
+
+bool
+Proxy::listen(const string& address, unsigned port)
+{
+    lcb_error_t err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_IOPS, &io);
+    if (err != LCB_SUCCESS) {
+        log("Couldn't get I/O plugin: %s", lcb_strerror(NULL, err));
+        return false;
+    }
+
+    // Client sockets are plain BSD sockets, so the plugin must be able to
+    // watch them for readiness
+    lcb_timer_procs timer;
+    lcb_bsd_procs bsd;
+    lcb_completion_procs completion;
+    lcb_iomodel_t model = LCB_IOMODEL_COMPLETION;
+    memset(&timer, 0, sizeof timer);
+    memset(&bsd, 0, sizeof bsd);
+    memset(&completion, 0, sizeof completion);
+    if (io->version >= 2) {
+        // v2 and v3 tables lay out their fields differently
+        lcb_io_procs_fn get_procs = io->version == 2 ?
+            io->v.v2.get_procs : io->v.v3.get_procs;
+        get_procs(LCB_IOPROCS_VERSION, &loop, &timer, &bsd, &ev,
+            &completion, &model);
+    }
+    if (model != LCB_IOMODEL_EVENT) {
+        log("The I/O plugin must be event-based");
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        log("Invalid listen address '%s'", address.c_str());
+        return false;
+    }
+
+    int one = 1;
+    lsnfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lsnfd == -1 ||
+            setsockopt(lsnfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one) ||
+            bind(lsnfd, (struct sockaddr *)&addr, sizeof addr) ||
+            ::listen(lsnfd, 1024) || !set_nonblocking(lsnfd)) {
+        log("Couldn't listen on %s:%u: %s",
+            address.c_str(), port, strerror(errno));
+        return false;
+    }
+
+    socklen_t addrlen = sizeof addr;
+    if (getsockname(lsnfd, (struct sockaddr *)&addr, &addrlen) != 0) {
+        log("getsockname() failed: %s", strerror(errno));
+        return false;
+    }
+    lsnport = ntohs(addr.sin_port);
+
+    lsnev = ev.create(io);
+    ev.watch(io, lsnfd, lsnev, LCB_READ_EVENT, this, listener_event);
+    return true;
+}
+
+void
+Proxy::accept()
+{
+    for (;;) {
+        int fd = ::accept(lsnfd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log("accept() failed: %s", strerror(errno));
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        if (!set_nonblocking(fd)) {
+            ::close(fd);
+            continue;
+        }
+        new Client(this, fd);
+    }
+}
+
+Client::Client(Proxy *proxy_, int fd_) :
+    proxy(proxy_), fd(fd_), watching(0), hoff(0), woff(0)
+{
+    head = tail = Chunk::create(CHUNK_SIZE);
+    event = proxy->ev.create(proxy->io);
+    proxy->nclients++;
+    updateWatch();
+}
+
+void
+Client::updateWatch()
+{
+    short flags = 0;
+    if (pending.size() < MAX_PENDING) {
+        flags |= LCB_READ_EVENT;
+    }
+    if (!pending.empty() && pending.front()->ready) {
+        flags |= LCB_WRITE_EVENT;
+    }
+    if (flags != watching) {
+        proxy->ev.watch(proxy->io, fd, event, flags, this, client_event);
+        watching = flags;
+    }
+}
+
+void
+Client::onEvent(short events)
+{
+    if (events & LCB_WRITE_EVENT) {
+        flushOutput();
+    }
+    if (fd != -1 && (events & (LCB_READ_EVENT|LCB_ERROR_EVENT))) {
+        readInput();
+    }
+    if (fd == -1) {
+        delete this;
+    } else {
+        updateWatch();
+    }
+}
+
+void
+Client::onResponse()
+{
+    if (!pending.front()->ready) {
+        return; // Waiting for an earlier response
+    }
+    flushOutput();
+    if (fd == -1) {
+        delete this;
+    } else {
+        updateWatch();
+    }
+}
+
+size_t
+Client::available() const
+{
+    if (head == tail) {
+        return tail->used - hoff;
+    }
+    return head->used - hoff + tail->used;
+}
+
+void
+Client::peek(char *buf, size_t n) const
+{
+    size_t first = std::min(n, head->used - hoff);
+    memcpy(buf, head->data + hoff, first);
+    if (first < n) {
+        memcpy(buf + first, tail->data, n - first);
+    }
+}
+
+void
+Client::consume(size_t n)
+{
+    if (head == tail) {
+        hoff += n;
+    } else {
+        hoff = n - (head->used - hoff);
+        head->unref();
+        head = tail;
+    }
+}
+
+void
+Client::readInput()
+{
+    for (;;) {
+        if (tail->used == tail->capacity) {
+            size_t avail = available();
+            size_t wanted = CHUNK_SIZE;
+
+            if (avail >= HDRLEN) {
+                protocol_binary_request_header hdr;
+                peek((char *)hdr.bytes, HDRLEN);
+                wanted = std::max(wanted, HDRLEN + ntohl(hdr.request.bodylen));
+            }
+
+            Chunk *chunk = Chunk::create(wanted);
+            if (head != tail) {
+                // The partial packet already spans two buffers. Move it into
+                // one which can contain it entirely
+                peek(chunk->data, avail);
+                chunk->used = avail;
+                head->unref();
+                tail->unref();
+                head = chunk;
+                hoff = 0;
+            } else if (avail == 0) {
+                head->unref();
+                head = chunk;
+                hoff = 0;
+            }
+            tail = chunk;
+        }
+
+        ssize_t nr = recv(fd, tail->data + tail->used,
+            tail->capacity - tail->used, 0);
+        if (nr > 0) {
+            tail->used += nr;
+            processInput();
+            if (fd == -1 || pending.size() >= MAX_PENDING) {
+                return;
+            }
+        } else if (nr == 0) {
+            close();
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else {
+            close();
+            return;
+        }
+    }
+}
+
+void
+Client::processInput()
+{
+    lcb_sched_enter(proxy->instance);
+    for (;;) {
+        protocol_binary_request_header hdr;
+        size_t avail = available();
+        if (avail < HDRLEN) {
+            break;
+        }
+
+        peek((char *)hdr.bytes, HDRLEN);
+        if (hdr.request.magic != PROTOCOL_BINARY_REQ ||
+                ntohl(hdr.request.bodylen) > MAX_BODYLEN) {
+            log("Closing client which sent an invalid packet");
+            lcb_sched_leave(proxy->instance);
+            close();
+            return;
+        }
+
+        size_t pktlen = HDRLEN + ntohl(hdr.request.bodylen);
+        if (avail < pktlen) {
+            break;
+        }
+        dispatch(pktlen);
+        if (fd == -1) {
+            break;
+        }
+        consume(pktlen);
+    }
+    lcb_sched_leave(proxy->instance);
+    flushOutput();
+}
+
+void
+Client::dispatch(size_t pktlen)
+{
+    protocol_binary_request_header hdr;
+    peek((char *)hdr.bytes, HDRLEN);
+    Request *req = new Request(this, hdr);
+    pending.push_back(req);
+
+    switch (hdr.request.opcode) {
+    case PROTOCOL_BINARY_CMD_GET:
+    case PROTOCOL_BINARY_CMD_GETK:
+    case PROTOCOL_BINARY_CMD_SET:
+    case PROTOCOL_BINARY_CMD_ADD:
+    case PROTOCOL_BINARY_CMD_REPLACE:
+    case PROTOCOL_BINARY_CMD_DELETE:
+    case PROTOCOL_BINARY_CMD_INCREMENT:
+    case PROTOCOL_BINARY_CMD_DECREMENT:
+    case PROTOCOL_BINARY_CMD_APPEND:
+    case PROTOCOL_BINARY_CMD_PREPEND:
+    case PROTOCOL_BINARY_CMD_TOUCH:
+    case PROTOCOL_BINARY_CMD_GAT:
+    case PROTOCOL_BINARY_CMD_GET_LOCKED:
+    case PROTOCOL_BINARY_CMD_UNLOCK_KEY:
+        if (hdr.request.keylen) {
+            forward(req, pktlen);
+        } else {
+            req->setStatus(PROTOCOL_BINARY_RESPONSE_EINVAL);
+            proxy->nlocal++;
+        }
+        break;
+
+    case PROTOCOL_BINARY_CMD_NOOP:
+        req->setStatus(PROTOCOL_BINARY_RESPONSE_SUCCESS);
+        proxy->nlocal++;
+        break;
+
+    default:
+        // Quiet commands (which may not receive a reply), and commands which
+        // aren't directed at a single key cannot be forwarded
+        req->setStatus(PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED);
+        proxy->nlocal++;
+        break;
+    }
+}
+
+void
+Client::forward(Request *req, size_t pktlen)
+{
+    lcb_CMDPKTFWD cmd = { 0 };
+    lcb_IOV iov[2];
+    vector<char> copied;
+    size_t first = std::min(pktlen, head->used - hoff);
+    size_t nheader;
+    bool nocopy = true;
+
+    {
+        protocol_binary_request_header hdr;
+        peek((char *)hdr.bytes, HDRLEN);
+        nheader = HDRLEN + hdr.request.extlen + ntohs(hdr.request.keylen);
+    }
+
+    if (first == pktlen) {
+        cmd.vb.vtype = LCB_KV_CONTIG;
+        cmd.vb.u_buf.contig.bytes = head->data + hoff;
+        cmd.vb.u_buf.contig.nbytes = pktlen;
+        req->holdChunk(head);
+
+    } else if (first >= nheader) {
+        // The value straddles the two buffers. Pass both fragments
+        iov[0].iov_base = head->data + hoff;
+        iov[0].iov_len = first;
+        iov[1].iov_base = tail->data;
+        iov[1].iov_len = pktlen - first;
+        cmd.vb.vtype = LCB_KV_IOV;
+        cmd.vb.u_buf.multi.iov = iov;
+        cmd.vb.u_buf.multi.niov = 2;
+        cmd.vb.u_buf.multi.total_length = pktlen;
+        req->holdChunk(head);
+        req->holdChunk(tail);
+
+    } else {
+        // The header itself is fragmented. The library would copy it anyway,
+        // and would not signal when it was done with the value, so just copy
+        // the entire packet
+        copied.resize(pktlen);
+        peek(&copied[0], pktlen);
+        cmd.vb.vtype = LCB_KV_COPY;
+        cmd.vb.u_buf.contig.bytes = &copied[0];
+        cmd.vb.u_buf.contig.nbytes = pktlen;
+        nocopy = false;
+    }
+
+    // References for the response and flushed callbacks
+    req->refcount += nocopy ? 2 : 1;
+
+    lcb_error_t err = lcb_pktfwd3(proxy->instance, req, &cmd);
+    if (err != LCB_SUCCESS) {
+        req->refcount -= nocopy ? 2 : 1;
+        req->releaseChunks();
+        req->setStatus(err == LCB_CLIENT_ENOMEM ?
+            PROTOCOL_BINARY_RESPONSE_ENOMEM : PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+        proxy->nlocal++;
+    } else {
+        proxy->nforwarded++;
+    }
+}
+
+void
+Client::flushOutput()
+{
+    while (fd != -1 && !pending.empty() && pending.front()->ready) {
+        struct iovec iov[MAX_WRITE_IOVS];
+        int niov = 0;
+        size_t skip = woff;
+
+        for (std::deque<Request *>::iterator it = pending.begin();
+                it != pending.end() && (*it)->ready; ++it) {
+            const vector<lcb_IOV>& riovs = (*it)->iovs;
+            for (size_t ii = 0; ii < riovs.size() && niov < MAX_WRITE_IOVS; ii++) {
+                if (skip >= riovs[ii].iov_len) {
+                    skip -= riovs[ii].iov_len;
+                    continue;
+                }
+                iov[niov].iov_base = (char *)riovs[ii].iov_base + skip;
+                iov[niov].iov_len = riovs[ii].iov_len - skip;
+                niov++;
+                skip = 0;
+            }
+            if (niov == MAX_WRITE_IOVS) {
+                break;
+            }
+        }
+
+        ssize_t nw = writev(fd, iov, niov);
+        if (nw == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close();
+            }
+            return;
+        }
+
+        // Retire the responses which were written in full
+        size_t written = woff + nw;
+        while (!pending.empty() && pending.front()->ready) {
+            Request *req = pending.front();
+            size_t total = 0;
+            for (size_t ii = 0; ii < req->iovs.size(); ii++) {
+                total += req->iovs[ii].iov_len;
+            }
+            if (written < total) {
+                break;
+            }
+            written -= total;
+            pending.pop_front();
+            req->client = NULL;
+            req->releaseResponse();
+            req->unref();
+        }
+        woff = written;
+    }
+}
+
+void
+Client::close()
+{
+    proxy->ev.cancel(proxy->io, fd, event);
+    proxy->ev.destroy(proxy->io, event);
+    ::close(fd);
+    fd = -1;
+
+    for (size_t ii = 0; ii < pending.size(); ii++) {
+        Request *req = pending[ii];
+        req->client = NULL;
+        req->releaseResponse();
+        req->unref();
+    }
+    pending.clear();
+    if (head != tail) {
+        head->unref();
+    }
+    tail->unref();
+    proxy->nclients--;
+    // The object itself is deleted by the outermost event handler, once it
+    // sees the descriptor has been closed
+}
+
+extern "C" {
+static void
+pktfwd_callback(lcb_t, const void *cookie, lcb_error_t err,
+    lcb_PKTFWDRESP *resp)
+{
+    Request *req = (Request *)cookie;
+    Client *client = req->client;
+
+    if (client == NULL) {
+        // Client has disconnected
+        req->unref();
+        return;
+    }
+
+    if (err != LCB_SUCCESS || resp == NULL || resp->nitems == 0) {
+        req->setStatus(err == LCB_CLIENT_ENOMEM ?
+            PROTOCOL_BINARY_RESPONSE_ENOMEM : PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+    } else {
+        for (unsigned ii = 0; ii < resp->nitems; ii++) {
+            lcb_backbuf_ref(resp->bufs[ii]);
+            req->bufs.push_back(resp->bufs[ii]);
+            req->iovs.push_back(resp->iovs[ii]);
+        }
+        // The response is contiguous, so its header is at the start of the
+        // first IOV. The library assigned its own opaque, put the client's back
+        protocol_binary_response_header *hdr =
+                (protocol_binary_response_header *)resp->iovs[0].iov_base;
+        hdr->response.opaque = req->opaque;
+        req->ready = true;
+    }
+    req->unref();
+
+    client->onResponse();
+}
+
+static void
+pktflushed_callback(lcb_t, const void *cookie)
+{
+    Request *req = (Request *)cookie;
+    req->releaseChunks();
+    req->unref();
+}
+}
+
+int main(int argc, char **argv)
+{
+    lcb_error_t err;
+    lcb_t instance;
+    struct lcb_create_st cropts;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    Parser parser("cbc-proxy");
+    config.addOptions(parser);
+    parser.parse(argc, argv, false);
+
+    config.params.fillCropts(cropts);
+    err = lcb_create(&instance, &cropts);
+    if (err != LCB_SUCCESS) {
+        log("Failed to create instance: %s", lcb_strerror(NULL, err));
+        exit(EXIT_FAILURE);
+    }
+    config.params.doCtls(instance);
+    lcb_set_pktfwd_callback(instance, pktfwd_callback);
+    lcb_set_pktflushed_callback(instance, pktflushed_callback);
+
+    lcb_connect(instance);
+    lcb_wait(instance);
+    err = lcb_get_bootstrap_status(instance);
+    if (err != LCB_SUCCESS) {
+        log("Failed to connect: %s", lcb_strerror(instance, err));
+        exit(EXIT_FAILURE);
+    }
+
+    Proxy proxy(instance);
+    if (!proxy.listen(config.o_bind.result(), config.o_port.result())) {
+        exit(EXIT_FAILURE);
+    }
+
+    log("Listening on %s:%u", config.o_bind.result().c_str(), proxy.getPort());
+    proxy.run();
+
+    // Responses to clients may still be in flight; don't wait for them
+    return EXIT_SUCCESS;
+}
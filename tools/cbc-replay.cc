@@ -0,0 +1,479 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2014 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Traffic replay.
+ *
+ * Reads a capture written by the library (see LCB_CNTL_CAPTURE_PATH) and
+ * re-issues the requests the captured connections sent, using lcb_pktfwd3(),
+ * at the times they were originally sent (optionally sped up or slowed
+ * down). This reproduces a recorded load shape against another cluster, or
+ * against the stand-in server in tests/kvserver, without writing a workload
+ * by hand.
+ *
+ * Requests are mapped to nodes by their keys, so the target may have a
+ * different number of nodes than the captured cluster. Requests which can't
+ * be forwarded that way are skipped: those without a key (such as the NOOPs
+ * ending batches of quiet GETs), and "quiet" mutations which don't always get
+ * a reply. Quiet reads are replayed as their regular counterparts.
+ *
+ * Latencies are measured from the time each request should have been sent,
+ * so a target which can't keep up shows as such.
+ */
+
+#include "config.h"
+#include "common/my_inttypes.h"
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/api3.h>
+#include <libcouchbase/pktfwd.h>
+#include <memcached/protocol_binary.h>
+#include <lcbio/capture.h>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include "common/options.h"
+#include "common/hdrhistogram.h"
+
+using namespace cbc;
+using namespace cliopts;
+using std::vector;
+using std::string;
+using std::map;
+
+#define HDRLEN sizeof(protocol_binary_request_header)
+
+/* Stop sending with this many requests outstanding, until some complete */
+#define MAX_PENDING 4096
+
+/* Interval of the pacing timer, in microseconds */
+#define TICK_USEC 1000
+
+static void
+log(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buffer, sizeof buffer, format, args);
+    std::cerr << "[cbc-replay] " << buffer << std::endl;
+    va_end(args);
+}
+
+class Configuration
+{
+public:
+    Configuration() :
+        o_file("file"),
+        o_speed("speed")
+    {
+        o_file.abbrev('f').argdesc("PATH").mandatory().description("Capture to replay");
+        o_speed.setDefault(1).description("Multiplier for the original rate: 2 replays twice as fast, 0 as fast as possible");
+    }
+
+    void addOptions(Parser& parser) {
+        parser.addOption(o_file);
+        parser.addOption(o_speed);
+        params.addToParser(parser);
+    }
+
+    StringOption o_file;
+    FloatOption o_speed;
+    ConnParams params;
+};
+
+static Configuration config;
+
+/* Regular command for a quiet read, as the library retries them */
+static lcb_U8
+unquietOpcode(lcb_U8 opcode)
+{
+    switch (opcode) {
+    case PROTOCOL_BINARY_CMD_GETQ:
+        return PROTOCOL_BINARY_CMD_GET;
+    case PROTOCOL_BINARY_CMD_GETKQ:
+        return PROTOCOL_BINARY_CMD_GETK;
+    case PROTOCOL_BINARY_CMD_GATQ:
+        return PROTOCOL_BINARY_CMD_GAT;
+    default:
+        return opcode;
+    }
+}
+
+static bool
+isQuiet(lcb_U8 opcode)
+{
+    switch (opcode) {
+    case PROTOCOL_BINARY_CMD_GETQ:
+    case PROTOCOL_BINARY_CMD_GETKQ:
+    case PROTOCOL_BINARY_CMD_SETQ:
+    case PROTOCOL_BINARY_CMD_ADDQ:
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+    case PROTOCOL_BINARY_CMD_DELETEQ:
+    case PROTOCOL_BINARY_CMD_INCREMENTQ:
+    case PROTOCOL_BINARY_CMD_DECREMENTQ:
+    case PROTOCOL_BINARY_CMD_QUITQ:
+    case PROTOCOL_BINARY_CMD_FLUSHQ:
+    case PROTOCOL_BINARY_CMD_APPENDQ:
+    case PROTOCOL_BINARY_CMD_PREPENDQ:
+    case PROTOCOL_BINARY_CMD_GATQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static lcb_U32
+getBE(const char *buf, unsigned n)
+{
+    lcb_U32 value = 0;
+    for (unsigned ii = 0; ii < n; ii++) {
+        value = (value << 8) | (lcb_U8)buf[ii];
+    }
+    return value;
+}
+
+/** The requests of a capture, in the order they were sent */
+class Capture
+{
+public:
+    struct Request {
+        lcb_U64 when; // Microseconds since the start of the capture
+        size_t offset; // In #packets
+        lcb_U32 length;
+    };
+
+    Capture() : nskipped(0), nconns(0), truncated(false) {}
+
+    bool load(const string& path, string& errmsg) {
+        std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) {
+            errmsg = "Couldn't open " + path;
+            return false;
+        }
+        string data((std::istreambuf_iterator<char>(ifs)),
+            std::istreambuf_iterator<char>());
+        size_t nmagic = sizeof(LCBIO_CAPTURE_MAGIC) - 1;
+        if (data.compare(0, nmagic, LCBIO_CAPTURE_MAGIC) != 0) {
+            errmsg = path + " is not a capture";
+            return false;
+        }
+
+        map<lcb_U64, string> streams; // Unparsed requests, by connection
+        size_t pos = nmagic;
+        lcb_U64 now = 0;
+        while (pos < data.size()) {
+            lcb_U64 elapsed, connkey, nbytes;
+            if (!getVarint(data, pos, elapsed) ||
+                    !getVarint(data, pos, connkey) ||
+                    !getVarint(data, pos, nbytes) ||
+                    nbytes > data.size() - pos) {
+                truncated = true;
+                break;
+            }
+            now += elapsed;
+
+            lcb_U64 connid = connkey >> 2;
+            switch (connkey & 3) {
+            case LCBIO_CAPTURE_OPEN:
+                streams[connid].clear();
+                nconns++;
+                break;
+            case LCBIO_CAPTURE_SEND: {
+                string& stream = streams[connid];
+                stream.append(data, pos, nbytes);
+                addRequests(stream, now);
+                break;
+            }
+            case LCBIO_CAPTURE_CLOSE:
+                streams.erase(connid);
+                break;
+            default:
+                break;
+            }
+            pos += nbytes;
+        }
+        return true;
+    }
+
+    const vector<Request>& getRequests() const { return requests; }
+    const char *getPacket(const Request& req) const { return &packets[req.offset]; }
+
+    size_t nskipped;
+    size_t nconns;
+    bool truncated;
+
+private:
+    static bool getVarint(const string& data, size_t& pos, lcb_U64& value) {
+        value = 0;
+        for (unsigned shift = 0; pos < data.size() && shift < 64; shift += 7) {
+            lcb_U8 cur = data[pos++];
+            value |= (lcb_U64)(cur & 0x7f) << shift;
+            if (!(cur & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Take the complete requests off the front of a connection's stream
+    void addRequests(string& stream, lcb_U64 now) {
+        size_t pos = 0;
+        while (stream.size() - pos >= HDRLEN) {
+            const char *hdr = stream.data() + pos;
+            if ((lcb_U8)hdr[0] != PROTOCOL_BINARY_REQ) {
+                // Lost track of the framing; the rest of it is unusable
+                log("Garbage in a request stream. Skipping %lu bytes",
+                    (unsigned long)(stream.size() - pos));
+                pos = stream.size();
+                break;
+            }
+            lcb_U32 pktlen = HDRLEN + getBE(hdr + 8, 4);
+            if (stream.size() - pos < pktlen) {
+                break;
+            }
+            lcb_U8 opcode = unquietOpcode(hdr[1]);
+            if (getBE(hdr + 2, 2) == 0 || isQuiet(opcode)) {
+                nskipped++;
+            } else {
+                Request req;
+                req.when = now;
+                req.offset = packets.size();
+                req.length = pktlen;
+                packets.insert(packets.end(), hdr, hdr + pktlen);
+                packets[req.offset + 1] = opcode;
+                requests.push_back(req);
+            }
+            pos += pktlen;
+        }
+        stream.erase(0, pos);
+    }
+
+    vector<char> packets;
+    vector<Request> requests;
+};
+
+extern "C" {
+static void pacerCallback(lcb_timer_t, lcb_t, const void *);
+static void pktfwdCallback(lcb_t, const void *, lcb_error_t, lcb_PKTFWDRESP *);
+}
+
+// As in cbc-pillowfight, the (deprecated) standalone timer API is the only
+// public way to get periodic callbacks from the instance's loop.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+static lcb_timer_t
+createPacer(lcb_t instance, const void *cookie, uint32_t usec)
+{
+    lcb_error_t err = LCB_SUCCESS;
+    lcb_timer_t tm = lcb_timer_create(instance, cookie, usec, 1, pacerCallback, &err);
+    if (err != LCB_SUCCESS) {
+        log("Couldn't create pacing timer: %s", lcb_strerror(instance, err));
+        exit(EXIT_FAILURE);
+    }
+    return tm;
+}
+
+static void
+destroyPacer(lcb_t instance, lcb_timer_t tm)
+{
+    lcb_timer_destroy(instance, tm);
+}
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+class Replayer
+{
+public:
+    Replayer(lcb_t handle, const Capture& cap, double speedup) :
+        instance(handle), capture(cap), requests(cap.getRequests()),
+        speed(speedup), pacer(NULL), next(0), npending(0), nfailed(0),
+        start(0)
+    {
+        lcb_set_cookie(instance, this);
+        lcb_set_pktfwd_callback(instance, pktfwdCallback);
+    }
+
+    void run() {
+        if (requests.empty()) {
+            return;
+        }
+        start = lcb_nstime();
+        pacer = createPacer(instance, this, TICK_USEC);
+        tick(); // Rather than a whole interval late
+        lcb_wait(instance);
+    }
+
+    void tick() {
+        lcb_U64 now = lcb_nstime();
+        lcb_sched_enter(instance);
+        while (next < requests.size() && npending < MAX_PENDING &&
+                intendedTime(next) <= now) {
+            send(next++);
+        }
+        lcb_sched_leave(instance);
+        if (next == requests.size()) {
+            // lcb_wait() returns once the outstanding requests complete
+            destroyPacer(instance, pacer);
+            pacer = NULL;
+        }
+    }
+
+    void onResponse(size_t ix, lcb_error_t err, const lcb_PKTFWDRESP *resp) {
+        lcb_U64 now = lcb_nstime();
+        lcb_U64 intended = intendedTime(ix);
+        latencies.record(now > intended ? now - intended : 0);
+        npending--;
+
+        if (err != LCB_SUCCESS || resp == NULL || resp->header == NULL) {
+            nfailed++;
+        } else {
+            lcb_U16 status = getBE((const char *)resp->header + 6, 2);
+            if (status != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                statuses[status]++;
+            }
+        }
+    }
+
+    void report() {
+        double elapsed = start ? (lcb_nstime() - start) / 1000000000.0 : 0;
+        double original = requests.empty() ? 0 :
+            (requests.back().when - requests.front().when) / 1000000.0;
+        printf("Replayed %lu requests from %lu connections in %.3fs "
+            "(originally %.3fs), %lu skipped\n",
+            (unsigned long)requests.size(), (unsigned long)capture.nconns,
+            elapsed, original, (unsigned long)capture.nskipped);
+        printf("Failed: %" PRIu64 "\n", nfailed);
+        for (map<lcb_U16, lcb_U64>::const_iterator it = statuses.begin();
+                it != statuses.end(); ++it) {
+            printf("Status 0x%02x: %" PRIu64 "\n", it->first, it->second);
+        }
+        printf("Latency(us) min=%.1f mean=%.1f p50=%.1f p90=%.1f p99=%.1f "
+            "p99.9=%.1f max=%.1f\n",
+            latencies.min() / 1000.0, latencies.mean() / 1000.0,
+            latencies.percentile(50) / 1000.0, latencies.percentile(90) / 1000.0,
+            latencies.percentile(99) / 1000.0, latencies.percentile(99.9) / 1000.0,
+            latencies.max() / 1000.0);
+    }
+
+private:
+    lcb_U64 intendedTime(size_t ix) const {
+        if (speed <= 0) {
+            return start;
+        }
+        lcb_U64 offset = requests[ix].when - requests.front().when;
+        return start + (lcb_U64)(offset * 1000 / speed);
+    }
+
+    void send(size_t ix) {
+        const Capture::Request& req = requests[ix];
+        lcb_CMDPKTFWD cmd = { 0 };
+        cmd.vb.vtype = LCB_KV_COPY;
+        cmd.vb.u_buf.contig.bytes = capture.getPacket(req);
+        cmd.vb.u_buf.contig.nbytes = req.length;
+        lcb_error_t err = lcb_pktfwd3(instance, (const void *)(uintptr_t)ix, &cmd);
+        if (err == LCB_SUCCESS) {
+            npending++;
+        } else {
+            nfailed++;
+        }
+    }
+
+    lcb_t instance;
+    const Capture& capture;
+    const vector<Capture::Request>& requests;
+    double speed;
+    lcb_timer_t pacer;
+    size_t next;
+    size_t npending;
+    lcb_U64 nfailed;
+    lcb_U64 start;
+    map<lcb_U16, lcb_U64> statuses; // Unsuccessful replies
+    HdrHistogram latencies;
+};
+
+extern "C" {
+static void
+pacerCallback(lcb_timer_t, lcb_t, const void *cookie)
+{
+    ((Replayer *)cookie)->tick();
+}
+
+static void
+pktfwdCallback(lcb_t instance, const void *cookie, lcb_error_t err,
+    lcb_PKTFWDRESP *resp)
+{
+    Replayer *replayer = (Replayer *)lcb_get_cookie(instance);
+    replayer->onResponse((size_t)(uintptr_t)cookie, err, resp);
+}
+}
+
+int main(int argc, char **argv)
+{
+    lcb_error_t err;
+    lcb_t instance;
+    struct lcb_create_st cropts;
+
+    Parser parser("cbc-replay");
+    config.addOptions(parser);
+    parser.parse(argc, argv, false);
+
+    Capture capture;
+    string errmsg;
+    if (!capture.load(config.o_file.result(), errmsg)) {
+        log("%s", errmsg.c_str());
+        exit(EXIT_FAILURE);
+    }
+    if (capture.truncated) {
+        log("Capture is truncated; replaying what precedes the cut");
+    }
+
+    config.params.fillCropts(cropts);
+    err = lcb_create(&instance, &cropts);
+    if (err != LCB_SUCCESS) {
+        log("Failed to create instance: %s", lcb_strerror(NULL, err));
+        exit(EXIT_FAILURE);
+    }
+    config.params.doCtls(instance);
+
+    lcb_connect(instance);
+    lcb_wait(instance);
+    err = lcb_get_bootstrap_status(instance);
+    if (err != LCB_SUCCESS) {
+        log("Failed to connect: %s", lcb_strerror(instance, err));
+        exit(EXIT_FAILURE);
+    }
+
+    Replayer replayer(instance, capture, config.o_speed.result());
+    replayer.run();
+    replayer.report();
+    if (config.params.shouldDump()) {
+        lcb_dump(instance, stderr, LCB_DUMP_ALL);
+    }
+    lcb_destroy(instance);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+#include "hdrhistogram.h"
+#include <math.h>
+using namespace cbc;
+
+// 2^11 sub-buckets gives a worst-case relative error of 1/1024
+#define SUB_BUCKET_BITS 11
+#define SUB_BUCKET_HALF_BITS (SUB_BUCKET_BITS - 1)
+#define SUB_BUCKET_HALF (1U << SUB_BUCKET_HALF_BITS)
+#define SUB_BUCKET_MASK ((1U << SUB_BUCKET_BITS) - 1)
+#define BUCKET_COUNT 27
+#define HIGHEST_TRACKABLE ((((uint64_t)SUB_BUCKET_MASK + 1) << (BUCKET_COUNT - 1)) - 1)
+
+static unsigned
+bit_length(uint64_t v)
+{
+    unsigned n = 0;
+    if (v >> 32) { n += 32; v >>= 32; }
+    if (v >> 16) { n += 16; v >>= 16; }
+    if (v >> 8) { n += 8; v >>= 8; }
+    if (v >> 4) { n += 4; v >>= 4; }
+    if (v >> 2) { n += 2; v >>= 2; }
+    if (v >> 1) { n += 1; v >>= 1; }
+    return n + (unsigned)v;
+}
+
+HdrHistogram::HdrHistogram() :
+    counts((BUCKET_COUNT + 1) * SUB_BUCKET_HALF)
+{
+    reset();
+}
+
+size_t
+HdrHistogram::indexOf(uint64_t value) const
+{
+    unsigned bucket = bit_length(value | SUB_BUCKET_MASK) - SUB_BUCKET_BITS;
+    uint64_t sub = value >> bucket;
+    return ((size_t)(bucket + 1) << SUB_BUCKET_HALF_BITS) + (size_t)(sub - SUB_BUCKET_HALF);
+}
+
+uint64_t
+HdrHistogram::valueAt(size_t index) const
+{
+    int bucket = (int)(index >> SUB_BUCKET_HALF_BITS) - 1;
+    uint64_t sub = (index & (SUB_BUCKET_HALF - 1)) + SUB_BUCKET_HALF;
+    if (bucket < 0) {
+        sub -= SUB_BUCKET_HALF;
+        bucket = 0;
+    }
+    // Return the highest value which maps to this slot
+    return (sub << bucket) + ((uint64_t)1 << bucket) - 1;
+}
+
+void
+HdrHistogram::record(uint64_t value)
+{
+    if (value > HIGHEST_TRACKABLE) {
+        value = HIGHEST_TRACKABLE;
+    }
+    counts[indexOf(value)]++;
+    total++;
+    sum += value;
+    if (value < minval) {
+        minval = value;
+    }
+    if (value > maxval) {
+        maxval = value;
+    }
+}
+
+void
+HdrHistogram::add(const HdrHistogram& other)
+{
+    for (size_t ii = 0; ii < counts.size(); ++ii) {
+        counts[ii] += other.counts[ii];
+    }
+    total += other.total;
+    sum += other.sum;
+    if (other.total && other.minval < minval) {
+        minval = other.minval;
+    }
+    if (other.maxval > maxval) {
+        maxval = other.maxval;
+    }
+}
+
+void
+HdrHistogram::reset()
+{
+    for (size_t ii = 0; ii < counts.size(); ++ii) {
+        counts[ii] = 0;
+    }
+    total = 0;
+    sum = 0;
+    minval = (uint64_t)-1;
+    maxval = 0;
+}
+
+uint64_t
+HdrHistogram::percentile(double pct) const
+{
+    if (!total) {
+        return 0;
+    }
+    if (pct > 100) {
+        pct = 100;
+    }
+
+    uint64_t target = (uint64_t)ceil(pct / 100.0 * (double)total);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t ii = 0; ii < counts.size(); ++ii) {
+        seen += counts[ii];
+        if (seen >= target) {
+            uint64_t v = valueAt(ii);
+            return v > maxval ? maxval : v;
+        }
+    }
+    return maxval;
+}
@@ -0,0 +1,44 @@
+#ifndef CBC_HDRHISTOGRAM_H
+#define CBC_HDRHISTOGRAM_H
+#include "my_inttypes.h"
+#include <stddef.h>
+#include <vector>
+
+namespace cbc {
+
+/**
+ * Log-linear latency histogram in the style of HdrHistogram.
+ *
+ * Values (nanoseconds) are recorded with three significant digits of
+ * precision: each power-of-two range is split into 1024 linear sub-buckets.
+ * Recording is O(1) and does not allocate, so it may be called from within
+ * operation callbacks. Values above the trackable maximum (~137 seconds) are
+ * clamped.
+ */
+class HdrHistogram {
+public:
+    HdrHistogram();
+    void record(uint64_t value);
+    void add(const HdrHistogram& other);
+    void reset();
+
+    uint64_t percentile(double pct) const;
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? minval : 0; }
+    uint64_t max() const { return maxval; }
+    double mean() const { return total ? (double)sum / (double)total : 0; }
+
+private:
+    size_t indexOf(uint64_t value) const;
+    uint64_t valueAt(size_t index) const;
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minval;
+    uint64_t maxval;
+};
+
+}
+
+#endif